@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include "CH58x_common.h"
+#include "HAL/config.h"
 
 #ifndef cbi
 #define cbi(sfr, bit) (_SFR_BYTE(sfr) &= ~_BV(bit))
@@ -43,8 +44,23 @@ static void (*twi_onSlaveTransmit)(void);
 static void (*twi_onSlaveReceive)(uint8_t*, int);
 
 static uint8_t twi_masterBuffer[TWI_BUFFER_LENGTH];
-static volatile uint8_t twi_masterBufferIndex;
-static volatile uint8_t twi_masterBufferLength;
+static volatile uint16_t twi_masterBufferIndex;
+static volatile uint16_t twi_masterBufferLength;
+
+// Where the master bytes come from / go to: twi_masterBuffer for
+// twi_readFrom() and twi_writeTo(), the descriptor segments for queued
+// transfers
+static twi_seg_t twi_masterSeg;
+static const twi_seg_t *twi_seg;
+static uint8_t twi_segCount;            // segments left, including twi_seg
+static uint16_t twi_segPos;
+
+// Queued transfers, twi_xfer is the one at the head (on the bus when
+// twi_xferRunning)
+static twi_xfer_t * volatile twi_xfer;
+static twi_xfer_t *twi_xferTail;
+static volatile uint8_t twi_xferRunning;
+static uint8_t twi_xferInDone;
 
 static uint8_t twi_txBuffer[TWI_BUFFER_LENGTH];
 static volatile uint8_t twi_txBufferIndex;
@@ -57,6 +73,167 @@ static volatile uint8_t twi_error;
 
 static bool isnack = false;
 static bool lastdata_sent = false;
+
+static void twi_kick(void);
+
+/*
+ * Function twi_segSetup
+ * Desc     points the master byte iteration at a segment list
+ * Input    seg: segments
+ *          count: number of segments
+ * Output   total number of bytes
+ */
+static uint16_t twi_segSetup(const twi_seg_t *seg, uint8_t count) {
+    uint16_t total = 0;
+    uint8_t i;
+
+    for (i = 0; i < count; ++i) {
+        total += seg[i].len;
+    }
+    // skip empty segments, twi_segNext() relies on twi_seg->len != 0
+    while (count && 0 == seg->len) {
+        ++seg;
+        --count;
+    }
+    twi_seg = seg;
+    twi_segCount = count;
+    twi_segPos = 0;
+    return total;
+}
+
+/*
+ * Function twi_segNext
+ * Desc     next master byte
+ * Input    none
+ * Output   pointer to the byte, NULL past the end of the segments
+ */
+__HIGH_CODE
+static uint8_t *twi_segNext(void) {
+    uint8_t *p;
+
+    if (0 == twi_segCount) {
+        return NULL;
+    }
+    p = &twi_seg->buf[twi_segPos];
+    if (++twi_segPos >= twi_seg->len) {
+        twi_segPos = 0;
+        do {
+            ++twi_seg;
+            --twi_segCount;
+        } while (twi_segCount && 0 == twi_seg->len);
+    }
+    return p;
+}
+
+/*
+ * Function twi_xferRead
+ * Desc     sets up the read phase of the queued transfer at the head,
+ *          the same way twi_readFrom() does
+ * Input    none
+ * Output   none
+ */
+__HIGH_CODE
+static void twi_xferRead(void) {
+    uint16_t length = twi_segSetup(twi_xfer->rx, twi_xfer->rx_count);
+
+    twi_state = TWI_MRX;
+    if (length == 1) {
+        R16_I2C_CTRL1 &= ~RB_I2C_ACK;
+        isnack = true;
+    } else {
+        isnack = false;
+    }
+    twi_masterBufferIndex = 0;
+    twi_masterBufferLength = length - 1;
+    twi_slarw = TW_READ;
+    twi_slarw |= twi_xfer->address << 1;
+}
+
+/*
+ * Function twi_xferStart
+ * Desc     puts the queued transfer at the head on the bus
+ * Input    none
+ * Output   none
+ */
+__HIGH_CODE
+static void twi_xferStart(void) {
+    twi_xfer_t *x = twi_xfer;
+    uint16_t length = twi_segSetup(x->tx, x->tx_count);
+
+    twi_xferRunning = true;
+    twi_sendStop = true;
+    twi_error = 0xFF;
+    if (length) {
+        twi_state = TWI_MTX;
+        twi_masterBufferIndex = 0;
+        twi_masterBufferLength = length;
+        twi_slarw = TW_WRITE;
+        twi_slarw |= x->address << 1;
+    } else {
+        twi_xferRead();
+    }
+
+    // the stop of the previous transfer may still be going out
+    while (R16_I2C_CTRL1 & RB_I2C_STOP) {
+        continue;
+    }
+    R16_I2C_CTRL2 |= (I2C_IT_BUF | I2C_IT_EVT | I2C_IT_ERR);
+    twi_start();
+}
+
+/*
+ * Function twi_xferDone
+ * Desc     completes the queued transfer at the head once the bus is
+ *          released and starts the next one
+ * Input    none
+ * Output   none
+ */
+__HIGH_CODE
+static void twi_xferDone(void) {
+    twi_xfer_t *x = twi_xfer;
+
+    twi_xferRunning = false;
+    twi_xfer = x->next;
+    if (NULL == twi_xfer) {
+        twi_xferTail = NULL;
+    }
+
+    if (twi_error == 0xFF)
+        x->status = TWI_XFER_OK;
+    else if (twi_error == TW_MT_NACK || twi_error == TW_MR_SLA_NACK)
+        x->status = TWI_XFER_NACK;
+    else
+        x->status = TWI_XFER_ERROR;
+
+    // the callback may submit again, twi_submit() leaves the start to us
+    twi_xferInDone = true;
+    if (x->done) {
+        x->done(x);
+    }
+    twi_xferInDone = false;
+    if (TWI_NO_TASK != x->task_id) {
+        tmos_set_event(x->task_id, x->event);
+    }
+
+    if (twi_xfer) {
+        twi_xferStart();
+    }
+}
+
+/*
+ * Function twi_waitIdle
+ * Desc     waits until twi_readFrom()/twi_writeTo() may take the bus.
+ *          Queued transfers go first, except in the middle of a repeated
+ *          start which still owns the bus
+ * Input    none
+ * Output   none
+ */
+__HIGH_CODE
+static void twi_waitIdle(void) {
+    while (TWI_READY != twi_state || (twi_xfer && !twi_inRepStart)) {
+        twi_kick();
+    }
+}
 /*
  * Function twi_init
  * Desc     readys twi pins and sets twi bitrate
@@ -68,6 +245,9 @@ void twi_init(void) {
     twi_state = TWI_READY;
     twi_sendStop = true;      // default value
     twi_inRepStart = false;
+    twi_xfer = NULL;
+    twi_xferTail = NULL;
+    twi_xferRunning = false;
 
     GPIOB_ModeCfg( GPIO_Pin_13 | GPIO_Pin_12, GPIO_ModeIN_PU);
 
@@ -135,9 +315,7 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length,
     }
 
     // wait until twi is ready, become master receiver
-    while (TWI_READY != twi_state) {
-        continue;
-    }
+    twi_waitIdle();
     twi_state = TWI_MRX;
     twi_sendStop = sendStop;
     // reset error state (0xFF.. no error occured)
@@ -149,6 +327,9 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length,
     }
 
     // initialize buffer iteration vars
+    twi_masterSeg.buf = twi_masterBuffer;
+    twi_masterSeg.len = length;
+    twi_segSetup(&twi_masterSeg, 1);
     twi_masterBufferIndex = 0;
     twi_masterBufferLength = length - 1;  // This is not intuitive, read on...
     // On receive, the previously configured ACK/NACK setting is transmitted in
@@ -192,6 +373,9 @@ uint8_t twi_readFrom(uint8_t address, uint8_t* data, uint8_t length,
         data[i] = twi_masterBuffer[i];
     }
 
+    // run what was queued meanwhile
+    twi_kick();
+
     return length;
 }
 
@@ -218,15 +402,16 @@ uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length,
         return 1;
     }
     // wait until twi is ready, become master transmitter
-    while (TWI_READY != twi_state) {
-        continue;
-    }
+    twi_waitIdle();
     twi_state = TWI_MTX;
     twi_sendStop = sendStop;
     // reset error state (0xFF.. no error occured)
     twi_error = 0xFF;
 
     // initialize buffer iteration vars
+    twi_masterSeg.buf = twi_masterBuffer;
+    twi_masterSeg.len = length;
+    twi_segSetup(&twi_masterSeg, 1);
     twi_masterBufferIndex = 0;
     twi_masterBufferLength = length;
 
@@ -256,6 +441,9 @@ uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length,
     while (wait && (TWI_MTX == twi_state)) {
         continue;
     }
+    if (wait) {
+        twi_kick();
+    }
     if (twi_error == 0xFF)
         return 0;   // success
     else if (twi_error == TW_MT_NACK)
@@ -264,6 +452,89 @@ uint8_t twi_writeTo(uint8_t address, uint8_t* data, uint8_t length,
         return 3;   // other twi error
 }
 
+/*
+ * Function twi_submit
+ * Desc     queues a transfer and returns at once. Queued transfers run back
+ *          to back from the interrupt, each one ends with a stop; on
+ *          completion status is set, then done() is called and task_id is
+ *          posted event. May be called from done()
+ * Input    xfer: transfer descriptor, owned by the driver until status
+ *          leaves TWI_XFER_BUSY
+ * Output   0 .. queued
+ *          1 .. nothing to transfer, or xfer already queued
+ */
+__HIGH_CODE
+uint8_t twi_submit(twi_xfer_t* xfer) {
+    uint16_t txLength = 0, rxLength = 0;
+    twi_xfer_t *x;
+    uint8_t i;
+
+    for (i = 0; i < xfer->tx_count; ++i) {
+        txLength += xfer->tx[i].len;
+    }
+    for (i = 0; i < xfer->rx_count; ++i) {
+        rxLength += xfer->rx[i].len;
+    }
+    if (0 == txLength && 0 == rxLength) {
+        return 1;
+    }
+
+    // queued means on the list, status may hold anything before the first
+    // submit
+    PFIC_DisableIRQ(I2C_IRQn);
+    for (x = twi_xfer; x; x = x->next) {
+        if (x == xfer) {
+            PFIC_EnableIRQ(I2C_IRQn);
+            return 1;
+        }
+    }
+    if (0 == rxLength) {
+        xfer->rx_count = 0;
+    }
+    xfer->status = TWI_XFER_BUSY;
+    xfer->next = NULL;
+    if (twi_xfer) {
+        twi_xferTail->next = xfer;
+    } else {
+        twi_xfer = xfer;
+    }
+    twi_xferTail = xfer;
+    PFIC_EnableIRQ(I2C_IRQn);
+
+    if (!twi_xferInDone) {
+        twi_kick();
+    }
+    return 0;
+}
+
+/*
+ * Function twi_wait
+ * Desc     waits for a queued transfer to complete
+ * Input    xfer: transfer descriptor
+ * Output   its status, twi_writeTo() codes
+ */
+uint8_t twi_wait(twi_xfer_t* xfer) {
+    while (TWI_XFER_BUSY == xfer->status) {
+        twi_kick();
+    }
+    return xfer->status;
+}
+
+/*
+ * Function twi_kick
+ * Desc     starts the queued transfers if the bus is free
+ * Input    none
+ * Output   none
+ */
+__HIGH_CODE
+static void twi_kick(void) {
+    PFIC_DisableIRQ(I2C_IRQn);
+    if (twi_xfer && !twi_xferRunning && TWI_READY == twi_state && !twi_inRepStart) {
+        twi_xferStart();
+    }
+    PFIC_EnableIRQ(I2C_IRQn);
+}
+
 /*
  * Function twi_transmit
  * Desc     fills slave tx buffer with data
@@ -381,6 +652,7 @@ static uint8_t time = 0;
 __HIGH_CODE
 void I2C_IRQHandler(void) {
     uint32_t status = R16_I2C_STAR1 | (R16_I2C_STAR2 << 16);
+    uint8_t *p;
 //    PRINT("%x\n", status);
 
     status == lasttmp ? time++: (time = 0);
@@ -396,11 +668,14 @@ void I2C_IRQHandler(void) {
 
         if(status & (RB_I2C_TRA<<16)){
             //master transmitter
-            if (status & (RB_I2C_ADDR | RB_I2C_BTF | RB_I2C_TxE)) { //slave receiver acked address or sent bit
+            // TWI_MRX here: a queued transfer is turning around, ignore the
+            // write events until its repeated start
+            if ((status & (RB_I2C_ADDR | RB_I2C_BTF | RB_I2C_TxE)) && TWI_MTX == twi_state) { //slave receiver acked address or sent bit
                 // if there is data to send, send it, otherwise stop
                 if (twi_masterBufferIndex < (twi_masterBufferLength)) {
                     // copy data to output register and ack
-                    R16_I2C_DATAR = twi_masterBuffer[twi_masterBufferIndex++];
+                    R16_I2C_DATAR = *twi_segNext();
+                    twi_masterBufferIndex++;
                     time>100?PRINT("R16_I2C_DATAR\n"):0;
                     twi_reply(1);
 
@@ -411,7 +686,12 @@ void I2C_IRQHandler(void) {
 //                    }
                 } else {
                         lastdata_sent = false;
-                        if (twi_sendStop) {
+                        if (twi_xferRunning && twi_xfer->rx_count) {
+                            // queued write-then-read: repeated start, the
+                            // SB event sends the read address
+                            twi_xferRead();
+                            twi_start();
+                        } else if (twi_sendStop) {
 //                            LOG_INFO("send stop");
                              time>100?PRINT("stop\n"):0;
                              twi_stop();
@@ -454,7 +734,13 @@ void I2C_IRQHandler(void) {
             if (status & RB_I2C_RxNE) { // data received, ack sent
 
                 // put byte into buffer
-                twi_masterBuffer[twi_masterBufferIndex++] = R16_I2C_DATAR;
+                p = twi_segNext();
+                if (p) {
+                    *p = R16_I2C_DATAR;
+                } else {
+                    (void)R16_I2C_DATAR;
+                }
+                twi_masterBufferIndex++;
                 // ack if more bytes are expected, otherwise nack
                 if (twi_masterBufferIndex < twi_masterBufferLength) {
                     twi_reply(1);
@@ -482,19 +768,33 @@ void I2C_IRQHandler(void) {
 
             if (status & RB_I2C_AF) {  //nack received
                 R16_I2C_STAR1 &= ~RB_I2C_AF; //clear flag
-                // put final byte into buffer
-                twi_masterBuffer[twi_masterBufferIndex++] = R16_I2C_DATAR;
-
-                if (twi_sendStop)
+                if (0 == twi_masterBufferIndex) {
+                    // address nack, no byte came in: fail the read instead
+                    // of handing back what the buffer held before
+                    isnack = false;
+                    twi_error = TW_MR_SLA_NACK;
                     twi_stop();
-                else {
-                    twi_inRepStart = true;    // we're gonna send the START
-                    // don't enable the interrupt. We'll generate the start, but we
-                    // avoid handling the interrupt until we're in the next transaction,
-                    // at the point where we would normally issue the start.
-                    R16_I2C_CTRL2 &= ~(I2C_IT_BUF | I2C_IT_EVT | I2C_IT_ERR);
-                    twi_start();
-                    twi_state = TWI_READY;
+                } else {
+                    // put final byte into buffer
+                    p = twi_segNext();
+                    if (p) {
+                        *p = R16_I2C_DATAR;
+                    } else {
+                        (void)R16_I2C_DATAR;
+                    }
+                    twi_masterBufferIndex++;
+
+                    if (twi_sendStop)
+                        twi_stop();
+                    else {
+                        twi_inRepStart = true;    // we're gonna send the START
+                        // don't enable the interrupt. We'll generate the start, but we
+                        // avoid handling the interrupt until we're in the next transaction,
+                        // at the point where we would normally issue the start.
+                        R16_I2C_CTRL2 &= ~(I2C_IT_BUF | I2C_IT_EVT | I2C_IT_ERR);
+                        twi_start();
+                        twi_state = TWI_READY;
+                    }
                 }
             }
         }
@@ -603,6 +903,11 @@ void I2C_IRQHandler(void) {
         R16_I2C_STAR1 &= ~RB_I2C_ARLO; //clear flag
     }
 
+    // a queued transfer stopped (done or failed)
+    if (twi_xferRunning && TWI_READY == twi_state) {
+        twi_xferDone();
+    }
+
 //    PRINT("\n");
 }
 
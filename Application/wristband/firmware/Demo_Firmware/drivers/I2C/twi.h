@@ -41,6 +41,7 @@
 
 #define TW_MT_NACK          1
 #define TW_MT_ARB_LOST      2
+#define TW_MR_SLA_NACK      3
 #define TW_BUS_ERROR        4
 
 #define TWI_READY 0
@@ -49,6 +50,38 @@
 #define TWI_SRX   3
 #define TWI_STX   4
 
+// Queued transfers: status of a descriptor, twi_writeTo() error codes on
+// completion
+#define TWI_XFER_OK       0
+#define TWI_XFER_NACK     2
+#define TWI_XFER_ERROR    3
+#define TWI_XFER_BUSY     0xFF
+
+#define TWI_NO_TASK       0xFF    // no TMOS event on completion
+
+// One piece of a scatter/gather buffer, any length
+typedef struct {
+    uint8_t *buf;
+    uint16_t len;
+} twi_seg_t;
+
+// Write the tx segments, then read the rx segments after a repeated start,
+// then stop. Either part may be empty (count 0). The descriptor and the
+// segments must stay valid until status leaves TWI_XFER_BUSY. status and
+// next belong to the driver and need no initial value.
+typedef struct twi_xfer {
+    uint8_t address;                    // 7 bit device address
+    const twi_seg_t *tx;
+    uint8_t tx_count;
+    const twi_seg_t *rx;
+    uint8_t rx_count;
+    void (*done)(struct twi_xfer *);    // called from the I2C interrupt, may be NULL
+    uint8_t task_id;                    // TMOS task to post event to, or TWI_NO_TASK
+    uint16_t event;
+    volatile uint8_t status;
+    struct twi_xfer *next;
+} twi_xfer_t;
+
 void twi_init(void);
 void twi_disable(void);
 void twi_setAddress(uint8_t);
@@ -62,6 +95,8 @@ void twi_reply(uint8_t);
 void twi_start(void);
 void twi_stop(void);
 void twi_releaseBus(void);
+uint8_t twi_submit(twi_xfer_t*);
+uint8_t twi_wait(twi_xfer_t*);
 
 #endif
 
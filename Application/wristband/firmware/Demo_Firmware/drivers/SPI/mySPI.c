@@ -31,14 +31,25 @@ void MySPIdisbale(void)
     PFIC_DisableIRQ( SPI0_IRQn );
 }
 
+// Wait for the last DMA transfer to be fully shifted out. TOTAL_CNT is
+// non-zero from the moment MySPIsendbuf() starts a transfer, RB_SPI_FREE
+// only once the shifter has started
 __HIGH_CODE
-void MySPIsendbuf( uint8_t *pbuf, uint16_t len)
+void MySPIwait(void)
 {
-    while(!(R8_SPI0_INT_FLAG & RB_SPI_FREE) )
+    while(R16_SPI0_TOTAL_CNT || !(R8_SPI0_INT_FLAG & RB_SPI_FREE))
     {
 //        LOG_INFO(".");
         ;
     }
+}
+
+// Start a DMA transfer and return, pbuf (RAM only) must stay untouched
+// until the next MySPIsendbuf()/MySPIwait()
+__HIGH_CODE
+void MySPIsendbuf( uint8_t *pbuf, uint16_t len)
+{
+    MySPIwait();
 
     R8_SPI0_CTRL_MOD |= RB_SPI_ALL_CLEAR;
     R8_SPI0_CTRL_MOD &= ~RB_SPI_ALL_CLEAR;
@@ -52,8 +63,9 @@ void MySPIsendbuf( uint8_t *pbuf, uint16_t len)
 __HIGH_CODE
 void MySPIsenddata(uint8_t data)
 {
+    // data lives on the stack, let the DMA finish with it
     MySPIsendbuf(&data, 1);
-
+    MySPIwait();
 }
 
 __HIGH_CODE
@@ -14,6 +14,7 @@ struct SPI_t{
 
 void MySPIinit(void);
 void MySPIdisbale(void);
+void MySPIwait(void);
 void MySPIsendbuf( uint8_t *pbuf, uint16_t len);
 void MySPIsenddata(uint8_t data);
 
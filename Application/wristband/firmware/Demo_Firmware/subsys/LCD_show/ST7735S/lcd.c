@@ -22,13 +22,11 @@ struct show_node {
  ******************************************************************************/
 void LCD_Fill(uint16_t xsta, uint16_t ysta, uint16_t xend, uint16_t yend,
         uint16_t color) {
-    uint16_t i, j;
-    LCD_Address_Set(xsta, ysta, xend - 1, yend - 1); //ʾΧ
-    for (i = ysta; i < yend; i++) {
-        for (j = xsta; j < xend; j++) {
-            LCD_WR_DATA(color);
-        }
-    }
+    if (xend <= xsta || yend <= ysta)
+        return;
+    LCD_WR_Window(xsta, ysta, xend - 1, yend - 1); //ʾΧ
+    LCD_WR_Run(color, (uint32_t)(xend - xsta) * (yend - ysta));
+    LCD_WR_End();
 }
 
 /******************************************************************************
@@ -187,15 +185,16 @@ void LCD_ShowChinese12x12(uint16_t x, uint16_t y, uint8_t *s, uint16_t fc,
     for (k = 0; k < HZnum; k++) {
         if ((tfont12[k].Index[0] == *(s))
                 && (tfont12[k].Index[1] == *(s + 1))) {
-            LCD_Address_Set(x, y, x + sizey - 1, y + sizey - 1);
+            if (!mode)
+                LCD_WR_Window(x, y, x + sizey - 1, y + sizey - 1);
             for (i = 0; i < TypefaceNum; i++) {
                 for (j = 0; j < 8; j++) {
                     if (!mode)	//ǵӷʽ
                     {
                         if (tfont12[k].Msk[i] & (0x01 << j))
-                            LCD_WR_DATA(fc);
+                            LCD_WR_Color(fc);
                         else
-                            LCD_WR_DATA(bc);
+                            LCD_WR_Color(bc);
                         m++;
                         if (m % sizey == 0) {
                             m = 0;
@@ -214,6 +213,8 @@ void LCD_ShowChinese12x12(uint16_t x, uint16_t y, uint8_t *s, uint16_t fc,
                     }
                 }
             }
+            if (!mode)
+                LCD_WR_End();
         }
         continue;  //ҵӦֿ˳ֹظȡģӰ
     }
@@ -241,15 +242,16 @@ void LCD_ShowChinese16x16(uint16_t x, uint16_t y, uint8_t *s, uint16_t fc,
     for (k = 0; k < HZnum; k++) {
         if ((tfont16[k].Index[0] == *(s))
                 && (tfont16[k].Index[1] == *(s + 1))) {
-            LCD_Address_Set(x, y, x + sizey - 1, y + sizey - 1);
+            if (!mode)
+                LCD_WR_Window(x, y, x + sizey - 1, y + sizey - 1);
             for (i = 0; i < TypefaceNum; i++) {
                 for (j = 0; j < 8; j++) {
                     if (!mode)	//ǵӷʽ
                     {
                         if (tfont16[k].Msk[i] & (0x01 << j))
-                            LCD_WR_DATA(fc);
+                            LCD_WR_Color(fc);
                         else
-                            LCD_WR_DATA(bc);
+                            LCD_WR_Color(bc);
                         m++;
                         if (m % sizey == 0) {
                             m = 0;
@@ -268,6 +270,8 @@ void LCD_ShowChinese16x16(uint16_t x, uint16_t y, uint8_t *s, uint16_t fc,
                     }
                 }
             }
+            if (!mode)
+                LCD_WR_End();
         }
         continue;  //ҵӦֿ˳ֹظȡģӰ
     }
@@ -295,15 +299,16 @@ void LCD_ShowChinese24x24(uint16_t x, uint16_t y, uint8_t *s, uint16_t fc,
     for (k = 0; k < HZnum; k++) {
         if ((tfont24[k].Index[0] == *(s))
                 && (tfont24[k].Index[1] == *(s + 1))) {
-            LCD_Address_Set(x, y, x + sizey - 1, y + sizey - 1);
+            if (!mode)
+                LCD_WR_Window(x, y, x + sizey - 1, y + sizey - 1);
             for (i = 0; i < TypefaceNum; i++) {
                 for (j = 0; j < 8; j++) {
                     if (!mode)	//ǵӷʽ
                     {
                         if (tfont24[k].Msk[i] & (0x01 << j))
-                            LCD_WR_DATA(fc);
+                            LCD_WR_Color(fc);
                         else
-                            LCD_WR_DATA(bc);
+                            LCD_WR_Color(bc);
                         m++;
                         if (m % sizey == 0) {
                             m = 0;
@@ -322,6 +327,8 @@ void LCD_ShowChinese24x24(uint16_t x, uint16_t y, uint8_t *s, uint16_t fc,
                     }
                 }
             }
+            if (!mode)
+                LCD_WR_End();
         }
         continue;  //ҵӦֿ˳ֹظȡģӰ
     }
@@ -349,15 +356,16 @@ void LCD_ShowChinese32x32(uint16_t x, uint16_t y, uint8_t *s, uint16_t fc,
     for (k = 0; k < HZnum; k++) {
         if ((tfont32[k].Index[0] == *(s))
                 && (tfont32[k].Index[1] == *(s + 1))) {
-            LCD_Address_Set(x, y, x + sizey - 1, y + sizey - 1);
+            if (!mode)
+                LCD_WR_Window(x, y, x + sizey - 1, y + sizey - 1);
             for (i = 0; i < TypefaceNum; i++) {
                 for (j = 0; j < 8; j++) {
                     if (!mode)	//ǵӷʽ
                     {
                         if (tfont32[k].Msk[i] & (0x01 << j))
-                            LCD_WR_DATA(fc);
+                            LCD_WR_Color(fc);
                         else
-                            LCD_WR_DATA(bc);
+                            LCD_WR_Color(bc);
                         m++;
                         if (m % sizey == 0) {
                             m = 0;
@@ -376,6 +384,8 @@ void LCD_ShowChinese32x32(uint16_t x, uint16_t y, uint8_t *s, uint16_t fc,
                     }
                 }
             }
+            if (!mode)
+                LCD_WR_End();
         }
         continue;  //ҵӦֿ˳ֹظȡģӰ
     }
@@ -400,7 +410,8 @@ void LCD_ShowChar(uint16_t x, uint16_t y, uint8_t num, uint16_t fc, uint16_t bc,
     sizex = sizey / 2;
     TypefaceNum = (sizex / 8 + ((sizex % 8) ? 1 : 0)) * sizey;
     num = num - ' ';    //õƫƺֵ
-    LCD_Address_Set(x, y, x + sizex - 1, y + sizey - 1);  //ùλ 
+    if (!mode)
+        LCD_WR_Window(x, y, x + sizex - 1, y + sizey - 1);  //ùλ 
     for (i = 0; i < TypefaceNum; i++) {
         if (sizey == 12)
             temp = ascii_1206[num][i];		       //6x12
@@ -411,14 +422,14 @@ void LCD_ShowChar(uint16_t x, uint16_t y, uint8_t num, uint16_t fc, uint16_t bc,
         else if (sizey == 32)
             temp = ascii_3216[num][i];		 //16x32
         else
-            return;
+            break;
         for (t = 0; t < 8; t++) {
             if (!mode)		 //ǵģʽ
             {
                 if (temp & (0x01 << t))
-                    LCD_WR_DATA(fc);
+                    LCD_WR_Color(fc);
                 else
-                    LCD_WR_DATA(bc);
+                    LCD_WR_Color(bc);
                 m++;
                 if (m % sizex == 0) {
                     m = 0;
@@ -437,6 +448,8 @@ void LCD_ShowChar(uint16_t x, uint16_t y, uint8_t num, uint16_t fc, uint16_t bc,
             }
         }
     }
+    if (!mode)
+        LCD_WR_End();
 }
 
 /******************************************************************************
@@ -577,22 +590,9 @@ __HIGH_CODE
 void LCD_ShowPicture(uint16_t x, uint16_t y, uint16_t length, uint16_t width,
         const uint8_t pic[])
 {
-    uint32_t k = 0;
-    __attribute__((aligned(4)))  uint8_t tmpbuf[LCD_W*2];
-    LCD_Address_Set(x, y, x + length - 1, y + width - 1);
-
-    LCD_CS_Clr();
-    for(int i = 0; i < width; i++) {
-//        for(int p = 0; p < length * 2; p+=2){
-//            tmpbuf[p+1] = pic[k++];
-//            tmpbuf[p] = pic[k++];
-//        }
-        tmos_memcpy(tmpbuf, &pic[k+=length * 2], length * 2);
-
-        uint8_t * addr = (uint8_t *)tmpbuf;
-        MySPIsendbuf(addr, length * 2);
-    }
-    LCD_CS_Set();
+    LCD_WR_Window(x, y, x + length - 1, y + width - 1);
+    LCD_WR_Copy(pic, (uint32_t)length * width * 2);
+    LCD_WR_End();
 }
 
 static uint32_t color = 0;
@@ -633,15 +633,14 @@ static uint32_t temp = 0;
 __HIGH_CODE
 void LCD_Showtest(uint16_t x, uint16_t y, uint16_t length, uint16_t width)
 {
-    LCD_Address_Set(x, y, x + length - 1, y + width - 1);
+    LCD_WR_Window(x, y, x + length - 1, y + width - 1);
 
     color = temp;
     for (uint32_t i = 0; i < width; i++) {
-        for (uint32_t j = 0; j < length; j++) {
-            LCD_WR_DATA((uint16_t)colorbuf[color]);
-        }
+        LCD_WR_Run((uint16_t)colorbuf[color], length);
         color++;
     }
+    LCD_WR_End();
 
     temp++;
     if(temp>= (sizeof(colorbuf)/sizeof(colorbuf[0])-1 - 160))
@@ -1,6 +1,15 @@
+#include <string.h>
 #include "lcd_init.h"
 #include "SPI/mySPI.h"
 
+#define LCD_WR_BUF_SIZE  (((LCD_W > LCD_H) ? LCD_W : LCD_H) * 2)  //һ
+#define LCD_WR_RUN_MIN   16  //̵ͬɫֱдл
+
+// ˫壺DMAһʱһ
+__attribute__((aligned(4))) static uint8_t lcd_buf[2][LCD_WR_BUF_SIZE];
+static uint8_t lcd_bufIdx;      //Ļ
+static uint16_t lcd_bufLen;
+
 void LCD_GPIO_Init(void) {
     GPIOA_SetBits( GPIO_Pin_0 | GPIO_Pin_13 | GPIO_Pin_14 | GPIO_Pin_4 |
             GPIO_Pin_5 | GPIO_Pin_6);
@@ -31,6 +40,7 @@ void LCD_WR_buf(uint8_t *dat, uint16_t len)
 //  LCD_Writ_Bus(dat);
     LCD_CS_Clr();
     MySPIsendbuf(dat, len);
+    MySPIwait();
     LCD_CS_Set();
 }
 
@@ -58,8 +68,11 @@ void LCD_WR_DATA8(uint8_t dat)
 __HIGH_CODE
 void LCD_WR_DATA(uint16_t dat)
 {
-    LCD_Writ_Bus(dat >> 8);
-    LCD_Writ_Bus(dat);
+    uint8_t buf[2];
+
+    buf[0] = dat >> 8;
+    buf[1] = dat;
+    LCD_WR_buf(buf, 2);
 
 //    LCD_Writ_Bus(dat);
 //    LCD_Writ_Bus(dat<<8);
@@ -125,6 +138,127 @@ void LCD_Address_Set(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
     }
 }
 
+/******************************************************************************
+ ˵ôڲƬѡ֮LCD_WR_Color/LCD_WR_Run/LCD_WR_Copy
+ дأLCD_WR_End
+ ݣx1,x2 еʼͽַ
+ y1,y2 еʼͽַ
+ ֵ  
+ ******************************************************************************/
+__HIGH_CODE
+void LCD_WR_Window(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+    LCD_Address_Set(x1, y1, x2, y2);
+    lcd_bufLen = 0;
+    LCD_CS_Clr(); //ƬѡֵLCD_WR_End
+}
+
+/******************************************************************************
+ ˵DMAĻ壬лһ
+ ݣ
+ ֵ  
+ ******************************************************************************/
+__HIGH_CODE
+static void LCD_WR_Flush(void)
+{
+    if (lcd_bufLen) {
+        MySPIsendbuf(lcd_buf[lcd_bufIdx], lcd_bufLen); //ȴһ巢
+        lcd_bufIdx ^= 1;
+        lcd_bufLen = 0;
+    }
+}
+
+/******************************************************************************
+ ˵дһ
+ ݣcolor ɫ
+ ֵ  
+ ******************************************************************************/
+__HIGH_CODE
+void LCD_WR_Color(uint16_t color)
+{
+    uint8_t *p = &lcd_buf[lcd_bufIdx][lcd_bufLen];
+
+    p[0] = color >> 8;
+    p[1] = color;
+    lcd_bufLen += 2;
+    if (lcd_bufLen >= LCD_WR_BUF_SIZE) {
+        LCD_WR_Flush();
+    }
+}
+
+/******************************************************************************
+ ˵дcountͬɫأһһκظDMA
+ ݣcolor ɫ
+ count ظ
+ ֵ  
+ ******************************************************************************/
+__HIGH_CODE
+void LCD_WR_Run(uint16_t color, uint32_t count)
+{
+    uint16_t i, n;
+    uint8_t *p;
+
+    if (count <= LCD_WR_RUN_MIN) {
+        while (count--) {
+            LCD_WR_Color(color);
+        }
+        return;
+    }
+
+    LCD_WR_Flush();
+    p = lcd_buf[lcd_bufIdx];
+    n = (count < LCD_WR_BUF_SIZE / 2) ? count : LCD_WR_BUF_SIZE / 2;
+    for (i = 0; i < n; i++) {
+        p[2 * i] = color >> 8;
+        p[2 * i + 1] = color;
+    }
+    while (count) {
+        n = (count < LCD_WR_BUF_SIZE / 2) ? count : LCD_WR_BUF_SIZE / 2;
+        MySPIsendbuf(p, n * 2); //ݲ䣬ֱط
+        count -= n;
+    }
+    lcd_bufIdx ^= 1;
+}
+
+/******************************************************************************
+ ˵дݣֽǰ巢ͣݿFlash
+ ݣdat 
+ len ֽ
+ ֵ  
+ ******************************************************************************/
+__HIGH_CODE
+void LCD_WR_Copy(const uint8_t *dat, uint32_t len)
+{
+    uint16_t n;
+
+    while (len) {
+        n = LCD_WR_BUF_SIZE - lcd_bufLen;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&lcd_buf[lcd_bufIdx][lcd_bufLen], dat, n);
+        lcd_bufLen += n;
+        dat += n;
+        len -= n;
+        if (lcd_bufLen >= LCD_WR_BUF_SIZE) {
+            LCD_WR_Flush();
+        }
+    }
+}
+
+/******************************************************************************
+ ˵ʣأȴDMAɺͷƬѡ
+ ݣ
+ ֵ  
+ ******************************************************************************/
+__HIGH_CODE
+void LCD_WR_End(void)
+{
+    LCD_WR_Flush();
+    MySPIwait();
+    LCD_CS_Set();
+}
+
 void LCD_Init(void) {
     LCD_GPIO_Init(); //ʼGPIO
 
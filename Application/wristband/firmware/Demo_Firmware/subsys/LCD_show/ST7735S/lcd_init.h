@@ -48,6 +48,11 @@ void LCD_WR_DATA8(uint8_t dat);//д
 void LCD_WR_DATA(uint16_t dat);//дֽ
 void LCD_WR_REG(uint8_t dat);//дһָ
 void LCD_Address_Set(uint16_t x1,uint16_t y1,uint16_t x2,uint16_t y2);//꺯
+void LCD_WR_Window(uint16_t x1,uint16_t y1,uint16_t x2,uint16_t y2);//ôڲƬѡֱLCD_WR_End
+void LCD_WR_Color(uint16_t color);//дһأ壩
+void LCD_WR_Run(uint16_t color, uint32_t count);//дcountͬɫ
+void LCD_WR_Copy(const uint8_t *dat, uint32_t len);//д
+void LCD_WR_End(void);//ʣݲͷƬѡ
 void LCD_Init(void);//LCDʼ
 #endif
 
@@ -220,6 +220,117 @@ void MPU9250::initMPU9250()
 }
 
 
+// Switch from data ready polling to FIFO batching: accel and gyro samples at
+// 1 kHz / (1 + rateDiv) are queued in the 512 byte FIFO and read in bursts by
+// readFIFO(). The MPU9250 has no FIFO watermark interrupt, the only FIFO
+// interrupt is overflow, so the FIFO is set to stop when full and the INT pin
+// (latched until INT_STATUS is read) only reports a full FIFO.
+void MPU9250::initFIFO(uint8_t rateDiv)
+{
+  writeByte(MPU9250_ADDRESS, SMPLRT_DIV, rateDiv);
+  uint8_t c = readByte(MPU9250_ADDRESS, CONFIG);
+  writeByte(MPU9250_ADDRESS, CONFIG, c | 0x40);  // FIFO_MODE, drop new samples when full
+  resetFIFO();
+  writeByte(MPU9250_ADDRESS, INT_PIN_CFG, 0x22);
+  writeByte(MPU9250_ADDRESS, INT_ENABLE, 0x10);  // Enable FIFO overflow (bit 4) interrupt only
+  readByte(MPU9250_ADDRESS, INT_STATUS);         // Release a pending latched interrupt
+}
+
+void MPU9250::resetFIFO()
+{
+  writeByte(MPU9250_ADDRESS, FIFO_EN, 0x00);
+  writeByte(MPU9250_ADDRESS, USER_CTRL, 0x04);   // Reset FIFO
+  writeByte(MPU9250_ADDRESS, USER_CTRL, 0x40);   // Enable FIFO
+  writeByte(MPU9250_ADDRESS, FIFO_EN, 0x78);     // Enable gyro and accelerometer sensors for FIFO
+}
+
+// Queue one I2C transfer for every sample in the FIFO and return at once,
+// the bus runs it from the interrupt. event is posted to taskId (TWI_NO_TASK
+// for none) when the bytes are in, readFIFO() then parses them. Returns the
+// number of samples requested, 0 when the FIFO is empty or a burst is still
+// pending.
+uint16_t MPU9250::requestFIFO(uint8_t taskId, uint16_t event)
+{
+  uint8_t data[2];
+
+  if (fifoPending) {
+    return 0;
+  }
+
+  // Reading INT_STATUS also releases the INT pin
+  fifoStatus = readByte(MPU9250_ADDRESS, INT_STATUS);
+  readBytes(MPU9250_ADDRESS, FIFO_COUNTH, 2, &data[0]);
+  fifoCount = ((((uint16_t)data[0] & 0x1F) << 8) | data[1]) / MPU9250_FIFO_SAMPLE;
+  if (fifoCount > MPU9250_FIFO_SAMPLES) {
+    fifoCount = MPU9250_FIFO_SAMPLES;
+  }
+  if (fifoCount == 0) {
+    if (fifoStatus & 0x10) {
+      resetFIFO();
+    }
+    return 0;
+  }
+
+  // Register address, then the whole burst past the Wire buffer limit
+  fifoSeg[0].buf = &fifoReg;
+  fifoSeg[0].len = 1;
+  fifoSeg[1].buf = fifoData;
+  fifoSeg[1].len = fifoCount * MPU9250_FIFO_SAMPLE;
+  fifoXfer.address = MPU9250_ADDRESS;
+  fifoXfer.tx = &fifoSeg[0];
+  fifoXfer.tx_count = 1;
+  fifoXfer.rx = &fifoSeg[1];
+  fifoXfer.rx_count = 1;
+  fifoXfer.done = NULL;
+  fifoXfer.task_id = taskId;
+  fifoXfer.event = event;
+  if (twi_submit(&fifoXfer) != 0) {
+    return 0;
+  }
+  fifoPending = true;
+  return fifoCount;
+}
+
+// Read at most max queued samples, oldest first. Parses the burst of the last
+// requestFIFO(), waiting for it if it is still on the bus; without one it
+// reads the FIFO now. Returns the number of samples stored in accel/gyro.
+uint16_t MPU9250::readFIFO(int16_t (*accel)[3], int16_t (*gyro)[3], uint16_t max)
+{
+  uint16_t n = 0, ii;
+
+  if (!fifoPending) {
+    requestFIFO(TWI_NO_TASK, 0);
+  }
+  if (fifoPending) {
+    fifoPending = false;
+    if (twi_wait(&fifoXfer) == TWI_XFER_OK) {
+      n = fifoCount;
+    }
+  }
+  if (n > max) {
+    n = max;
+  }
+
+  for (ii = 0; ii < n; ii++)
+  {
+    uint8_t * s = &fifoData[ii * MPU9250_FIFO_SAMPLE];
+    accel[ii][0] = (int16_t) (((int16_t)s[0] << 8) | s[1]  );
+    accel[ii][1] = (int16_t) (((int16_t)s[2] << 8) | s[3]  );
+    accel[ii][2] = (int16_t) (((int16_t)s[4] << 8) | s[5]  );
+    gyro[ii][0]  = (int16_t) (((int16_t)s[6] << 8) | s[7]  );
+    gyro[ii][1]  = (int16_t) (((int16_t)s[8] << 8) | s[9]  );
+    gyro[ii][2]  = (int16_t) (((int16_t)s[10] << 8) | s[11]);
+  }
+
+  // A full FIFO has stopped sampling, restart it so the next batch is
+  // contiguous again
+  if (fifoStatus & 0x10) {
+    fifoStatus = 0;
+    resetFIFO();
+  }
+  return n;
+}
+
 // Function which accumulates gyro and accelerometer data after device
 // initialization. It calculates the average of the at-rest readings and then
 // loads the resulting offsets into accelerometer and gyro bias registers.
@@ -9,6 +9,9 @@
 #define _MPU9250_H_
 
 #include "I2C/myi2c.h"
+extern "C" {
+#include "I2C/twi.h"
+}
 
 // See also MPU-9250 Register Map and Descriptions, Revision 4.0,
 // RM-MPU-9250A-00, Rev. 1.4, 9/9/2013 for registers not listed in above
@@ -169,6 +172,11 @@
 // eggfly added
 #define PWR1_SLEEP_BIT     6
 
+// FIFO batching, accel and gyro (FIFO_EN 0x78) give 12 bytes per sample
+#define MPU9250_FIFO_SIZE     512
+#define MPU9250_FIFO_SAMPLE   12
+#define MPU9250_FIFO_SAMPLES  (MPU9250_FIFO_SIZE / MPU9250_FIFO_SAMPLE)
+
 // Using the MPU-9250 breakout board, ADO is set to 0
 // Seven-bit device address is 110100 for ADO = 0 and 110101 for ADO = 1
 #define ADO 1
@@ -237,6 +245,15 @@ class MPU9250
     
     uint32_t num_steps;
 
+    // FIFO burst queued on the I2C bus by requestFIFO()
+    uint8_t fifoData[MPU9250_FIFO_SAMPLES * MPU9250_FIFO_SAMPLE];
+    uint8_t fifoReg = FIFO_R_W;
+    twi_seg_t fifoSeg[2];
+    twi_xfer_t fifoXfer = {};
+    uint16_t fifoCount = 0;
+    uint8_t fifoStatus = 0;
+    bool fifoPending = false;
+
   public:
     void getMres();
     void getGres();
@@ -255,6 +272,10 @@ class MPU9250
     void readBytes(uint8_t, uint8_t, uint8_t, uint8_t *);
     void setSleepEnabled(bool enabled); // eggfly added
     void writeBit(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint8_t data); // eggfly added
+    void initFIFO(uint8_t rateDiv);
+    void resetFIFO();
+    uint16_t requestFIFO(uint8_t taskId, uint16_t event);
+    uint16_t readFIFO(int16_t (*accel)[3], int16_t (*gyro)[3], uint16_t max);
 };  // class MPU9250
 
 extern MPU9250 IMU;
@@ -18,6 +18,18 @@ static int32_t lpf[NUM_TUPLES]                    = {0};
 static int64_t autocorr_buff[NUM_AUTOCORR_LAGS]   = {0};                        //holds the autocorrelation results
 static int64_t deriv[NUM_AUTOCORR_LAGS]           = {0};                        //holds derivative
 
+//state of the streaming counter (count_steps_push). instead of recomputing the whole window, each new sample
+//slides it by one: the oldest sample's lag products are subtracted, the new sample's are added
+static uint8_t  stream_mag[LPF_FILT_LEN]          = {0};                        //last magnitudes, history of the FIR low pass filter
+static int32_t  stream_lpf[NUM_TUPLES]            = {0};                        //ring of low pass filtered samples, the current window
+static int64_t  stream_lagsum[NUM_AUTOCORR_LAGS]  = {0};                        //sum of lpf[i]*lpf[i+lag] over the window, mean not removed
+static int32_t  stream_sum                        = 0;                          //sum of the window, for the running mean
+static uint16_t stream_count                      = 0;                          //samples in the window
+static uint8_t  stream_head                       = 0;                          //oldest sample in the ring, where the next one goes
+static uint8_t  stream_mag_ind                    = 0;                          //where the next magnitude goes
+static uint8_t  stream_hop                        = 0;                          //samples since the last evaluation
+static uint16_t stream_frac                       = 0;                          //fraction of a step carried to the next evaluation, Q8
+
 static uint32_t SquareRoot(uint32_t a_nInput);
 static void derivative(int64_t *autocorr_buff, int64_t *deriv);
 static void autocorr(int32_t *lpf, int64_t *autocorr_buff);
@@ -25,6 +37,7 @@ static void remove_mean(int32_t *lpf);
 static void lowpassfilt(uint8_t *mag_sqrt, int32_t *lpf);
 static uint8_t get_precise_peakind(int64_t *autocorr_buff, uint8_t peak_ind);
 static void get_autocorr_peak_stats(int64_t *autocorr_buff, uint8_t *neg_slope_count, int64_t *delta_amplitude_right, uint8_t *pos_slope_count, int64_t *delta_amplitude_left, uint8_t peak_ind);
+static uint8_t get_step_period(int64_t *autocorr_buff, int64_t *deriv);
 
 //fixed point square root estimation from http://stackoverflow.com/questions/1100090/looking-for-an-efficient-integer-square-root-algorithm-for-arm-thumb2
 /**
@@ -73,7 +86,7 @@ static void get_autocorr_peak_stats(int64_t *autocorr_buff, uint8_t *neg_slope_c
     //first look to the right of the peak. walk forward until the slope begins decreasing
     uint8_t  neg_slope_ind = peak_ind;
     uint16_t loop_limit    = NUM_AUTOCORR_LAGS-1;
-    while ((autocorr_buff[neg_slope_ind+1] - autocorr_buff[neg_slope_ind] < 0) && (neg_slope_ind < loop_limit)) {
+    while ((neg_slope_ind < loop_limit) && (autocorr_buff[neg_slope_ind+1] - autocorr_buff[neg_slope_ind] < 0)) {
         *neg_slope_count = *neg_slope_count + 1;
         neg_slope_ind    = neg_slope_ind + 1;
     }
@@ -85,7 +98,7 @@ static void get_autocorr_peak_stats(int64_t *autocorr_buff, uint8_t *neg_slope_c
     //next look to the left of the peak. walk backward until the slope begins increasing
     uint8_t pos_slope_ind = peak_ind;
     loop_limit    = 0;
-    while ((autocorr_buff[pos_slope_ind] - autocorr_buff[pos_slope_ind-1] > 0) && (pos_slope_ind > loop_limit)) {
+    while ((pos_slope_ind > loop_limit) && (autocorr_buff[pos_slope_ind] - autocorr_buff[pos_slope_ind-1] > 0)) {
         *pos_slope_count = *pos_slope_count + 1;
         pos_slope_ind    = pos_slope_ind - 1;
     }
@@ -192,28 +205,10 @@ static void lowpassfilt(uint8_t *mag_sqrt, int32_t *lpf) {
 }
 
 
-//algorithm interface
-uint8_t count_steps(int8_t *data) {
+//find the step period in autocorr_buff. returns the period in samples, 0 if the autocorrelation has no valid peak
+static uint8_t get_step_period(int64_t *autocorr_buff, int64_t *deriv) {
     
-    //assume data is in the format data = [x1,y1,z1,x2,y2,z2...etc]
-    //calculate the magnitude of each of triplet ie temp_mag = [x1^2+y1^2+z1^2]
-    //then temp_mag = sqrt(temp_mag)
     uint16_t i;
-    uint16_t temp_mag;
-    for (i = 0; i < NUM_TUPLES; i++) {
-        temp_mag = (uint16_t)((uint16_t)data[i*3+0]*(uint16_t)data[i*3+0] + (uint16_t)data[i*3+1]*(uint16_t)data[i*3+1] + (uint16_t)data[i*3+2]*(uint16_t)data[i*3+2]);
-        mag_sqrt[i] = (uint8_t)SquareRoot(temp_mag);
-
-    }
-    
-    //apply low pass filter to mag_sqrt, result is stored in lpf
-    lowpassfilt(mag_sqrt, lpf);
-    
-    //remove mean from lpf, store result in lpf
-    remove_mean(lpf);
-    
-    //do the autocorrelation on the lpf buffer, store the result in autocorr_buff
-    autocorr(lpf, autocorr_buff);
     
     //get the derivative of the autocorr_buff, store in deriv
     derivative(autocorr_buff, deriv);
@@ -230,6 +225,10 @@ uint8_t count_steps(int8_t *data) {
             break;
         }
     }
+    if (peak_ind == 0) {
+        //no peak at all. the checks below would reject it anyway, after reading before the buffer
+        return 0;
+    }
     
     //hone in on the exact peak index
     peak_ind = get_precise_peakind(autocorr_buff, peak_ind);
@@ -243,17 +242,44 @@ uint8_t count_steps(int8_t *data) {
     get_autocorr_peak_stats(autocorr_buff, &neg_slope_count, &delta_amplitude_right, &pos_slope_count, &delta_amplitude_left, peak_ind);
 
 
-    //now check the conditions to see if it was a real peak or not, and if so, calculate the number of steps
-    uint8_t num_steps = 0;
+    //now check the conditions to see if it was a real peak or not
+    if ((pos_slope_count > AUTOCORR_MIN_HALF_LEN) && (neg_slope_count > AUTOCORR_MIN_HALF_LEN) && (delta_amplitude_right > AUTOCORR_DELTA_AMPLITUDE_THRESH) && (delta_amplitude_left > AUTOCORR_DELTA_AMPLITUDE_THRESH)) {
+        return peak_ind;
+    }
+    //not a valid autocorrelation peak
+    return 0;
+}
 
 
-    if ((pos_slope_count > AUTOCORR_MIN_HALF_LEN) && (neg_slope_count > AUTOCORR_MIN_HALF_LEN) && (delta_amplitude_right > AUTOCORR_DELTA_AMPLITUDE_THRESH) && (delta_amplitude_left > AUTOCORR_DELTA_AMPLITUDE_THRESH)) {
-        //the period is peak_ind/sampling_rate seconds. that corresponds to a frequency of 1/period
-        //with the frequency known, and the number of seconds is 4 seconds, you can then find out the number of steps
+//algorithm interface
+uint8_t count_steps(int8_t *data) {
+    
+    //assume data is in the format data = [x1,y1,z1,x2,y2,z2...etc]
+    //calculate the magnitude of each of triplet ie temp_mag = [x1^2+y1^2+z1^2]
+    //then temp_mag = sqrt(temp_mag)
+    uint16_t i;
+    uint16_t temp_mag;
+    for (i = 0; i < NUM_TUPLES; i++) {
+        temp_mag = (uint16_t)((uint16_t)data[i*3+0]*(uint16_t)data[i*3+0] + (uint16_t)data[i*3+1]*(uint16_t)data[i*3+1] + (uint16_t)data[i*3+2]*(uint16_t)data[i*3+2]);
+        mag_sqrt[i] = (uint8_t)SquareRoot(temp_mag);
+
+    }
+    
+    //apply low pass filter to mag_sqrt, result is stored in lpf
+    lowpassfilt(mag_sqrt, lpf);
+    
+    //remove mean from lpf, store result in lpf
+    remove_mean(lpf);
+    
+    //do the autocorrelation on the lpf buffer, store the result in autocorr_buff
+    autocorr(lpf, autocorr_buff);
+    
+    //the period is peak_ind/sampling_rate seconds. that corresponds to a frequency of 1/period
+    //with the frequency known, and the number of seconds is 4 seconds, you can then find out the number of steps
+    uint8_t peak_ind = get_step_period(autocorr_buff, deriv);
+    uint8_t num_steps = 0;
+    if (peak_ind) {
         num_steps = (SAMPLING_RATE*WINDOW_LENGTH)/peak_ind;
-    } else {
-        //not a valid autocorrelation peak
-        num_steps = 0;
     }
     
     //printf("num steps: %i\n", num_steps);
@@ -261,4 +287,93 @@ uint8_t count_steps(int8_t *data) {
 }
 
 
+//restart the streaming counter with an empty window
+void count_steps_reset(void) {
+    
+    uint8_t i;
+    for (i = 0; i < LPF_FILT_LEN; i++) {
+        stream_mag[i] = 0;
+    }
+    for (i = 0; i < NUM_AUTOCORR_LAGS; i++) {
+        stream_lagsum[i] = 0;
+    }
+    stream_sum     = 0;
+    stream_count   = 0;
+    stream_head    = 0;
+    stream_mag_ind = 0;
+    stream_hop     = 0;
+    stream_frac    = 0;
+}
+
 
+//streaming interface: feed one x,y,z sample at SAMPLING_RATE, returns the steps completed with it.
+//every STEP_HOP samples the last NUM_TUPLES samples are checked exactly like count_steps() does,
+//and the steps of the new STEP_HOP samples are credited from the period found
+uint8_t count_steps_push(int8_t x, int8_t y, int8_t z) {
+    
+    uint8_t i, k, lag;
+    int32_t lpf_new = 0;
+    int32_t oldest;
+    
+    //magnitude and low pass filter. the filter history carries over, the batch version restarts it every window
+    stream_mag[stream_mag_ind] = (uint8_t)SquareRoot((uint32_t)((int16_t)x*x + (int16_t)y*y + (int16_t)z*z));
+    k = stream_mag_ind;
+    for (i = 0; i < LPF_FILT_LEN; i++) {
+        lpf_new += (int32_t)lpf_coeffs[i]*(int32_t)stream_mag[k];
+        k = (k == 0) ? LPF_FILT_LEN-1 : k-1;
+    }
+    stream_mag_ind = (stream_mag_ind == LPF_FILT_LEN-1) ? 0 : stream_mag_ind+1;
+    
+    //the oldest sample leaves the window, with its products with the samples after it
+    if (stream_count == NUM_TUPLES) {
+        oldest = stream_lpf[stream_head];
+        k = stream_head;
+        for (lag = 0; lag < NUM_AUTOCORR_LAGS; lag++) {
+            stream_lagsum[lag] -= (int64_t)oldest*(int64_t)stream_lpf[k];
+            k = (k == NUM_TUPLES-1) ? 0 : k+1;
+        }
+        stream_sum -= oldest;
+    } else {
+        stream_count++;
+    }
+    
+    //the new one comes in, with its products with the samples before it
+    stream_lpf[stream_head] = lpf_new;
+    stream_sum += lpf_new;
+    k = stream_head;
+    for (lag = 0; lag < NUM_AUTOCORR_LAGS && lag < stream_count; lag++) {
+        stream_lagsum[lag] += (int64_t)lpf_new*(int64_t)stream_lpf[k];
+        k = (k == 0) ? NUM_TUPLES-1 : k-1;
+    }
+    stream_head = (stream_head == NUM_TUPLES-1) ? 0 : stream_head+1;
+    
+    if (stream_count < NUM_TUPLES || ++stream_hop < STEP_HOP) {
+        return 0;
+    }
+    stream_hop = 0;
+    
+    //autocorrelation of the mean removed window from the lag sums:
+    //sum((a[i]-m)*(a[i+lag]-m)) = lagsum - m*(sum of first N-lag + sum of last N-lag) + (N-lag)*m*m
+    int32_t mean     = stream_sum/(NUM_TUPLES);
+    int32_t head_sum = stream_sum;  //sum of the first N-lag samples
+    int32_t tail_sum = stream_sum;  //sum of the last N-lag samples
+    uint8_t first    = stream_head;
+    uint8_t last     = (stream_head == 0) ? NUM_TUPLES-1 : stream_head-1;
+    for (lag = 0; lag < NUM_AUTOCORR_LAGS; lag++) {
+        autocorr_buff[lag] = stream_lagsum[lag] - (int64_t)mean*(int64_t)(head_sum + tail_sum) + (int64_t)(NUM_TUPLES-lag)*mean*mean;
+        head_sum -= stream_lpf[last];
+        tail_sum -= stream_lpf[first];
+        last  = (last == 0) ? NUM_TUPLES-1 : last-1;
+        first = (first == NUM_TUPLES-1) ? 0 : first+1;
+    }
+    
+    uint8_t peak_ind = get_step_period(autocorr_buff, deriv);
+    if (peak_ind == 0) {
+        stream_frac = 0;
+        return 0;
+    }
+    stream_frac += (STEP_HOP << 8)/peak_ind;
+    uint8_t num_steps = stream_frac >> 8;
+    stream_frac &= 0xFF;
+    return num_steps;
+}
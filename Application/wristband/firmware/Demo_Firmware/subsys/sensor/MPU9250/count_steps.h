@@ -5,7 +5,10 @@
 #define SAMPLING_RATE           20                       //20 hz sampling rate
 #define NUM_TUPLES              80                       //80 sets of accelerometer readings (so in other words, 80*3 = 240 samples)
 #define WINDOW_LENGTH           NUM_TUPLES/SAMPLING_RATE //window length in seconds
+#define STEP_HOP                SAMPLING_RATE            //the streaming counter checks the window once a second
 
 uint8_t count_steps(int8_t *data);
+void count_steps_reset(void);
+uint8_t count_steps_push(int8_t x, int8_t y, int8_t z);
 
 #endif /* count_steps_h */
\ No newline at end of file
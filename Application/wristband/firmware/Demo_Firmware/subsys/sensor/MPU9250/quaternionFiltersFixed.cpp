@@ -0,0 +1,383 @@
+// Fixed-point port of quaternionFilters.cpp. The CH583 has no FPU, so the
+// float filters spend most of their time in soft-float sqrt/mul/div calls;
+// here everything is 32x32->64 integer arithmetic, which the RV32IM core does
+// in one or two instructions per product.
+//
+// Formats: quaternion and unit vectors Q30, rotation rates Q16 rad/s, angle
+// increments Q30 rad, gradient/feedback terms Q28/Q29 where the float values
+// can exceed 2.0. The structure follows the float code line by line so the
+// two can be compared directly.
+
+#include "quaternionFiltersFixed.h"
+
+#define Q30_HALF        (1L << 29)
+
+// Same free parameters as the float filters: Kp = 10, Ki = 0,
+// beta = sqrt(3/4) * PI * (40 / 180)
+#define KpFixed         (10L << 16)     // Q16
+#define KiFixed         (0L << 16)      // Q16
+#define betaFixed       649184079L      // Q30
+
+// Seeds for invSqrtFixed(): 1/sqrt() at the middle of 48 slices of [0.25, 1)
+static const uint32_t invSqrtSeed[48] = {
+  2114695713, 2053387115, 1997119227, 1945237133, 1897199172, 1852552937,
+  1810917218, 1771968208, 1735428857, 1701060526, 1668656406, 1638036256,
+  1609042172, 1581535151, 1555392273, 1530504391, 1506774204, 1484114654,
+  1462447584, 1441702596, 1421816090, 1402730445, 1384393311, 1366757007,
+  1349778000, 1333416450, 1317635818, 1302402522, 1287685637, 1273456629,
+  1259689126, 1246358707, 1233442724, 1220920139, 1208771378, 1196978204,
+  1185523604, 1174391680, 1163567563, 1153037323, 1142787899, 1132807028,
+  1123083182, 1113605518, 1104363818, 1095348453, 1086550331, 1077960865,
+};
+
+// atan(2^-i) in degrees, Q16, for the CORDIC in atan2Fixed()
+#define CORDIC_STEPS    20
+static const int32_t cordicAngle[CORDIC_STEPS] = {
+  2949120, 1740967, 919879, 466945, 234379,
+  117304, 58666, 29335, 14668, 7334,
+  3667, 1833, 917, 458, 229,
+  115, 57, 29, 14, 7,
+};
+
+// Vector to hold integral error for Mahony method, Q16
+static int32_t eIntFixed[3] = {0, 0, 0};
+// Vector to hold quaternion, Q30
+static int32_t qFixed[4] = {Q30_ONE, 0, 0, 0};
+
+// Q30 * Q30 -> Q30, rounded
+static inline int32_t qmul(int32_t a, int32_t b)
+{
+  return (int32_t)(((int64_t)a * b + Q30_HALF) >> 30);
+}
+
+// Round a 64-bit sum of products down by sh bits
+static inline int32_t qround(int64_t acc, uint8_t sh)
+{
+  return (int32_t)((acc + ((int64_t)1 << (sh - 1))) >> sh);
+}
+
+// Jacobian (Q28) times objective function (Q29), scaled to Q55 so six terms
+// can be summed without overflow
+static inline int64_t jf(int32_t j, int32_t f)
+{
+  return ((int64_t)j * f) >> 2;
+}
+
+uint32_t invSqrtFixed(uint64_t x, uint8_t * shift)
+{
+  uint8_t  s = __builtin_clzll(x) & ~1;
+  uint32_t X, y;
+  uint64_t t;
+
+  // x = X * 2^(64 - s) with X in [0.25, 1), X in Q32
+  x <<= s;
+  *shift = (64 - s) >> 1;
+  X = (uint32_t)(x >> 32);
+
+  // Two Newton steps y = y * (3 - X * y^2) / 2 take the 1.5 % seed to 2e-7
+  y = invSqrtSeed[(X >> 26) - 16];
+  t = ((uint64_t)X * (((uint64_t)y * y) >> 30)) >> 32;
+  y = (uint32_t)(((uint64_t)y * (uint32_t)(3UL * Q30_ONE - t)) >> 31);
+  t = ((uint64_t)X * (((uint64_t)y * y) >> 30)) >> 32;
+  y = (uint32_t)(((uint64_t)y * (uint32_t)(3UL * Q30_ONE - t)) >> 31);
+
+  return y;
+}
+
+// sqrt(x) for x < 2^62; a Q60 argument gives a Q30 result
+static uint32_t sqrtFixed(uint64_t x)
+{
+  uint32_t r;
+  uint8_t  k;
+
+  if (x == 0) return 0;
+  r = invSqrtFixed(x, &k);
+  // sqrt(x) = x * r * 2^-(30 + k), and x < 2^2k keeps the product in 64 bits
+  return (uint32_t)(((x >> k) * r) >> 30);
+}
+
+// Scale v to a Q30 unit vector, whatever its scale; 0 if v is null
+static uint8_t normalizeFixed(int32_t * v, uint8_t n)
+{
+  uint32_t big = 0;
+  uint64_t ss = 0;
+  uint32_t r;
+  uint8_t  i, k, sh = 0;
+
+  for (i = 0; i < n; i++)
+  {
+    big |= (v[i] < 0) ? 0U - (uint32_t)v[i] : (uint32_t)v[i];
+  }
+  while (big >= (uint32_t)Q30_ONE)  // keeps the sum of squares below 2^62
+  {
+    big >>= 1;
+    sh++;
+  }
+  for (i = 0; i < n; i++)
+  {
+    v[i] >>= sh;
+    ss += (int64_t)v[i] * v[i];
+  }
+  if (ss == 0) return 0;
+
+  r = invSqrtFixed(ss, &k);
+  for (i = 0; i < n; i++)
+  {
+    v[i] = (int32_t)(((int64_t)v[i] * r + ((int64_t)1 << (k - 1))) >> k);
+  }
+  return 1;
+}
+
+// Same for 64-bit input, the top bits are dropped first
+static uint8_t normalizeFixed64(const int64_t * w, int32_t * v, uint8_t n)
+{
+  uint64_t big = 0;
+  uint8_t  i, sh = 0;
+
+  for (i = 0; i < n; i++)
+  {
+    big |= (w[i] < 0) ? 0ULL - (uint64_t)w[i] : (uint64_t)w[i];
+  }
+  while (big >= (uint64_t)Q30_ONE)
+  {
+    big >>= 1;
+    sh++;
+  }
+  for (i = 0; i < n; i++)
+  {
+    v[i] = (int32_t)(w[i] >> sh);
+  }
+  return normalizeFixed(v, n);
+}
+
+// deltat / 2 in seconds, Q30
+static int32_t halfDtFixed(uint32_t deltat)
+{
+  if (deltat > AHRS_FIXED_MAX_DT_US) deltat = AHRS_FIXED_MAX_DT_US;
+  // 2^29 / 10^6 in Q16
+  return (int32_t)(((uint64_t)deltat * 35184372UL) >> 16);
+}
+
+void MadgwickQuaternionUpdateFixed(int32_t ax, int32_t ay, int32_t az, int32_t gx, int32_t gy, int32_t gz, int32_t mx, int32_t my, int32_t mz, uint32_t deltat)
+{
+  // short name local variable for readability
+  int32_t q1 = qFixed[0], q2 = qFixed[1], q3 = qFixed[2], q4 = qFixed[3];
+  int32_t a[3] = {ax, ay, az};
+  int32_t m[3] = {mx, my, mz};
+  int32_t hx, hy, _2bx, _2bz;
+  int32_t fg1, fg2, fg3, fb1, fb2, fb3;
+  int64_t s[4];
+  int32_t sn[4] = {0, 0, 0, 0};
+  int32_t halfdt, betadt;
+  int64_t gdx, gdy, gdz;
+  int64_t qn[4];
+
+  // Auxiliary variables to avoid repeated arithmetic
+  int32_t q1q1 = qmul(q1, q1);
+  int32_t q1q2 = qmul(q1, q2);
+  int32_t q1q3 = qmul(q1, q3);
+  int32_t q1q4 = qmul(q1, q4);
+  int32_t q2q2 = qmul(q2, q2);
+  int32_t q2q3 = qmul(q2, q3);
+  int32_t q2q4 = qmul(q2, q4);
+  int32_t q3q3 = qmul(q3, q3);
+  int32_t q3q4 = qmul(q3, q4);
+  int32_t q4q4 = qmul(q4, q4);
+
+  // Normalise accelerometer and magnetometer measurement
+  if (!normalizeFixed(a, 3)) return;
+  if (!normalizeFixed(m, 3)) return;
+  ax = a[0]; ay = a[1]; az = a[2];
+  mx = m[0]; my = m[1]; mz = m[2];
+
+  // Reference direction of Earth's magnetic field
+  hx = qround((int64_t)mx * (q1q1 + q2q2 - q3q3 - q4q4) + (int64_t)my * (q2q3 - q1q4) * 2 +
+              (int64_t)mz * (q1q3 + q2q4) * 2, 30);
+  hy = qround((int64_t)mx * (q1q4 + q2q3) * 2 + (int64_t)my * (q1q1 - q2q2 + q3q3 - q4q4) +
+              (int64_t)mz * (q3q4 - q1q2) * 2, 30);
+  _2bx = sqrtFixed((int64_t)hx * hx + (int64_t)hy * hy);
+  _2bz = qround((int64_t)mx * (q2q4 - q1q3) * 2 + (int64_t)my * (q1q2 + q3q4) * 2 +
+                (int64_t)mz * (q1q1 - q2q2 - q3q3 + q4q4), 30);
+
+  // Objective function, Q29
+  fg1 = (int32_t)(((int64_t)(q2q4 - q1q3) * 2 - ax) >> 1);
+  fg2 = (int32_t)(((int64_t)(q1q2 + q3q4) * 2 - ay) >> 1);
+  fg3 = (int32_t)(((int64_t)Q30_ONE - (int64_t)q2q2 * 2 - (int64_t)q3q3 * 2 - az) >> 1);
+  fb1 = qround((int64_t)_2bx * (Q30_HALF - q3q3 - q4q4) + (int64_t)_2bz * (q2q4 - q1q3), 31) - (mx >> 1);
+  fb2 = qround((int64_t)_2bx * (q2q3 - q1q4) + (int64_t)_2bz * (q1q2 + q3q4), 31) - (my >> 1);
+  fb3 = qround((int64_t)_2bx * (q1q3 + q2q4) + (int64_t)_2bz * (Q30_HALF - q2q2 - q3q3), 31) - (mz >> 1);
+
+  // Gradient decent algorithm corrective step, Jacobian terms in Q28
+  s[0] = jf(-(q3 >> 1), fg1) + jf(q2 >> 1, fg2)
+       + jf(qround(-(int64_t)_2bz * q3, 32), fb1)
+       + jf(qround(-(int64_t)_2bx * q4 + (int64_t)_2bz * q2, 32), fb2)
+       + jf(qround((int64_t)_2bx * q3, 32), fb3);
+  s[1] = jf(q4 >> 1, fg1) + jf(q1 >> 1, fg2) + jf(-q2, fg3)
+       + jf(qround((int64_t)_2bz * q4, 32), fb1)
+       + jf(qround((int64_t)_2bx * q3 + (int64_t)_2bz * q1, 32), fb2)
+       + jf(qround((int64_t)_2bx * q4 - (int64_t)_2bz * q2 * 2, 32), fb3);
+  s[2] = jf(-(q1 >> 1), fg1) + jf(q4 >> 1, fg2) + jf(-q3, fg3)
+       + jf(qround(-(int64_t)_2bx * q3 * 2 - (int64_t)_2bz * q1, 32), fb1)
+       + jf(qround((int64_t)_2bx * q2 + (int64_t)_2bz * q4, 32), fb2)
+       + jf(qround((int64_t)_2bx * q1 - (int64_t)_2bz * q3 * 2, 32), fb3);
+  s[3] = jf(q2 >> 1, fg1) + jf(q3 >> 1, fg2)
+       + jf(qround(-(int64_t)_2bx * q4 * 2 + (int64_t)_2bz * q2, 32), fb1)
+       + jf(qround(-(int64_t)_2bx * q1 + (int64_t)_2bz * q3, 32), fb2)
+       + jf(qround((int64_t)_2bx * q2, 32), fb3);
+  normalizeFixed64(s, sn, 4);    // normalise step magnitude, stays 0 at the optimum
+
+  // Rate of change of quaternion, integrated over deltat
+  halfdt = halfDtFixed(deltat);
+  betadt = qmul(betaFixed, halfdt) * 2;
+  gdx = qround((int64_t)gx * halfdt, 16);
+  gdy = qround((int64_t)gy * halfdt, 16);
+  gdz = qround((int64_t)gz * halfdt, 16);
+  qn[0] = q1 + qround(-q2 * gdx - q3 * gdy - q4 * gdz, 30) - qmul(betadt, sn[0]);
+  qn[1] = q2 + qround(q1 * gdx + q3 * gdz - q4 * gdy, 30) - qmul(betadt, sn[1]);
+  qn[2] = q3 + qround(q1 * gdy - q2 * gdz + q4 * gdx, 30) - qmul(betadt, sn[2]);
+  qn[3] = q4 + qround(q1 * gdz + q2 * gdy - q3 * gdx, 30) - qmul(betadt, sn[3]);
+
+  // normalise quaternion
+  normalizeFixed64(qn, qFixed, 4);
+}
+
+// Similar to Madgwick scheme but uses proportional and integral filtering on
+// the error between estimated reference vectors and measured ones.
+void MahonyQuaternionUpdateFixed(int32_t ax, int32_t ay, int32_t az, int32_t gx, int32_t gy, int32_t gz, int32_t mx, int32_t my, int32_t mz, uint32_t deltat)
+{
+  // short name local variable for readability
+  int32_t q1 = qFixed[0], q2 = qFixed[1], q3 = qFixed[2], q4 = qFixed[3];
+  int32_t a[3] = {ax, ay, az};
+  int32_t m[3] = {mx, my, mz};
+  int32_t hx, hy, bx, bz;
+  int32_t vx, vy, vz, wx, wy, wz;
+  int32_t ex, ey, ez;
+  int32_t halfdt;
+  int64_t rx, ry, rz, gdx, gdy, gdz;
+  int64_t qn[4];
+
+  // Auxiliary variables to avoid repeated arithmetic
+  int32_t q1q1 = qmul(q1, q1);
+  int32_t q1q2 = qmul(q1, q2);
+  int32_t q1q3 = qmul(q1, q3);
+  int32_t q1q4 = qmul(q1, q4);
+  int32_t q2q2 = qmul(q2, q2);
+  int32_t q2q3 = qmul(q2, q3);
+  int32_t q2q4 = qmul(q2, q4);
+  int32_t q3q3 = qmul(q3, q3);
+  int32_t q3q4 = qmul(q3, q4);
+  int32_t q4q4 = qmul(q4, q4);
+
+  // Normalise accelerometer and magnetometer measurement
+  if (!normalizeFixed(a, 3)) return;
+  if (!normalizeFixed(m, 3)) return;
+  ax = a[0]; ay = a[1]; az = a[2];
+  mx = m[0]; my = m[1]; mz = m[2];
+
+  // Reference direction of Earth's magnetic field
+  hx = qround((int64_t)mx * (Q30_HALF - q3q3 - q4q4) + (int64_t)my * (q2q3 - q1q4) + (int64_t)mz * (q2q4 + q1q3), 29);
+  hy = qround((int64_t)mx * (q2q3 + q1q4) + (int64_t)my * (Q30_HALF - q2q2 - q4q4) + (int64_t)mz * (q3q4 - q1q2), 29);
+  bx = sqrtFixed((int64_t)hx * hx + (int64_t)hy * hy);
+  bz = qround((int64_t)mx * (q2q4 - q1q3) + (int64_t)my * (q3q4 + q1q2) + (int64_t)mz * (Q30_HALF - q2q2 - q3q3), 29);
+
+  // Estimated direction of gravity and magnetic field
+  vx = 2 * (q2q4 - q1q3);
+  vy = 2 * (q1q2 + q3q4);
+  vz = q1q1 - q2q2 - q3q3 + q4q4;
+  wx = qround((int64_t)bx * (Q30_HALF - q3q3 - q4q4) + (int64_t)bz * (q2q4 - q1q3), 29);
+  wy = qround((int64_t)bx * (q2q3 - q1q4) + (int64_t)bz * (q1q2 + q3q4), 29);
+  wz = qround((int64_t)bx * (q1q3 + q2q4) + (int64_t)bz * (Q30_HALF - q2q2 - q3q3), 29);
+
+  // Error is cross product between estimated direction and measured direction of gravity, Q28
+  ex = qround((int64_t)ay * vz - (int64_t)az * vy + (int64_t)my * wz - (int64_t)mz * wy, 32);
+  ey = qround((int64_t)az * vx - (int64_t)ax * vz + (int64_t)mz * wx - (int64_t)mx * wz, 32);
+  ez = qround((int64_t)ax * vy - (int64_t)ay * vx + (int64_t)mx * wy - (int64_t)my * wx, 32);
+  if (KiFixed > 0)
+  {
+    eIntFixed[0] += ex >> 12;   // accumulate integral error
+    eIntFixed[1] += ey >> 12;
+    eIntFixed[2] += ez >> 12;
+  }
+  else
+  {
+    eIntFixed[0] = 0;           // prevent integral wind up
+    eIntFixed[1] = 0;
+    eIntFixed[2] = 0;
+  }
+
+  // Apply feedback terms; the rates stay in Q28 so the feedback keeps the
+  // resolution of the error terms
+  rx = ((int64_t)gx << 12) + (((int64_t)KpFixed * ex) >> 16) + (((int64_t)KiFixed * eIntFixed[0]) >> 4);
+  ry = ((int64_t)gy << 12) + (((int64_t)KpFixed * ey) >> 16) + (((int64_t)KiFixed * eIntFixed[1]) >> 4);
+  rz = ((int64_t)gz << 12) + (((int64_t)KpFixed * ez) >> 16) + (((int64_t)KiFixed * eIntFixed[2]) >> 4);
+
+  // Integrate rate of change of quaternion; like the float filter, q2..q4
+  // are updated with the new q1
+  halfdt = halfDtFixed(deltat);
+  gdx = qround(rx * halfdt, 28);
+  gdy = qround(ry * halfdt, 28);
+  gdz = qround(rz * halfdt, 28);
+  qn[0] = q1 + qround(-q2 * gdx - q3 * gdy - q4 * gdz, 30);
+  qn[1] = q2 + qround(qn[0] * gdx + q3 * gdz - q4 * gdy, 30);
+  qn[2] = q3 + qround(qn[0] * gdy - q2 * gdz + q4 * gdx, 30);
+  qn[3] = q4 + qround(qn[0] * gdz + q2 * gdy - q3 * gdx, 30);
+
+  // Normalise quaternion
+  normalizeFixed64(qn, qFixed, 4);
+}
+
+const int32_t * getQFixed() { return qFixed; }
+
+// atan2(y, x) in degrees, Q16, by CORDIC vectoring; |x|, |y| <= 1.0 in Q30
+static int32_t atan2Fixed(int32_t y, int32_t x)
+{
+  int32_t angle = 0;
+  int32_t t;
+  uint8_t i;
+
+  // half scale leaves room for the CORDIC gain of 1.65
+  x >>= 1;
+  y >>= 1;
+  if (x < 0)
+  { // rotate by 180 degrees into the right half plane
+    angle = (y >= 0) ? (180L << 16) : -(180L << 16);
+    x = -x;
+    y = -y;
+  }
+  for (i = 0; i < CORDIC_STEPS; i++)
+  {
+    if (y > 0)
+    {
+      t = x + (y >> i);
+      y = y - (x >> i);
+      angle += cordicAngle[i];
+    }
+    else
+    {
+      t = x - (y >> i);
+      y = y + (x >> i);
+      angle -= cordicAngle[i];
+    }
+    x = t;
+  }
+  return angle;
+}
+
+void quaternionToEulerFixed(int32_t * yaw, int32_t * pitch, int32_t * roll)
+{
+  int32_t q1 = qFixed[0], q2 = qFixed[1], q3 = qFixed[2], q4 = qFixed[3];
+  int32_t q1q1 = qmul(q1, q1);
+  int32_t q2q2 = qmul(q2, q2);
+  int32_t q3q3 = qmul(q3, q3);
+  int32_t q4q4 = qmul(q4, q4);
+  int32_t sp;
+
+  *yaw  = atan2Fixed(2 * (qmul(q2, q3) + qmul(q1, q4)), q1q1 + q2q2 - q3q3 - q4q4);
+  *roll = atan2Fixed(2 * (qmul(q1, q2) + qmul(q3, q4)), q1q1 - q2q2 - q3q3 + q4q4);
+
+  // -asin(sp) as -atan2(sp, sqrt(1 - sp^2))
+  sp = 2 * (qmul(q2, q4) - qmul(q1, q3));
+  if (sp > Q30_ONE) sp = Q30_ONE;
+  if (sp < -Q30_ONE) sp = -Q30_ONE;
+  *pitch = -atan2Fixed(sp, (int32_t)sqrtFixed(((uint64_t)1 << 60) - (int64_t)sp * sp));
+}
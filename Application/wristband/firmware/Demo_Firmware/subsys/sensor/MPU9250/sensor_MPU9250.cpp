@@ -1,5 +1,7 @@
 #include "MPU9250.h"
 #include "quaternionFilters.h"
+#include "quaternionFiltersFixed.h"
+#include "sensor_MPU9250.h"
 #include <math.h>
 
 extern "C"{
@@ -9,6 +11,7 @@ extern "C"{
 
 
 #define AHRS true         // Set to false for basic data read
+#define AHRS_FIXED true   // Set to false to run the float filters, the core has no FPU
 #define SerialDebugMPU9250   false  // Set to true to get Serial output for debugging
 #define SerialDebugCalibrate true  // Set to true to get Serial output for debugging
 
@@ -72,6 +75,14 @@ bool setupMPU9250() {
       PRINT("%.2f\n", IMU.magCalibration[2]);
     }
     PRINT("AK8963 magCalibration done!\n");
+
+#if MPU9250_FIFO_BATCH
+    IMU.initFIFO(MPU9250_PERIOD_MS - 1);
+    // A full FIFO posts MPU9250_EVENT early, see GPIOA_IRQHandler()
+    GPIOA_ModeCfg(MPU9250_INT_PIN, GPIO_ModeIN_PD);
+    GPIOA_ITModeCfg(MPU9250_INT_PIN, GPIO_ITMode_RiseEdge);
+    PFIC_EnableIRQ(GPIO_A_IRQn);
+#endif
   }
   else {
       return false;
@@ -87,6 +98,11 @@ void sleepMPU9250()
 void WakeMPU9250()
 {
     IMU.setSleepEnabled(DISABLE);
+    count_steps_reset();    // the window must not span the sleep
+#if MPU9250_FIFO_BATCH
+    IMU.resetFIFO();        // drop what was queued before the sleep
+    IMU.readByte(MPU9250_ADDRESS, INT_STATUS);
+#endif
 }
 
 int32_t readMPU9250_step( int8_t *data ) {
@@ -158,77 +174,58 @@ int32_t readMPU9250_step( int8_t *data ) {
     return -1;
 }
 
-void readMPU9250() {
-  // If intPin goes high, all data registers have new data
-  // On interrupt, check if data ready interrupt
-  if (IMU.readByte(MPU9250_ADDRESS, INT_STATUS) & 0x01)
-  {
-    IMU.readAccelData(IMU.accelCount);  // Read the x/y/z adc values
-    IMU.getAres();
-
-    // Now we'll calculate the accleration value into actual g's
-    // This depends on scale being set
-    IMU.ax = (float)IMU.accelCount[0] * IMU.aRes; // - accelBias[0];
-    IMU.ay = (float)IMU.accelCount[1] * IMU.aRes; // - accelBias[1];
-    IMU.az = (float)IMU.accelCount[2] * IMU.aRes; // - accelBias[2];
-
-    IMU.readGyroData(IMU.gyroCount);  // Read the x/y/z adc values
-    IMU.getGres();
-
-    // Calculate the gyro value into actual degrees per second
-    // This depends on scale being set
-    IMU.gx = (float)IMU.gyroCount[0] * IMU.gRes;
-    IMU.gy = (float)IMU.gyroCount[1] * IMU.gRes;
-    IMU.gz = (float)IMU.gyroCount[2] * IMU.gRes;
+// Scale the raw magnetometer counts in IMU.magCount to milliGauss
+static void magMPU9250() {
+  IMU.getMres();
+  // User environmental x-axis correction in milliGauss, should be
+  // automatically calculated
+  IMU.magbias[0] = +470.;
+  // User environmental x-axis correction in milliGauss TODO axis??
+  IMU.magbias[1] = +120.;
+  // User environmental x-axis correction in milliGauss
+  IMU.magbias[2] = +125.;
+
+  // Calculate the magnetometer values in milliGauss
+  // Include factory calibration per data sheet and user environmental
+  // corrections
+  // Get actual magnetometer value, this depends on scale being set
+  IMU.mx = (float)IMU.magCount[0] * IMU.mRes * IMU.magCalibration[0] -
+           IMU.magbias[0];
+  IMU.my = (float)IMU.magCount[1] * IMU.mRes * IMU.magCalibration[1] -
+           IMU.magbias[1];
+  IMU.mz = (float)IMU.magCount[2] * IMU.mRes * IMU.magCalibration[2] -
+           IMU.magbias[2];
+}
 
-    IMU.readMagData(IMU.magCount);  // Read the x/y/z adc values
-    IMU.getMres();
-    // User environmental x-axis correction in milliGauss, should be
-    // automatically calculated
-    IMU.magbias[0] = +470.;
-    // User environmental x-axis correction in milliGauss TODO axis??
-    IMU.magbias[1] = +120.;
-    // User environmental x-axis correction in milliGauss
-    IMU.magbias[2] = +125.;
-
-    // Calculate the magnetometer values in milliGauss
-    // Include factory calibration per data sheet and user environmental
-    // corrections
-    // Get actual magnetometer value, this depends on scale being set
-    IMU.mx = (float)IMU.magCount[0] * IMU.mRes * IMU.magCalibration[0] -
-             IMU.magbias[0];
-    IMU.my = (float)IMU.magCount[1] * IMU.mRes * IMU.magCalibration[1] -
-             IMU.magbias[1];
-    IMU.mz = (float)IMU.magCount[2] * IMU.mRes * IMU.magCalibration[2] -
-             IMU.magbias[2];
-  } // if (readByte(MPU9250_ADDRESS, INT_STATUS) & 0x01)
+// Feed the accel/gyro counts in IMU to the step counter and the quaternion
+// filter, deltat is the time since the previous sample in microseconds
+static void fuseMPU9250(uint32_t deltat) {
+  // Now we'll calculate the accleration value into actual g's
+  // This depends on scale being set
+  IMU.ax = (float)IMU.accelCount[0] * IMU.aRes; // - accelBias[0];
+  IMU.ay = (float)IMU.accelCount[1] * IMU.aRes; // - accelBias[1];
+  IMU.az = (float)IMU.accelCount[2] * IMU.aRes; // - accelBias[2];
+
+  // Calculate the gyro value into actual degrees per second
+  // This depends on scale being set
+  IMU.gx = (float)IMU.gyroCount[0] * IMU.gRes;
+  IMU.gy = (float)IMU.gyroCount[1] * IMU.gRes;
+  IMU.gz = (float)IMU.gyroCount[2] * IMU.gRes;
 
-  static uint16_t i    = 0;
-  float    temp = 0;
-  static int8_t data[245];
 //    int *acc = (int *)malloc(sizeof(int) * 240);
   //scaling factor to convert the decimal data to int8 integers. calculated in matlab by taking the absolute value of all the data
   //and then calculating the max of that data. then divide that by 127 to get the scaling factor
   float scale_factor = 55.3293;
 
-  temp     = roundf(IMU.ax * scale_factor);
-  data[i++] = (int8_t)temp;
-
-  temp     = roundf(IMU.ay * scale_factor);
-  data[i++] = (int8_t)temp;
-
-  temp     = roundf(IMU.az * scale_factor);
-  data[i++] = (int8_t)temp;
-
-  if(i >= 240) {
-      i = 0;
-      IMU.num_steps += count_steps(data);
+  // The step counter wants SAMPLING_RATE, the fusion runs faster
+  static uint8_t step_div = 0;
+  if (++step_div >= 1000 / MPU9250_PERIOD_MS / SAMPLING_RATE) {
+    step_div = 0;
+    IMU.num_steps += count_steps_push((int8_t)roundf(IMU.ax * scale_factor),
+                                      (int8_t)roundf(IMU.ay * scale_factor),
+                                      (int8_t)roundf(IMU.az * scale_factor));
   }
 
-  // Must be called before updating quaternions!
-  IMU.updateTime();
-
-
   // Sensors x (y)-axis of the accelerometer is aligned with the y (x)-axis of
   // the magnetometer; the magnetometer z-axis (+ down) is opposite to z-axis
   // (+ up) of accelerometer and gyro! We have to make some allowance for this
@@ -238,9 +235,23 @@ void readMPU9250() {
   // modified to allow any convenient orientation convention. This is ok by
   // aircraft orientation standards! Pass gyro rate as rad/s
   //  MadgwickQuaternionUpdate(ax, ay, az, gx*PI/180.0f, gy*PI/180.0f, gz*PI/180.0f,  my,  mx, mz);
+#if AHRS_FIXED
+  // Accel as raw counts, gyro in rad/s Q16, mag in mG Q10, deltat in us
+  MahonyQuaternionUpdateFixed(IMU.accelCount[0], IMU.accelCount[1], IMU.accelCount[2],
+                              floatToFixed(IMU.gx, (float)(DEG_TO_RAD * Q16_ONE)),
+                              floatToFixed(IMU.gy, (float)(DEG_TO_RAD * Q16_ONE)),
+                              floatToFixed(IMU.gz, (float)(DEG_TO_RAD * Q16_ONE)),
+                              floatToFixed(IMU.my, 1024.0f), floatToFixed(IMU.mx, 1024.0f),
+                              floatToFixed(IMU.mz, 1024.0f), deltat);
+#else
   MahonyQuaternionUpdate(IMU.ax, IMU.ay, IMU.az, IMU.gx * DEG_TO_RAD,
                          IMU.gy * DEG_TO_RAD, IMU.gz * DEG_TO_RAD, IMU.my,
-                         IMU.mx, IMU.mz, IMU.deltat);
+                         IMU.mx, IMU.mz, deltat * 1e-6f);
+#endif
+}
+
+// Update yaw/pitch/roll from the quaternion, at most every 20 ms
+static void eulerMPU9250() {
   // Serial print and/or display at 0.5 s rate independent of data rates
   IMU.delt_t = millis() - IMU.count;
 
@@ -273,6 +284,12 @@ void readMPU9250() {
       PRINT("\n");
 //      PRINT(" mG\n");
 
+#if AHRS_FIXED
+      PRINT("q0 = %.4f\n", *getQFixed() * (1.0f / Q30_ONE));
+      PRINT("qx = %.4f\n", *(getQFixed() + 1) * (1.0f / Q30_ONE));
+      PRINT("qy = %.4f\n", *(getQFixed() + 2) * (1.0f / Q30_ONE));
+      PRINT("qz = %.4f\n", *(getQFixed() + 3) * (1.0f / Q30_ONE));
+#else
       //Serial.print("q0 = ");
       PRINT("q0 = %.2f\n", *getQ());
       // Serial.print(" qx = ");
@@ -281,8 +298,16 @@ void readMPU9250() {
       PRINT("qy = %.2f\n",*(getQ() + 2));
       // Serial.print(" qz = ");
       PRINT("qz = %.2f\n",*(getQ() + 3));
+#endif
     }
 
+#if AHRS_FIXED
+    int32_t yaw, pitch, roll;
+    quaternionToEulerFixed(&yaw, &pitch, &roll);
+    IMU.yaw   = yaw * (1.0f / Q16_ONE);
+    IMU.pitch = pitch * (1.0f / Q16_ONE);
+    IMU.roll  = roll * (1.0f / Q16_ONE);
+#else
     IMU.yaw   = atan2(2.0f * (*(getQ() + 1) * *(getQ() + 2) + *getQ() *
                               *(getQ() + 3)), *getQ() * *getQ() + * (getQ() + 1) * *(getQ() + 1)
                       - * (getQ() + 2) * *(getQ() + 2) - * (getQ() + 3) * *(getQ() + 3));
@@ -293,11 +318,12 @@ void readMPU9250() {
                       - * (getQ() + 2) * *(getQ() + 2) + * (getQ() + 3) * *(getQ() + 3));
     IMU.pitch *= RAD_TO_DEG;
     IMU.yaw   *= RAD_TO_DEG;
+    IMU.roll  *= RAD_TO_DEG;
+#endif
     // Declination of SparkFun Electronics (4005'26.6"N 10511'05.9"W)is
     //  8 30' E   0 21' (or 8.5) on 2016-07-19
     // - http://www.ngdc.noaa.gov/geomag-web/#declination
     IMU.yaw   -= 8.5;
-    IMU.roll  *= RAD_TO_DEG;
 
     if (SerialDebugMPU9250) {
       PRINT("Yaw, Pitch, Roll: ");
@@ -315,6 +341,50 @@ void readMPU9250() {
   } // if (IMU.delt_t > 20)
 }
 
+void readMPU9250() {
+  // If intPin goes high, all data registers have new data
+  // On interrupt, check if data ready interrupt
+  if (IMU.readByte(MPU9250_ADDRESS, INT_STATUS) & 0x01)
+  {
+    IMU.readAccelData(IMU.accelCount);  // Read the x/y/z adc values
+    IMU.getAres();
+    IMU.readGyroData(IMU.gyroCount);  // Read the x/y/z adc values
+    IMU.getGres();
+    IMU.readMagData(IMU.magCount);  // Read the x/y/z adc values
+    magMPU9250();
+  } // if (readByte(MPU9250_ADDRESS, INT_STATUS) & 0x01)
+
+  // Must be called before updating quaternions!
+  uint32_t lastUpdate = IMU.lastUpdate;
+  IMU.updateTime();
+  fuseMPU9250((IMU.Now - lastUpdate) * 1000);
+  eulerMPU9250();
+}
+
+// Drain the FIFO and run every queued sample through the filters. The FIFO
+// samples are exactly one sample period apart, whatever the task latency was.
+uint16_t readMPU9250Batch() {
+  static int16_t accel[MPU9250_FIFO_SAMPLES][3];
+  static int16_t gyro[MPU9250_FIFO_SAMPLES][3];
+  uint16_t n = IMU.readFIFO(accel, gyro, MPU9250_FIFO_SAMPLES);
+  uint16_t i;
+
+  IMU.getAres();
+  IMU.getGres();
+  // The magnetometer only updates at 8 Hz, one reading serves the batch
+  IMU.readMagData(IMU.magCount);
+  magMPU9250();
+
+  for (i = 0; i < n; i++) {
+    memcpy(IMU.accelCount, accel[i], sizeof(IMU.accelCount));
+    memcpy(IMU.gyroCount, gyro[i], sizeof(IMU.gyroCount));
+    fuseMPU9250(MPU9250_PERIOD_MS * 1000);
+  }
+  IMU.updateTime();
+  eulerMPU9250();
+  return n;
+}
+
 // void get_cursor_position(uint8_t *x, uint8_t *y) {
 //   int cursor_x = SCREEN_WIDTH / 2 + (int)(SCREEN_WIDTH / 2 * (IMU.roll / MAX_CURSOR_ACC));
 //   int cursor_y = SCREEN_HEIGHT / 2 - (int)(SCREEN_HEIGHT / 2 * (IMU.pitch / MAX_CURSOR_ACC));
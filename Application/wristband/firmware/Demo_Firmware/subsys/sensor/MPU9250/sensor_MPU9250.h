@@ -3,11 +3,21 @@
 
 #include <stdint.h>
 
+#define MPU9250_PERIOD_MS       10      // readMPU9250() call period, 100 Hz fusion
+
+// Let the sensor queue samples in its FIFO and wake up every MPU9250_BATCH_MS
+// to fuse the whole batch instead of polling every MPU9250_PERIOD_MS
+#define MPU9250_FIFO_BATCH      1
+#define MPU9250_BATCH_MS        200     // 20 samples, the FIFO holds 42
+// PA pin wired to the MPU9250 INT output, raised when the FIFO is full
+#define MPU9250_INT_PIN         GPIO_Pin_15
+
 bool setupMPU9250(void);
 void sleepMPU9250(void);
 void WakeMPU9250(void);
 
 void readMPU9250(void);
+uint16_t readMPU9250Batch(void);
 int32_t readMPU9250_step( int8_t *data );
 
 #endif // _SENSOR_MPU9250_H_
@@ -0,0 +1,224 @@
+// Host benchmark for quaternionFiltersFixed.cpp
+//
+// Replays an IMU trace (see gen_imu_trace.c for the format, recorded traces
+// in the same format work too) through the fixed-point filter, the float
+// filter of quaternionFilters.cpp and the same float source built with
+// double. The float filter and one double build get the values readMPU9250()
+// has, the fixed filter the values it passes after floatToFixed(), and a
+// second double build the same values converted back, which separates the
+// fixed-point arithmetic from the input rounding. Reports the largest
+// quaternion and Euler deviations and the time per update, and fails if the
+// fixed filter leaves the bounds documented in quaternionFiltersFixed.h.
+//
+//   ahrs_bench <mahony|madgwick> trace.csv
+//
+// Host times only rank the implementations on this machine; the CH583 has
+// no FPU, so on target the float filter pays for soft-float calls the host
+// does in hardware.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "quaternionFilters.h"
+#include "quaternionFiltersFixed.h"
+
+// quaternionFilters.cpp built with double, see quaternionFiltersDouble.cpp;
+// D is fed like the float filter, Q like the fixed one
+void MadgwickQuaternionUpdateD(double ax, double ay, double az, double gx, double gy, double gz, double mx, double my,
+                               double mz, double deltat);
+void MahonyQuaternionUpdateD(double ax, double ay, double az, double gx, double gy, double gz, double mx, double my,
+                             double mz, double deltat);
+const double * getQD();
+void MadgwickQuaternionUpdateQ(double ax, double ay, double az, double gx, double gy, double gz, double mx, double my,
+                               double mz, double deltat);
+void MahonyQuaternionUpdateQ(double ax, double ay, double az, double gx, double gy, double gz, double mx, double my,
+                             double mz, double deltat);
+const double * getQQ();
+
+// Bounds of quaternionFiltersFixed.h: quaternion component against the
+// double build with the same inputs, at most twice the float32 deviation
+// where Madgwick's step direction turns ill-conditioned, and
+// quaternionToEulerFixed() in degrees
+#define QFIXED_BOUND    1e-6
+#define EULER_BOUND     2e-4
+
+// readMPU9250() scales, see sensor_MPU9250.cpp
+#define GYRO_SCALE      ((float)(DEG_TO_RAD * Q16_ONE))
+#define MAG_SCALE       1024.0f
+
+struct Sample
+{
+  uint32_t dt;
+  int16_t  a[3];
+  float    g[3];   // dps
+  float    m[3];   // mG, magnetometer order
+};
+
+static std::vector<Sample> trace;
+
+static bool load(const char * path)
+{
+  FILE * f = fopen(path, "r");
+  char   line[256];
+  Sample s;
+  int    a[3];
+
+  if (!f) return false;
+  while (fgets(line, sizeof(line), f))
+  {
+    if (sscanf(line, "%u,%d,%d,%d,%f,%f,%f,%f,%f,%f", &s.dt, &a[0], &a[1], &a[2], &s.g[0], &s.g[1], &s.g[2],
+               &s.m[0], &s.m[1], &s.m[2]) != 10)
+      continue;
+    for (int k = 0; k < 3; k++) s.a[k] = (int16_t)a[k];
+    trace.push_back(s);
+  }
+  fclose(f);
+  return !trace.empty();
+}
+
+static bool mahony;
+
+// The four implementations
+static void stepFixed(const Sample & s)
+{
+  int32_t g[3], m[3];
+
+  for (int k = 0; k < 3; k++) g[k] = floatToFixed(s.g[k], GYRO_SCALE);
+  for (int k = 0; k < 3; k++) m[k] = floatToFixed(s.m[k], MAG_SCALE);
+  if (mahony)
+    MahonyQuaternionUpdateFixed(s.a[0], s.a[1], s.a[2], g[0], g[1], g[2], m[1], m[0], m[2], s.dt);
+  else
+    MadgwickQuaternionUpdateFixed(s.a[0], s.a[1], s.a[2], g[0], g[1], g[2], m[1], m[0], m[2], s.dt);
+}
+
+static void stepFloat(const Sample & s)
+{
+  const float aRes = 2.0f / 32768.0f;
+
+  if (mahony)
+    MahonyQuaternionUpdate(s.a[0] * aRes, s.a[1] * aRes, s.a[2] * aRes, s.g[0] * DEG_TO_RAD, s.g[1] * DEG_TO_RAD,
+                           s.g[2] * DEG_TO_RAD, s.m[1], s.m[0], s.m[2], s.dt * 1e-6f);
+  else
+    MadgwickQuaternionUpdate(s.a[0] * aRes, s.a[1] * aRes, s.a[2] * aRes, s.g[0] * DEG_TO_RAD, s.g[1] * DEG_TO_RAD,
+                             s.g[2] * DEG_TO_RAD, s.m[1], s.m[0], s.m[2], s.dt * 1e-6f);
+}
+
+static void stepDouble(const Sample & s)
+{
+  const double aRes = 2.0 / 32768.0;
+
+  if (mahony)
+    MahonyQuaternionUpdateD(s.a[0] * aRes, s.a[1] * aRes, s.a[2] * aRes, s.g[0] * DEG_TO_RAD, s.g[1] * DEG_TO_RAD,
+                            s.g[2] * DEG_TO_RAD, s.m[1], s.m[0], s.m[2], s.dt * 1e-6);
+  else
+    MadgwickQuaternionUpdateD(s.a[0] * aRes, s.a[1] * aRes, s.a[2] * aRes, s.g[0] * DEG_TO_RAD, s.g[1] * DEG_TO_RAD,
+                              s.g[2] * DEG_TO_RAD, s.m[1], s.m[0], s.m[2], s.dt * 1e-6);
+}
+
+static void stepDoubleFixedInputs(const Sample & s)
+{
+  const double aRes = 2.0 / 32768.0;
+  double g[3], m[3];
+
+  for (int k = 0; k < 3; k++) g[k] = floatToFixed(s.g[k], GYRO_SCALE) * (1.0 / Q16_ONE);
+  for (int k = 0; k < 3; k++) m[k] = floatToFixed(s.m[k], MAG_SCALE) * (1.0 / MAG_SCALE);
+  if (mahony)
+    MahonyQuaternionUpdateQ(s.a[0] * aRes, s.a[1] * aRes, s.a[2] * aRes, g[0], g[1], g[2], m[1], m[0], m[2],
+                            s.dt * 1e-6);
+  else
+    MadgwickQuaternionUpdateQ(s.a[0] * aRes, s.a[1] * aRes, s.a[2] * aRes, g[0], g[1], g[2], m[1], m[0], m[2],
+                              s.dt * 1e-6);
+}
+
+// largest component difference, q and -q are the same rotation
+static double qdiff(const double * ref, const double * q)
+{
+  double dp = 0, dn = 0;
+
+  for (int k = 0; k < 4; k++)
+  {
+    dp = fmax(dp, fabs(q[k] - ref[k]));
+    dn = fmax(dn, fabs(q[k] + ref[k]));
+  }
+  return fmin(dp, dn);
+}
+
+static double angdiff(double a, double b)
+{
+  double d = fmod(fabs(a - b), 360.0);
+  return fmin(d, 360.0 - d);
+}
+
+static double nsPerUpdate(void (*step)(const Sample &), int rounds)
+{
+  struct timespec t0, t1;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (int r = 0; r < rounds; r++)
+    for (size_t i = 0; i < trace.size(); i++) step(trace[i]);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / ((double)rounds * trace.size());
+}
+
+int main(int argc, char ** argv)
+{
+  double errFixed = 0, errInput = 0, errFloat = 0, errEuler = 0, bound;
+  size_t worst = 0;
+
+  if (argc < 3 || !load(argv[2]))
+  {
+    fprintf(stderr, "usage: %s <mahony|madgwick> trace.csv\n", argv[0]);
+    return 2;
+  }
+  mahony = strcmp(argv[1], "mahony") == 0;
+
+  for (size_t i = 0; i < trace.size(); i++)
+  {
+    double qf[4], qs[4], e[3];
+    int32_t yaw, pitch, roll;
+
+    stepDouble(trace[i]);
+    stepDoubleFixedInputs(trace[i]);
+    stepFloat(trace[i]);
+    stepFixed(trace[i]);
+    for (int k = 0; k < 4; k++)
+    {
+      qf[k] = getQFixed()[k] * (1.0 / Q30_ONE);
+      qs[k] = getQ()[k];
+    }
+    if (qdiff(getQQ(), qf) > errFixed)
+    {
+      errFixed = qdiff(getQQ(), qf);
+      worst = i;
+    }
+    errInput = fmax(errInput, qdiff(getQD(), qf));
+    errFloat = fmax(errFloat, qdiff(getQD(), qs));
+
+    // the Euler conversion alone, against libm on the fixed quaternion
+    quaternionToEulerFixed(&yaw, &pitch, &roll);
+    e[0] = atan2(2 * (qf[1] * qf[2] + qf[0] * qf[3]), qf[0] * qf[0] + qf[1] * qf[1] - qf[2] * qf[2] - qf[3] * qf[3]);
+    e[1] = -asin(fmax(-1.0, fmin(1.0, 2 * (qf[1] * qf[3] - qf[0] * qf[2]))));
+    e[2] = atan2(2 * (qf[0] * qf[1] + qf[2] * qf[3]), qf[0] * qf[0] - qf[1] * qf[1] - qf[2] * qf[2] + qf[3] * qf[3]);
+    errEuler = fmax(errEuler, angdiff(yaw * (1.0 / Q16_ONE), e[0] * RAD_TO_DEG));
+    errEuler = fmax(errEuler, angdiff(pitch * (1.0 / Q16_ONE), e[1] * RAD_TO_DEG));
+    errEuler = fmax(errEuler, angdiff(roll * (1.0 / Q16_ONE), e[2] * RAD_TO_DEG));
+  }
+
+  printf("%s %s: %zu samples\n", argv[1], argv[2], trace.size());
+  printf("  max |q - q_double|  fixed %.2e (sample %zu), with input rounding %.2e  float %.2e\n", errFixed, worst,
+         errInput, errFloat);
+  printf("  max Euler conversion error %.2e deg\n", errEuler);
+  printf("  ns/update  double %.0f  float %.0f  fixed %.0f\n", nsPerUpdate(stepDouble, 20),
+         nsPerUpdate(stepFloat, 20), nsPerUpdate(stepFixed, 20));
+
+  bound = fmax(QFIXED_BOUND, 2 * errFloat);
+  if (errFixed > bound || errEuler > EULER_BOUND)
+  {
+    printf("FAIL: above the documented bound (%.1e quaternion, %.0e deg Euler)\n", bound, EULER_BOUND);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,140 @@
+/* Synthetic MPU9250 traces for ahrs_bench and steps_bench
+ *
+ * A wrist orientation is driven by a few sinusoidal body rates (up to about
+ * 2 rad/s while walking, 0.3 rad/s at rest) and integrated exactly; the
+ * sensors see gravity, the Earth field, the body bounce of each step and
+ * the arm swing, with noise and the MPU9250 quantisation (2 g, 250 dps,
+ * 0.6 mG full-scale steps). The walk alternates walking and standing
+ * segments at a cadence that drifts around 1.8 steps/s.
+ *
+ * Output, one sample per line after a "# steps <n>" line with the true
+ * step count:
+ *   dt_us,ax,ay,az,gx,gy,gz,mx,my,mz
+ * accel in raw counts (16384 per g), gyro in dps, mag in mG with x and y in
+ * the magnetometer's own order, the same values readMPU9250() has.
+ *
+ *   gen_imu_trace <walk|rest> <seconds> <rate_hz> [seed] > trace.csv
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static double gauss(void)
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/* v_body = R(q)^T v_world */
+static void to_body(const double *q, const double *w, double *b)
+{
+    double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+    b[0] = (1 - 2 * (q2 * q2 + q3 * q3)) * w[0] + 2 * (q1 * q2 + q0 * q3) * w[1] + 2 * (q1 * q3 - q0 * q2) * w[2];
+    b[1] = 2 * (q1 * q2 - q0 * q3) * w[0] + (1 - 2 * (q1 * q1 + q3 * q3)) * w[1] + 2 * (q2 * q3 + q0 * q1) * w[2];
+    b[2] = 2 * (q1 * q3 + q0 * q2) * w[0] + 2 * (q2 * q3 - q0 * q1) * w[1] + (1 - 2 * (q1 * q1 + q2 * q2)) * w[2];
+}
+
+int main(int argc, char **argv)
+{
+    const double gWorld[3] = {0, 0, 1};        /* g, the filters expect +z up at rest */
+    const double bWorld[3] = {220, 0, -420};   /* mG, north and down */
+    double       q[4] = {1, 0, 0, 0}, w[3], g[3], b[3], f[3], n;
+    double       seconds, rate, t, dt, amp, swing, stepHz, stepPhase = 0;
+    long         i, count, steps = 0;
+    int          walk;
+
+    if(argc < 4)
+    {
+        fprintf(stderr, "usage: %s <walk|rest> <seconds> <rate_hz> [seed]\n", argv[0]);
+        return 2;
+    }
+    walk = strcmp(argv[1], "walk") == 0;
+    seconds = atof(argv[2]);
+    rate = atof(argv[3]);
+    srand(argc > 4 ? atoi(argv[4]) : 1);
+
+    dt = 1.0 / rate;
+    count = (long)(seconds * rate);
+    amp = walk ? 1.0 : 0.15;       /* rad/s per rate component */
+    stepHz = 1.8 + 0.1 * gauss();  /* steps per second */
+
+    /* the step count comes first, so run the cadence once ahead */
+    for(i = 0; i < count; i++)
+    {
+        t = i * dt;
+        if(walk && fmod(t, 60) < 45)
+        {
+            stepPhase += (stepHz + 0.25 * sin(2 * M_PI * t / 97)) * dt;
+        }
+    }
+    steps = (long)stepPhase;
+    printf("# steps %ld\n", steps);
+    stepPhase = 0;
+
+    for(i = 0; i < count; i++)
+    {
+        double dq[4], h, p, moving;
+        int    k;
+
+        t = i * dt;
+        /* walking for 45 s of every minute */
+        moving = walk && fmod(t, 60) < 45;
+        if(moving)
+        {
+            stepPhase += (stepHz + 0.25 * sin(2 * M_PI * t / 97)) * dt;
+        }
+        p = 2 * M_PI * stepPhase;
+        swing = moving ? 0.15 : 0.0;   /* g of arm swing along x, one per stride */
+
+        w[0] = amp * (1.2 * sin(p / 2) + 0.3 * sin(2 * M_PI * 0.13 * t));
+        w[1] = amp * (0.8 * sin(p / 2 + 1.1) + 0.4 * sin(2 * M_PI * 0.07 * t + 0.4));
+        w[2] = amp * (0.5 * sin(2 * M_PI * 0.21 * t + 2.0) + 0.2 * sin(p));
+
+        /* exact rotation over dt for a rate held constant */
+        n = sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+        h = n * dt / 2;
+        dq[0] = cos(h);
+        for(k = 0; k < 3; k++)
+        {
+            dq[k + 1] = n > 0 ? w[k] / n * sin(h) : 0;
+        }
+        {
+            double r[4];
+
+            r[0] = q[0] * dq[0] - q[1] * dq[1] - q[2] * dq[2] - q[3] * dq[3];
+            r[1] = q[0] * dq[1] + q[1] * dq[0] + q[2] * dq[3] - q[3] * dq[2];
+            r[2] = q[0] * dq[2] - q[1] * dq[3] + q[2] * dq[0] + q[3] * dq[1];
+            r[3] = q[0] * dq[3] + q[1] * dq[2] - q[2] * dq[1] + q[3] * dq[0];
+            n = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + r[3] * r[3]);
+            for(k = 0; k < 4; k++)
+            {
+                q[k] = r[k] / n;
+            }
+        }
+
+        /* specific force: gravity plus the vertical bounce of each step */
+        f[0] = gWorld[0];
+        f[1] = gWorld[1];
+        f[2] = gWorld[2] + (moving ? 0.4 * sin(p) + 0.1 * sin(2 * p + 0.7) : 0);
+        to_body(q, f, g);
+        to_body(q, bWorld, b);
+        g[0] += swing * sin(p / 2) + 0.004 * gauss();
+        g[1] += 0.3 * swing * sin(p / 2 + 0.5) + 0.004 * gauss();
+        g[2] += 0.6 * swing * sin(p / 2 + 1.0) + 0.004 * gauss();
+        for(k = 0; k < 3; k++)
+        {
+            g[k] = round(g[k] * 16384);
+            if(g[k] > 32767) g[k] = 32767;
+            if(g[k] < -32768) g[k] = -32768;
+            b[k] = round((b[k] + 3.0 * gauss()) / 0.6) * 0.6;
+            w[k] = round((w[k] * 180 / M_PI + 0.05 * gauss()) * 131.072) / 131.072;
+        }
+        printf("%.0f,%.0f,%.0f,%.0f,%.5f,%.5f,%.5f,%.1f,%.1f,%.1f\n", dt * 1e6, g[0], g[1], g[2], w[0], w[1], w[2],
+               b[1], b[0], b[2]);
+    }
+    return 0;
+}
@@ -0,0 +1,13 @@
+// quaternionFilters.cpp built with double as the reference of ahrs_bench.
+// Built twice, with REF=D and REF=Q, for two independent filter states.
+#include <math.h>
+#include <stdio.h>
+
+#define CAT_(a, b)                  a##b
+#define CAT(a, b)                   CAT_(a, b)
+#define float                       double
+#define MadgwickQuaternionUpdate    CAT(MadgwickQuaternionUpdate, REF)
+#define MahonyQuaternionUpdate      CAT(MahonyQuaternionUpdate, REF)
+#define getQ                        CAT(getQ, REF)
+
+#include "quaternionFilters.cpp"
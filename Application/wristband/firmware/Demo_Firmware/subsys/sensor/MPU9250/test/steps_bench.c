@@ -0,0 +1,186 @@
+/* Host replay of count_steps_push() against count_steps()
+ *
+ * Replays the accelerometer columns of an IMU trace (gen_imu_trace.c format,
+ * SAMPLING_RATE samples/s) scaled to int8 like readMPU9250() does. The batch
+ * counter gets consecutive NUM_TUPLES windows as the old code did, the
+ * streaming one every sample. At every streaming evaluation the
+ * autocorrelation rebuilt from the lag sums must equal remove_mean() and
+ * autocorr() run on the same window; count_steps.c is included for that.
+ * Reports both step totals, the steps per 20 s segment and the host time per
+ * second of data. Fails if the streaming total is further from the trace's
+ * "# steps" line than the batch one by more than 2 %, or, without that
+ * line, more than 10 % away from the batch total.
+ *
+ *   steps_bench trace.csv
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../count_steps.c"
+
+#define MAX_SAMPLES  (SAMPLING_RATE * 3600)
+#define SEGMENT      (SAMPLING_RATE * 20)
+
+static int8_t   acc[MAX_SAMPLES * 3];
+static unsigned count;
+static long     truth = -1;
+static unsigned mismatches;
+
+static int load(const char *path)
+{
+    /* same scaling as readMPU9250(): raw counts to g at 2 g full scale, then
+     * to int8 */
+    const float aRes = 2.0f / 32768.0f, scale_factor = 55.3293f;
+    FILE       *f = fopen(path, "r");
+    char        line[256];
+    unsigned    dt;
+    int         a[3], k;
+
+    if(!f)
+    {
+        return 0;
+    }
+    while(count < MAX_SAMPLES && fgets(line, sizeof(line), f))
+    {
+        if(sscanf(line, "# steps %ld", &truth) == 1 ||
+           sscanf(line, "%u,%d,%d,%d", &dt, &a[0], &a[1], &a[2]) != 4)
+        {
+            continue;
+        }
+        if(count == 0 && (dt < 900000 / SAMPLING_RATE || dt > 1100000 / SAMPLING_RATE))
+        {
+            fprintf(stderr, "%s: %u us per sample, the counters expect %d samples/s\n", path, dt, SAMPLING_RATE);
+        }
+        for(k = 0; k < 3; k++)
+        {
+            acc[count * 3 + k] = (int8_t)roundf(a[k] * aRes * scale_factor);
+        }
+        count++;
+    }
+    fclose(f);
+    return count >= NUM_TUPLES;
+}
+
+static double now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static unsigned run_batch(unsigned *seg)
+{
+    unsigned i, total = 0, steps;
+
+    for(i = 0; i + NUM_TUPLES <= count; i += NUM_TUPLES)
+    {
+        steps = count_steps(&acc[i * 3]);
+        total += steps;
+        if(seg)
+        {
+            seg[(i + NUM_TUPLES - 1) / SEGMENT] += steps;
+        }
+    }
+    return total;
+}
+
+/* remove_mean() and autocorr() on the streaming window, oldest first */
+static void check_autocorr(unsigned at)
+{
+    int32_t  win[NUM_TUPLES];
+    int64_t  ref[NUM_AUTOCORR_LAGS];
+    unsigned i;
+
+    for(i = 0; i < NUM_TUPLES; i++)
+    {
+        win[i] = stream_lpf[(stream_head + i) % NUM_TUPLES];
+    }
+    remove_mean(win);
+    autocorr(win, ref);
+    if(memcmp(ref, autocorr_buff, sizeof(ref)) != 0)
+    {
+        if(mismatches++ == 0)
+        {
+            printf("  autocorrelation differs at sample %u\n", at);
+        }
+    }
+}
+
+static unsigned run_stream(unsigned *seg)
+{
+    unsigned i, total = 0, steps;
+
+    count_steps_reset();
+    for(i = 0; i < count; i++)
+    {
+        steps = count_steps_push(acc[i * 3], acc[i * 3 + 1], acc[i * 3 + 2]);
+        total += steps;
+        if(seg)
+        {
+            seg[i / SEGMENT] += steps;
+            if(stream_count == NUM_TUPLES && stream_hop == 0)
+            {
+                check_autocorr(i);
+            }
+        }
+    }
+    return total;
+}
+
+int main(int argc, char **argv)
+{
+    static unsigned seg_batch[MAX_SAMPLES / SEGMENT + 1], seg_stream[MAX_SAMPLES / SEGMENT + 1];
+    unsigned        batch, stream, i, rounds = 20;
+    double          t0, t_batch, t_stream;
+
+    if(argc < 2 || !load(argv[1]))
+    {
+        fprintf(stderr, "usage: %s trace.csv\n", argv[0]);
+        return 2;
+    }
+
+    batch = run_batch(seg_batch);
+    stream = run_stream(seg_stream);
+
+    t0 = now_ns();
+    for(i = 0; i < rounds; i++)
+    {
+        run_batch(NULL);
+    }
+    t_batch = (now_ns() - t0) / rounds;
+    t0 = now_ns();
+    for(i = 0; i < rounds; i++)
+    {
+        run_stream(NULL);
+    }
+    t_stream = (now_ns() - t0) / rounds;
+
+    printf("%s: %u samples, steps batch %u stream %u", argv[1], count, batch, stream);
+    if(truth >= 0)
+    {
+        printf(" true %ld", truth);
+    }
+    printf("\n  per %d s:", SEGMENT / SAMPLING_RATE);
+    for(i = 0; i * SEGMENT < count; i++)
+    {
+        printf(" %u/%u", seg_batch[i], seg_stream[i]);
+    }
+    printf("\n  host ns per second of data  batch %.0f  stream %.0f\n", t_batch * SAMPLING_RATE / count,
+           t_stream * SAMPLING_RATE / count);
+
+    if(mismatches)
+    {
+        printf("FAIL: %u evaluations differ from remove_mean() + autocorr()\n", mismatches);
+        return 1;
+    }
+    if(truth >= 0 ? labs((long)stream - truth) > labs((long)batch - truth) + truth / 50
+                  : labs((long)stream - (long)batch) > (long)batch / 10 + 2)
+    {
+        printf("FAIL: streaming total off\n");
+        return 1;
+    }
+    return 0;
+}
@@ -704,6 +704,61 @@ uint16_t MAX30105::check(void)
   return (numberOfSamples); //Let the world know how much new data we found
 }
 
+//Burst read up to maxSamples queued samples into red[] and IR[], oldest first
+//Unlike check() this bypasses the 4 deep sense array, so a whole FIFO (32
+//samples) can be drained at once, e.g. on the almost full interrupt
+//Green samples are read and dropped, IR[] is left alone in Red only mode
+//Returns the number of samples stored, overflow gets the number of samples lost
+uint8_t MAX30105::readFIFO(uint32_t *red, uint32_t *IR, uint8_t maxSamples, uint8_t *overflow)
+{
+  uint8_t bytesPerSample = activeLEDs * 3;
+
+  getINT1(); //Reading INT_STATUS_1 releases the INT pin
+
+  uint8_t readPointer = getReadPointer();
+  uint8_t writePointer = getWritePointer();
+  uint8_t lost = readRegister8(_i2caddr, MAX30105_FIFOOVERFLOW);
+  if (overflow != NULL) *overflow = lost;
+
+  int numberOfSamples = writePointer - readPointer;
+  if (numberOfSamples < 0) numberOfSamples += 32; //Wrap condition
+  if (numberOfSamples == 0 && lost > 0) numberOfSamples = 32; //Full FIFO, the pointers meet
+  if (numberOfSamples > maxSamples) numberOfSamples = maxSamples;
+  if (numberOfSamples == 0) return (0);
+
+  _i2cPort->beginTransmission(MAX30105_ADDRESS);
+  _i2cPort->write(MAX30105_FIFODATA);
+  _i2cPort->endTransmission();
+
+  //Whole samples per request, 5 of Red+IR fit in I2C_BUFFER_LENGTH
+  uint8_t samplesPerRead = I2C_BUFFER_LENGTH / bytesPerSample;
+  uint8_t stored = 0;
+
+  while (stored < numberOfSamples)
+  {
+    uint8_t toGet = numberOfSamples - stored;
+    if (toGet > samplesPerRead) toGet = samplesPerRead;
+
+    _i2cPort->requestFrom(MAX30105_ADDRESS, (uint8_t)(toGet * bytesPerSample));
+
+    for (uint8_t i = 0; i < toGet; i++, stored++)
+    {
+      for (uint8_t led = 0; led < activeLEDs; led++)
+      {
+        uint32_t tempLong = (uint32_t)_i2cPort->read() << 16;
+        tempLong |= (uint32_t)_i2cPort->read() << 8;
+        tempLong |= _i2cPort->read();
+        tempLong &= 0x3FFFF; //Zero out all but 18 bits
+
+        if (led == 0) red[stored] = tempLong;
+        else if (led == 1) IR[stored] = tempLong;
+      }
+    }
+  }
+
+  return (stored);
+}
+
 //Check for new data but give up after a certain amount of time
 //Returns true if new data was found
 //Returns false if new data was not found
@@ -108,6 +108,7 @@ class MAX30105 {
   uint32_t getFIFORed(void); //Returns the FIFO sample pointed to by tail
   uint32_t getFIFOIR(void); //Returns the FIFO sample pointed to by tail
   uint32_t getFIFOGreen(void); //Returns the FIFO sample pointed to by tail
+  uint8_t readFIFO(uint32_t *red, uint32_t *IR, uint8_t maxSamples, uint8_t *overflow = NULL); //Burst reads queued samples straight into the caller's arrays
 
   uint8_t getWritePointer(void);
   uint8_t getReadPointer(void);
@@ -1,8 +1,10 @@
 #include "CH58x_common.h"
 #include "MAX30105.h"
 #include "heartRate.h"
+#include "sensor_max30102.h"
 extern "C"{
     #include "spo2_algorithm.h"
+    #include "spo2_stream.h"
 }
 
 
@@ -31,6 +33,21 @@ bool setupMax30102(void)
      return false;
    }
 
+#if MAX30102_FIFO_BATCH
+   //Red + IR at 100 sps averaged by 4: FreqS (25) samples per second into the
+   //FIFO, the rate spo2_stream.c is tuned for
+   particleSensor.setup(60, 4, 2, 100, 411, 4096);
+   particleSensor.disableFIFORollover(); //Keep the oldest samples, readFIFO() reports the lost ones
+   particleSensor.setFIFOAlmostFull(MAX30102_FIFO_A_FULL);
+   particleSensor.enableAFULL();
+   particleSensor.getINT1(); //Release the power ready interrupt
+   spo2_stream_reset();
+
+   GPIOA_ModeCfg(MAX30102_INT_PIN, GPIO_ModeIN_PU);
+   GPIOA_ITModeCfg(MAX30102_INT_PIN, GPIO_ITMode_FallEdge);
+   PFIC_EnableIRQ(GPIO_A_IRQn);
+#endif
+
    return true;
 }
 
@@ -45,6 +62,11 @@ void WakeMax30102(void)
 {
     LOG_INFO("wake MAX30102");
     particleSensor.wakeUp();
+#if MAX30102_FIFO_BATCH
+    particleSensor.clearFIFO(); //Drop what was queued before the shutdown
+    particleSensor.getINT1();
+    spo2_stream_reset();
+#endif
 }
 
 
@@ -219,3 +241,35 @@ int read_HeartRate(float *beatsPerMinute, int *beatAvg)
 
 }
 
+
+//Drain the FIFO into the streaming HR/SpO2 estimator
+//beatAvg and spo2 are only written when a beat gave a valid value
+//Returns 0 when there is no finger on the sensor, like read_HeartRate()
+int read_HeartRateBatch(int *beatAvg, int *spo2)
+{
+    static uint32_t red[32], ir[32];
+    static spo2_result_t result;
+    static uint32_t irValue;
+    uint8_t lost;
+
+    uint8_t n = particleSensor.readFIFO(red, ir, 32, &lost);
+    if (lost)
+        spo2_stream_reset(); //The gap would stretch one beat interval
+
+    for (uint8_t i = 0; i < n; i++)
+    {
+        if (spo2_stream_push(ir[i], red[i], &result))
+        {
+            if (result.hr_valid) *beatAvg = result.heart_rate;
+            if (result.spo2_valid) *spo2 = result.spo2;
+        }
+    }
+    if (n)
+        irValue = ir[n - 1];
+
+    if (irValue < SPO2_FINGER_IR){
+        return 0;
+    }
+
+    return 1;
+}
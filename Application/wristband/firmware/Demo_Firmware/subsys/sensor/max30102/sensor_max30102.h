@@ -1,9 +1,18 @@
 #ifndef _SENSOR_MAX30102_H_
 #define _SENSOR_MAX30102_H_
 
+// Let the sensor queue samples in its FIFO and run the streaming HR/SpO2
+// estimator (spo2_stream.c) on the almost full interrupt instead of polling
+// read_HeartRate() every 15 ms
+#define MAX30102_FIFO_BATCH     1
+#define MAX30102_FIFO_A_FULL    15      // free slots left when INT fires: 17 samples, 0.68 s
+#define MAX30102_BATCH_MS       1000    // drain anyway if the INT pin never fires
+// PA pin wired to the MAX30102 INT output (open drain, active low)
+#define MAX30102_INT_PIN        GPIO_Pin_7
 
 int read_HeartRate(float *beatsPerMinute, int *beatAvg);
 int read_SPO2(void);
+int read_HeartRateBatch(int *beatAvg, int *spo2);
 bool setupMax30102(void);
 void shutMax30102(void);
 void WakeMax30102(void);
@@ -0,0 +1,200 @@
+#include <stdint.h>
+#include "spo2_algorithm.h"
+#include "spo2_stream.h"
+
+extern const uint8_t uch_spo2_table[184];
+
+#define RAW_SIZE        8       // raw history, covers the moving average delay
+#define DC_SHIFT        3       // DC removal pole, fc = FreqS / (2 * pi * 8)
+#define THR_SHIFT       4       // threshold decay per sample
+#define SETTLE          (FreqS * 2)
+#define MIN_DIST        (FreqS * 60 / SPO2_MAX_BPM)
+#define MAX_DIST        (FreqS * 60 / SPO2_MIN_BPM)
+
+static uint32_t n;                          // samples since reset
+static int32_t  dc_ir;                      // Q8
+static int32_t  ma[MA4_SIZE], ma_sum;       // inverted IR AC, moving average
+static int32_t  s1, s2;                     // ma_sum one and two samples ago
+static int32_t  thr;
+static uint32_t raw_ir[RAW_SIZE], raw_red[RAW_SIZE];
+
+// Last valley: smoothed peak position (sample + Q8 fraction) for the beat
+// interval, raw sample for the AC/DC ratio
+static uint8_t  have_valley;
+static uint32_t pk_at;
+static int32_t  pk_frac;
+static uint32_t v_at, v_ir, v_red;
+
+// Raw maxima since the last valley, fed up to (but excluding) next_feed
+static uint32_t next_feed;
+static uint32_t m_ir, m_ir_at, m_red, m_red_at;
+
+static int32_t  intervals[SPO2_AVG_BEATS];  // Q8 samples
+static int32_t  ratios[SPO2_AVG_BEATS];     // x100
+static uint8_t  interval_count, interval_head;
+static uint8_t  ratio_count, ratio_head;
+static uint32_t refractory;                 // samples, 5/8 of the mean interval
+
+void spo2_stream_reset(void)
+{
+    uint8_t i;
+
+    n = 0;
+    ma_sum = 0;
+    for (i = 0; i < MA4_SIZE; i++)
+        ma[i] = 0;
+    s1 = s2 = 0;
+    thr = SPO2_MIN_HEIGHT * MA4_SIZE;
+    have_valley = 0;
+    refractory = MIN_DIST;
+    interval_count = interval_head = 0;
+    ratio_count = ratio_head = 0;
+}
+
+static void feed_max(uint32_t end)
+{
+    for (; next_feed < end; next_feed++) {
+        uint32_t ir = raw_ir[next_feed % RAW_SIZE];
+        uint32_t red = raw_red[next_feed % RAW_SIZE];
+
+        if (ir > m_ir) {
+            m_ir = ir;
+            m_ir_at = next_feed;
+        }
+        if (red > m_red) {
+            m_red = red;
+            m_red_at = next_feed;
+        }
+    }
+}
+
+// AC of the raw maximum above the straight line between the two valleys,
+// as in maxim_heart_rate_and_oxygen_saturation()
+static int32_t beat_ac(uint32_t max, uint32_t max_at, uint32_t v0, uint32_t v1,
+                       uint32_t len)
+{
+    int32_t base = (int32_t)v0 + ((int32_t)v1 - (int32_t)v0) *
+                                 (int32_t)(max_at - v_at) / (int32_t)len;
+    return (int32_t)max - base;
+}
+
+static void valley_found(uint32_t j, int32_t frac, spo2_result_t *result,
+                         uint8_t *beat)
+{
+    uint8_t i, k;
+
+    if (have_valley) {
+        int32_t interval = (int32_t)((n - 1 - pk_at) << 8) + frac - pk_frac;
+
+        if (interval >= (MIN_DIST << 8) && interval <= (MAX_DIST << 8)) {
+            uint32_t len = j - v_at;
+            int32_t sum = 0;
+
+            intervals[interval_head] = interval;
+            interval_head = (interval_head + 1) % SPO2_AVG_BEATS;
+            if (interval_count < SPO2_AVG_BEATS)
+                interval_count++;
+            for (i = 0; i < interval_count; i++)
+                sum += intervals[i];
+            result->heart_rate = (FreqS * 60 * 256 * interval_count + sum / 2) / sum;
+            // The dicrotic notch comes well before 5/8 of the period
+            refractory = (uint32_t)(sum * 5 / 8 / interval_count) >> 8;
+            if (refractory < MIN_DIST)
+                refractory = MIN_DIST;
+            result->hr_valid = 1;
+
+            feed_max(j);
+            if (len > 3) {
+                int32_t red_ac = beat_ac(m_red, m_red_at, v_red, raw_red[j % RAW_SIZE], len);
+                int32_t ir_ac = beat_ac(m_ir, m_ir_at, v_ir, raw_ir[j % RAW_SIZE], len);
+
+                if (red_ac > 0 && ir_ac > 0) {
+                    ratios[ratio_head] = (int32_t)((int64_t)red_ac * m_ir * 100 /
+                                                   ((int64_t)ir_ac * m_red));
+                    ratio_head = (ratio_head + 1) % SPO2_AVG_BEATS;
+                    if (ratio_count < SPO2_AVG_BEATS)
+                        ratio_count++;
+                }
+            }
+
+            if (ratio_count) {
+                int32_t sorted[SPO2_AVG_BEATS], ratio;
+
+                for (i = 0; i < ratio_count; i++)
+                    sorted[i] = ratios[i];
+                maxim_sort_ascend(sorted, ratio_count);
+                k = ratio_count / 2;
+                ratio = (ratio_count & 1) ? sorted[k] : (sorted[k - 1] + sorted[k]) / 2;
+                if (ratio > 2 && ratio < 184) {
+                    result->spo2 = uch_spo2_table[ratio];
+                    result->spo2_valid = 1;
+                } else {
+                    result->spo2_valid = 0;
+                }
+            }
+            *beat = 1;
+        }
+    }
+
+    have_valley = 1;
+    pk_at = n - 1;
+    pk_frac = frac;
+    v_at = j;
+    v_ir = raw_ir[j % RAW_SIZE];
+    v_red = raw_red[j % RAW_SIZE];
+    m_ir = m_red = 0;
+    m_ir_at = m_red_at = j;
+    next_feed = j;
+}
+
+uint8_t spo2_stream_push(uint32_t ir, uint32_t red, spo2_result_t *result)
+{
+    uint8_t beat = 0;
+    int32_t a, s0;
+
+    if (ir < SPO2_FINGER_IR) {
+        if (n)
+            spo2_stream_reset();
+        return 0;
+    }
+
+    if (n == 0)
+        dc_ir = (int32_t)ir << 8;
+    dc_ir += (((int32_t)ir << 8) - dc_ir) >> DC_SHIFT;
+    raw_ir[n % RAW_SIZE] = ir;
+    raw_red[n % RAW_SIZE] = red;
+
+    // Inverted so the valleys of the raw signal are peaks here
+    a = (dc_ir - ((int32_t)ir << 8)) >> 8;
+    ma_sum += a - ma[n % MA4_SIZE];
+    ma[n % MA4_SIZE] = a;
+    s0 = ma_sum;
+
+    if (have_valley && n >= MA4_SIZE)
+        feed_max(n - MA4_SIZE + 1);
+
+    if (thr > SPO2_MIN_HEIGHT * MA4_SIZE)
+        thr -= thr >> THR_SHIFT;
+
+    // s1 is a peak of the smoothed signal, it covers raw samples n-4 .. n-1
+    if (n >= SETTLE && s1 > thr && s1 > s2 && s1 >= s0 &&
+        (!have_valley || n - 1 - pk_at >= refractory)) {
+        int32_t den = s2 - 2 * s1 + s0;
+        int32_t frac = den ? (s2 - s0) * 128 / den : 0;
+        uint32_t j = n - MA4_SIZE, i;
+
+        for (i = j + 1; i < n; i++)
+            if (raw_ir[i % RAW_SIZE] < raw_ir[j % RAW_SIZE])
+                j = i;
+        valley_found(j, frac, result, &beat);
+        thr = s1 / 2;
+    } else if (have_valley && n - 1 - pk_at > MAX_DIST) {
+        // No beat for too long, the next valley starts over
+        have_valley = 0;
+    }
+
+    s2 = s1;
+    s1 = s0;
+    n++;
+    return beat;
+}
@@ -0,0 +1,38 @@
+#ifndef SPO2_STREAM_H_
+#define SPO2_STREAM_H_
+
+#include <stdint.h>
+
+// Streaming heart rate / SpO2 for the MAX30102.
+//
+// Same sampling rate (FreqS) and SpO2 calibration (uch_spo2_table) as
+// maxim_heart_rate_and_oxygen_saturation(), but the samples are pushed one at
+// a time as they come out of the sensor FIFO and the result is updated on
+// every beat. There is no sample window, the state is a few dozen words, and
+// everything is integer.
+//
+// Per sample: DC removal (first order IIR, ~0.5 Hz), 4 point moving average
+// (first zero at FreqS / 4) on the inverted IR signal, then an incremental
+// valley detector with an adaptive threshold and a refractory period of 5/8
+// of the mean beat interval (at least 60 * FreqS / SPO2_MAX_BPM samples). Per
+// beat: the interval between the last two valleys (parabolic sub-sample
+// position) and the red/IR AC/DC ratio measured between them.
+
+#define SPO2_MIN_BPM        40
+#define SPO2_MAX_BPM        200
+#define SPO2_AVG_BEATS      4       // beats averaged for HR, median for SpO2
+#define SPO2_MIN_HEIGHT     30      // smallest valley depth in ADC counts
+#define SPO2_FINGER_IR      50000   // raw IR below this: no finger on the sensor
+
+typedef struct {
+    int32_t heart_rate;     // beats per minute
+    int32_t spo2;           // percent
+    int8_t  hr_valid;
+    int8_t  spo2_valid;
+} spo2_result_t;
+
+void spo2_stream_reset(void);
+// Returns 1 when the sample completed a beat and result was updated
+uint8_t spo2_stream_push(uint32_t ir, uint32_t red, spo2_result_t *result);
+
+#endif /* SPO2_STREAM_H_ */
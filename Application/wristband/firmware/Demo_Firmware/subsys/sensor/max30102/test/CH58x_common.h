@@ -0,0 +1,10 @@
+/* Host stand-in for the CH58x device header, spo2_algorithm.c only needs
+ * the integer types and min() of CH583SFR.h */
+#ifndef __CH58x_COMMON_H__
+#define __CH58x_COMMON_H__
+
+#include <stdint.h>
+
+#define min(a,b)                (((a) < (b)) ? (a) : (b))
+
+#endif
@@ -0,0 +1,107 @@
+/* Synthetic MAX30102 traces for spo2_replay
+ *
+ * 25 samples/s of IR and red as the sensor reports them: a DC level with
+ * slow baseline wander, minus a pulse (sharp systolic upstroke, dicrotic
+ * notch, slow diastolic run-off) scaled by the perfusion index, plus noise.
+ * The red pulse is the IR one times the ratio R that uch_spo2_table maps to
+ * the wanted SpO2. Heart rate and SpO2 follow a scenario with beat-to-beat
+ * variability; both are written next to the samples as the truth.
+ *
+ * Output, one sample per line:
+ *   ir,red,hr_bpm,spo2_percent
+ *
+ *   gen_ppg_trace <rest|walk|desat> <seconds> [seed] > trace.csv
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FS 25.0
+
+static double gauss(void)
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/* Blood volume over one beat, phase in [0, 1), peak 1 */
+static double pulse(double p)
+{
+    double v = p < 0.15 ? sin(p / 0.15 * M_PI / 2) : exp(-(p - 0.15) * 3.5);
+
+    return v + 0.12 * exp(-pow((p - 0.42) / 0.06, 2));
+}
+
+/* Inverse of the uch_spo2_table fit -45.060 R^2 + 30.354 R + 94.845, on the
+ * falling branch (R above 0.34) where real readings are */
+static double ratio_for(double spo2)
+{
+    return (30.354 + sqrt(30.354 * 30.354 - 4 * 45.060 * (spo2 - 94.845))) / (2 * 45.060);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds, t, hr, spo2, phase = 0, beat_hr, wander = 0;
+    long   i, count;
+    int    mode;
+
+    if(argc < 3)
+    {
+        fprintf(stderr, "usage: %s <rest|walk|desat> <seconds> [seed]\n", argv[0]);
+        return 2;
+    }
+    mode = strcmp(argv[1], "walk") == 0 ? 1 : strcmp(argv[1], "desat") == 0 ? 2 : 0;
+    seconds = atof(argv[2]);
+    srand(argc > 3 ? atoi(argv[3]) : 1);
+
+    count = (long)(seconds * FS);
+    beat_hr = mode == 1 ? 105 : 68;
+    for(i = 0; i < count; i++)
+    {
+        double ir, red, perf, r, p;
+
+        t = i / FS;
+        if(mode == 1)
+        {
+            /* walking: faster and drifting up, weaker perfusion, more motion */
+            hr = 100 + 20 * t / seconds + 5 * sin(2 * M_PI * t / 40);
+            spo2 = 97;
+        }
+        else
+        {
+            hr = 62 + 6 * sin(2 * M_PI * t / 30);
+            /* desat: 97 % down to 88 % and back over the middle third */
+            spo2 = 97;
+            if(mode == 2 && t > seconds / 3 && t < seconds * 2 / 3)
+            {
+                spo2 = 97 - 9 * sin((t - seconds / 3) / (seconds / 3) * M_PI);
+            }
+        }
+
+        phase += beat_hr / 60.0 / FS;
+        if(phase >= 1)
+        {
+            phase -= 1;
+            beat_hr = hr * (1 + 0.03 * gauss()); /* next beat */
+        }
+
+        perf = mode == 1 ? 0.006 : 0.012;
+        r = ratio_for(spo2);
+        p = pulse(phase);
+        wander += 0.02 * gauss() - wander * 0.01;
+        ir = 120000 * (1 + 0.004 * wander) * (1 - perf * p);
+        red = 90000 * (1 + 0.004 * wander) * (1 - r * perf * p);
+        if(mode == 1)
+        {
+            ir += 150 * sin(2 * M_PI * 1.8 * t);
+            red += 110 * sin(2 * M_PI * 1.8 * t);
+        }
+        ir += 20 * gauss();
+        red += 20 * gauss();
+        printf("%ld,%ld,%.1f,%.1f\n", lround(ir), lround(red), hr, spo2);
+    }
+    return 0;
+}
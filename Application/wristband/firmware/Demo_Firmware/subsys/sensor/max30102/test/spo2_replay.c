@@ -0,0 +1,194 @@
+/* Host replay of spo2_stream.c against the Maxim reference
+ *
+ * A PPG trace (see gen_ppg_trace.c for the format; recorded traces with only
+ * the ir,red columns work too) is pushed sample by sample through
+ * spo2_stream_push(), and, like read_SPO2() did, every FreqS samples the last
+ * BUFFER_SIZE go through maxim_heart_rate_and_oxygen_saturation(). Once a
+ * second both latest outputs are compared with each other and with the
+ * truth columns when the trace has them. Reports the validity, the mean
+ * absolute errors and the host time per second of data, and fails if the
+ * stream estimator is less often valid or less accurate than the reference
+ * by more than the margins below.
+ *
+ *   spo2_replay trace.csv
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "spo2_algorithm.h"
+#include "spo2_stream.h"
+
+#define MAX_SAMPLES (FreqS * 3600)
+
+/* Margins against the reference, bpm and percent */
+#define HR_MARGIN   2.0
+#define SPO2_MARGIN 1.0
+
+typedef struct {
+    unsigned seconds, valid;
+    double   err_sum;   /* against the truth, or the reference without one */
+    double   ref_sum;   /* against the reference, seconds both are valid */
+    unsigned ref_count;
+} stat_t;
+
+static uint32_t ir[MAX_SAMPLES], red[MAX_SAMPLES];
+static double   hr_true[MAX_SAMPLES], spo2_true[MAX_SAMPLES];
+static unsigned count;
+static int      has_truth;
+
+static int load(const char *path)
+{
+    FILE    *f = fopen(path, "r");
+    char     line[128];
+    unsigned i, r;
+    double   h, s;
+
+    if(!f)
+    {
+        return 0;
+    }
+    has_truth = 1;
+    while(count < MAX_SAMPLES && fgets(line, sizeof(line), f))
+    {
+        int n = sscanf(line, "%u,%u,%lf,%lf", &i, &r, &h, &s);
+
+        if(n < 2)
+        {
+            continue;
+        }
+        if(n < 4)
+        {
+            has_truth = 0;
+        }
+        ir[count] = i;
+        red[count] = r;
+        hr_true[count] = h;
+        spo2_true[count] = s;
+        count++;
+    }
+    fclose(f);
+    return count >= BUFFER_SIZE;
+}
+
+static double now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static double absd(double x)
+{
+    return x < 0 ? -x : x;
+}
+
+static void tally(stat_t *st, int valid, double value, double truth, int ref_valid, double ref)
+{
+    st->seconds++;
+    if(!valid)
+    {
+        return;
+    }
+    st->valid++;
+    st->err_sum += absd(value - truth);
+    if(ref_valid)
+    {
+        st->ref_sum += absd(value - ref);
+        st->ref_count++;
+    }
+}
+
+static double mean(double sum, unsigned n)
+{
+    return n ? sum / n : 0;
+}
+
+int main(int argc, char **argv)
+{
+    spo2_result_t res = {0, 0, 0, 0};
+    stat_t        s_hr = {0}, s_spo2 = {0}, r_hr = {0}, r_spo2 = {0};
+    int32_t       ref_hr = 0, ref_spo2 = 0;
+    int8_t        ref_hr_valid = 0, ref_spo2_valid = 0;
+    double        t_stream, t_ref, t0;
+    unsigned      k, beats = 0, fail = 0;
+
+    if(argc < 2 || !load(argv[1]))
+    {
+        fprintf(stderr, "usage: %s trace.csv (ir,red[,hr,spo2] at %d samples/s)\n", argv[0], FreqS);
+        return 2;
+    }
+
+    spo2_stream_reset();
+    for(k = 0; k < count; k++)
+    {
+        beats += spo2_stream_push(ir[k], red[k], &res);
+
+        if(k + 1 < BUFFER_SIZE || (k + 1) % FreqS)
+        {
+            continue;
+        }
+        maxim_heart_rate_and_oxygen_saturation(&ir[k + 1 - BUFFER_SIZE], BUFFER_SIZE, &red[k + 1 - BUFFER_SIZE],
+                                               &ref_spo2, &ref_spo2_valid, &ref_hr, &ref_hr_valid);
+
+        /* The reference reports the middle of its window, the truth is
+         * taken there for both */
+        if(has_truth)
+        {
+            unsigned mid = k + 1 - BUFFER_SIZE / 2;
+
+            tally(&s_hr, res.hr_valid, res.heart_rate, hr_true[mid], ref_hr_valid, ref_hr);
+            tally(&s_spo2, res.spo2_valid, res.spo2, spo2_true[mid], ref_spo2_valid, ref_spo2);
+            tally(&r_hr, ref_hr_valid, ref_hr, hr_true[mid], 0, 0);
+            tally(&r_spo2, ref_spo2_valid, ref_spo2, spo2_true[mid], 0, 0);
+        }
+        else
+        {
+            tally(&s_hr, res.hr_valid, res.heart_rate, ref_hr, ref_hr_valid, ref_hr);
+            tally(&s_spo2, res.spo2_valid, res.spo2, ref_spo2, ref_spo2_valid, ref_spo2);
+            tally(&r_hr, ref_hr_valid, ref_hr, ref_hr, 0, 0);
+            tally(&r_spo2, ref_spo2_valid, ref_spo2, ref_spo2, 0, 0);
+        }
+    }
+
+    /* Timing passes over the whole trace, same call pattern */
+    spo2_stream_reset();
+    t0 = now_ns();
+    for(k = 0; k < count; k++)
+    {
+        spo2_stream_push(ir[k], red[k], &res);
+    }
+    t_stream = now_ns() - t0;
+    t0 = now_ns();
+    for(k = BUFFER_SIZE - 1; k < count; k += FreqS)
+    {
+        maxim_heart_rate_and_oxygen_saturation(&ir[k + 1 - BUFFER_SIZE], BUFFER_SIZE, &red[k + 1 - BUFFER_SIZE],
+                                               &ref_spo2, &ref_spo2_valid, &ref_hr, &ref_hr_valid);
+    }
+    t_ref = now_ns() - t0;
+
+    printf("%s: %u samples, %u beats, %u comparisons\n", argv[1], count, beats, s_hr.seconds);
+    printf("  HR    valid stream %3u%% ref %3u%%  mean |err| stream %.1f ref %.1f bpm%s  |stream-ref| %.1f\n",
+           100 * s_hr.valid / s_hr.seconds, 100 * r_hr.valid / r_hr.seconds, mean(s_hr.err_sum, s_hr.valid),
+           mean(r_hr.err_sum, r_hr.valid), has_truth ? "" : " (vs ref)", mean(s_hr.ref_sum, s_hr.ref_count));
+    printf("  SpO2  valid stream %3u%% ref %3u%%  mean |err| stream %.1f ref %.1f %%%s  |stream-ref| %.1f\n",
+           100 * s_spo2.valid / s_spo2.seconds, 100 * r_spo2.valid / r_spo2.seconds,
+           mean(s_spo2.err_sum, s_spo2.valid), mean(r_spo2.err_sum, r_spo2.valid), has_truth ? "" : " (vs ref)",
+           mean(s_spo2.ref_sum, s_spo2.ref_count));
+    printf("  host ns per second of data  stream %.0f  ref %.0f\n", t_stream * FreqS / count,
+           t_ref * FreqS / count);
+
+    if(s_hr.valid < r_hr.valid || s_spo2.valid < r_spo2.valid)
+    {
+        printf("FAIL: stream valid less often than the reference\n");
+        fail = 1;
+    }
+    if(has_truth && (mean(s_hr.err_sum, s_hr.valid) > mean(r_hr.err_sum, r_hr.valid) + HR_MARGIN ||
+                     mean(s_spo2.err_sum, s_spo2.valid) > mean(r_spo2.err_sum, r_spo2.valid) + SPO2_MARGIN))
+    {
+        printf("FAIL: stream less accurate than the reference\n");
+        fail = 1;
+    }
+    return fail;
+}
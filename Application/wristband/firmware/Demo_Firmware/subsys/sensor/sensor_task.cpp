@@ -15,6 +15,32 @@ uint8_t Sensor_TaskID = INVALID_TASK_ID;
 
 static uint32_t last_time = millis();
 
+// Step count and wrist raise/lower after each fusion update
+static void Sensor_MPU9250Report(void)
+{
+    static bool is_light = true;
+
+    static int32_t steps_last = -1;
+    if(IMU.num_steps != steps_last) {
+        OnBoard_SendMsg(show_TaskID, STEP_MSG_EVT, 1, &IMU.num_steps);
+    }
+    steps_last = IMU.num_steps;
+
+    if(IMU.pitch > -45.0 && IMU.pitch < 45.0 && (IMU.roll > 145.0 || IMU.roll < -135.0)) {
+         if(!is_light && (millis() - last_time > 1000) ) {
+             OnBoard_SendMsg(show_TaskID, WRIST_MSG_EVT, 1, NULL);
+             last_time = millis();
+             is_light = true;
+         }
+    } else {
+        if(is_light && (millis() - last_time > 1000)){
+            OnBoard_SendMsg(show_TaskID, WRIST_MSG_EVT, 0, NULL);
+            last_time = millis();
+            is_light = false;
+        }
+    }
+}
+
 static void Sensor_ProcessTMOSMsg( tmos_event_hdr_t *pMsg )
 {
   switch ( pMsg->event )
@@ -93,41 +119,53 @@ uint16_t Sensor_ProcessEvent( uint8 task_id, uint16 events )
     }
 
     if ( events & MPU9250_EVENT ){
-        static bool is_light = true;
-
+#if MPU9250_FIFO_BATCH
+        // The burst runs from the I2C interrupt, MPU9250_FIFO_EVENT fuses it
+        IMU.requestFIFO(Sensor_TaskID, MPU9250_FIFO_EVENT);
+        tmos_start_task(Sensor_TaskID, MPU9250_EVENT, MS1_TO_SYSTEM_TIME(MPU9250_BATCH_MS));
+#else
         readMPU9250();
+        Sensor_MPU9250Report();
+        tmos_start_task(Sensor_TaskID, MPU9250_EVENT, MS1_TO_SYSTEM_TIME(MPU9250_PERIOD_MS));
+#endif
+        return (events ^ MPU9250_EVENT);
+    }
 
-        int32_t steps_last = -1;
-        if(IMU.num_steps != steps_last) {
-            OnBoard_SendMsg(show_TaskID, STEP_MSG_EVT, 1, &IMU.num_steps);
-        }
-        steps_last = IMU.num_steps;
-
-        if(IMU.pitch > -45.0 && IMU.pitch < 45.0 && (IMU.roll > 145.0 || IMU.roll < -135.0)) {
-             if(!is_light && (millis() - last_time > 1000) ) {
-                 OnBoard_SendMsg(show_TaskID, WRIST_MSG_EVT, 1, NULL);
-                 last_time = millis();
-                 is_light = true;
-             }
-        } else {
-            if(is_light && (millis() - last_time > 1000)){
-                OnBoard_SendMsg(show_TaskID, WRIST_MSG_EVT, 0, NULL);
-                last_time = millis();
-                is_light = false;
-            }
-        }
-
-      tmos_start_task(Sensor_TaskID, MPU9250_EVENT, MS1_TO_SYSTEM_TIME(50));
-      return (events ^ MPU9250_EVENT);
+#if MPU9250_FIFO_BATCH
+    if ( events & MPU9250_FIFO_EVENT ){
+        readMPU9250Batch();
+        Sensor_MPU9250Report();
+        return (events ^ MPU9250_FIFO_EVENT);
     }
+#endif
 
     if ( events & MAX30105_EVENT ){
 
-        static float beatsPerMinute;
         static int beatAvg;
-        static float beatsPerMinute_last;
         static bool isNOsend = false;
 
+#if MAX30102_FIFO_BATCH
+        static int spo2;
+        static int beatAvg_last;
+
+        if(read_HeartRateBatch(&beatAvg, &spo2)){
+          if(beatAvg != beatAvg_last) {
+              LOG_INFO("HR %d SpO2 %d", beatAvg, spo2);
+              OnBoard_SendMsg(show_TaskID, HEARTBT_MSG_EVT, 1, &beatAvg);
+              OnBoard_SendMsg(heartRate_TaskID, HEARTBT_MSG_EVT, 1, &beatAvg);
+              isNOsend = false;
+          }
+          beatAvg_last = beatAvg;
+        } else {
+            (!isNOsend)?OnBoard_SendMsg(heartRate_TaskID, HEARTBT_MSG_EVT, 0, NULL):0;
+            isNOsend = true;
+        }
+
+        tmos_start_task(Sensor_TaskID, MAX30105_EVENT, MS1_TO_SYSTEM_TIME(MAX30102_BATCH_MS));
+#else
+        static float beatsPerMinute;
+        static float beatsPerMinute_last;
+
         if(read_HeartRate(&beatsPerMinute, &beatAvg)){
           if(beatsPerMinute != beatsPerMinute_last) {
               OnBoard_SendMsg(show_TaskID, HEARTBT_MSG_EVT, 1, &beatAvg);
@@ -142,6 +180,7 @@ uint16_t Sensor_ProcessEvent( uint8 task_id, uint16 events )
 
 //        read_SPO2();
         tmos_start_task(Sensor_TaskID, MAX30105_EVENT, MS1_TO_SYSTEM_TIME(15));
+#endif
         return (events ^ MAX30105_EVENT);
     }
 
@@ -150,6 +189,20 @@ uint16_t Sensor_ProcessEvent( uint8 task_id, uint16 events )
 
 
 
+// Sensor FIFO full (MPU9250) or almost full (MAX30102), drain it now instead
+// of waiting for the batch timer
+__HIGH_CODE
+void GPIOA_IRQHandler(void) {
+    if (GPIOA_ReadITFlagBit(MPU9250_INT_PIN)) {
+        GPIOA_ClearITFlagBit(MPU9250_INT_PIN);
+        tmos_set_event(Sensor_TaskID, MPU9250_EVENT);
+    }
+    if (GPIOA_ReadITFlagBit(MAX30102_INT_PIN)) {
+        GPIOA_ClearITFlagBit(MAX30102_INT_PIN);
+        tmos_set_event(Sensor_TaskID, MAX30105_EVENT);
+    }
+}
+
 void Sensor_Task_Init(void) {
 
     Sensor_TaskID = TMOS_ProcessEventRegister( Sensor_ProcessEvent );
@@ -5,6 +5,7 @@
 
 #define MPU9250_EVENT            0x0001
 #define MAX30105_EVENT           0x0002
+#define MPU9250_FIFO_EVENT       0x0004
 
 
 void Sensor_Task_Init(void);
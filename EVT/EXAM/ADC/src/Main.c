@@ -3,7 +3,7 @@
  * Author             : WCH
  * Version            : V1.0
  * Date               : 2021/03/09
- * Description        : adcʾ¶ȼ⡢ͨ⡢ͨ⡢TouchKey⡢жϷʽ
+ * Description        : adcʾ¶ȼ⡢ͨ⡢ͨ⡢TouchKey⡢жϷʽDMA˫
  *********************************************************************************
  * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
  * Attention: This software (modified or not) and binary are used for 
@@ -17,6 +17,34 @@ uint16_t adcBuff[40];
 volatile uint8_t adclen;
 volatile uint8_t DMA_end = 0;
 
+__attribute__((aligned(4))) uint16_t adcStreamBuff[2 * 256];
+
+volatile uint8_t  adcStreaming = 0;
+volatile uint16_t adcStreamHalves = 0;
+
+/*********************************************************************
+ * @fn      ADC_StreamDone
+ *
+ * @brief   One half of the stream buffer is ready, already calibrated
+ *
+ * @return  none
+ */
+void ADC_StreamDone(uint16_t *buf, uint16_t len, uint8_t evt)
+{
+    uint32_t sum = 0;
+    uint16_t i;
+
+    for(i = 0; i < len; i++)
+    {
+        sum += buf[i];
+    }
+    PRINT("%c %d%s\n", (evt & ADC_STREAM_EVT_FULL) ? 'B' : 'A', (int)(sum / len),
+          (evt & ADC_STREAM_EVT_OVERRUN) ? " overrun" : "");
+    adcStreamHalves++;
+}
+
+ADC_StreamTypeDef adcStream = {adcStreamBuff, 256, 0, ADC_StreamDone};
+
 /*********************************************************************
  * @fn      DebugInit
  *
@@ -144,6 +172,23 @@ int main()
         PRINT("%d \n", adcBuff[i]);
     }
 
+    /* DMA streaming: PA4, loop DMA over a double buffer, each half is calibrated
+     * and handed to ADC_StreamDone while the DMA fills the other one */
+    PRINT("\n7.Single channel DMA streaming...\n");
+    GPIOA_ModeCfg(GPIO_Pin_4, GPIO_ModeIN_Floating);
+    ADC_ExtSingleChSampInit(SampleFreq_3_2, ADC_PGA_0);
+    adcStream.offset = ADC_DataCalib_Rough();
+    ADC_ChannelCfg(0);
+    adcStreaming = 1;
+    ADC_StreamStart(&adcStream, 192); // (256-192)*16 system clocks per sample, 4.4ms per half
+    while(adcStreamHalves < 16)
+    {
+        ADC_StreamPoll();
+    }
+    ADC_StreamStop();
+    adcStreaming = 0;
+    PRINT("overruns %d\n", (int)adcStream.overruns);
+
     while(1);
 }
 
@@ -158,7 +203,11 @@ __INTERRUPT
 __HIGH_CODE
 void ADC_IRQHandler(void) //adcжϷ
 {
-    if(ADC_GetDMAStatus())
+    if(adcStreaming)
+    {
+        ADC_StreamIRQHandler();
+    }
+    else if(ADC_GetDMAStatus())
     {
         ADC_StopDMA();
         R16_ADC_DMA_BEG = ((uint32_t)adcBuff) & 0xffff;
@@ -1,23 +1,32 @@
 /********************************** (C) COPYRIGHT *******************************
  * File Name          : app_drv_fifo.c
  * Author             : WCH
- * Version            : V1.1
- * Date               : 2022/01/19
+ * Version            : V1.2
+ * Date               : 2022/06/10
  * Description        :
  *********************************************************************************
  * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
- * Attention: This software (modified or not) and binary are used for 
+ * Attention: This software (modified or not) and binary are used for
  * microcontroller manufactured by Nanjing Qinheng Microelectronics.
  *******************************************************************************/
 
+#include <string.h>
 #include "app_drv_fifo.h"
 
+// Keep the data accesses on the right side of an index update
+#define FIFO_BARRIER()    __asm__ volatile("" ::: "memory")
+
 static __inline uint16_t fifo_length(app_drv_fifo_t *fifo)
 {
     uint16_t tmp = fifo->begin;
     return fifo->end - tmp;
 }
 
+static __inline uint16_t fifo_free(app_drv_fifo_t *fifo)
+{
+    return fifo->size - fifo_length(fifo);
+}
+
 uint16_t app_drv_fifo_length(app_drv_fifo_t *fifo)
 {
     return fifo_length(fifo);
@@ -71,6 +80,60 @@ bool app_drv_fifo_is_full(app_drv_fifo_t *fifo)
     return (fifo_length(fifo) == fifo->size);
 }
 
+uint16_t
+app_drv_fifo_read_peek_contiguous(app_drv_fifo_t *fifo, uint8_t **pp_data)
+{
+    const uint16_t byte_count = fifo_length(fifo);
+    const uint16_t offset = fifo->begin & fifo->size_mask;
+    const uint16_t contiguous = fifo->size - offset;
+
+    (*pp_data) = &fifo->data[offset];
+    return MIN(byte_count, contiguous);
+}
+
+app_drv_fifo_result_t
+app_drv_fifo_read_commit(app_drv_fifo_t *fifo, uint16_t length)
+{
+    if(fifo == NULL)
+    {
+        return APP_DRV_FIFO_RESULT_NULL;
+    }
+    if(length > fifo_length(fifo))
+    {
+        return APP_DRV_FIFO_RESULT_LENGTH_ERROR;
+    }
+    FIFO_BARRIER();
+    fifo->begin += length;
+    return APP_DRV_FIFO_RESULT_SUCCESS;
+}
+
+uint16_t
+app_drv_fifo_write_peek_contiguous(app_drv_fifo_t *fifo, uint8_t **pp_data)
+{
+    const uint16_t available_count = fifo_free(fifo);
+    const uint16_t offset = fifo->end & fifo->size_mask;
+    const uint16_t contiguous = fifo->size - offset;
+
+    (*pp_data) = &fifo->data[offset];
+    return MIN(available_count, contiguous);
+}
+
+app_drv_fifo_result_t
+app_drv_fifo_write_commit(app_drv_fifo_t *fifo, uint16_t length)
+{
+    if(fifo == NULL)
+    {
+        return APP_DRV_FIFO_RESULT_NULL;
+    }
+    if(length > fifo_free(fifo))
+    {
+        return APP_DRV_FIFO_RESULT_LENGTH_ERROR;
+    }
+    FIFO_BARRIER();
+    fifo->end += length;
+    return APP_DRV_FIFO_RESULT_SUCCESS;
+}
+
 app_drv_fifo_result_t
 app_drv_fifo_write(app_drv_fifo_t *fifo, uint8_t *data, uint16_t *p_write_length)
 {
@@ -82,12 +145,11 @@ app_drv_fifo_write(app_drv_fifo_t *fifo, uint8_t *data, uint16_t *p_write_length
     {
         return APP_DRV_FIFO_RESULT_NULL;
     }
-    //PRINT("fifo_length = %d\r\n",fifo_length(fifo));
-    const uint16_t available_count = fifo->size - fifo_length(fifo);
-    const uint16_t requested_len = (*p_write_length);
-    uint16_t       index = 0;
-    uint16_t       write_size = MIN(requested_len, available_count);
-    //PRINT("available_count %d\r\n",available_count);
+    const uint16_t available_count = fifo_free(fifo);
+    const uint16_t offset = fifo->end & fifo->size_mask;
+    uint16_t       write_size = MIN(*p_write_length, available_count);
+    uint16_t       first = MIN(write_size, fifo->size - offset);
+
     // Check if the FIFO is FULL.
     if(available_count == 0)
     {
@@ -97,15 +159,16 @@ app_drv_fifo_write(app_drv_fifo_t *fifo, uint8_t *data, uint16_t *p_write_length
     // Check if application has requested only the size.
     if(data == NULL)
     {
+        (*p_write_length) = write_size;
         return APP_DRV_FIFO_RESULT_SUCCESS;
     }
 
-    for(index = 0; index < write_size; index++)
-    {
-        //push
-        fifo->data[fifo->end & fifo->size_mask] = data[index];
-        fifo->end++;
-    }
+    //copy in at most two chunks, the free space may wrap to the buffer start
+    memcpy(&fifo->data[offset], data, first);
+    memcpy(fifo->data, data + first, write_size - first);
+    FIFO_BARRIER();
+    fifo->end += write_size;
+
     (*p_write_length) = write_size;
     return APP_DRV_FIFO_RESULT_SUCCESS;
 }
@@ -117,22 +180,26 @@ app_drv_fifo_write_from_same_addr(app_drv_fifo_t *fifo, uint8_t *data, uint16_t
     {
         return APP_DRV_FIFO_RESULT_NULL;
     }
-    const uint16_t available_count = fifo->size_mask - fifo_length(fifo) + 1;
-    const uint16_t requested_len = (write_length);
-    uint16_t       index = 0;
-    uint16_t       write_size = MIN(requested_len, available_count);
+    volatile uint8_t *src = (volatile uint8_t *)data;
+    uint8_t          *p;
+    uint16_t          n, index;
 
     // Check if the FIFO is FULL.
-    if(available_count == 0)
+    if(fifo_free(fifo) == 0)
     {
         return APP_DRV_FIFO_RESULT_NOT_MEM;
     }
 
-    for(index = 0; index < write_size; index++)
+    while(write_length && (n = app_drv_fifo_write_peek_contiguous(fifo, &p)) != 0)
     {
-        //push
-        fifo->data[fifo->end & fifo->size_mask] = data[0];
-        fifo->end++;
+        n = MIN(n, write_length);
+        for(index = 0; index < n; index++)
+        {
+            p[index] = *src;
+        }
+        FIFO_BARRIER();
+        fifo->end += n;
+        write_length -= n;
     }
     return APP_DRV_FIFO_RESULT_SUCCESS;
 }
@@ -140,52 +207,65 @@ app_drv_fifo_write_from_same_addr(app_drv_fifo_t *fifo, uint8_t *data, uint16_t
 app_drv_fifo_result_t
 app_drv_fifo_read(app_drv_fifo_t *fifo, uint8_t *data, uint16_t *p_read_length)
 {
-    if(fifo == NULL)
+    app_drv_fifo_result_t result = app_drv_fifo_peek(fifo, data, p_read_length);
+
+    if(result == APP_DRV_FIFO_RESULT_SUCCESS)
     {
-        return APP_DRV_FIFO_RESULT_NULL;
+        FIFO_BARRIER();
+        fifo->begin += (*p_read_length);
     }
-    if(p_read_length == NULL)
+    return result;
+}
+
+app_drv_fifo_result_t
+app_drv_fifo_read_to_same_addr(app_drv_fifo_t *fifo, uint8_t *data, uint16_t read_length)
+{
+    if(fifo == NULL)
     {
         return APP_DRV_FIFO_RESULT_NULL;
     }
-    const uint16_t byte_count = fifo_length(fifo);
-    const uint16_t requested_len = (*p_read_length);
-    uint32_t       index = 0;
-    uint32_t       read_size = MIN(requested_len, byte_count);
+    volatile uint8_t *dst = (volatile uint8_t *)data;
+    uint8_t          *p;
+    uint16_t          n, index;
 
-    if(byte_count == 0)
+    while(read_length && (n = app_drv_fifo_read_peek_contiguous(fifo, &p)) != 0)
     {
-        return APP_DRV_FIFO_RESULT_NOT_FOUND;
+        n = MIN(n, read_length);
+        for(index = 0; index < n; index++)
+        {
+            *dst = p[index];
+        }
+        FIFO_BARRIER();
+        fifo->begin += n;
+        read_length -= n;
     }
-    //PRINT("read size = %d,byte_count = %d\r\n",read_size,byte_count);
-    for(index = 0; index < read_size; index++)
-    {
-        //pop
-        data[index] = fifo->data[fifo->begin & fifo->size_mask];
-        fifo->begin++;
-    }
-
-    (*p_read_length) = read_size;
     return APP_DRV_FIFO_RESULT_SUCCESS;
 }
 
 app_drv_fifo_result_t
-app_drv_fifo_read_to_same_addr(app_drv_fifo_t *fifo, uint8_t *data, uint16_t read_length)
+app_drv_fifo_peek(app_drv_fifo_t *fifo, uint8_t *data, uint16_t *p_read_length)
 {
     if(fifo == NULL)
     {
         return APP_DRV_FIFO_RESULT_NULL;
     }
+    if(p_read_length == NULL)
+    {
+        return APP_DRV_FIFO_RESULT_NULL;
+    }
     const uint16_t byte_count = fifo_length(fifo);
-    const uint16_t requested_len = (read_length);
-    uint32_t       index = 0;
-    uint32_t       read_size = MIN(requested_len, byte_count);
+    const uint16_t offset = fifo->begin & fifo->size_mask;
+    uint16_t       read_size = MIN(*p_read_length, byte_count);
+    uint16_t       first = MIN(read_size, fifo->size - offset);
 
-    for(index = 0; index < read_size; index++)
+    if(byte_count == 0)
     {
-        //pop
-        data[0] = fifo->data[fifo->begin & fifo->size_mask];
-        fifo->begin++;
+        return APP_DRV_FIFO_RESULT_NOT_FOUND;
     }
+    //copy in at most two chunks, the tail may wrap to the buffer start
+    memcpy(data, &fifo->data[offset], first);
+    memcpy(data + first, fifo->data, read_size - first);
+
+    (*p_read_length) = read_size;
     return APP_DRV_FIFO_RESULT_SUCCESS;
 }
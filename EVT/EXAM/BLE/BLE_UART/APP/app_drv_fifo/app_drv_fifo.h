@@ -52,11 +52,17 @@ typedef enum
 
 /*!
  * FIFO structure
+ *
+ * Single producer / single consumer use, e.g. an interrupt writing and the
+ * main loop reading, needs no locking: the producer only moves 'end', the
+ * consumer only moves 'begin', and both indexes are updated after the data
+ * is copied. app_drv_fifo_flush, push and pop are not part of that contract,
+ * call them with the other side quiet.
  */
 typedef struct Fifo_s
 {
-    uint16_t begin;
-    uint16_t end;
+    volatile uint16_t begin;
+    volatile uint16_t end;
     uint8_t *data;
     uint16_t size;
     uint16_t size_mask;
@@ -130,4 +136,52 @@ app_drv_fifo_result_t
 app_drv_fifo_read_to_same_addr(app_drv_fifo_t *fifo, uint8_t *data,
                                uint16_t read_length);
 
+/*!
+ * Copies data out of the FIFO without removing it
+ *
+ * \param [IN] fifo              Pointer to the FIFO object
+ * \param [IN] data              Destination buffer
+ * \param [IN/OUT] p_read_length Requested length, returns the copied length
+ */
+app_drv_fifo_result_t
+app_drv_fifo_peek(app_drv_fifo_t *fifo, uint8_t *data, uint16_t *p_read_length);
+
+/*!
+ * Returns the readable span at the FIFO tail without copying
+ *
+ * \param [IN] fifo     Pointer to the FIFO object
+ * \param [OUT] pp_data Start of the span
+ * \retval length       Bytes readable in place, 0 when the FIFO is empty
+ */
+uint16_t
+app_drv_fifo_read_peek_contiguous(app_drv_fifo_t *fifo, uint8_t **pp_data);
+
+/*!
+ * Removes data consumed in place or copied out with app_drv_fifo_peek
+ *
+ * \param [IN] fifo   Pointer to the FIFO object
+ * \param [IN] length Number of bytes to drop
+ */
+app_drv_fifo_result_t
+app_drv_fifo_read_commit(app_drv_fifo_t *fifo, uint16_t length);
+
+/*!
+ * Returns the writable span at the FIFO head without copying
+ *
+ * \param [IN] fifo     Pointer to the FIFO object
+ * \param [OUT] pp_data Start of the span
+ * \retval length       Bytes writable in place, 0 when the FIFO is full
+ */
+uint16_t
+app_drv_fifo_write_peek_contiguous(app_drv_fifo_t *fifo, uint8_t **pp_data);
+
+/*!
+ * Publishes data filled in place after app_drv_fifo_write_peek_contiguous
+ *
+ * \param [IN] fifo   Pointer to the FIFO object
+ * \param [IN] length Number of bytes filled in
+ */
+app_drv_fifo_result_t
+app_drv_fifo_write_commit(app_drv_fifo_t *fifo, uint16_t length);
+
 #endif // __APP_DRV_FIFO_H__
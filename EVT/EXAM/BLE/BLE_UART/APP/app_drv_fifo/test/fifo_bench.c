@@ -0,0 +1,129 @@
+/* Host benchmark for app_drv_fifo.c
+ *
+ * Moves BLE sized packets (244 bytes, the largest notification payload)
+ * through FIFOs of the sizes app_uart.c uses, with app_drv_fifo_write() and
+ * app_drv_fifo_read() against the byte per iteration loops they replaced,
+ * kept below as old_write() and old_read(). Both sides check the data they
+ * read back. Fails if the chunked copy is not faster.
+ *
+ *   make -C EVT/EXAM/BLE/BLE_UART/APP/app_drv_fifo/test bench
+ *
+ * Host numbers only rank the two loops on this machine; on the CH583 the
+ * byte loop also pays for the volatile index reloads on every byte.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "app_drv_fifo.h"
+
+#define PACKET      244
+#define BYTES       (64UL << 20)
+
+static uint8_t buf[1024], in[PACKET], out[PACKET];
+
+/* app_drv_fifo_write() and app_drv_fifo_read() before the chunked copy */
+static app_drv_fifo_result_t old_write(app_drv_fifo_t *fifo, uint8_t *data, uint16_t *p_write_length)
+{
+    const uint16_t available_count = fifo->size - (uint16_t)(fifo->end - fifo->begin);
+    uint16_t       index = 0;
+    uint16_t       write_size = MIN(*p_write_length, available_count);
+
+    if(available_count == 0)
+    {
+        return APP_DRV_FIFO_RESULT_NOT_MEM;
+    }
+    for(index = 0; index < write_size; index++)
+    {
+        fifo->data[fifo->end & fifo->size_mask] = data[index];
+        fifo->end++;
+    }
+    (*p_write_length) = write_size;
+    return APP_DRV_FIFO_RESULT_SUCCESS;
+}
+
+static app_drv_fifo_result_t old_read(app_drv_fifo_t *fifo, uint8_t *data, uint16_t *p_read_length)
+{
+    const uint16_t byte_count = fifo->end - fifo->begin;
+    uint32_t       index = 0;
+    uint32_t       read_size = MIN(*p_read_length, byte_count);
+
+    if(byte_count == 0)
+    {
+        return APP_DRV_FIFO_RESULT_NOT_FOUND;
+    }
+    for(index = 0; index < read_size; index++)
+    {
+        data[index] = fifo->data[fifo->begin & fifo->size_mask];
+        fifo->begin++;
+    }
+    (*p_read_length) = read_size;
+    return APP_DRV_FIFO_RESULT_SUCCESS;
+}
+
+typedef app_drv_fifo_result_t (*fifo_op_t)(app_drv_fifo_t *, uint8_t *, uint16_t *);
+
+/* write a packet, read it back, until BYTES have passed; MB/s */
+static double run(uint16_t size, fifo_op_t wr, fifo_op_t rd)
+{
+    app_drv_fifo_t  fifo;
+    struct timespec t0, t1;
+    unsigned long   done;
+    uint16_t        len, i;
+    double          s;
+
+    app_drv_fifo_init(&fifo, buf, size);
+    /* half a packet ahead, every read is the packet rotated by that */
+    len = PACKET / 2;
+    wr(&fifo, in, &len);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(done = 0; done < BYTES; done += PACKET)
+    {
+        len = PACKET;
+        wr(&fifo, in, &len);
+        len = PACKET;
+        rd(&fifo, out, &len);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    for(i = 0; i < PACKET; i++)
+    {
+        if(out[i] != in[(i + PACKET / 2) % PACKET])
+        {
+            printf("FAIL: data differs at byte %u\n", i);
+            exit(1);
+        }
+    }
+    s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    return done / s / 1e6;
+}
+
+int main(void)
+{
+    static const uint16_t sizes[] = {512, 1024};
+    unsigned              k, i;
+    double                old_mbs, new_mbs;
+    int                   fail = 0;
+
+    for(i = 0; i < PACKET; i++)
+    {
+        in[i] = (uint8_t)(i * 7 + 1);
+    }
+    for(k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++)
+    {
+        old_mbs = run(sizes[k], old_write, old_read);
+        new_mbs = run(sizes[k], app_drv_fifo_write, app_drv_fifo_read);
+        printf("fifo %4u, %u byte packets: byte loop %.0f MB/s, chunked %.0f MB/s\n", sizes[k], PACKET, old_mbs,
+               new_mbs);
+        if(new_mbs < old_mbs)
+        {
+            fail = 1;
+        }
+    }
+    if(fail)
+    {
+        printf("FAIL: the chunked copy is slower\n");
+    }
+    return fail;
+}
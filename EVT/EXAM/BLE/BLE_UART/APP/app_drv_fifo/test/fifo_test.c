@@ -0,0 +1,326 @@
+/* Host fuzz test for app_drv_fifo.c
+ *
+ * Every power-of-two size from 1 to 32768 gets a random mix of all the
+ * calls, checked after each one against a plain reference queue: returned
+ * lengths and results, the bytes read, and the FIFO contents. The buffer is
+ * allocated at its exact size so the address sanitizer sees any access past
+ * it, and enough data passes through each FIFO for the 16 bit indexes to
+ * wrap several times.
+ *
+ *   make -C EVT/EXAM/BLE/BLE_UART/APP/app_drv_fifo/test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "app_drv_fifo.h"
+
+#define MAX_SIZE    32768
+#define WRAPS       3       /* times the indexes pass 65535 per size */
+
+#define CHECK(c, ...)                                    \
+    do {                                                 \
+        if(!(c)) {                                       \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);  \
+            printf(__VA_ARGS__);                         \
+            printf("\n");                                \
+            exit(1);                                     \
+        }                                                \
+    } while(0)
+
+/* reference queue */
+static uint8_t  model[MAX_SIZE];
+static unsigned model_head, model_count, model_size;
+
+static uint8_t  src[2 * MAX_SIZE], dst[2 * MAX_SIZE];
+static uint8_t  next_byte;
+static unsigned long moved;
+
+static unsigned rnd(unsigned n)
+{
+    return (unsigned)(((unsigned long)rand() << 16 ^ rand()) % n);
+}
+
+static void model_put(uint8_t b)
+{
+    model[(model_head + model_count++) % model_size] = b;
+}
+
+static uint8_t model_get(void)
+{
+    uint8_t b = model[model_head];
+
+    model_head = (model_head + 1) % model_size;
+    model_count--;
+    moved++;
+    return b;
+}
+
+static unsigned model_free(void)
+{
+    return model_size - model_count;
+}
+
+/* length of a request: empty, a few bytes, or up to twice the FIFO */
+static uint16_t rnd_len(void)
+{
+    switch(rnd(4))
+    {
+        case 0:
+            return 0;
+        case 1:
+            return rnd(4);
+        default:
+            return rnd(MIN(2 * model_size, 65535) + 1);
+    }
+}
+
+static void fill_src(uint16_t n)
+{
+    uint16_t i;
+
+    for(i = 0; i < n; i++)
+    {
+        src[i] = next_byte++;
+    }
+}
+
+static void check_state(app_drv_fifo_t *fifo)
+{
+    uint16_t len = MAX_SIZE;
+    unsigned i;
+
+    CHECK(app_drv_fifo_length(fifo) == model_count, "length %u, expected %u", app_drv_fifo_length(fifo),
+          model_count);
+    CHECK(app_drv_fifo_is_empty(fifo) == (model_count == 0), "is_empty");
+    CHECK(app_drv_fifo_is_full(fifo) == (model_count == model_size), "is_full");
+    if(model_count == 0)
+    {
+        CHECK(app_drv_fifo_peek(fifo, dst, &len) == APP_DRV_FIFO_RESULT_NOT_FOUND, "peek on empty");
+        return;
+    }
+    CHECK(app_drv_fifo_peek(fifo, dst, &len) == APP_DRV_FIFO_RESULT_SUCCESS && len == model_count,
+          "peek all gave %u of %u", len, model_count);
+    for(i = 0; i < model_count; i++)
+    {
+        CHECK(dst[i] == model[(model_head + i) % model_size], "byte %u of %u differs", i, model_count);
+    }
+}
+
+static void op_write(app_drv_fifo_t *fifo)
+{
+    uint16_t len = rnd_len(), req = len, n = MIN(len, model_free()), i;
+    int      size_only = rnd(8) == 0;
+
+    fill_src(len);
+    app_drv_fifo_result_t res = app_drv_fifo_write(fifo, size_only ? NULL : src, &len);
+    if(model_free() == 0)
+    {
+        CHECK(res == APP_DRV_FIFO_RESULT_NOT_MEM, "write %u to a full FIFO gave %d", req, res);
+        return;
+    }
+    CHECK(res == APP_DRV_FIFO_RESULT_SUCCESS && len == n, "write %u gave %d, %u of %u", req, res, len, n);
+    if(!size_only)
+    {
+        for(i = 0; i < n; i++)
+        {
+            model_put(src[i]);
+        }
+    }
+}
+
+static void op_write_same_addr(app_drv_fifo_t *fifo)
+{
+    uint16_t len = rnd_len(), n = MIN(len, model_free()), i;
+    uint8_t  reg = next_byte++;
+
+    app_drv_fifo_result_t res = app_drv_fifo_write_from_same_addr(fifo, &reg, len);
+    if(model_free() == 0)
+    {
+        CHECK(res == APP_DRV_FIFO_RESULT_NOT_MEM, "same address write to a full FIFO gave %d", res);
+        return;
+    }
+    CHECK(res == APP_DRV_FIFO_RESULT_SUCCESS, "same address write gave %d", res);
+    for(i = 0; i < n; i++)
+    {
+        model_put(reg);
+    }
+}
+
+static void op_read(app_drv_fifo_t *fifo, int peek)
+{
+    uint16_t len = rnd_len(), req = len, n = MIN(len, model_count), i;
+
+    app_drv_fifo_result_t res =
+        peek ? app_drv_fifo_peek(fifo, dst, &len) : app_drv_fifo_read(fifo, dst, &len);
+    if(model_count == 0)
+    {
+        CHECK(res == APP_DRV_FIFO_RESULT_NOT_FOUND, "read from an empty FIFO gave %d", res);
+        return;
+    }
+    CHECK(res == APP_DRV_FIFO_RESULT_SUCCESS && len == n, "read %u gave %d, %u of %u", req, res, len, n);
+    for(i = 0; i < n; i++)
+    {
+        uint8_t b = peek ? model[(model_head + i) % model_size] : model_get();
+
+        CHECK(dst[i] == b, "read byte %u is %02x, expected %02x", i, dst[i], b);
+    }
+}
+
+static void op_read_same_addr(app_drv_fifo_t *fifo)
+{
+    uint16_t len = rnd_len(), n = MIN(len, model_count), i;
+    uint8_t  reg = 0, last = 0;
+
+    CHECK(app_drv_fifo_read_to_same_addr(fifo, &reg, len) == APP_DRV_FIFO_RESULT_SUCCESS, "same address read");
+    for(i = 0; i < n; i++)
+    {
+        last = model_get();
+    }
+    if(n)
+    {
+        CHECK(reg == last, "same address read left %02x, expected %02x", reg, last);
+    }
+}
+
+/* zero-copy consumer: take part of the contiguous span, maybe twice */
+static void op_read_span(app_drv_fifo_t *fifo)
+{
+    uint8_t *p;
+    uint16_t n, take, i;
+    int      k;
+
+    for(k = 0; k < 2; k++)
+    {
+        n = app_drv_fifo_read_peek_contiguous(fifo, &p);
+        CHECK(n <= model_count && (model_count == 0 || n > 0), "read span %u with %u queued", n, model_count);
+        CHECK(n == MIN(model_count, model_size - model_head), "read span %u, expected %u", n,
+              MIN(model_count, model_size - model_head));
+        take = rnd(n + 1);
+        for(i = 0; i < take; i++)
+        {
+            CHECK(p[i] == model_get(), "span byte %u differs", i);
+        }
+        CHECK(app_drv_fifo_read_commit(fifo, take) == APP_DRV_FIFO_RESULT_SUCCESS, "read commit %u", take);
+    }
+    CHECK(app_drv_fifo_read_commit(fifo, model_count + 1) == APP_DRV_FIFO_RESULT_LENGTH_ERROR,
+          "read commit past the data");
+}
+
+/* zero-copy producer: fill part of the contiguous span, maybe twice */
+static void op_write_span(app_drv_fifo_t *fifo)
+{
+    uint8_t *p;
+    uint16_t n, put, i;
+    unsigned tail;
+    int      k;
+
+    for(k = 0; k < 2; k++)
+    {
+        tail = (model_head + model_count) % model_size;
+        n = app_drv_fifo_write_peek_contiguous(fifo, &p);
+        CHECK(n == MIN(model_free(), model_size - tail), "write span %u, expected %u", n,
+              MIN(model_free(), model_size - tail));
+        put = rnd(n + 1);
+        for(i = 0; i < put; i++)
+        {
+            p[i] = next_byte;
+            model_put(next_byte++);
+        }
+        CHECK(app_drv_fifo_write_commit(fifo, put) == APP_DRV_FIFO_RESULT_SUCCESS, "write commit %u", put);
+    }
+    CHECK(app_drv_fifo_write_commit(fifo, model_free() + 1) == APP_DRV_FIFO_RESULT_LENGTH_ERROR,
+          "write commit past the free space");
+}
+
+static void op_push_pop(app_drv_fifo_t *fifo)
+{
+    uint8_t b;
+
+    if(model_count < model_size && rnd(2))
+    {
+        app_drv_fifo_push(fifo, next_byte);
+        model_put(next_byte++);
+    }
+    else if(model_count)
+    {
+        b = app_drv_fifo_pop(fifo);
+        CHECK(b == model_get(), "pop");
+    }
+}
+
+static void fuzz(uint16_t size)
+{
+    app_drv_fifo_t fifo;
+    uint8_t       *buf = malloc(size);
+    unsigned long  ops = 0;
+
+    CHECK(buf, "out of memory");
+    CHECK(app_drv_fifo_init(&fifo, buf, size) == APP_DRV_FIFO_RESULT_SUCCESS, "init %u", size);
+    model_head = 0;
+    model_count = 0;
+    model_size = size;
+    moved = 0;
+
+    while(moved < WRAPS * 65536UL)
+    {
+        switch(rnd(8))
+        {
+            case 0:
+            case 1:
+                op_write(&fifo);
+                break;
+            case 2:
+                op_write_same_addr(&fifo);
+                break;
+            case 3:
+                op_read(&fifo, 0);
+                break;
+            case 4:
+                op_read(&fifo, rnd(2));
+                op_read_same_addr(&fifo);
+                break;
+            case 5:
+                op_read_span(&fifo);
+                break;
+            case 6:
+                op_write_span(&fifo);
+                break;
+            default:
+                op_push_pop(&fifo);
+                break;
+        }
+        /* the full comparison costs a pass over the FIFO, thin it out for
+         * the large sizes */
+        if(size <= 64 || rnd(size / 64) == 0)
+        {
+            check_state(&fifo);
+        }
+        ops++;
+    }
+    check_state(&fifo);
+
+    app_drv_fifo_flush(&fifo);
+    model_count = 0;
+    model_head = 0;
+    check_state(&fifo);
+    free(buf);
+    printf("size %5u: %lu calls, %lu bytes through\n", size, ops, moved);
+}
+
+int main(void)
+{
+    app_drv_fifo_t fifo;
+    uint8_t        buf[4];
+    uint32_t       size;
+
+    CHECK(app_drv_fifo_init(&fifo, buf, 0) == APP_DRV_FIFO_RESULT_LENGTH_ERROR, "size 0 accepted");
+    CHECK(app_drv_fifo_init(&fifo, buf, 3) == APP_DRV_FIFO_RESULT_LENGTH_ERROR, "size 3 accepted");
+
+    srand(1);
+    for(size = 1; size <= MAX_SIZE; size <<= 1)
+    {
+        fuzz((uint16_t)size);
+    }
+    printf("app_drv_fifo fuzz ok\n");
+    return 0;
+}
@@ -37,8 +37,6 @@
 /*********************************************************************
  * GLOBAL VARIABLES
  */
-uint8_t to_test_buffer[BLE_BUFF_MAX_LEN - 4 - 3];
-
 app_drv_fifo_t app_uart_tx_fifo;
 app_drv_fifo_t app_uart_rx_fifo;
 
@@ -95,7 +93,11 @@ void app_uart_process(void)
     SYS_DisableAllIrq(&irq_status);
     if(uart_rx_flag)
     {
-        tmos_start_task(Peripheral_TaskID, UART_TO_BLE_SEND_EVT, 2);
+        //keep a pending back off, restarting it would starve the sender
+        if(tmos_get_task_timer(Peripheral_TaskID, UART_TO_BLE_SEND_EVT) == 0)
+        {
+            tmos_set_event(Peripheral_TaskID, UART_TO_BLE_SEND_EVT);
+        }
         uart_rx_flag = false;
     }
     SYS_RecoverIrq(irq_status);
@@ -217,7 +219,7 @@ void on_bleuartServiceEvt(uint16_t connection_handle, ble_uart_evt_t *p_evt)
             //to ble
             uint16_t to_write_length = p_evt->data.length;
             app_drv_fifo_write(&app_uart_rx_fifo, (uint8_t *)p_evt->data.p_data, &to_write_length);
-            tmos_start_task(Peripheral_TaskID, UART_TO_BLE_SEND_EVT, 2);
+            uart_rx_flag = true;
             //end of nofify back test
 
             //ble to uart
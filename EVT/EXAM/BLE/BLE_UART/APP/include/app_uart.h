@@ -28,8 +28,6 @@ extern "C" {
  * CONSTANTS
  */
 
-extern uint8_t to_test_buffer[BLE_BUFF_MAX_LEN - 4 - 3];
-
 extern app_drv_fifo_t app_uart_tx_fifo;
 extern app_drv_fifo_t app_uart_rx_fifo;
 
@@ -60,6 +60,12 @@
 // Company Identifier: WCH
 #define WCH_COMPANY_ID                       0x07D7
 
+// Wait for more uart data before sending a short notification (units of 625us)
+#define UART_TO_BLE_WAIT_DELAY               4
+
+// Waits before a short notification is sent anyway
+#define UART_TO_BLE_WAIT_CNT                 10
+
 /*********************************************************************
  * TYPEDEFS
  */
@@ -82,15 +88,6 @@ uint8_t Peripheral_TaskID = INVALID_TASK_ID; // Task ID for internal task/event
  * LOCAL VARIABLES
  */
 
-//for send to ble
-typedef enum
-{
-    SEND_TO_BLE_TO_SEND = 1,
-    SEND_TO_BLE_ALLOC_FAILED,
-    SEND_TO_BLE_SEND_FAILED,
-} send_to_ble_state_t;
-send_to_ble_state_t send_to_ble_state = SEND_TO_BLE_TO_SEND;
-
 blePaControlConfig_t pa_lna_ctl;
 
 //static uint8 Peripheral_TaskID = INVALID_TASK_ID;   // Task ID for internal task/event processing
@@ -148,6 +145,7 @@ static void peripheralParamUpdateCB(uint16 connHandle, uint16 connInterval,
                                     uint16 connSlaveLatency, uint16 connTimeout);
 static void peripheralInitConnItem(peripheralConnItem_t *peripheralConnList);
 static void peripheralRssiCB(uint16 connHandle, int8 rssi);
+static tmosTimer peripheralUartToBle(void);
 
 /*********************************************************************
  * PROFILE CALLBACKS
@@ -285,7 +283,6 @@ uint32_t get_fattime(void)
  */
 uint16 Peripheral_ProcessEvent(uint8 task_id, uint16 events)
 {
-    static attHandleValueNoti_t noti;
     //  VOID task_id; // TMOS required parameter that isn't used in this function
 
     if(events & SYS_EVENT_MSG)
@@ -330,117 +327,109 @@ uint16 Peripheral_ProcessEvent(uint8 task_id, uint16 events)
 
     if(events & UART_TO_BLE_SEND_EVT)
     {
-        static uint16_t read_length = 0;
-        ;
-        uint8_t result = 0xff;
-        switch(send_to_ble_state)
+        tmosTimer delay = peripheralUartToBle();
+
+        if(delay)
         {
-            case SEND_TO_BLE_TO_SEND:
+            tmos_start_task(Peripheral_TaskID, UART_TO_BLE_SEND_EVT, delay);
+        }
+        return (events ^ UART_TO_BLE_SEND_EVT);
+    }
+    // Discard unknown events
+    return 0;
+}
 
-                //notify is not enabled
-                if(!ble_uart_notify_is_ready(peripheralConnList.connHandle))
-                {
-                    if(peripheralConnList.connHandle == GAP_CONNHANDLE_INIT)
-                    {
-                        //connection lost, flush rx fifo here
-                        app_drv_fifo_flush(&app_uart_rx_fifo);
-                    }
-                    break;
-                }
-                read_length = ATT_GetMTU(peripheralConnList.connHandle) - 3;
+/*********************************************************************
+ * @fn      peripheralUartToBleBackoff
+ *
+ * @brief   Time until the link layer has room again. The queue drains
+ *          BLE_TX_NUM_EVENT packets per connection event, so wait for
+ *          about half of the unacknowledged packets to go out.
+ *
+ * @param   unack - unacknowledged packets in the link layer
+ *
+ * @return  delay in units of 625us
+ */
+static tmosTimer peripheralUartToBleBackoff(uint32_t unack)
+{
+    uint32_t events = (unack + 2 * BLE_TX_NUM_EVENT - 1) / (2 * BLE_TX_NUM_EVENT);
+    uint32_t delay;
 
-                if(app_drv_fifo_length(&app_uart_rx_fifo) >= read_length)
-                {
-                    PRINT("FIFO_LEN:%d\r\n", app_drv_fifo_length(&app_uart_rx_fifo));
-                    result = app_drv_fifo_read(&app_uart_rx_fifo, to_test_buffer, &read_length);
-                    uart_to_ble_send_evt_cnt = 0;
-                }
-                else
-                {
-                    if(uart_to_ble_send_evt_cnt > 10)
-                    {
-                        result = app_drv_fifo_read(&app_uart_rx_fifo, to_test_buffer, &read_length);
-                        uart_to_ble_send_evt_cnt = 0;
-                    }
-                    else
-                    {
-                        tmos_start_task(Peripheral_TaskID, UART_TO_BLE_SEND_EVT, 4);
-                        uart_to_ble_send_evt_cnt++;
-                        PRINT("NO TIME OUT\r\n");
-                    }
-                }
+    if(events == 0)
+    {
+        events = 1;
+    }
+    // connInterval is in units of 1.25ms
+    delay = events * peripheralConnList.connInterval * 2;
 
-                if(APP_DRV_FIFO_RESULT_SUCCESS == result)
-                {
-                    noti.len = read_length;
-                    noti.pValue = GATT_bm_alloc(peripheralConnList.connHandle, ATT_HANDLE_VALUE_NOTI, noti.len, NULL, 0);
-                    if(noti.pValue != NULL)
-                    {
-                        tmos_memcpy(noti.pValue, to_test_buffer, noti.len);
-                        result = ble_uart_notify(peripheralConnList.connHandle, &noti, 0);
-                        if(result != SUCCESS)
-                        {
-                            PRINT("R1:%02x\r\n", result);
-                            send_to_ble_state = SEND_TO_BLE_SEND_FAILED;
-                            GATT_bm_free((gattMsg_t *)&noti, ATT_HANDLE_VALUE_NOTI);
-                            tmos_start_task(Peripheral_TaskID, UART_TO_BLE_SEND_EVT, 2);
-                        }
-                        else
-                        {
-                            send_to_ble_state = SEND_TO_BLE_TO_SEND;
-                            //app_fifo_write(&app_uart_tx_fifo,to_test_buffer,&read_length);
-                            //app_drv_fifo_write(&app_uart_tx_fifo,to_test_buffer,&read_length);
-                            read_length = 0;
-                            tmos_start_task(Peripheral_TaskID, UART_TO_BLE_SEND_EVT, 2);
-                        }
-                    }
-                    else
-                    {
-                        send_to_ble_state = SEND_TO_BLE_ALLOC_FAILED;
-                        tmos_start_task(Peripheral_TaskID, UART_TO_BLE_SEND_EVT, 2);
-                    }
-                }
-                else
-                {
-                    //send_to_ble_state = SEND_TO_BLE_FIFO_EMPTY;
-                }
-                break;
-            case SEND_TO_BLE_ALLOC_FAILED:
-            case SEND_TO_BLE_SEND_FAILED:
+    return (delay != 0) ? (tmosTimer)delay : 1;
+}
 
-                noti.len = read_length;
-                noti.pValue = GATT_bm_alloc(peripheralConnList.connHandle, ATT_HANDLE_VALUE_NOTI, noti.len, NULL, 0);
-                if(noti.pValue != NULL)
-                {
-                    tmos_memcpy(noti.pValue, to_test_buffer, noti.len);
-                    result = ble_uart_notify(peripheralConnList.connHandle, &noti, 0);
-                    if(result != SUCCESS)
-                    {
-                        PRINT("R2:%02x\r\n", result);
-                        send_to_ble_state = SEND_TO_BLE_SEND_FAILED;
-                        GATT_bm_free((gattMsg_t *)&noti, ATT_HANDLE_VALUE_NOTI);
-                        tmos_start_task(Peripheral_TaskID, UART_TO_BLE_SEND_EVT, 2);
-                    }
-                    else
-                    {
-                        send_to_ble_state = SEND_TO_BLE_TO_SEND;
-                        //app_drv_fifo_write(&app_uart_tx_fifo,to_test_buffer,&read_length);
-                        read_length = 0;
-                        tmos_start_task(Peripheral_TaskID, UART_TO_BLE_SEND_EVT, 2);
-                    }
-                }
-                else
-                {
-                    send_to_ble_state = SEND_TO_BLE_ALLOC_FAILED;
-                    tmos_start_task(Peripheral_TaskID, UART_TO_BLE_SEND_EVT, 2);
-                }
-                break;
-            default:
-                break;
+/*********************************************************************
+ * @fn      peripheralUartToBle
+ *
+ * @brief   Move uart rx data into notifications. Queues as many packets
+ *          as the link layer accepts, each one is filled straight from
+ *          the fifo and only removed from it once the stack took it.
+ *
+ * @return  delay before the next run in units of 625us, 0 - idle
+ */
+static tmosTimer peripheralUartToBle(void)
+{
+    attHandleValueNoti_t noti;
+    uint16_t             connHandle = peripheralConnList.connHandle;
+    uint16_t             payload;
+    uint16_t             length;
+    uint32_t             unack;
+
+    //notify is not enabled
+    if(!ble_uart_notify_is_ready(connHandle))
+    {
+        if(connHandle == GAP_CONNHANDLE_INIT)
+        {
+            //connection lost, flush rx fifo here
+            app_drv_fifo_flush(&app_uart_rx_fifo);
         }
-        return (events ^ UART_TO_BLE_SEND_EVT);
+        return 0;
+    }
+    payload = ATT_GetMTU(connHandle) - 3;
+
+    while((length = app_drv_fifo_length(&app_uart_rx_fifo)) != 0)
+    {
+        unack = LL_GetNumberOfUnAckPacket(connHandle);
+        if(unack >= BLE_BUFF_NUM)
+        {
+            return peripheralUartToBleBackoff(unack);
+        }
+        if(length < payload)
+        {
+            //short packet, give the uart a chance to fill it up
+            if(uart_to_ble_send_evt_cnt < UART_TO_BLE_WAIT_CNT)
+            {
+                uart_to_ble_send_evt_cnt++;
+                return UART_TO_BLE_WAIT_DELAY;
+            }
+        }
+        else
+        {
+            length = payload;
+        }
+
+        noti.pValue = GATT_bm_alloc(connHandle, ATT_HANDLE_VALUE_NOTI, length, NULL, 0);
+        if(noti.pValue == NULL)
+        {
+            return peripheralUartToBleBackoff(unack);
+        }
+        app_drv_fifo_peek(&app_uart_rx_fifo, noti.pValue, &length);
+        noti.len = length;
+        if(ble_uart_notify(connHandle, &noti, 0) != SUCCESS)
+        {
+            GATT_bm_free((gattMsg_t *)&noti, ATT_HANDLE_VALUE_NOTI);
+            return peripheralUartToBleBackoff(unack);
+        }
+        app_drv_fifo_read_commit(&app_uart_rx_fifo, length);
+        uart_to_ble_send_evt_cnt = 0;
     }
-    // Discard unknown events
     return 0;
 }
 
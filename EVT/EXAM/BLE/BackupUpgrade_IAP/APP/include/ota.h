@@ -60,6 +60,24 @@ typedef struct
     unsigned char Revd[3];
 } OTADataFlashInfo_t;
 
+/* imageB -> imageA swap journal, the DataFlash page after the image flag.
+ * A reset during the copy resumes from the blocks recorded here. */
+#define OTA_SWAP_JOURNAL_ADD   (OTA_DATAFLASH_ADD + EEPROM_PAGE_SIZE)
+#define OTA_SWAP_MAGIC         0x50415753 // "SWAP"
+#define OTA_SWAP_BLOCK_NUM     (IMAGE_A_SIZE / FLASH_BLOCK_SIZE)
+#define OTA_SWAP_BLOCK_DONE    0x00       // done[] entry once the block matches, erased 0xFF is pending
+#define OTA_SWAP_RETRY         3          // copy passes before giving up on a digest mismatch
+#define OTA_SWAP_HEAD_LEN      16
+
+typedef struct
+{
+    uint32_t magic;                     // OTA_SWAP_MAGIC
+    uint32_t crc;                       // CRC32 of imageB
+    uint32_t crc_inv;                   // ~crc, header written completely
+    uint32_t rsv;
+    uint8_t  done[OTA_SWAP_BLOCK_NUM];  // one byte per FLASH_BLOCK_SIZE block
+} OTASwapJournal_t;
+
 /* OTA IAPͨѶЭ鶨 */
 /* ַʹ4ƫ */
 typedef union
@@ -23,6 +23,13 @@ __attribute__((aligned(8))) uint8_t block_buf[16];
 
 #define jumpApp    ((void (*)(void))((int *)IMAGE_A_START_ADD))
 
+/* imageB -> imageA swap journal */
+__attribute__((aligned(4))) OTASwapJournal_t swap_journal;
+
+static const uint32_t crc32_tab[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
 /*********************************************************************
  * GLOBAL TYPEDEFS
  */
@@ -54,6 +61,144 @@ void SwitchImageFlag(uint8_t new_flag)
     EEPROM_WRITE(OTA_DATAFLASH_ADD, (uint32_t *)&block_buf[0], 4);
 }
 
+/*********************************************************************
+ * @fn      ImageCRC32
+ *
+ * @brief   CRC32 (IEEE 802.3) of a code flash range, same as the OTA digest
+ *
+ * @param   addr    - start address
+ * @param   len     - length
+ *
+ * @return  crc
+ */
+uint32_t ImageCRC32(uint32_t addr, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *)addr;
+    uint32_t       crc = 0xFFFFFFFF;
+
+    while(len--)
+    {
+        crc = (crc >> 4) ^ crc32_tab[(crc ^ *p) & 0x0F];
+        crc = (crc >> 4) ^ crc32_tab[(crc ^ (*p >> 4)) & 0x0F];
+        p++;
+    }
+    return ~crc;
+}
+
+/*********************************************************************
+ * @fn      ImageBlockSame
+ *
+ * @brief   Compare one block of imageA with the same block of imageB
+ *
+ * @param   blk     - block index
+ *
+ * @return  1 if equal
+ */
+uint8_t ImageBlockSame(uint16_t blk)
+{
+    const uint32_t *a = (const uint32_t *)(IMAGE_A_START_ADD + blk * FLASH_BLOCK_SIZE);
+    const uint32_t *b = (const uint32_t *)(IMAGE_B_START_ADD + blk * FLASH_BLOCK_SIZE);
+    uint16_t        i;
+
+    for(i = 0; i < FLASH_BLOCK_SIZE / 4; i++)
+    {
+        if(a[i] != b[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*********************************************************************
+ * @fn      SwapJournalStart
+ *
+ * @brief   Load the swap journal, start a new one if it belongs to
+ *          another imageB
+ *
+ * @param   crc     - CRC32 of imageB
+ *
+ * @return  none
+ */
+void SwapJournalStart(uint32_t crc)
+{
+    EEPROM_READ(OTA_SWAP_JOURNAL_ADD, &swap_journal, sizeof(swap_journal));
+    if(swap_journal.magic == OTA_SWAP_MAGIC && swap_journal.crc == crc && swap_journal.crc_inv == ~crc)
+    {
+        PRINT("swap resume\n");
+        return;
+    }
+
+    EEPROM_ERASE(OTA_SWAP_JOURNAL_ADD, EEPROM_PAGE_SIZE);
+    memset(&swap_journal, 0xFF, sizeof(swap_journal));
+    swap_journal.magic = OTA_SWAP_MAGIC;
+    swap_journal.crc = crc;
+    swap_journal.crc_inv = ~crc;
+    swap_journal.rsv = 0;
+    EEPROM_WRITE(OTA_SWAP_JOURNAL_ADD, &swap_journal, OTA_SWAP_HEAD_LEN);
+}
+
+/*********************************************************************
+ * @fn      SwapImage
+ *
+ * @brief   Copy imageB into imageA block by block. Blocks that already
+ *          match are not touched, every finished block is recorded in
+ *          the journal, so a reset only redoes the block it hit.
+ *
+ * @return  0 if imageA matches the imageB digest
+ */
+uint8_t SwapImage(void)
+{
+    __attribute__((aligned(8))) uint8_t flash_Data[1024];
+    __attribute__((aligned(4))) uint8_t done = OTA_SWAP_BLOCK_DONE; // EEPROM_WRITE source, done[blk] is unaligned
+
+    uint32_t crc, addr;
+    uint16_t blk, copied;
+    uint8_t  pass, i;
+
+    crc = ImageCRC32(IMAGE_B_START_ADD, IMAGE_B_SIZE);
+    SwapJournalStart(crc);
+
+    for(pass = 0; pass < OTA_SWAP_RETRY; pass++)
+    {
+        copied = 0;
+        for(blk = 0; blk < OTA_SWAP_BLOCK_NUM; blk++)
+        {
+            if(swap_journal.done[blk] == OTA_SWAP_BLOCK_DONE)
+            {
+                continue;
+            }
+            if(!ImageBlockSame(blk))
+            {
+                addr = blk * FLASH_BLOCK_SIZE;
+                FLASH_ROM_ERASE(IMAGE_A_START_ADD + addr, FLASH_BLOCK_SIZE);
+                for(i = 0; i < FLASH_BLOCK_SIZE / sizeof(flash_Data); i++)
+                {
+                    FLASH_ROM_READ(IMAGE_B_START_ADD + addr, flash_Data, sizeof(flash_Data));
+                    FLASH_ROM_WRITE(IMAGE_A_START_ADD + addr, flash_Data, sizeof(flash_Data));
+                    addr += sizeof(flash_Data);
+                }
+                copied++;
+            }
+            swap_journal.done[blk] = OTA_SWAP_BLOCK_DONE;
+            EEPROM_WRITE(OTA_SWAP_JOURNAL_ADD + OTA_SWAP_HEAD_LEN + blk, &done, 1);
+        }
+        PRINT("swap %d blocks copied\n", copied);
+
+        if(ImageCRC32(IMAGE_A_START_ADD, IMAGE_A_SIZE) == crc)
+        {
+            return 0;
+        }
+
+        /* something went wrong, compare every block again */
+        PRINT("swap digest err\n");
+        EEPROM_ERASE(OTA_SWAP_JOURNAL_ADD, EEPROM_PAGE_SIZE);
+        memset(swap_journal.done, 0xFF, sizeof(swap_journal.done));
+        EEPROM_WRITE(OTA_SWAP_JOURNAL_ADD, &swap_journal, OTA_SWAP_HEAD_LEN);
+    }
+    return 1;
+}
+
 /*********************************************************************
  * @fn      jump_APP
  *
@@ -65,16 +210,20 @@ void jump_APP(void)
 {
     if(CurrImageFlag == IMAGE_IAP_FLAG)
     {
-        __attribute__((aligned(8))) uint8_t flash_Data[1024];
-
-        uint8_t i;
-        FLASH_ROM_ERASE(IMAGE_A_START_ADD, IMAGE_A_SIZE);
-        for(i = 0; i < IMAGE_A_SIZE / 1024; i++)
+        /* nothing to copy from an erased imageB, keep imageA */
+        if(*(uint32_t *)IMAGE_B_START_ADD == 0xFFFFFFFF)
+        {
+            SwitchImageFlag(IMAGE_A_FLAG);
+            jumpApp();
+        }
+        if(SwapImage())
         {
-            FLASH_ROM_READ(IMAGE_B_START_ADD + (i * 1024), flash_Data, 1024);
-            FLASH_ROM_WRITE(IMAGE_A_START_ADD + (i * 1024), flash_Data, 1024);
+            /* imageA is not usable, keep the flag, the copy is retried on the next power up */
+            PRINT("swap failed\n");
+            while(1);
         }
         SwitchImageFlag(IMAGE_A_FLAG);
+        EEPROM_ERASE(OTA_SWAP_JOURNAL_ADD, EEPROM_PAGE_SIZE);
         // ٱݴ
         FLASH_ROM_ERASE(IMAGE_B_START_ADD, IMAGE_A_SIZE);
     }
@@ -47,6 +47,8 @@
 #define CMD_IAP_VERIFY         0x82               // IAPУ
 #define CMD_IAP_END            0x83               // IAP־
 #define CMD_IAP_INFO           0x84               // IAPȡ豸Ϣ
+#define CMD_IAP_PATCH          0x85               // delta patch or compressed image, same layout as program, see ota_delta.h
+#define CMD_IAP_DIGEST         0x86               // CRC32 of a written range, same layout as verify, buf = 4 byte length
 
 /* ֡ȶ */
 #define IAP_LEN                247
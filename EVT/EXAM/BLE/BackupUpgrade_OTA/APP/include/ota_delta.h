@@ -0,0 +1,117 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : ota_delta.h
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : Delta and compressed OTA, rebuilds the new image into
+ *                      imageB from a stream: a patch against imageA or an
+ *                      LZ4 compressed image
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+/******************************************************************************/
+#ifndef __OTA_DELTA_H
+#define __OTA_DELTA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Stream layout, all fields little endian:
+ *
+ *   header (OTA_DELTA_HEAD_LEN bytes)
+ *     0  magic "WCHD" delta patch, "WCHZ" compressed image
+ *     4  version, flags, reserved[2]
+ *     8  old image size      12  old image CRC32 (both 0 for "WCHZ")
+ *     16 new image size      20  new image CRC32
+ *     24 body size           28  CRC32 of bytes 0..27
+ *
+ *   "WCHD" body, a sequence of operations
+ *     OTA_DELTA_OP_DIFF  <n>        n bytes = old + diff, old pointer += n
+ *                                   diff is coded as pairs <zeros> <m> m*byte
+ *     OTA_DELTA_OP_EXTRA <n> n*byte n literal bytes
+ *     OTA_DELTA_OP_SEEK  <d>        old pointer += d (zigzag coded)
+ *
+ *   <n> values are LEB128 varints. Image offsets are relative to
+ *   IMAGE_A_START_ADD (old) and IMAGE_B_START_ADD (new).
+ *
+ *   "WCHZ" body, one LZ4 block. Matches reach back up to 64 KB into
+ *   imageB, so no RAM window is needed.
+ *
+ * The header travels alone in the first CMD_IAP_PATCH packet, the body
+ * follows in packets whose address is the stream offset / 16.
+ */
+#define OTA_DELTA_MAGIC          0x44484357 // "WCHD"
+#define OTA_LZ4_MAGIC            0x5A484357 // "WCHZ"
+#define OTA_DELTA_VERSION        1
+#define OTA_DELTA_HEAD_LEN       32
+
+#define OTA_DELTA_OP_DIFF        0x01
+#define OTA_DELTA_OP_EXTRA       0x02
+#define OTA_DELTA_OP_SEEK        0x03
+
+/* stream types reported by CMD_IAP_INFO */
+#define OTA_STREAM_DELTA         0x01
+#define OTA_STREAM_LZ4           0x02
+
+/* bytes hashed per OTA_DeltaDigestStep call */
+#define OTA_DELTA_DIGEST_SLICE   4096
+
+/* status returned to the host besides SUCCESS */
+#define OTA_DELTA_BUSY           0xF0 // digest check running, not sent to the host
+#define OTA_DELTA_ERR_HEAD       0xF1 // bad header
+#define OTA_DELTA_ERR_BASE       0xF2 // imageA is not the image the patch was made from
+#define OTA_DELTA_ERR_FORMAT     0xF3 // malformed body
+#define OTA_DELTA_ERR_FLASH      0xF4 // imageB program failed
+#define OTA_DELTA_ERR_DIGEST     0xF5 // rebuilt image does not match
+#define OTA_DELTA_ERR_SEQ        0xF6 // packet out of order
+
+/**
+ * @brief   Drop any stream in progress, imageB must be erased before the next one
+ */
+extern void OTA_DeltaReset(void);
+
+/**
+ * @brief   Feed stream bytes, they are applied to imageB as they arrive
+ *
+ * @param   offset  - stream offset of pData
+ * @param   pData   - stream bytes
+ * @param   len     - byte count
+ *
+ * @return  SUCCESS, OTA_DELTA_BUSY when a digest check was started
+ *          (call OTA_DeltaDigestStep until it returns the final status),
+ *          otherwise an OTA_DELTA_ERR_xxx code
+ */
+extern uint8_t OTA_DeltaWrite(uint32_t offset, const uint8_t *pData, uint16_t len);
+
+/**
+ * @brief   Hash the next OTA_DELTA_DIGEST_SLICE bytes of the running check
+ *
+ * @return  OTA_DELTA_BUSY while running, then SUCCESS or an error code
+ */
+extern uint8_t OTA_DeltaDigestStep(void);
+
+/**
+ * @brief   A stream has been started since the last reset
+ */
+extern uint8_t OTA_DeltaIsActive(void);
+
+/**
+ * @brief   The stream was applied and imageB matches the new image digest
+ */
+extern uint8_t OTA_DeltaIsComplete(void);
+
+/**
+ * @brief   CRC32 (IEEE 802.3, same as zlib crc32), start with crc = 0
+ */
+extern uint32_t OTA_CRC32(uint32_t crc, const uint8_t *pData, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
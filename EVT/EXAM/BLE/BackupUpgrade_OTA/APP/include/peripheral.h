@@ -29,6 +29,8 @@ extern "C" {
 #define SBP_START_DEVICE_EVT    0x0001
 #define SBP_PERIODIC_EVT        0x0002
 #define OTA_FLASH_ERASE_EVT     0x0004  //OTA Flash
+#define OTA_DELTA_DIGEST_EVT    0x0008  //OTA delta digest check
+#define OTA_DIGEST_EVT          0x0010  //OTA imageB CRC32 for CMD_IAP_DIGEST
 
 /*********************************************************************
  * MACROS
@@ -0,0 +1,661 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : ota_delta.c
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : Delta and compressed OTA streams. The stream is parsed
+ *                      as it arrives, the new image is assembled in one Flash
+ *                      page of RAM and programmed into imageB. Delta patches
+ *                      read old bytes straight from imageA, LZ4 matches are
+ *                      copied back from the part of imageB already written.
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+/*********************************************************************
+ * INCLUDES
+ */
+#include "CONFIG.h"
+#include "OTA.h"
+#include "ota_delta.h"
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+/* parser states */
+enum
+{
+    DELTA_ST_IDLE = 0,   // waiting for the header
+    DELTA_ST_CHECK_BASE, // hashing imageA
+    DELTA_ST_OP,         // waiting for an operation code
+    DELTA_ST_ARG,        // operation argument
+    DELTA_ST_ZEROS,      // DIFF: count of unchanged bytes
+    DELTA_ST_LIT_LEN,    // DIFF: count of changed bytes
+    DELTA_ST_LIT,        // DIFF: changed bytes
+    DELTA_ST_EXTRA,      // EXTRA: literal bytes
+    DELTA_ST_LZ_TOKEN,   // LZ4: sequence token
+    DELTA_ST_LZ_LIT_LEN, // LZ4: literal length extension
+    DELTA_ST_LZ_LIT,     // LZ4: literal bytes
+    DELTA_ST_LZ_OFF0,    // LZ4: match offset, low byte
+    DELTA_ST_LZ_OFF1,    // LZ4: match offset, high byte
+    DELTA_ST_LZ_MATCH_LEN, // LZ4: match length extension
+    DELTA_ST_CHECK_NEW,  // hashing imageB
+    DELTA_ST_DONE,
+    DELTA_ST_ERROR,
+};
+
+/*********************************************************************
+ * TYPEDEFS
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint8_t  version;
+    uint8_t  flags;
+    uint8_t  rsv[2];
+    uint32_t oldSize;
+    uint32_t oldCrc;
+    uint32_t newSize;
+    uint32_t newCrc;
+    uint32_t bodySize;
+    uint32_t headCrc;
+} otaDeltaHead_t;
+
+/*********************************************************************
+ * LOCAL VARIABLES
+ */
+static otaDeltaHead_t deltaHead;
+
+static uint8_t  deltaState = DELTA_ST_IDLE;
+static uint8_t  deltaErr;
+static uint8_t  deltaOp;
+static uint32_t deltaRecv;   // patch bytes accepted
+static uint32_t deltaOldPos; // imageA read offset
+static uint32_t deltaNewPos; // imageB bytes produced, page window included
+static uint32_t deltaRun;    // bytes left in the current operation
+static uint32_t deltaLit;    // changed bytes left in the current DIFF pair, LZ4 literals
+static uint16_t deltaOff;    // LZ4 match offset
+
+static uint32_t deltaVarint;
+static uint8_t  deltaVarShift;
+
+static uint32_t deltaCrc;
+static uint32_t deltaCrcAddr;
+static uint32_t deltaCrcLeft;
+
+/* RAM window, one Flash page of the new image */
+static __attribute__((aligned(4))) uint8_t deltaPage[EEPROM_PAGE_SIZE];
+static uint16_t deltaFill;
+
+static const uint32_t crc32Tab[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+/*********************************************************************
+ * @fn      OTA_CRC32
+ *
+ * @brief   CRC32 (IEEE 802.3), nibble table to keep Flash use small
+ *
+ * @param   crc     - previous result, 0 to start
+ * @param   pData   - data
+ * @param   len     - data length
+ *
+ * @return  crc
+ */
+uint32_t OTA_CRC32(uint32_t crc, const uint8_t *pData, uint32_t len)
+{
+    crc = ~crc;
+    while(len--)
+    {
+        crc = (crc >> 4) ^ crc32Tab[(crc ^ *pData) & 0x0F];
+        crc = (crc >> 4) ^ crc32Tab[(crc ^ (*pData >> 4)) & 0x0F];
+        pData++;
+    }
+    return ~crc;
+}
+
+static uint8_t delta_fail(uint8_t status)
+{
+    deltaState = DELTA_ST_ERROR;
+    deltaErr = status;
+    return status;
+}
+
+static void delta_next(uint8_t state)
+{
+    deltaState = state;
+    deltaVarint = 0;
+    deltaVarShift = 0;
+}
+
+/* returns 1 once a complete varint is in deltaVarint */
+static uint8_t delta_varint(uint8_t b)
+{
+    if(deltaVarShift > 28)
+    {
+        delta_fail(OTA_DELTA_ERR_FORMAT);
+        return 0;
+    }
+    deltaVarint |= (uint32_t)(b & 0x7F) << deltaVarShift;
+    deltaVarShift += 7;
+    return !(b & 0x80);
+}
+
+static void delta_check_start(uint32_t addr, uint32_t len, uint8_t state)
+{
+    deltaCrc = 0;
+    deltaCrcAddr = addr;
+    deltaCrcLeft = len;
+    deltaState = state;
+}
+
+/*********************************************************************
+ * @fn      delta_flush
+ *
+ * @brief   Program the page window into imageB
+ *
+ * @return  SUCCESS or OTA_DELTA_ERR_FLASH
+ */
+static uint8_t delta_flush(void)
+{
+    uint32_t addr = IMAGE_B_START_ADD + deltaNewPos - deltaFill;
+
+    if(deltaFill == 0)
+    {
+        return SUCCESS;
+    }
+    /* the tail is padded with erased bytes to a whole dword */
+    if(FLASH_ROM_WRITE(addr, deltaPage, (deltaFill + 3) & ~3))
+    {
+        return OTA_DELTA_ERR_FLASH;
+    }
+    tmos_memset(deltaPage, 0xFF, sizeof(deltaPage));
+    deltaFill = 0;
+    return SUCCESS;
+}
+
+static uint8_t delta_put(uint8_t b)
+{
+    deltaPage[deltaFill++] = b;
+    deltaNewPos++;
+    if(deltaFill == EEPROM_PAGE_SIZE)
+    {
+        return delta_flush();
+    }
+    return SUCCESS;
+}
+
+static uint8_t delta_copy_old(uint32_t len)
+{
+    uint32_t n;
+
+    while(len)
+    {
+        n = MIN(len, EEPROM_PAGE_SIZE - deltaFill);
+        tmos_memcpy(&deltaPage[deltaFill], (uint8_t *)(IMAGE_A_START_ADD + deltaOldPos), n);
+        deltaFill += n;
+        deltaOldPos += n;
+        deltaNewPos += n;
+        len -= n;
+        if(deltaFill == EEPROM_PAGE_SIZE && delta_flush())
+        {
+            return OTA_DELTA_ERR_FLASH;
+        }
+    }
+    return SUCCESS;
+}
+
+/* a byte of the new image that was already produced */
+static uint8_t delta_out_byte(uint32_t pos)
+{
+    uint32_t base = deltaNewPos - deltaFill;
+
+    if(pos >= base)
+    {
+        return deltaPage[pos - base];
+    }
+    return *(uint8_t *)(IMAGE_B_START_ADD + pos);
+}
+
+/*********************************************************************
+ * @fn      delta_copy_back
+ *
+ * @brief   LZ4 match, the source may overlap the bytes being produced
+ *
+ * @return  SUCCESS or error
+ */
+static uint8_t delta_copy_back(void)
+{
+    uint32_t len = deltaRun + 4;
+    uint8_t  status = SUCCESS;
+
+    if(len > deltaHead.newSize - deltaNewPos)
+    {
+        return OTA_DELTA_ERR_FORMAT;
+    }
+    while(len-- && status == SUCCESS)
+    {
+        status = delta_put(delta_out_byte(deltaNewPos - deltaOff));
+    }
+    delta_next(DELTA_ST_LZ_TOKEN);
+    return status;
+}
+
+/*********************************************************************
+ * @fn      delta_arg
+ *
+ * @brief   An operation argument is complete, check it against both images
+ *
+ * @return  SUCCESS or error
+ */
+static uint8_t delta_arg(void)
+{
+    uint32_t n = deltaVarint;
+    int32_t  seek;
+
+    switch(deltaOp)
+    {
+        case OTA_DELTA_OP_DIFF:
+            if(n > deltaHead.oldSize - deltaOldPos || n > deltaHead.newSize - deltaNewPos)
+            {
+                return OTA_DELTA_ERR_FORMAT;
+            }
+            deltaRun = n;
+            delta_next(n ? DELTA_ST_ZEROS : DELTA_ST_OP);
+            break;
+
+        case OTA_DELTA_OP_EXTRA:
+            if(n > deltaHead.newSize - deltaNewPos)
+            {
+                return OTA_DELTA_ERR_FORMAT;
+            }
+            deltaRun = n;
+            delta_next(n ? DELTA_ST_EXTRA : DELTA_ST_OP);
+            break;
+
+        default: // OTA_DELTA_OP_SEEK
+            seek = (int32_t)(n >> 1) ^ -(int32_t)(n & 1);
+            if((seek < 0 && (uint32_t)-seek > deltaOldPos) ||
+               (seek > 0 && (uint32_t)seek > deltaHead.oldSize - deltaOldPos))
+            {
+                return OTA_DELTA_ERR_FORMAT;
+            }
+            deltaOldPos += seek;
+            delta_next(DELTA_ST_OP);
+            break;
+    }
+    return SUCCESS;
+}
+
+/*********************************************************************
+ * @fn      delta_byte
+ *
+ * @brief   Run one patch body byte through the parser
+ *
+ * @return  SUCCESS or error
+ */
+static uint8_t delta_byte(uint8_t b)
+{
+    uint8_t status = SUCCESS;
+
+    switch(deltaState)
+    {
+        case DELTA_ST_OP:
+            if(b < OTA_DELTA_OP_DIFF || b > OTA_DELTA_OP_SEEK)
+            {
+                return OTA_DELTA_ERR_FORMAT;
+            }
+            deltaOp = b;
+            delta_next(DELTA_ST_ARG);
+            break;
+
+        case DELTA_ST_ARG:
+            if(delta_varint(b))
+            {
+                status = delta_arg();
+            }
+            break;
+
+        case DELTA_ST_ZEROS:
+            if(delta_varint(b))
+            {
+                if(deltaVarint > deltaRun)
+                {
+                    return OTA_DELTA_ERR_FORMAT;
+                }
+                status = delta_copy_old(deltaVarint);
+                deltaRun -= deltaVarint;
+                delta_next(deltaRun ? DELTA_ST_LIT_LEN : DELTA_ST_OP);
+            }
+            break;
+
+        case DELTA_ST_LIT_LEN:
+            if(delta_varint(b))
+            {
+                if(deltaVarint == 0 || deltaVarint > deltaRun)
+                {
+                    return OTA_DELTA_ERR_FORMAT;
+                }
+                deltaLit = deltaVarint;
+                delta_next(DELTA_ST_LIT);
+            }
+            break;
+
+        case DELTA_ST_LIT:
+            status = delta_put(*(uint8_t *)(IMAGE_A_START_ADD + deltaOldPos) + b);
+            deltaOldPos++;
+            deltaRun--;
+            if(--deltaLit == 0)
+            {
+                delta_next(deltaRun ? DELTA_ST_ZEROS : DELTA_ST_OP);
+            }
+            break;
+
+        case DELTA_ST_EXTRA:
+            status = delta_put(b);
+            if(--deltaRun == 0)
+            {
+                delta_next(DELTA_ST_OP);
+            }
+            break;
+
+        case DELTA_ST_LZ_TOKEN:
+            if(deltaNewPos == deltaHead.newSize)
+            {
+                return OTA_DELTA_ERR_FORMAT;
+            }
+            deltaLit = b >> 4;
+            deltaRun = b & 0x0F;
+            if(deltaLit == 15)
+            {
+                delta_next(DELTA_ST_LZ_LIT_LEN);
+            }
+            else
+            {
+                delta_next(deltaLit ? DELTA_ST_LZ_LIT : DELTA_ST_LZ_OFF0);
+            }
+            break;
+
+        case DELTA_ST_LZ_LIT_LEN:
+            deltaLit += b;
+            if(deltaLit > deltaHead.newSize - deltaNewPos)
+            {
+                return OTA_DELTA_ERR_FORMAT;
+            }
+            if(b != 255)
+            {
+                delta_next(DELTA_ST_LZ_LIT);
+            }
+            break;
+
+        case DELTA_ST_LZ_LIT:
+            if(deltaNewPos == deltaHead.newSize)
+            {
+                return OTA_DELTA_ERR_FORMAT;
+            }
+            status = delta_put(b);
+            if(--deltaLit == 0)
+            {
+                /* the last sequence of the block has no match */
+                delta_next((deltaNewPos == deltaHead.newSize) ? DELTA_ST_LZ_TOKEN : DELTA_ST_LZ_OFF0);
+            }
+            break;
+
+        case DELTA_ST_LZ_OFF0:
+            deltaOff = b;
+            deltaState = DELTA_ST_LZ_OFF1;
+            break;
+
+        case DELTA_ST_LZ_OFF1:
+            deltaOff |= (uint16_t)b << 8;
+            if(deltaOff == 0 || deltaOff > deltaNewPos)
+            {
+                return OTA_DELTA_ERR_FORMAT;
+            }
+            if(deltaRun == 15)
+            {
+                deltaState = DELTA_ST_LZ_MATCH_LEN;
+            }
+            else
+            {
+                status = delta_copy_back();
+            }
+            break;
+
+        case DELTA_ST_LZ_MATCH_LEN:
+            deltaRun += b;
+            if(deltaRun > deltaHead.newSize)
+            {
+                return OTA_DELTA_ERR_FORMAT;
+            }
+            if(b != 255)
+            {
+                status = delta_copy_back();
+            }
+            break;
+
+        default:
+            return OTA_DELTA_ERR_FORMAT;
+    }
+
+    if(deltaState == DELTA_ST_ERROR)
+    {
+        return deltaErr;
+    }
+    return status;
+}
+
+/*********************************************************************
+ * @fn      delta_head
+ *
+ * @brief   Check the header, a delta patch then hashes imageA first
+ *
+ * @return  OTA_DELTA_BUSY, SUCCESS or error
+ */
+static uint8_t delta_head(const uint8_t *pData, uint16_t len)
+{
+    if(len != OTA_DELTA_HEAD_LEN)
+    {
+        return OTA_DELTA_ERR_HEAD;
+    }
+    tmos_memcpy(&deltaHead, pData, OTA_DELTA_HEAD_LEN);
+    if(deltaHead.version != OTA_DELTA_VERSION ||
+       deltaHead.headCrc != OTA_CRC32(0, pData, OTA_DELTA_HEAD_LEN - 4) ||
+       deltaHead.newSize == 0 || deltaHead.newSize > IMAGE_B_SIZE ||
+       deltaHead.bodySize == 0)
+    {
+        return OTA_DELTA_ERR_HEAD;
+    }
+    if(deltaHead.magic == OTA_DELTA_MAGIC)
+    {
+        if(deltaHead.oldSize == 0 || deltaHead.oldSize > IMAGE_A_SIZE)
+        {
+            return OTA_DELTA_ERR_HEAD;
+        }
+    }
+    else if(deltaHead.magic != OTA_LZ4_MAGIC || deltaHead.oldSize != 0)
+    {
+        return OTA_DELTA_ERR_HEAD;
+    }
+
+    deltaRecv = OTA_DELTA_HEAD_LEN;
+    deltaOldPos = 0;
+    deltaNewPos = 0;
+    deltaFill = 0;
+    tmos_memset(deltaPage, 0xFF, sizeof(deltaPage));
+    if(deltaHead.magic == OTA_LZ4_MAGIC)
+    {
+        delta_next(DELTA_ST_LZ_TOKEN);
+        return SUCCESS;
+    }
+    delta_check_start(IMAGE_A_START_ADD, deltaHead.oldSize, DELTA_ST_CHECK_BASE);
+    return OTA_DELTA_BUSY;
+}
+
+/*********************************************************************
+ * @fn      OTA_DeltaReset
+ *
+ * @brief   Drop any stream in progress
+ *
+ * @return  none
+ */
+void OTA_DeltaReset(void)
+{
+    deltaState = DELTA_ST_IDLE;
+    deltaRecv = 0;
+}
+
+/*********************************************************************
+ * @fn      OTA_DeltaWrite
+ *
+ * @brief   Feed stream bytes. A packet already applied (lost ack) is
+ *          acknowledged again without being applied twice.
+ *
+ * @param   offset  - stream offset of pData
+ * @param   pData   - stream bytes
+ * @param   len     - byte count
+ *
+ * @return  SUCCESS, OTA_DELTA_BUSY or error
+ */
+uint8_t OTA_DeltaWrite(uint32_t offset, const uint8_t *pData, uint16_t len)
+{
+    uint8_t status = SUCCESS;
+
+    switch(deltaState)
+    {
+        case DELTA_ST_ERROR:
+            return deltaErr;
+
+        case DELTA_ST_CHECK_BASE:
+        case DELTA_ST_CHECK_NEW:
+            return OTA_DELTA_ERR_SEQ;
+
+        case DELTA_ST_IDLE:
+            if(offset != 0)
+            {
+                return OTA_DELTA_ERR_SEQ;
+            }
+            status = delta_head(pData, len);
+            return (status == OTA_DELTA_BUSY || status == SUCCESS) ? status : delta_fail(status);
+
+        default:
+            break;
+    }
+
+    if(len && offset + len <= deltaRecv)
+    {
+        return SUCCESS;
+    }
+    if(offset != deltaRecv || deltaState == DELTA_ST_DONE)
+    {
+        return OTA_DELTA_ERR_SEQ;
+    }
+    if(len > OTA_DELTA_HEAD_LEN + deltaHead.bodySize - deltaRecv)
+    {
+        return delta_fail(OTA_DELTA_ERR_FORMAT);
+    }
+
+    deltaRecv += len;
+    while(len-- && status == SUCCESS)
+    {
+        status = delta_byte(*pData++);
+    }
+    if(status != SUCCESS)
+    {
+        return delta_fail(status);
+    }
+
+    if(deltaRecv == OTA_DELTA_HEAD_LEN + deltaHead.bodySize)
+    {
+        if(deltaNewPos != deltaHead.newSize ||
+           deltaState != ((deltaHead.magic == OTA_LZ4_MAGIC) ? DELTA_ST_LZ_TOKEN : DELTA_ST_OP))
+        {
+            return delta_fail(OTA_DELTA_ERR_FORMAT);
+        }
+        if(delta_flush())
+        {
+            return delta_fail(OTA_DELTA_ERR_FLASH);
+        }
+        delta_check_start(IMAGE_B_START_ADD, deltaHead.newSize, DELTA_ST_CHECK_NEW);
+        return OTA_DELTA_BUSY;
+    }
+    return SUCCESS;
+}
+
+/*********************************************************************
+ * @fn      OTA_DeltaDigestStep
+ *
+ * @brief   Hash the next slice of the running imageA/imageB check
+ *
+ * @return  OTA_DELTA_BUSY while running, then SUCCESS or error
+ */
+uint8_t OTA_DeltaDigestStep(void)
+{
+    uint32_t n;
+
+    if(deltaState == DELTA_ST_ERROR)
+    {
+        return deltaErr;
+    }
+    if(deltaState != DELTA_ST_CHECK_BASE && deltaState != DELTA_ST_CHECK_NEW)
+    {
+        return SUCCESS;
+    }
+
+    n = MIN(deltaCrcLeft, OTA_DELTA_DIGEST_SLICE);
+    deltaCrc = OTA_CRC32(deltaCrc, (const uint8_t *)deltaCrcAddr, n);
+    deltaCrcAddr += n;
+    deltaCrcLeft -= n;
+    if(deltaCrcLeft)
+    {
+        return OTA_DELTA_BUSY;
+    }
+
+    if(deltaState == DELTA_ST_CHECK_BASE)
+    {
+        if(deltaCrc != deltaHead.oldCrc)
+        {
+            return delta_fail(OTA_DELTA_ERR_BASE);
+        }
+        delta_next(DELTA_ST_OP);
+    }
+    else
+    {
+        if(deltaCrc != deltaHead.newCrc)
+        {
+            return delta_fail(OTA_DELTA_ERR_DIGEST);
+        }
+        deltaState = DELTA_ST_DONE;
+    }
+    return SUCCESS;
+}
+
+/*********************************************************************
+ * @fn      OTA_DeltaIsActive
+ *
+ * @brief   A stream has been started since the last reset
+ *
+ * @return  TRUE/FALSE
+ */
+uint8_t OTA_DeltaIsActive(void)
+{
+    return (deltaState != DELTA_ST_IDLE);
+}
+
+/*********************************************************************
+ * @fn      OTA_DeltaIsComplete
+ *
+ * @brief   imageB holds the verified new image
+ *
+ * @return  TRUE/FALSE
+ */
+uint8_t OTA_DeltaIsComplete(void)
+{
+    return (deltaState == DELTA_ST_DONE);
+}
+
+/*********************************************************************
+*********************************************************************/
@@ -18,6 +18,7 @@
 #include "GATTprofile.h"
 #include "Peripheral.h"
 #include "OTA.h"
+#include "ota_delta.h"
 #include "OTAprofile.h"
 
 /*********************************************************************
@@ -150,6 +151,11 @@ uint32_t EraseBlockCnt = 0; //
 /* FLASH У */
 uint8_t VerifyStatus = 0;
 
+/* CMD_IAP_DIGEST, hashed in slices by OTA_DIGEST_EVT */
+static uint32_t DigestAdd = 0;
+static uint32_t DigestLen = 0;
+static uint32_t DigestCrc = 0;
+
 /*********************************************************************
  * LOCAL FUNCTIONS
  */
@@ -161,6 +167,7 @@ void        OTA_IAPReadDataComplete(unsigned char index);
 void        OTA_IAPWriteData(unsigned char index, unsigned char *p_data, unsigned char w_len);
 void        Rec_OTA_IAP_DataDeal(void);
 void        OTA_IAP_SendCMDDealSta(uint8_t deal_status);
+void        OTA_IAP_SendData(uint8_t *p_send_data, uint8_t send_len);
 
 /*********************************************************************
  * PROFILE CALLBACKS
@@ -385,6 +392,50 @@ uint16_t Peripheral_ProcessEvent(uint8_t task_id, uint16_t events)
         return (events);
     }
 
+    //OTA_DELTA_DIGEST_EVT
+    if(events & OTA_DELTA_DIGEST_EVT)
+    {
+        uint8_t status;
+
+        /* one slice per pass, the link keeps running in between */
+        status = OTA_DeltaDigestStep();
+        if(status == OTA_DELTA_BUSY)
+        {
+            return (events);
+        }
+
+        PRINT("DELTA digest %02x\r\n", status);
+        OTA_IAP_SendCMDDealSta(status);
+        return (events ^ OTA_DELTA_DIGEST_EVT);
+    }
+
+    //OTA_DIGEST_EVT
+    if(events & OTA_DIGEST_EVT)
+    {
+        uint32_t n;
+        uint8_t  rsp[6];
+
+        n = MIN(DigestLen, OTA_DELTA_DIGEST_SLICE);
+        DigestCrc = OTA_CRC32(DigestCrc, (uint8_t *)DigestAdd, n);
+        DigestAdd += n;
+        DigestLen -= n;
+        if(DigestLen)
+        {
+            return (events);
+        }
+
+        PRINT("IAP_DIGEST %08x\r\n", (int)DigestCrc);
+        /* status, reserved, CRC32 little endian */
+        rsp[0] = SUCCESS;
+        rsp[1] = 0;
+        rsp[2] = (uint8_t)(DigestCrc);
+        rsp[3] = (uint8_t)(DigestCrc >> 8);
+        rsp[4] = (uint8_t)(DigestCrc >> 16);
+        rsp[5] = (uint8_t)(DigestCrc >> 24);
+        OTA_IAP_SendData(rsp, sizeof(rsp));
+        return (events ^ OTA_DIGEST_EVT);
+    }
+
     // Discard unknown events
     return 0;
 }
@@ -658,6 +709,9 @@ void Rec_OTA_IAP_DataDeal(void)
             EraseAdd = OpAdd;
             EraseBlockCnt = 0;
 
+            /* imageB is rewritten, a delta patch starts over */
+            OTA_DeltaReset();
+
             /* ͷڲ0 */
             VerifyStatus = 0;
 
@@ -699,11 +753,73 @@ void Rec_OTA_IAP_DataDeal(void)
             OTA_IAP_SendCMDDealSta(VerifyStatus);
             break;
         }
+        /* CRC32 of a written range, replaces sending the image again for CMD_IAP_VERIFY */
+        case CMD_IAP_DIGEST:
+        {
+            OpAdd = (uint32_t)(iap_rec_data.verify.addr[0]);
+            OpAdd |= ((uint32_t)(iap_rec_data.verify.addr[1]) << 8);
+            OpAdd = OpAdd * 16;
+
+            OpAdd += IMAGE_A_SIZE;
+
+            OpParaDataLen = (uint32_t)(iap_rec_data.verify.buf[0]);
+            OpParaDataLen |= ((uint32_t)(iap_rec_data.verify.buf[1]) << 8);
+            OpParaDataLen |= ((uint32_t)(iap_rec_data.verify.buf[2]) << 16);
+            OpParaDataLen |= ((uint32_t)(iap_rec_data.verify.buf[3]) << 24);
+
+            PRINT("IAP_DIGEST: %08x len:%d \r\n", (int)OpAdd, (int)OpParaDataLen);
+
+            if(iap_rec_data.verify.len != 4 || OpAdd < IMAGE_B_START_ADD || OpAdd >= IMAGE_IAP_START_ADD ||
+               OpParaDataLen == 0 || OpParaDataLen > IMAGE_IAP_START_ADD - OpAdd)
+            {
+                OTA_IAP_SendCMDDealSta(0xFF);
+            }
+            else
+            {
+                DigestAdd = OpAdd;
+                DigestLen = OpParaDataLen;
+                DigestCrc = 0;
+                tmos_set_event(Peripheral_TaskID, OTA_DIGEST_EVT);
+            }
+            break;
+        }
+        /* delta patch or compressed image */
+        case CMD_IAP_PATCH:
+        {
+            uint8_t status;
+
+            OpParaDataLen = iap_rec_data.program.len;
+            OpAdd = (uint32_t)(iap_rec_data.program.addr[0]);
+            OpAdd |= ((uint32_t)(iap_rec_data.program.addr[1]) << 8);
+            OpAdd = OpAdd * 16;
+
+            PRINT("IAP_PATCH: %08x len:%d \r\n", (int)OpAdd, (int)OpParaDataLen);
+
+            status = OTA_DeltaWrite(OpAdd, iap_rec_data.program.buf, (uint16_t)OpParaDataLen);
+            if(status == OTA_DELTA_BUSY)
+            {
+                /* the status is sent once the digest check finishes */
+                tmos_set_event(Peripheral_TaskID, OTA_DELTA_DIGEST_EVT);
+            }
+            else
+            {
+                if(status)             PRINT("IAP_PATCH err %02x\r\n", status);
+                OTA_IAP_SendCMDDealSta(status);
+            }
+            break;
+        }
         /* ̽ */
         case CMD_IAP_END:
         {
             PRINT("IAP_END \r\n");
 
+            /* never switch to a half applied patch */
+            if(OTA_DeltaIsActive() && !OTA_DeltaIsComplete())
+            {
+                OTA_IAP_SendCMDDealSta(OTA_DELTA_ERR_DIGEST);
+                break;
+            }
+
             /* ǰImageA */
             /* رյǰʹжϣ߷һֱȫر */
             DisableAllIRQ();
@@ -738,6 +854,10 @@ void Rec_OTA_IAP_DataDeal(void)
 
             send_buf[7] = CHIP_ID&0xFF;
             send_buf[8] = (CHIP_ID>>8)&0xFF;
+
+            /* CMD_IAP_PATCH stream version and types, 0 - not supported */
+            send_buf[9] = OTA_DELTA_VERSION;
+            send_buf[10] = OTA_STREAM_DELTA | OTA_STREAM_LZ4;
             /* Ҫ */
 
             /* Ϣ */
@@ -0,0 +1,21 @@
+/* Host stand-in for config.h: just what ota_delta.c needs, Flash-ROM writes
+ * go to the simulated flash in ota_delta_test.c */
+#ifndef __CONFIG_H
+#define __CONFIG_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define SUCCESS                 0
+#define MIN(n, m)               (((n) < (m)) ? (n) : (m))
+
+#define EEPROM_PAGE_SIZE        256
+
+#define tmos_memcpy             memcpy
+#define tmos_memset             memset
+
+uint32_t sim_flash_write(uint32_t addr, const void *buf, uint32_t len);
+
+#define FLASH_ROM_WRITE(addr, buf, len)    sim_flash_write(addr, buf, len)
+
+#endif
@@ -0,0 +1,17 @@
+/* Host stand-in for ota.h: the same image layout, moved up by FLASH_SIM_BASE
+ * where ota_delta_test.c maps the simulated flash. ota_delta.c addresses the
+ * images through uint32_t as on the chip, so the mapping sits below 4 GB */
+#ifndef __OTA_H
+#define __OTA_H
+
+#define FLASH_SIM_BASE          0x10000000
+
+#define IMAGE_SIZE              (216 * 1024)
+
+#define IMAGE_A_START_ADD       (FLASH_SIM_BASE + 4 * 1024)
+#define IMAGE_A_SIZE            IMAGE_SIZE
+
+#define IMAGE_B_START_ADD       (IMAGE_A_START_ADD + IMAGE_SIZE)
+#define IMAGE_B_SIZE            IMAGE_SIZE
+
+#endif
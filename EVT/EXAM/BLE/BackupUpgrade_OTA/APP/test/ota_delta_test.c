@@ -0,0 +1,811 @@
+/* Host test for the delta and LZ4 OTA streams (ota_delta.c)
+ *
+ * A patch and a compressed image built by Tool/OTA_Tool/wch_ota.py are fed
+ * to OTA_DeltaWrite() the way peripheral.c does: the header alone, then the
+ * body in frames (128 and 240 bytes as sent, 16 to cut fields apart), each
+ * digest check run to its end. The images live in a simulated flash mapped
+ * where OTA.h puts imageA and imageB. Flash is read-only outside
+ * FLASH_ROM_WRITE. Programming must be dword aligned, must stay inside imageB
+ * and must not program a byte twice. The address sanitizer also poisons
+ * imageA past the old image and every imageB byte not yet programmed, so the
+ * parser cannot read them; LZ4 matches must come from bytes already
+ * produced. Both streams must rebuild the new image. Corrupted, truncated,
+ * hand-made malformed and out of order streams, a wrong base image and a
+ * failing flash must end in an error, never in a complete image.
+ *
+ *   make -C EVT/EXAM/BLE/BackupUpgrade_OTA/APP/test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sanitizer/asan_interface.h>
+#include "CONFIG.h"
+#include "OTA.h"
+#include "ota_delta.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0   // a hint then, checked below
+#endif
+
+#define FLASH_SIM_SIZE  (IMAGE_B_START_ADD + IMAGE_B_SIZE - FLASH_SIM_BASE)
+#define IMAGE_A         ((uint8_t *)(uintptr_t)IMAGE_A_START_ADD)
+#define IMAGE_B         ((uint8_t *)(uintptr_t)IMAGE_B_START_ADD)
+
+#define INCOMPLETE      0xFE    // run(): the stream ended without an error
+
+#define CHECK(c, ...)                                    \
+    do {                                                 \
+        if(!(c)) {                                       \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);  \
+            printf(__VA_ARGS__);                         \
+            printf("\n");                                \
+            exit(1);                                     \
+        }                                                \
+    } while(0)
+
+static uint8_t  old_img[IMAGE_SIZE], new_img[IMAGE_SIZE];
+static uint32_t old_len, new_len;
+
+static uint8_t  delta[2 * IMAGE_SIZE], lz4[2 * IMAGE_SIZE], bad[2 * IMAGE_SIZE];
+static uint32_t delta_len, lz4_len;
+
+static uint32_t fail_off;   // run(): offset of the frame that was refused
+
+static long          fail_write = -1; // FLASH_ROM_WRITE call that reports an error
+static unsigned long writes;
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+static void flash_protect(uint8_t *p, uint32_t len, int writable)
+{
+    CHECK(mprotect(p, len, writable ? PROT_READ | PROT_WRITE : PROT_READ) == 0, "mprotect");
+}
+
+uint32_t sim_flash_write(uint32_t addr, const void *buf, uint32_t len)
+{
+    uint8_t *p = (uint8_t *)(uintptr_t)addr;
+    uint32_t i;
+
+    CHECK(!(addr & 3) && !(len & 3) && !((uintptr_t)buf & 3), "unaligned program of %u bytes at %08x", len, addr);
+    CHECK(addr >= IMAGE_B_START_ADD && len && len <= IMAGE_B_START_ADD + IMAGE_B_SIZE - addr,
+          "program of %u bytes at %08x, outside imageB", len, addr);
+    if(writes++ == (unsigned long)fail_write)
+    {
+        return 1;
+    }
+    ASAN_UNPOISON_MEMORY_REGION(p, len);
+    for(i = 0; i < len; i++)
+    {
+        CHECK(p[i] == 0xFF, "imageB+%u programmed twice", addr - IMAGE_B_START_ADD + i);
+    }
+    flash_protect(IMAGE_B, IMAGE_B_SIZE, 1);
+    memcpy(p, buf, len);
+    flash_protect(IMAGE_B, IMAGE_B_SIZE, 0);
+    return 0;
+}
+
+static void flash_map(void)
+{
+    void *p = mmap((void *)(uintptr_t)FLASH_SIM_BASE, FLASH_SIM_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    CHECK(p == (void *)(uintptr_t)FLASH_SIM_BASE, "cannot map the simulated flash at %08x", FLASH_SIM_BASE);
+    /* the flash below imageA is none of the parser's business */
+    ASAN_POISON_MEMORY_REGION(p, IMAGE_A_START_ADD - FLASH_SIM_BASE);
+}
+
+/* imageA holds img, nothing past it may be read */
+static void flash_load_a(const uint8_t *img, uint32_t len)
+{
+    flash_protect(IMAGE_A, IMAGE_A_SIZE, 1);
+    ASAN_UNPOISON_MEMORY_REGION(IMAGE_A, IMAGE_A_SIZE);
+    memset(IMAGE_A, 0xFF, IMAGE_A_SIZE);
+    memcpy(IMAGE_A, img, len);
+    flash_protect(IMAGE_A, IMAGE_A_SIZE, 0);
+    ASAN_POISON_MEMORY_REGION(IMAGE_A + len, IMAGE_A_SIZE - len);
+}
+
+/* CMD_IAP_ERASE of imageB, nothing may be read before it is programmed */
+static void flash_erase_b(void)
+{
+    flash_protect(IMAGE_B, IMAGE_B_SIZE, 1);
+    ASAN_UNPOISON_MEMORY_REGION(IMAGE_B, IMAGE_B_SIZE);
+    memset(IMAGE_B, 0xFF, IMAGE_B_SIZE);
+    flash_protect(IMAGE_B, IMAGE_B_SIZE, 0);
+    ASAN_POISON_MEMORY_REGION(IMAGE_B, IMAGE_B_SIZE);
+    writes = 0;
+}
+
+static uint8_t finish(uint8_t status)
+{
+    while(status == OTA_DELTA_BUSY)
+    {
+        status = OTA_DeltaDigestStep();
+    }
+    return status;
+}
+
+/*
+ * Feed a stream as peripheral.c does, frame bytes per body frame, into a
+ * freshly erased imageB; resend repeats every frame as after a lost ack.
+ * Returns the first error, SUCCESS once the image is complete, or INCOMPLETE.
+ */
+static uint8_t run(const uint8_t *s, uint32_t len, uint16_t frame, int resend)
+{
+    uint32_t off = 0;
+    uint16_t n;
+    uint8_t  status;
+
+    flash_erase_b();
+    OTA_DeltaReset();
+    while(off < len)
+    {
+        n = off ? MIN(frame, len - off) : MIN(OTA_DELTA_HEAD_LEN, len);
+        status = finish(OTA_DeltaWrite(off, s + off, n));
+        if(status != SUCCESS)
+        {
+            CHECK(!OTA_DeltaIsComplete(), "complete after error %02x", status);
+            fail_off = off;
+            return status;
+        }
+        if(resend)
+        {
+            CHECK(OTA_DeltaWrite(off, s + off, n) == SUCCESS, "frame at %u sent again", off);
+        }
+        off += n;
+    }
+    return OTA_DeltaIsComplete() ? SUCCESS : INCOMPLETE;
+}
+
+static void expect_image(const uint8_t *s, uint32_t len, uint16_t frame, int resend, const uint8_t *img,
+                         uint32_t img_len)
+{
+    uint8_t status = run(s, len, frame, resend);
+
+    CHECK(status == SUCCESS, "%u byte frames%s: %02x", frame, resend ? ", sent twice" : "", status);
+    CHECK(memcmp(IMAGE_B, img, img_len) == 0, "%u byte frames: imageB differs from the new image", frame);
+}
+
+static void expect_good(const uint8_t *s, uint32_t len, uint16_t frame, int resend)
+{
+    expect_image(s, len, frame, resend, new_img, new_len);
+}
+
+/* a damaged stream may only pass if it still rebuilds the new image */
+static uint8_t expect_bad(const uint8_t *s, uint32_t len, uint16_t frame)
+{
+    uint8_t status = run(s, len, frame, 0);
+
+    if(status == SUCCESS)
+    {
+        CHECK(memcmp(IMAGE_B, new_img, new_len) == 0, "damaged stream passed with a different image");
+    }
+    else
+    {
+        CHECK(status == OTA_DELTA_ERR_FORMAT || status == OTA_DELTA_ERR_DIGEST, "damaged stream: %02x", status);
+    }
+    return status;
+}
+
+/* header for a body cut to body_len, sealed again so only the body is short */
+static void reseal(uint8_t *s, uint32_t body_len)
+{
+    uint32_t crc;
+
+    memcpy(s + 24, &body_len, 4);
+    crc = OTA_CRC32(0, s, OTA_DELTA_HEAD_LEN - 4);
+    memcpy(s + 28, &crc, 4);
+}
+
+static uint32_t put_varint(uint8_t *p, uint32_t v)
+{
+    uint32_t n = 0;
+
+    while(v > 0x7F)
+    {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+/* stream around a hand-made body, a delta one is made against old_img */
+static uint32_t make_stream(uint8_t *s, uint32_t magic, uint32_t new_size, uint32_t new_crc,
+                            const uint8_t *body, uint32_t body_len)
+{
+    uint32_t head[8] = {magic, OTA_DELTA_VERSION, 0, 0, new_size, new_crc, body_len, 0};
+
+    if(magic == OTA_DELTA_MAGIC)
+    {
+        head[2] = old_len;
+        head[3] = OTA_CRC32(0, old_img, old_len);
+    }
+    head[7] = OTA_CRC32(0, (const uint8_t *)head, OTA_DELTA_HEAD_LEN - 4);
+    memcpy(s, head, OTA_DELTA_HEAD_LEN);
+    memcpy(s + OTA_DELTA_HEAD_LEN, body, body_len);
+    return OTA_DELTA_HEAD_LEN + body_len;
+}
+
+/*
+ * Operations that break the format or reach outside either image. Each one is
+ * otherwise well formed and would rebuild a new image, or read or program
+ * flash the simulation refuses, if the parser let it through.
+ */
+static void test_delta_malformed(void)
+{
+    static uint8_t body[IMAGE_B_SIZE + 2 * EEPROM_PAGE_SIZE];
+    uint8_t        out[4] = {0};
+    uint32_t       n, len, new_size;
+    uint8_t        status;
+    int            k;
+
+    for(k = 0; k < 16; k++)
+    {
+        n = 0;
+        new_size = 1;
+        if(k >= 5 && k <= 7)
+        {
+            /* a diff over the last 8 bytes of the old image */
+            body[n++] = OTA_DELTA_OP_SEEK;
+            n += put_varint(body + n, 2 * (old_len - 8));
+            body[n++] = OTA_DELTA_OP_DIFF;
+            body[n++] = 8;
+            new_size = 64;
+        }
+        switch(k)
+        {
+            case 0: // seek past the end of the old image
+                body[n++] = OTA_DELTA_OP_SEEK;
+                n += put_varint(body + n, 2 * (old_len + 1));
+                body[n++] = OTA_DELTA_OP_DIFF;
+                body[n++] = 1;
+                body[n++] = 1;
+                break;
+            case 1: // to its end, then read from there
+                body[n++] = OTA_DELTA_OP_SEEK;
+                n += put_varint(body + n, 2 * old_len);
+                body[n++] = OTA_DELTA_OP_DIFF;
+                body[n++] = 1;
+                body[n++] = 1;
+                break;
+            case 2: // seek before its start, and back
+                body[n++] = OTA_DELTA_OP_SEEK;
+                body[n++] = 1;
+                body[n++] = OTA_DELTA_OP_SEEK;
+                body[n++] = 2;
+                body[n++] = OTA_DELTA_OP_DIFF;
+                body[n++] = 1;
+                body[n++] = 1;
+                out[0] = old_img[0];
+                break;
+            case 3: // diff longer than the old image
+                new_size = old_len + 1;
+                body[n++] = OTA_DELTA_OP_DIFF;
+                n += put_varint(body + n, new_size);
+                n += put_varint(body + n, new_size);
+                break;
+            case 4: // a page more than imageB holds
+                new_size = IMAGE_B_SIZE;
+                body[n++] = OTA_DELTA_OP_EXTRA;
+                n += put_varint(body + n, IMAGE_B_SIZE + EEPROM_PAGE_SIZE);
+                memset(body + n, 0, IMAGE_B_SIZE + EEPROM_PAGE_SIZE);
+                n += IMAGE_B_SIZE + EEPROM_PAGE_SIZE;
+                break;
+            case 5: // more unchanged bytes than the diff
+                body[n++] = 9;
+                break;
+            case 6: // empty changed run
+                body[n++] = 2;
+                body[n++] = 0;
+                memset(body + n, 0, 10);
+                n += 10;
+                break;
+            case 7: // more changed bytes than the diff
+                body[n++] = 2;
+                body[n++] = 7;
+                memset(body + n, 0, 7);
+                n += 7;
+                body[n++] = 16;
+                break;
+            case 8: // unknown operations, with a seek argument
+            case 9:
+                body[n++] = (k == 8) ? 0 : OTA_DELTA_OP_SEEK + 1;
+                body[n++] = 0;
+                body[n++] = OTA_DELTA_OP_EXTRA;
+                body[n++] = 1;
+                body[n++] = 0xA5;
+                out[0] = 0xA5;
+                break;
+            case 10: // varint longer than 32 bits
+                body[n++] = OTA_DELTA_OP_EXTRA;
+                memset(body + n, 0x80, 5);
+                n += 5;
+                body[n++] = 0;
+                break;
+            case 11: // body ends inside an operation
+                body[n++] = OTA_DELTA_OP_EXTRA;
+                body[n++] = 1;
+                break;
+            case 12: // body ends before the new image does
+                body[n++] = OTA_DELTA_OP_EXTRA;
+                body[n++] = 1;
+                body[n++] = 0;
+                new_size = 2;
+                break;
+            case 13: // body ends inside a varint
+                body[n++] = OTA_DELTA_OP_EXTRA;
+                body[n++] = 0x80;
+                break;
+            case 14: // body ends with an operation code, the image complete
+                body[n++] = OTA_DELTA_OP_EXTRA;
+                body[n++] = 1;
+                body[n++] = 0xA5;
+                body[n++] = OTA_DELTA_OP_SEEK;
+                out[0] = 0xA5;
+                break;
+            default: // a diff that runs a page past imageB
+                new_size = IMAGE_B_SIZE;
+                body[n++] = OTA_DELTA_OP_EXTRA;
+                n += put_varint(body + n, IMAGE_B_SIZE - 64);
+                memset(body + n, 0, IMAGE_B_SIZE - 64);
+                n += IMAGE_B_SIZE - 64;
+                body[n++] = OTA_DELTA_OP_DIFF;
+                n += put_varint(body + n, 64 + EEPROM_PAGE_SIZE);
+                n += put_varint(body + n, 64 + EEPROM_PAGE_SIZE);
+                break;
+        }
+        len = make_stream(bad, OTA_DELTA_MAGIC, new_size, OTA_CRC32(0, out, MIN(new_size, sizeof(out))), body, n);
+        status = run(bad, len, 240, 0);
+        CHECK(status == OTA_DELTA_ERR_FORMAT, "malformed patch %d: %02x", k, status);
+    }
+
+    /* header fields out of range, sealed with a good CRC */
+    memset(body, 0, 8);
+    for(k = 0; k < 5; k++)
+    {
+        len = make_stream(bad, OTA_DELTA_MAGIC, 64, 0, body, 8);
+        switch(k)
+        {
+            case 0: // version
+                bad[4] = OTA_DELTA_VERSION + 1;
+                break;
+            case 1: // old image size
+            case 2:
+                n = (k == 1) ? IMAGE_A_SIZE + 1 : 0;
+                memcpy(bad + 8, &n, 4);
+                break;
+            default: // new image size
+                n = (k == 3) ? IMAGE_B_SIZE + 1 : 0;
+                memcpy(bad + 16, &n, 4);
+                break;
+        }
+        reseal(bad, 8);
+        status = run(bad, len, 16, 0);
+        CHECK(status == OTA_DELTA_ERR_HEAD, "header field %d out of range: %02x", k, status);
+    }
+    len = make_stream(bad, OTA_DELTA_MAGIC, 64, 0, body, 0);
+    CHECK(run(bad, len, 16, 0) == OTA_DELTA_ERR_HEAD, "empty body");
+
+    /* a last frame that runs past the body */
+    memcpy(bad, delta, delta_len);
+    bad[delta_len] = OTA_DELTA_OP_EXTRA;
+    CHECK(run(delta, delta_len - 1, 240, 0) == INCOMPLETE, "all but the last byte");
+    status = OTA_DeltaWrite(delta_len - 1, bad + delta_len - 1, 2);
+    CHECK(status == OTA_DELTA_ERR_FORMAT, "frame past the body: %02x", status);
+}
+
+static void test_delta(void)
+{
+    static const uint16_t frames[] = {240, 16};
+    unsigned long         flushes;
+    uint32_t              i, len, rebuilt = 0;
+    uint8_t               status;
+    int                   k;
+
+    flash_load_a(old_img, old_len);
+    for(k = 0; k < 2; k++)
+    {
+        expect_good(delta, delta_len, frames[k], 0);
+    }
+    expect_good(delta, delta_len, 240, 1);
+    flushes = writes;
+
+    /* every header byte is covered by the header CRC */
+    for(i = 0; i < OTA_DELTA_HEAD_LEN; i++)
+    {
+        memcpy(bad, delta, delta_len);
+        bad[i] ^= 1 << (i & 7);
+        status = run(bad, delta_len, 240, 0);
+        CHECK(status == OTA_DELTA_ERR_HEAD, "header byte %u flipped: %02x", i, status);
+    }
+
+    /* a patch for another base image */
+    old_img[old_len / 2] ^= 0x10;
+    flash_load_a(old_img, old_len);
+    status = run(delta, delta_len, 240, 0);
+    CHECK(status == OTA_DELTA_ERR_BASE, "wrong base image: %02x", status);
+    old_img[old_len / 2] ^= 0x10;
+    flash_load_a(old_img, old_len);
+
+    /* cut short: waits for the rest, or fails once the header says it ended */
+    for(len = 0; len < delta_len; len += (len < OTA_DELTA_HEAD_LEN + 64) ? 1 : 37)
+    {
+        status = run(delta, len, 240, 0);
+        CHECK(status == ((len && len < OTA_DELTA_HEAD_LEN) ? OTA_DELTA_ERR_HEAD : INCOMPLETE),
+              "cut to %u bytes: %02x", len, status);
+        if(len > OTA_DELTA_HEAD_LEN)
+        {
+            memcpy(bad, delta, len);
+            reseal(bad, len - OTA_DELTA_HEAD_LEN);
+            CHECK(expect_bad(bad, len, 240) != SUCCESS, "cut to %u bytes and resealed: passed", len);
+        }
+    }
+
+    /* body bytes changed */
+    for(k = 0; k < 400; k++)
+    {
+        memcpy(bad, delta, delta_len);
+        for(i = 1 + rnd(3); i; i--)
+        {
+            bad[OTA_DELTA_HEAD_LEN + rnd(delta_len - OTA_DELTA_HEAD_LEN)] ^= 1 + rnd(255);
+        }
+        rebuilt += expect_bad(bad, delta_len, 240 >> rnd(2)) == SUCCESS;
+    }
+    printf("delta: %u corrupted patches failed, %u still rebuilt the image\n", 400 - rebuilt, rebuilt);
+
+    /* a program error sticks until the next stream */
+    for(k = 0; k < 3; k++)
+    {
+        fail_write = (long)(k * (flushes - 1) / 2);
+        status = run(delta, delta_len, 240, 0);
+        CHECK(status == OTA_DELTA_ERR_FLASH, "program %ld failed: %02x", fail_write, status);
+        CHECK(OTA_DeltaWrite(0, delta, OTA_DELTA_HEAD_LEN) == OTA_DELTA_ERR_FLASH, "error not kept");
+    }
+    fail_write = -1;
+
+    /* out of order: refused without ending the stream */
+    flash_erase_b();
+    OTA_DeltaReset();
+    CHECK(OTA_DeltaWrite(16, delta + 16, 16) == OTA_DELTA_ERR_SEQ, "first frame not at 0");
+    CHECK(OTA_DeltaWrite(0, delta, OTA_DELTA_HEAD_LEN) == OTA_DELTA_BUSY, "header");
+    CHECK(OTA_DeltaWrite(OTA_DELTA_HEAD_LEN, delta + OTA_DELTA_HEAD_LEN, 16) == OTA_DELTA_ERR_SEQ,
+          "frame during the base check");
+    CHECK(finish(OTA_DELTA_BUSY) == SUCCESS, "base check");
+    CHECK(OTA_DeltaWrite(OTA_DELTA_HEAD_LEN + 16, delta + OTA_DELTA_HEAD_LEN + 16, 16) == OTA_DELTA_ERR_SEQ,
+          "frame skipped");
+    for(i = OTA_DELTA_HEAD_LEN; i < delta_len; i += len)
+    {
+        len = MIN(240, delta_len - i);
+        status = finish(OTA_DeltaWrite(i, delta + i, len));
+        CHECK(status == SUCCESS, "frame at %u after refused frames: %02x", i, status);
+    }
+    CHECK(OTA_DeltaIsComplete() && memcmp(IMAGE_B, new_img, new_len) == 0, "image after refused frames");
+    CHECK(OTA_DeltaWrite(delta_len, delta, 16) == OTA_DELTA_ERR_SEQ, "frame after the end");
+}
+
+/* LZ4 length extension bytes for n */
+static uint32_t put_lz4_len(uint8_t *p, uint32_t n)
+{
+    uint32_t k = 0;
+
+    for(; n >= 255; n -= 255)
+    {
+        p[k++] = 255;
+    }
+    p[k++] = (uint8_t)n;
+    return k;
+}
+
+/* a compressed image from wch_ota.py in the CMD_IAP_PATCH frame sizes */
+static void test_lz4(void)
+{
+    static const uint16_t frames[] = {128, 240};
+    uint32_t              i, len, rebuilt = 0;
+    uint8_t               status;
+    int                   k;
+
+    for(k = 0; k < 2; k++)
+    {
+        expect_good(lz4, lz4_len, frames[k], 0);
+        expect_good(lz4, lz4_len, frames[k], 1);
+    }
+
+    for(i = 0; i < OTA_DELTA_HEAD_LEN; i++)
+    {
+        memcpy(bad, lz4, lz4_len);
+        bad[i] ^= 1 << (i & 7);
+        status = run(bad, lz4_len, 128, 0);
+        CHECK(status == OTA_DELTA_ERR_HEAD, "header byte %u flipped: %02x", i, status);
+    }
+
+    /* the header of a compressed image names no old image */
+    for(k = 0; k < 2; k++)
+    {
+        memcpy(bad, lz4, lz4_len);
+        bad[k ? 8 : 3] ^= 1;
+        reseal(bad, lz4_len - OTA_DELTA_HEAD_LEN);
+        status = run(bad, lz4_len, 128, 0);
+        CHECK(status == OTA_DELTA_ERR_HEAD, "%s: %02x", k ? "old image size set" : "unknown magic", status);
+    }
+
+    for(len = 0; len < lz4_len; len += (len < OTA_DELTA_HEAD_LEN + 64) ? 1 : 997)
+    {
+        status = run(lz4, len, frames[len & 1], 0);
+        CHECK(status == ((len && len < OTA_DELTA_HEAD_LEN) ? OTA_DELTA_ERR_HEAD : INCOMPLETE),
+              "cut to %u bytes: %02x", len, status);
+        if(len > OTA_DELTA_HEAD_LEN)
+        {
+            memcpy(bad, lz4, len);
+            reseal(bad, len - OTA_DELTA_HEAD_LEN);
+            CHECK(expect_bad(bad, len, frames[len & 1]) != SUCCESS, "cut to %u bytes and resealed: passed", len);
+        }
+    }
+
+    for(k = 0; k < 300; k++)
+    {
+        memcpy(bad, lz4, lz4_len);
+        for(i = 1 + rnd(3); i; i--)
+        {
+            bad[OTA_DELTA_HEAD_LEN + rnd(lz4_len - OTA_DELTA_HEAD_LEN)] ^= 1 + rnd(255);
+        }
+        rebuilt += expect_bad(bad, lz4_len, frames[k & 1]) == SUCCESS;
+    }
+    printf("lz4: %u corrupted streams failed, %u still rebuilt the image\n", 300 - rebuilt, rebuilt);
+}
+
+/*
+ * Offsets and lengths that reach outside the image. Each stream would
+ * otherwise complete, or read or program flash the simulation refuses.
+ * In 16 byte frames the frame holding the bad field must be the one
+ * refused.
+ */
+static void test_lz4_malformed(void)
+{
+    static const uint16_t frames[] = {16, 128, 240};
+    static uint8_t        body[4096], out[IMAGE_SIZE];
+    uint32_t              n, at, len, new_size, run_len;
+    uint8_t               status;
+    int                   k, f;
+
+    for(k = 0; k < 11; k++)
+    {
+        memset(out, 0, sizeof(out));
+        memcpy(body, "\x40" "abcd", 5);
+        n = 5;
+        new_size = 8;
+        switch(k)
+        {
+            case 0: // offset 0, the erased RAM window would be copied
+                body[n++] = 0;
+                body[n++] = 0;
+                at = n - 1;
+                body[n++] = 0x10;
+                body[n++] = 'z';
+                new_size = 9;
+                memcpy(out, "abcd\xFF\xFF\xFF\xFF" "z", 9);
+                break;
+            case 1: // offset before the start of the image
+                body[n++] = 5;
+                body[n++] = 0;
+                at = n - 1;
+                body[n++] = 0x10;
+                body[n++] = 'z';
+                new_size = 9;
+                break;
+            case 2: // the same once a page is programmed, reaching into imageA
+                n = 0;
+                body[n++] = 0xF0;
+                n += put_lz4_len(body + n, 300 - 15);
+                memset(body + n, 0x5A, 300);
+                n += 300;
+                body[n++] = 301 & 0xFF;
+                body[n++] = 301 >> 8;
+                at = n - 1;
+                body[n++] = 0x10;
+                body[n++] = 'z';
+                new_size = 305;
+                break;
+            case 3: // literal length past the image
+                n = 0;
+                new_size = 100;
+                body[n++] = 0xF0;
+                at = n;
+                n += put_lz4_len(body + n, new_size + 1 - 15);
+                memset(body + n, 0, new_size + 1);
+                n += new_size + 1;
+                break;
+            case 4: // literals past the image, then matches
+                new_size = 4;
+                body[0] = 0x50;
+                body[n++] = 'e';
+                at = n - 1;
+                for(f = 0; f < 10; f++)
+                {
+                    memcpy(body + n, "\x01\x00\x00", 3);
+                    n += 3;
+                }
+                break;
+            case 5: // a sequence after the image is complete
+                new_size = 4;
+                at = n;
+                memcpy(body + n, "\x00\x01\x00", 3);
+                n += 3;
+                break;
+            case 6: // a match that runs a page past imageB
+                new_size = IMAGE_B_SIZE;
+                body[0] = 0x4F;
+                body[n++] = 1;
+                body[n++] = 0;
+                n += put_lz4_len(body + n, IMAGE_B_SIZE / 2 - 8 - 15);
+                body[n++] = 0x0F;
+                body[n++] = 1;
+                body[n++] = 0;
+                n += put_lz4_len(body + n, IMAGE_B_SIZE / 2 + EEPROM_PAGE_SIZE - 4 - 15);
+                at = n - 1;
+                break;
+            case 7: // match length extension past the image
+                new_size = 64;
+                body[0] = 0x4F;
+                body[n++] = 1;
+                body[n++] = 0;
+                at = n;
+                memset(body + n, 255, 40);
+                n += 40;
+                body[n++] = 0;
+                break;
+            case 8: // body ends inside an offset
+                body[n++] = 1;
+                at = n - 1;
+                break;
+            case 9: // body ends inside a literal length
+                n = 0;
+                body[n++] = 0xF0;
+                body[n++] = 255;
+                at = n - 1;
+                new_size = 64;
+                break;
+            default: // body ends before the image does
+                at = n - 1;
+                break;
+        }
+        len = make_stream(bad, OTA_LZ4_MAGIC, new_size, OTA_CRC32(0, out, new_size), body, n);
+        for(f = 0; f < 3; f++)
+        {
+            status = run(bad, len, frames[f], 0);
+            CHECK(status == OTA_DELTA_ERR_FORMAT, "malformed stream %d, %u byte frames: %02x", k, frames[f], status);
+            CHECK(f || fail_off == OTA_DELTA_HEAD_LEN + (at & ~15), "malformed stream %d refused at %u, not %u", k,
+                  fail_off, OTA_DELTA_HEAD_LEN + (at & ~15));
+        }
+    }
+
+    /* offset 1 through flushed pages, then the longest offset, read back from flash */
+    n = 0;
+    body[n++] = 0xFF;
+    n += put_lz4_len(body + n, 300 - 15);
+    for(len = 0; len < 300; len++)
+    {
+        body[n++] = out[len] = (uint8_t)rnd(256);
+    }
+    run_len = 65600 - 300;
+    body[n++] = 1;
+    body[n++] = 0;
+    n += put_lz4_len(body + n, run_len - 4 - 15);
+    memset(out + len, out[len - 1], run_len);
+    len += run_len;
+    run_len = 200;
+    body[n++] = 0x0F;
+    body[n++] = 0xFF;
+    body[n++] = 0xFF;
+    n += put_lz4_len(body + n, run_len - 4 - 15);
+    memcpy(out + len, out + len - 0xFFFF, run_len);
+    len += run_len;
+    body[n++] = 0x50;
+    memcpy(body + n, "tail!", 5);
+    memcpy(out + len, "tail!", 5);
+    n += 5;
+    len += 5;
+    new_size = len;
+    len = make_stream(bad, OTA_LZ4_MAGIC, new_size, OTA_CRC32(0, out, new_size), body, n);
+    for(f = 0; f < 3; f++)
+    {
+        expect_image(bad, len, frames[f], 0, out, new_size);
+    }
+
+    /* the offset back to the first byte */
+    len = make_stream(bad, OTA_LZ4_MAGIC, 9, OTA_CRC32(0, (const uint8_t *)"abcdabcdz", 9),
+                      (const uint8_t *)"\x40" "abcd\x04\x00\x10z", 9);
+    expect_image(bad, len, 16, 0, (const uint8_t *)"abcdabcdz", 9);
+}
+
+/* firmware-like images: runs of noise and repeats, the new one edited */
+static void gen(void)
+{
+    uint32_t n, from;
+
+    while(old_len < 96 * 1024)
+    {
+        n = 16 + rnd(400);
+        if(rnd(2) && old_len > 512)
+        {
+            from = rnd(old_len - 300);
+            for(n = 8 + rnd(292); n; n--)
+            {
+                old_img[old_len++] = old_img[from++];
+            }
+        }
+        else
+        {
+            while(n--)
+            {
+                old_img[old_len++] = (uint8_t)rnd(256);
+            }
+        }
+    }
+    memcpy(new_img, old_img, 30000);
+    for(n = 0; n < 1024; n++)
+    {
+        new_img[30000 + n] = (uint8_t)n;
+    }
+    memcpy(new_img + 31024, old_img + 30000, 20000);
+    memcpy(new_img + 51024, old_img + 52000, old_len - 52000);
+    new_len = 51024 + old_len - 52000;
+    for(n = 0; n < new_len; n += 3001)
+    {
+        new_img[n] ^= 0x5A;
+    }
+    for(n = 0; n < 2000; n++)
+    {
+        new_img[new_len++] = (uint8_t)rnd(256);
+    }
+}
+
+static uint32_t load(const char *path, uint8_t *buf, uint32_t max)
+{
+    FILE    *f = fopen(path, "rb");
+    uint32_t len;
+
+    CHECK(f, "cannot open %s", path);
+    len = fread(buf, 1, max, f);
+    CHECK(len && len < max && feof(f), "%s: bad size", path);
+    fclose(f);
+    return len;
+}
+
+static void save(const char *path, const uint8_t *buf, uint32_t len)
+{
+    FILE *f = fopen(path, "wb");
+
+    CHECK(f && fwrite(buf, 1, len, f) == len && fclose(f) == 0, "cannot write %s", path);
+}
+
+int main(int argc, char **argv)
+{
+    if(argc == 4 && strcmp(argv[1], "gen") == 0)
+    {
+        gen();
+        save(argv[2], old_img, old_len);
+        save(argv[3], new_img, new_len);
+        return 0;
+    }
+    CHECK(argc == 5, "usage: ota_delta_test gen <old> <new> | <old> <new> <delta patch> <compressed image>");
+
+    old_len = load(argv[1], old_img, sizeof(old_img));
+    new_len = load(argv[2], new_img, sizeof(new_img));
+    delta_len = load(argv[3], delta, sizeof(delta));
+    lz4_len = load(argv[4], lz4, sizeof(lz4));
+    flash_map();
+
+    test_delta();
+    test_delta_malformed();
+    test_lz4();
+    test_lz4_malformed();
+    printf("ota_delta ok\n");
+    return 0;
+}
@@ -44,8 +44,12 @@ void Lib_Calibration_LSI(void)
  */
 uint32_t Lib_Read_Flash(uint32_t addr, uint32_t num, uint32_t *pBuf)
 {
+#if(defined(BLE_SNV_JOURNAL)) && (BLE_SNV_JOURNAL == TRUE)
+    return SNV_JournalRead(addr, num * 4, (uint8_t *)pBuf);
+#else
     EEPROM_READ(addr, pBuf, num * 4);
     return 0;
+#endif
 }
 
 /*******************************************************************************
@@ -61,9 +65,13 @@ uint32_t Lib_Read_Flash(uint32_t addr, uint32_t num, uint32_t *pBuf)
  */
 uint32_t Lib_Write_Flash(uint32_t addr, uint32_t num, uint32_t *pBuf)
 {
+#if(defined(BLE_SNV_JOURNAL)) && (BLE_SNV_JOURNAL == TRUE)
+    return SNV_JournalWrite(addr, num * 4, (uint8_t *)pBuf);
+#else
     EEPROM_ERASE(addr, num * 4);
     EEPROM_WRITE(addr, pBuf, num * 4);
     return 0;
+#endif
 }
 #endif
 
@@ -105,6 +113,9 @@ void CH58X_BLEInit(void)
     cfg.SNVAddr = (uint32_t)BLE_SNV_ADDR;
     cfg.SNVBlock = (uint32_t)BLE_SNV_BLOCK;
     cfg.SNVNum = (uint32_t)BLE_SNV_NUM;
+  #if(defined(BLE_SNV_JOURNAL)) && (BLE_SNV_JOURNAL == TRUE)
+    SNV_JournalInit();
+  #endif
     cfg.readFlashCB = Lib_Read_Flash;
     cfg.writeFlashCB = Lib_Write_Flash;
 #endif
@@ -0,0 +1,482 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : SNV.c
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : Append-only, wear-levelled journal behind the BLE SNV
+ *                      flash callbacks
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+/******************************************************************************/
+/* Layout
+ *
+ * The logical SNV region seen by the BLE library is cut into units of
+ * SNV_JOURNAL_UNIT bytes. Every change of a unit is appended as a record to
+ * a ring of BLE_SNV_JOURNAL_PAGES Data-Flash pages, a RAM index keeps the
+ * location of the newest copy of each unit.
+ *
+ * page   : | magic(4) | seq(4) | record 0 | record 1 | ... |
+ * record : | unit | crc8 | ~unit | state | data[SNV_JOURNAL_UNIT] |
+ *
+ * A record is programmed with state 0xFF and committed by clearing the state
+ * byte afterwards, so a write cut by power loss is ignored on the next scan.
+ * Page headers follow the same rule, the magic is written after the seq.
+ * Pages are used in ring order with increasing seq. One page is always kept
+ * erased; when the head reaches it the oldest page is compacted: its live
+ * units are copied to the new head page, then it is erased.
+ *
+ * test/snv_journal_test.c runs this file on the host against a simulated
+ * Data-Flash image, including ring wrap, reclaim and power cuts.
+ */
+#include "HAL.h"
+
+#if(defined(BLE_SNV)) && (BLE_SNV == TRUE) && (defined(BLE_SNV_JOURNAL)) && (BLE_SNV_JOURNAL == TRUE)
+
+/* Data-Flash primitives, may be redirected to a simulated image */
+#ifndef SNV_FLASH_READ
+#define SNV_FLASH_READ(addr, buf, len)     EEPROM_READ(addr, buf, len)
+#endif
+#ifndef SNV_FLASH_WRITE
+#define SNV_FLASH_WRITE(addr, buf, len)    EEPROM_WRITE(addr, buf, len)
+#endif
+#ifndef SNV_FLASH_ERASE
+#define SNV_FLASH_ERASE(addr, len)         EEPROM_ERASE(addr, len)
+#endif
+
+#define SNV_PAGE_SIZE          EEPROM_PAGE_SIZE
+#define SNV_PAGE_HDR_SIZE      8
+#define SNV_REC_HDR_SIZE       4
+#define SNV_REC_SIZE           (SNV_REC_HDR_SIZE + SNV_JOURNAL_UNIT)
+#define SNV_REC_PER_PAGE       ((SNV_PAGE_SIZE - SNV_PAGE_HDR_SIZE) / SNV_REC_SIZE)
+#define SNV_PAGE_MAGIC         0x4A564E53 // "SNVJ"
+#define SNV_STATE_COMMIT       0x00
+#define SNV_INDEX_NONE         0xFFFF
+
+/* Besides the spare page and the head, the ring must be able to hold every
+ * unit with room to spare: then not every page can be fully live, and
+ * SNV_RecordWrite() finds a free slot after at most BLE_SNV_JOURNAL_PAGES - 1
+ * advances */
+#if(BLE_SNV_JOURNAL_PAGES < 3) || ((BLE_SNV_JOURNAL_PAGES - 2) * SNV_REC_PER_PAGE <= SNV_JOURNAL_UNIT_NUM)
+#error "BLE_SNV_JOURNAL_PAGES too small for the SNV size"
+#endif
+
+#if(SNV_JOURNAL_UNIT_NUM > 0xFF)
+#error "SNV_JOURNAL_UNIT too small for the SNV size"
+#endif
+
+#if(BLE_SNV_JOURNAL_ADDR < BLE_SNV_ADDR + SNV_JOURNAL_SIZE) && \
+    (BLE_SNV_JOURNAL_ADDR + BLE_SNV_JOURNAL_PAGES * SNV_PAGE_SIZE > BLE_SNV_ADDR)
+#define SNV_IMPORT_LEGACY      0 // journal overlaps the legacy block, nothing to import
+#else
+#define SNV_IMPORT_LEGACY      1
+#endif
+
+static uint16_t snvIndex[SNV_JOURNAL_UNIT_NUM];  // journal offset of the newest record
+static uint32_t snvPageSeq[BLE_SNV_JOURNAL_PAGES]; // 0 - page free
+static uint32_t snvSeq;
+static uint8_t  snvHead;
+static uint8_t  snvSlot;
+static uint8_t  snvReady = FALSE;
+
+/*******************************************************************************
+ * @fn      SNV_Crc8
+ *
+ * @brief   CRC-8 (poly 0x07) over the unit number and its data
+ */
+static uint8_t SNV_Crc8(uint8_t unit, const uint8_t *pData)
+{
+    uint8_t crc = 0;
+    uint8_t i, j;
+    uint8_t b;
+
+    for(i = 0; i <= SNV_JOURNAL_UNIT; i++)
+    {
+        b = (i == 0) ? unit : pData[i - 1];
+        crc ^= b;
+        for(j = 0; j < 8; j++)
+        {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint32_t SNV_PageAddr(uint8_t page)
+{
+    return BLE_SNV_JOURNAL_ADDR + (uint32_t)page * SNV_PAGE_SIZE;
+}
+
+static uint16_t SNV_SlotOffset(uint8_t page, uint8_t slot)
+{
+    return (uint16_t)(page * SNV_PAGE_SIZE + SNV_PAGE_HDR_SIZE + slot * SNV_REC_SIZE);
+}
+
+/*******************************************************************************
+ * @fn      SNV_IsBlank
+ *
+ * @brief   Check that a flash range still reads as erased
+ */
+static uint8_t SNV_IsBlank(uint32_t addr, uint32_t len)
+{
+    uint32_t buf[8];
+    uint32_t n, i;
+
+    while(len)
+    {
+        n = (len > sizeof(buf)) ? sizeof(buf) : len;
+        SNV_FLASH_READ(addr, buf, n);
+        for(i = 0; i < n; i++)
+        {
+            if(((uint8_t *)buf)[i] != 0xFF)
+            {
+                return FALSE;
+            }
+        }
+        addr += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+/*******************************************************************************
+ * @fn      SNV_PageOpen
+ *
+ * @brief   Erase a page if needed and make it the new head
+ */
+static void SNV_PageOpen(uint8_t page)
+{
+    uint32_t hdr[2];
+    uint32_t addr = SNV_PageAddr(page);
+
+    if(!SNV_IsBlank(addr, SNV_PAGE_SIZE))
+    {
+        SNV_FLASH_ERASE(addr, SNV_PAGE_SIZE);
+    }
+    /* seq first, the magic validates the header once seq is complete */
+    hdr[0] = SNV_PAGE_MAGIC;
+    hdr[1] = ++snvSeq;
+    SNV_FLASH_WRITE(addr + 4, &hdr[1], 4);
+    SNV_FLASH_WRITE(addr, &hdr[0], 4);
+    snvPageSeq[page] = snvSeq;
+    snvHead = page;
+    snvSlot = 0;
+}
+
+static void SNV_Advance(void);
+
+/*******************************************************************************
+ * @fn      SNV_RecordWrite
+ *
+ * @brief   Append one unit to the head page and commit it
+ */
+static void SNV_RecordWrite(uint8_t unit, const uint8_t *pData)
+{
+    __attribute__((aligned(4))) uint8_t rec[SNV_REC_SIZE];
+    uint32_t state = SNV_STATE_COMMIT; // aligned scratch word, little endian: the byte written is the low one
+    uint16_t offset;
+
+    /* a fully live page reclaimed into the new head leaves it full too */
+    while(snvSlot >= SNV_REC_PER_PAGE)
+    {
+        SNV_Advance();
+    }
+    offset = SNV_SlotOffset(snvHead, snvSlot);
+
+    rec[0] = unit;
+    rec[1] = SNV_Crc8(unit, pData);
+    rec[2] = (uint8_t)~unit;
+    rec[3] = 0xFF;
+    tmos_memcpy(&rec[SNV_REC_HDR_SIZE], pData, SNV_JOURNAL_UNIT);
+    SNV_FLASH_WRITE(BLE_SNV_JOURNAL_ADDR + offset, rec, SNV_REC_SIZE);
+    SNV_FLASH_WRITE(BLE_SNV_JOURNAL_ADDR + offset + 3, &state, 1);
+
+    snvIndex[unit] = offset;
+    snvSlot++;
+}
+
+/*******************************************************************************
+ * @fn      SNV_Reclaim
+ *
+ * @brief   Move the live units of a page to the head and erase it
+ */
+static void SNV_Reclaim(uint8_t page)
+{
+    __attribute__((aligned(4))) uint8_t data[SNV_JOURNAL_UNIT];
+    uint16_t lo = (uint16_t)(page * SNV_PAGE_SIZE);
+    uint16_t hi = lo + SNV_PAGE_SIZE;
+    uint8_t  u;
+
+    for(u = 0; u < SNV_JOURNAL_UNIT_NUM; u++)
+    {
+        if(snvIndex[u] != SNV_INDEX_NONE && snvIndex[u] >= lo && snvIndex[u] < hi)
+        {
+            SNV_FLASH_READ(BLE_SNV_JOURNAL_ADDR + snvIndex[u] + SNV_REC_HDR_SIZE, data, SNV_JOURNAL_UNIT);
+            SNV_RecordWrite(u, data);
+        }
+    }
+    SNV_FLASH_ERASE(SNV_PageAddr(page), SNV_PAGE_SIZE);
+    snvPageSeq[page] = 0;
+}
+
+/*******************************************************************************
+ * @fn      SNV_Advance
+ *
+ * @brief   Open the spare page as head, compact the oldest page when the
+ *          ring is full. The new head is empty and the oldest page holds at
+ *          most SNV_REC_PER_PAGE live units, so the copy always fits, but it
+ *          may fill the head completely.
+ */
+static void SNV_Advance(void)
+{
+    uint8_t next;
+
+    SNV_PageOpen((snvHead + 1) % BLE_SNV_JOURNAL_PAGES);
+    next = (snvHead + 1) % BLE_SNV_JOURNAL_PAGES;
+    if(snvPageSeq[next])
+    {
+        SNV_Reclaim(next);
+    }
+}
+
+/*******************************************************************************
+ * @fn      SNV_UnitLoad
+ *
+ * @brief   Current content of a unit, erased value if never written,
+ *          pData must be 4-byte aligned for SNV_FLASH_READ
+ */
+static void SNV_UnitLoad(uint8_t unit, uint8_t *pData)
+{
+    if(snvIndex[unit] == SNV_INDEX_NONE)
+    {
+        tmos_memset(pData, 0xFF, SNV_JOURNAL_UNIT);
+    }
+    else
+    {
+        SNV_FLASH_READ(BLE_SNV_JOURNAL_ADDR + snvIndex[unit] + SNV_REC_HDR_SIZE, pData, SNV_JOURNAL_UNIT);
+    }
+}
+
+/*******************************************************************************
+ * @fn      SNV_PageScan
+ *
+ * @brief   Index the committed records of a page, returns the first free slot
+ */
+static uint8_t SNV_PageScan(uint8_t page)
+{
+    __attribute__((aligned(4))) uint8_t rec[SNV_REC_SIZE];
+    uint8_t  slot, i, used = 0;
+    uint16_t offset;
+
+    for(slot = 0; slot < SNV_REC_PER_PAGE; slot++)
+    {
+        offset = SNV_SlotOffset(page, slot);
+        SNV_FLASH_READ(BLE_SNV_JOURNAL_ADDR + offset, rec, SNV_REC_SIZE);
+        for(i = 0; i < SNV_REC_SIZE; i++)
+        {
+            if(rec[i] != 0xFF)
+            {
+                used = slot + 1;
+                break;
+            }
+        }
+        if(rec[3] == SNV_STATE_COMMIT && rec[0] < SNV_JOURNAL_UNIT_NUM && rec[2] == (uint8_t)~rec[0] &&
+           rec[1] == SNV_Crc8(rec[0], &rec[SNV_REC_HDR_SIZE]))
+        {
+            snvIndex[rec[0]] = offset;
+        }
+    }
+    return used;
+}
+
+/*******************************************************************************
+ * @fn      SNV_JournalInit
+ *
+ * @brief   Scan the journal pages and rebuild the RAM index, formats the
+ *          ring (importing the legacy SNV block) when no journal is found
+ *
+ * @return  0 - success
+ */
+uint32_t SNV_JournalInit(void)
+{
+    uint32_t hdr[2];
+    uint8_t  p, q, oldest, run;
+    uint8_t  found = FALSE;
+
+    snvSeq = 0;
+    tmos_memset(snvIndex, 0xFF, sizeof(snvIndex));
+    for(p = 0; p < BLE_SNV_JOURNAL_PAGES; p++)
+    {
+        SNV_FLASH_READ(SNV_PageAddr(p), hdr, sizeof(hdr));
+        snvPageSeq[p] = 0;
+        if(hdr[0] == SNV_PAGE_MAGIC && hdr[1] != 0xFFFFFFFF && hdr[1] != 0)
+        {
+            snvPageSeq[p] = hdr[1];
+            if(!found || hdr[1] > snvSeq)
+            {
+                snvSeq = hdr[1];
+                snvHead = p;
+            }
+            found = TRUE;
+        }
+    }
+
+    if(!found)
+    {
+        SNV_PageOpen(0);
+#if(SNV_IMPORT_LEGACY)
+        {
+            __attribute__((aligned(4))) uint8_t data[SNV_JOURNAL_UNIT];
+            uint8_t u, i;
+
+            for(u = 0; u < SNV_JOURNAL_UNIT_NUM; u++)
+            {
+                SNV_FLASH_READ(BLE_SNV_ADDR + u * SNV_JOURNAL_UNIT, data, SNV_JOURNAL_UNIT);
+                for(i = 0; i < SNV_JOURNAL_UNIT; i++)
+                {
+                    if(data[i] != 0xFF)
+                    {
+                        SNV_RecordWrite(u, data);
+                        break;
+                    }
+                }
+            }
+        }
+#endif
+        snvReady = TRUE;
+        return 0;
+    }
+
+    /* the valid pages form one run in ring order ending at the head */
+    oldest = snvHead;
+    for(p = 1; p < BLE_SNV_JOURNAL_PAGES; p++)
+    {
+        q = (snvHead + BLE_SNV_JOURNAL_PAGES - p) % BLE_SNV_JOURNAL_PAGES;
+        if(snvPageSeq[q] == 0 || snvPageSeq[q] >= snvPageSeq[oldest])
+        {
+            break;
+        }
+        oldest = q;
+    }
+    run = (snvHead + BLE_SNV_JOURNAL_PAGES - oldest) % BLE_SNV_JOURNAL_PAGES;
+    for(p = 0; p < BLE_SNV_JOURNAL_PAGES; p++)
+    {
+        q = (oldest + p) % BLE_SNV_JOURNAL_PAGES;
+        if(p <= run)
+        {
+            snvSlot = SNV_PageScan(q);
+        }
+        else
+        {
+            snvPageSeq[q] = 0; // stray page outside the run, erased when reused
+        }
+    }
+
+    /* power lost while compacting, finish it */
+    q = (snvHead + 1) % BLE_SNV_JOURNAL_PAGES;
+    if(q != snvHead && snvPageSeq[q])
+    {
+        SNV_Reclaim(q);
+    }
+    snvReady = TRUE;
+    return 0;
+}
+
+/*******************************************************************************
+ * @fn      SNV_JournalRead
+ *
+ * @brief   Read from the logical SNV region
+ *
+ * @param   addr    - logical address, BLE_SNV_ADDR based
+ * @param   len     - bytes to read
+ * @param   pBuf    - destination
+ *
+ * @return  0 - success
+ */
+uint32_t SNV_JournalRead(uint32_t addr, uint32_t len, uint8_t *pBuf)
+{
+    __attribute__((aligned(4))) uint8_t data[SNV_JOURNAL_UNIT];
+    uint32_t off, n, pos;
+
+    if(!snvReady && SNV_JournalInit())
+    {
+        return 1;
+    }
+    if(addr < BLE_SNV_ADDR || addr + len > BLE_SNV_ADDR + SNV_JOURNAL_SIZE)
+    {
+        return 1;
+    }
+
+    off = addr - BLE_SNV_ADDR;
+    while(len)
+    {
+        pos = off % SNV_JOURNAL_UNIT;
+        n = SNV_JOURNAL_UNIT - pos;
+        if(n > len)
+        {
+            n = len;
+        }
+        SNV_UnitLoad(off / SNV_JOURNAL_UNIT, data);
+        tmos_memcpy(pBuf, &data[pos], n);
+        pBuf += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+ * @fn      SNV_JournalWrite
+ *
+ * @brief   Write to the logical SNV region, only changed units are appended
+ *
+ * @param   addr    - logical address, BLE_SNV_ADDR based
+ * @param   len     - bytes to write
+ * @param   pBuf    - source
+ *
+ * @return  0 - success
+ */
+uint32_t SNV_JournalWrite(uint32_t addr, uint32_t len, const uint8_t *pBuf)
+{
+    __attribute__((aligned(4))) uint8_t data[SNV_JOURNAL_UNIT];
+    uint32_t off, n, pos;
+    uint8_t  unit;
+
+    if(!snvReady && SNV_JournalInit())
+    {
+        return 1;
+    }
+    if(addr < BLE_SNV_ADDR || addr + len > BLE_SNV_ADDR + SNV_JOURNAL_SIZE)
+    {
+        return 1;
+    }
+
+    off = addr - BLE_SNV_ADDR;
+    while(len)
+    {
+        unit = off / SNV_JOURNAL_UNIT;
+        pos = off % SNV_JOURNAL_UNIT;
+        n = SNV_JOURNAL_UNIT - pos;
+        if(n > len)
+        {
+            n = len;
+        }
+        SNV_UnitLoad(unit, data);
+        if(tmos_memcmp(&data[pos], pBuf, n) == FALSE)
+        {
+            tmos_memcpy(&data[pos], pBuf, n);
+            SNV_RecordWrite(unit, data);
+        }
+        pBuf += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+#endif
+
+/******************************** endfile @ snv ******************************/
@@ -0,0 +1,73 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : SNV.h
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        :
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+/******************************************************************************/
+#ifndef __SNV_H
+#define __SNV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+ * CONSTANTS
+ */
+
+// Size of the logical SNV region handled by the journal
+#define SNV_JOURNAL_SIZE         (BLE_SNV_BLOCK * BLE_SNV_NUM)
+
+// Bytes of logical SNV carried by one journal record
+#define SNV_JOURNAL_UNIT         16
+#define SNV_JOURNAL_UNIT_NUM     ((SNV_JOURNAL_SIZE + SNV_JOURNAL_UNIT - 1) / SNV_JOURNAL_UNIT)
+
+/*********************************************************************
+ * FUNCTIONS
+ */
+
+/**
+ * @brief   Scan the journal pages and rebuild the RAM index, formats the
+ *          ring (importing the legacy SNV block) when no journal is found
+ *
+ * @return  0 - success
+ */
+extern uint32_t SNV_JournalInit(void);
+
+/**
+ * @brief   Read from the logical SNV region
+ *
+ * @param   addr    - logical address, BLE_SNV_ADDR based
+ * @param   len     - bytes to read
+ * @param   pBuf    - destination
+ *
+ * @return  0 - success
+ */
+extern uint32_t SNV_JournalRead(uint32_t addr, uint32_t len, uint8_t *pBuf);
+
+/**
+ * @brief   Write to the logical SNV region, only changed units are appended
+ *
+ * @param   addr    - logical address, BLE_SNV_ADDR based
+ * @param   len     - bytes to write
+ * @param   pBuf    - source
+ *
+ * @return  0 - success
+ */
+extern uint32_t SNV_JournalWrite(uint32_t addr, uint32_t len, const uint8_t *pBuf);
+
+/*********************************************************************
+*********************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
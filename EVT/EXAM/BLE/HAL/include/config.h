@@ -53,6 +53,9 @@
  BLE_SNV_ADDR                               - SNVϢַʹdata flash512ֽ( Ĭ:0x77E00 )
  BLE_SNV_BLOCK                              - SNVϢС( Ĭ:256 )
  BLE_SNV_NUM                                - SNVϢ( Ĭ:1 )
+ BLE_SNV_JOURNAL                            - Ƿ־ʽSNV׷д롢ҳĥ( Ĭ:FALSE )
+ BLE_SNV_JOURNAL_PAGES                      - SNV־ҳÿҳ256ֽ( Ĭ:8 )
+ BLE_SNV_JOURNAL_ADDR                       - SNV־ʼַ256ֽڶ( Ĭ:BLE_SNV_ADDR֮ǰ )
 
  RTC
  CLK_OSC32K                                 - RTCʱѡɫʹⲿ32K( 0 ⲿ(32768Hz)Ĭ:1ڲ(32000Hz)2ڲ(32768Hz) )
@@ -120,6 +123,15 @@
 #ifndef BLE_SNV_NUM
 #define BLE_SNV_NUM                         1
 #endif
+#ifndef BLE_SNV_JOURNAL
+#define BLE_SNV_JOURNAL                     FALSE
+#endif
+#ifndef BLE_SNV_JOURNAL_PAGES
+#define BLE_SNV_JOURNAL_PAGES               8
+#endif
+#ifndef BLE_SNV_JOURNAL_ADDR
+#define BLE_SNV_JOURNAL_ADDR                (BLE_SNV_ADDR-BLE_SNV_JOURNAL_PAGES*EEPROM_PAGE_SIZE)
+#endif
 #ifndef CLK_OSC32K
 #define CLK_OSC32K                          1   // ڴ޸ģڹԤ޸ģɫʹⲿ32K
 #endif
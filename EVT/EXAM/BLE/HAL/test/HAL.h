@@ -0,0 +1,38 @@
+/* Host stand-in for HAL.h: just what SNV.c needs, flash redirected to the
+ * simulated image in snv_journal_test.c */
+#ifndef __HAL_H
+#define __HAL_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define TRUE                    1
+#define FALSE                   0
+
+#define EEPROM_PAGE_SIZE        256
+
+#define BLE_SNV                 TRUE
+#define BLE_SNV_JOURNAL         TRUE
+#define BLE_SNV_ADDR            0x77E00
+#define BLE_SNV_BLOCK           256
+#define BLE_SNV_NUM             1
+#ifndef BLE_SNV_JOURNAL_PAGES
+#define BLE_SNV_JOURNAL_PAGES   8
+#endif
+#define BLE_SNV_JOURNAL_ADDR    (BLE_SNV_ADDR - BLE_SNV_JOURNAL_PAGES * EEPROM_PAGE_SIZE)
+
+#define tmos_memcpy             memcpy
+#define tmos_memset             memset
+#define tmos_memcmp(a, b, n)    (memcmp(a, b, n) == 0)
+
+void sim_read(uint32_t addr, void *buf, uint32_t len);
+void sim_write(uint32_t addr, const void *buf, uint32_t len);
+void sim_erase(uint32_t addr, uint32_t len);
+
+#define SNV_FLASH_READ(addr, buf, len)     sim_read(addr, buf, len)
+#define SNV_FLASH_WRITE(addr, buf, len)    sim_write(addr, buf, len)
+#define SNV_FLASH_ERASE(addr, len)         sim_erase(addr, len)
+
+#include "../include/SNV.h"
+
+#endif
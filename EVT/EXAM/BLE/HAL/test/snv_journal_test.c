@@ -0,0 +1,272 @@
+/* Host test for the SNV journal (SNV.c)
+ *
+ * The journal runs against a simulated Data-Flash image: programming can only
+ * clear bits, erase works on whole pages, and any write or erase outside the
+ * journal pages fails the test, as does a read or write buffer that is not
+ * 4-byte aligned (EEPROM_READ/EEPROM_WRITE require it). A RAM model of the
+ * logical SNV region is checked after every write and after every simulated
+ * reboot.
+ *
+ *   make -C EVT/EXAM/BLE/HAL/test
+ */
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "HAL.h"
+
+#define IMG_BASE        BLE_SNV_JOURNAL_ADDR
+#define IMG_SIZE        (BLE_SNV_ADDR + SNV_JOURNAL_SIZE - IMG_BASE)
+#define JOURNAL_END     (BLE_SNV_JOURNAL_ADDR + BLE_SNV_JOURNAL_PAGES * EEPROM_PAGE_SIZE)
+
+static uint8_t  img[IMG_SIZE];
+static uint32_t erases[BLE_SNV_JOURNAL_PAGES];
+static uint8_t  model[SNV_JOURNAL_SIZE];
+
+/* power cut: the cut_at-th program/erase from now is torn, then we jump out */
+static long    cut_at = -1;
+static jmp_buf cut_jmp;
+
+static int failures;
+
+#define CHECK(c, ...)                                    \
+    do {                                                 \
+        if(!(c)) {                                       \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);  \
+            printf(__VA_ARGS__);                         \
+            printf("\n");                                \
+            exit(1);                                     \
+        }                                                \
+    } while(0)
+
+static void journal_range(uint32_t addr, uint32_t len)
+{
+    CHECK(addr >= BLE_SNV_JOURNAL_ADDR && addr + len <= JOURNAL_END,
+          "access %05x+%u outside the journal", (unsigned)addr, (unsigned)len);
+}
+
+static int power_cut(void)
+{
+    return cut_at >= 0 && cut_at-- == 0;
+}
+
+void sim_read(uint32_t addr, void *buf, uint32_t len)
+{
+    CHECK(addr >= IMG_BASE && addr + len <= IMG_BASE + IMG_SIZE, "read %05x+%u", (unsigned)addr, (unsigned)len);
+    CHECK(((uintptr_t)buf & 3) == 0, "read %05x+%u into an unaligned buffer", (unsigned)addr, (unsigned)len);
+    memcpy(buf, &img[addr - IMG_BASE], len);
+}
+
+void sim_write(uint32_t addr, const void *buf, uint32_t len)
+{
+    uint32_t i;
+
+    journal_range(addr, len);
+    CHECK(((uintptr_t)buf & 3) == 0, "write %05x+%u from an unaligned buffer", (unsigned)addr, (unsigned)len);
+    CHECK((addr - BLE_SNV_JOURNAL_ADDR) % EEPROM_PAGE_SIZE + len <= EEPROM_PAGE_SIZE,
+          "write %05x+%u crosses a page end", (unsigned)addr, (unsigned)len);
+    if(power_cut())
+    {
+        len = rand() % (len + 1); /* torn: only a prefix made it */
+        for(i = 0; i < len; i++)
+            img[addr - IMG_BASE + i] &= ((const uint8_t *)buf)[i];
+        longjmp(cut_jmp, 1);
+    }
+    for(i = 0; i < len; i++)
+        img[addr - IMG_BASE + i] &= ((const uint8_t *)buf)[i];
+}
+
+void sim_erase(uint32_t addr, uint32_t len)
+{
+    journal_range(addr, len);
+    CHECK((addr - BLE_SNV_JOURNAL_ADDR) % EEPROM_PAGE_SIZE == 0 && len == EEPROM_PAGE_SIZE, "erase %05x+%u",
+          (unsigned)addr, (unsigned)len);
+    if(power_cut())
+    {
+        /* an interrupted erase leaves the page in an unknown state */
+        memset(&img[addr - IMG_BASE], rand() & 1 ? 0xFF : 0x5A, len / 2);
+        longjmp(cut_jmp, 1);
+    }
+    memset(&img[addr - IMG_BASE], 0xFF, len);
+    erases[(addr - BLE_SNV_JOURNAL_ADDR) / EEPROM_PAGE_SIZE]++;
+}
+
+static void format(void)
+{
+    memset(img, 0xFF, sizeof(img));
+    memset(erases, 0, sizeof(erases));
+    memset(model, 0xFF, sizeof(model));
+}
+
+static void verify(const char *what, long iter)
+{
+    uint8_t buf[SNV_JOURNAL_SIZE];
+    int     i;
+
+    CHECK(SNV_JournalRead(BLE_SNV_ADDR, SNV_JOURNAL_SIZE, buf) == 0, "%s: read failed", what);
+    for(i = 0; i < SNV_JOURNAL_SIZE; i++)
+        CHECK(buf[i] == model[i], "%s: iteration %ld, byte %d is %02x, expected %02x", what, iter, i, buf[i],
+              model[i]);
+}
+
+/* Random write; hot keeps writes inside a few units so pages stay fully live,
+ * which is what forces the multi-page advance on reclaim */
+static void random_write(uint32_t *addr, uint32_t *len, uint8_t *data, int hot)
+{
+    uint32_t i;
+
+    if(hot)
+    {
+        *addr = (rand() % 3) * SNV_JOURNAL_UNIT * 5 + rand() % SNV_JOURNAL_UNIT;
+        *len = 1 + rand() % 8;
+    }
+    else if(rand() % 8 == 0)
+    {
+        *addr = 0;
+        *len = SNV_JOURNAL_SIZE; /* the BLE library rewrites the whole block */
+    }
+    else
+    {
+        *addr = rand() % SNV_JOURNAL_SIZE;
+        *len = 1 + rand() % (SNV_JOURNAL_SIZE - *addr);
+    }
+    for(i = 0; i < *len; i++)
+        data[i] = rand() % 5 == 0 ? 0xFF : (uint8_t)rand();
+}
+
+static void test_random(unsigned seed)
+{
+    uint8_t  data[SNV_JOURNAL_SIZE];
+    uint32_t addr, len;
+    long     i;
+    uint32_t min, max;
+    int      p;
+
+    srand(seed);
+    format();
+    CHECK(SNV_JournalInit() == 0, "init");
+    for(i = 0; i < 20000; i++)
+    {
+        random_write(&addr, &len, data, (i / 500) & 1);
+        CHECK(SNV_JournalWrite(BLE_SNV_ADDR + addr, len, data) == 0, "write");
+        memcpy(&model[addr], data, len);
+        verify("write", i);
+        if(rand() % 64 == 0)
+        {
+            CHECK(SNV_JournalInit() == 0, "reinit");
+            verify("reboot", i);
+        }
+    }
+
+    /* every page went round the ring, evenly */
+    min = max = erases[0];
+    for(p = 1; p < BLE_SNV_JOURNAL_PAGES; p++)
+    {
+        if(erases[p] < min)
+            min = erases[p];
+        if(erases[p] > max)
+            max = erases[p];
+    }
+    CHECK(min > 10, "ring did not wrap (%u erases)", (unsigned)min);
+    CHECK(max - min <= 1, "uneven wear %u..%u", (unsigned)min, (unsigned)max);
+}
+
+/* A page whose every record is still live is reclaimed into the new head,
+ * the next record must go to a fresh page and not past the end of the head.
+ * Fill one page with distinct units, then hammer the remaining units until
+ * the ring has wrapped over that page several times. */
+static void test_full_live_page(void)
+{
+    uint8_t  data[SNV_JOURNAL_UNIT];
+    uint32_t u, i, per_page = (EEPROM_PAGE_SIZE - 8) / (4 + SNV_JOURNAL_UNIT);
+
+    format();
+    CHECK(SNV_JournalInit() == 0, "init");
+    for(i = 0; i < 20 * BLE_SNV_JOURNAL_PAGES * per_page; i++)
+    {
+        u = (i < per_page) ? i : per_page + i % (SNV_JOURNAL_UNIT_NUM - per_page);
+        memset(data, (uint8_t)(i * 31 + u), sizeof(data));
+        CHECK(SNV_JournalWrite(BLE_SNV_ADDR + u * SNV_JOURNAL_UNIT, sizeof(data), data) == 0, "write");
+        memcpy(&model[u * SNV_JOURNAL_UNIT], data, sizeof(data));
+        verify("full page", i);
+        if(i % 97 == 0)
+        {
+            CHECK(SNV_JournalInit() == 0, "reinit");
+            verify("full page reboot", i);
+        }
+    }
+}
+
+static void test_import(void)
+{
+    uint32_t i;
+
+    format();
+    for(i = 0; i < SNV_JOURNAL_SIZE; i++)
+        model[i] = (i % 40 < 20) ? (uint8_t)(i * 7) : 0xFF;
+    memcpy(&img[BLE_SNV_ADDR - IMG_BASE], model, SNV_JOURNAL_SIZE);
+    CHECK(SNV_JournalInit() == 0, "init");
+    verify("import", 0);
+    CHECK(SNV_JournalInit() == 0, "reinit");
+    verify("import reboot", 0);
+}
+
+/* Cut the power at every possible flash operation of a write: after reboot
+ * each unit holds either its old or its new content, all others are intact */
+static void test_power_cut(unsigned seed)
+{
+    uint8_t  data[SNV_JOURNAL_SIZE], buf[SNV_JOURNAL_SIZE];
+    uint32_t addr, len, u, i;
+    long     iter;
+
+    srand(seed);
+    format();
+    CHECK(SNV_JournalInit() == 0, "init");
+    for(iter = 0; iter < 20000; iter++)
+    {
+        random_write(&addr, &len, data, (iter / 300) & 1);
+        cut_at = rand() % 24;
+        if(setjmp(cut_jmp) == 0)
+        {
+            SNV_JournalWrite(BLE_SNV_ADDR + addr, len, data);
+            cut_at = -1;
+            memcpy(&model[addr], data, len);
+            verify("uncut", iter);
+            continue;
+        }
+        cut_at = -1;
+        CHECK(SNV_JournalInit() == 0, "reinit");
+        CHECK(SNV_JournalRead(BLE_SNV_ADDR, SNV_JOURNAL_SIZE, buf) == 0, "read");
+        for(u = 0; u < SNV_JOURNAL_UNIT_NUM; u++)
+        {
+            uint8_t *now = &buf[u * SNV_JOURNAL_UNIT];
+            uint8_t  want[SNV_JOURNAL_UNIT];
+
+            memcpy(want, &model[u * SNV_JOURNAL_UNIT], SNV_JOURNAL_UNIT);
+            for(i = 0; i < SNV_JOURNAL_UNIT; i++)
+            {
+                uint32_t off = u * SNV_JOURNAL_UNIT + i;
+                if(off >= addr && off < addr + len)
+                    want[i] = data[off - addr];
+            }
+            CHECK(memcmp(now, &model[u * SNV_JOURNAL_UNIT], SNV_JOURNAL_UNIT) == 0 ||
+                      memcmp(now, want, SNV_JOURNAL_UNIT) == 0,
+                  "power cut at iteration %ld: unit %u neither old nor new", iter, (unsigned)u);
+        }
+        memcpy(model, buf, sizeof(model));
+    }
+}
+
+int main(void)
+{
+    unsigned seed;
+
+    test_full_live_page();
+    test_import();
+    for(seed = 1; seed <= 4; seed++)
+        test_random(seed);
+    for(seed = 1; seed <= 4; seed++)
+        test_power_cut(seed);
+    printf("snv journal: %d pages, %d records/page, all tests passed\n", BLE_SNV_JOURNAL_PAGES,
+           (EEPROM_PAGE_SIZE - 8) / (4 + SNV_JOURNAL_UNIT));
+    return failures;
+}
@@ -114,6 +114,11 @@
 #define configGENERATE_RUN_TIME_STATS	0
 #define configUSE_PORT_OPTIMISED_TASK_SELECTION 0
 
+/* Tickless idle, the RTC wakes the core from Idle/Halt/Sleep. configRTC_CLOCK_HZ
+is the RTC source: 32000 for the internal LSI, 32768 for an external LSE. */
+#define configUSE_TICKLESS_IDLE			0
+#define configRTC_CLOCK_HZ				( 32000 )
+
 /* Co-routine definitions. */
 #define configUSE_CO_ROUTINES 			0
 #define configMAX_CO_ROUTINE_PRIORITIES ( 2 )
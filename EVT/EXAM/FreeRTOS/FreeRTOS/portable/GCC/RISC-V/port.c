@@ -97,6 +97,16 @@ void vPortSetupTimerInterrupt( void )
     PFIC_SetPriority(SysTick_IRQn, 0xf0);
     SysTick_Config(configCPU_CLOCK_HZ / configTICK_RATE_HZ);
 
+#if( configUSE_TICKLESS_IDLE == 1 )
+    /* RTC trigger mode wakes the core at the end of a suppressed tick period */
+    sys_safe_access_enable();
+    R8_SLP_WAKE_CTRL |= RB_SLP_RTC_WAKE;
+    sys_safe_access_disable();
+    sys_safe_access_enable();
+    R8_RTC_MODE_CTRL |= RB_RTC_TRIG_EN;
+    sys_safe_access_disable();
+    PFIC_EnableIRQ(RTC_IRQn);
+#endif
 }
 
 /*-----------------------------------------------------------*/
@@ -163,6 +173,165 @@ void SysTick_Handler( void )
     SysTick->SR &= (~(1<<0));
 }
 
+#if( configUSE_TICKLESS_IDLE == 1 )
+
+/* The RTC counts 32K cycles from 0 to portRTC_MAX_COUNT - 1, then wraps. */
+#define portRTC_MAX_COUNT				( 0xA8C00000UL )
+
+/* Keep one suppressed period well inside an RTC wrap. */
+#define portMAX_SUPPRESSED_TICKS		( ( TickType_t ) ( ( 0x40000000ULL * configTICK_RATE_HZ ) / configRTC_CLOCK_HZ ) )
+
+/* Shorter periods are not worth programming the RTC for. */
+#define portTICKLESS_MIN_CYCLES			( 4UL )
+
+/* Idle lengths, in RTC cycles, from which Halt and Sleep pay for their wake-up
+cost, and the time the 32MHz crystal needs to settle after them (same value as
+WAKE_UP_RTC_MAX_TIME in the BLE HAL). */
+#ifndef portTICKLESS_HALT_MIN_CYCLES
+	#define portTICKLESS_HALT_MIN_CYCLES	( configRTC_CLOCK_HZ / 500UL )
+#endif
+#ifndef portTICKLESS_SLEEP_MIN_CYCLES
+	#define portTICKLESS_SLEEP_MIN_CYCLES	( configRTC_CLOCK_HZ / 100UL )
+#endif
+#ifndef portTICKLESS_WAKEUP_CYCLES
+	#define portTICKLESS_WAKEUP_CYCLES		( ( configRTC_CLOCK_HZ * 14UL ) / 10000UL )
+#endif
+
+#if( portTICKLESS_HALT_MIN_CYCLES <= portTICKLESS_WAKEUP_CYCLES + portTICKLESS_MIN_CYCLES )
+	#error portTICKLESS_HALT_MIN_CYCLES must leave room for the crystal wake-up time.
+#endif
+
+__HIGH_CODE
+static uint32_t prvRTCAdd( uint32_t ulCount, uint32_t ulCycles )
+{
+	ulCount += ulCycles;
+	if( ulCount >= portRTC_MAX_COUNT )
+	{
+		ulCount -= portRTC_MAX_COUNT;
+	}
+	return ulCount;
+}
+
+__HIGH_CODE
+static void prvRTCSetTrigger( uint32_t ulCount )
+{
+	sys_safe_access_enable();
+	R32_RTC_TRIG = ulCount;
+	sys_safe_access_disable();
+	R8_RTC_FLAG_CTRL = RB_RTC_TRIG_CLR;
+}
+
+__attribute__((interrupt("WCH-Interrupt-fast")))
+__attribute__((section(".highcode")))
+void RTC_IRQHandler( void )
+{
+	/* Only wakes the core, the tick is corrected by vPortSuppressTicksAndSleep(). */
+	R8_RTC_FLAG_CTRL = ( RB_RTC_TMR_CLR | RB_RTC_TRIG_CLR );
+}
+
+/*
+ * Stop SysTick, sleep until the RTC reaches the end of the idle period (or
+ * another interrupt arrives), then step the kernel tick by the time the RTC
+ * measured and restart SysTick at the same phase within the tick.
+ */
+__HIGH_CODE
+void vPortSuppressTicksAndSleep( TickType_t xExpectedIdleTime )
+{
+const uint32_t ulReload = configCPU_CLOCK_HZ / configTICK_RATE_HZ;
+uint32_t ulPhase, ulStart, ulCycles, ulEnd, ulElapsed;
+uint64_t ullPhase;
+TickType_t xModifiableIdleTime, xCompleteTicks;
+
+	if( xExpectedIdleTime > portMAX_SUPPRESSED_TICKS )
+	{
+		xExpectedIdleTime = portMAX_SUPPRESSED_TICKS;
+	}
+
+	portDISABLE_INTERRUPTS();
+
+	/* A tick that expired before the stop stays pending in SR, let it run. */
+	SysTick->CTLR &= ~SysTick_CTLR_STE;
+	ulPhase = ( uint32_t ) SysTick->CNT;
+	ulStart = RTC_GetCycle32k();
+	ulCycles = ( uint32_t ) ( ( ( ( uint64_t ) xExpectedIdleTime * ulReload ) - ulPhase ) * configRTC_CLOCK_HZ / configCPU_CLOCK_HZ );
+
+	if( ( eTaskConfirmSleepModeStatus() == eAbortSleep ) || ( SysTick->SR & SysTick_SR_CNTIF ) || ( ulCycles < portTICKLESS_MIN_CYCLES ) )
+	{
+		SysTick->CTLR |= SysTick_CTLR_STE;
+		portENABLE_INTERRUPTS();
+		return;
+	}
+
+	xModifiableIdleTime = xExpectedIdleTime;
+	configPRE_SLEEP_PROCESSING( xModifiableIdleTime );
+	if( xModifiableIdleTime > 0 )
+	{
+		ulEnd = prvRTCAdd( ulStart, ulCycles );
+
+		if( ulCycles >= portTICKLESS_HALT_MIN_CYCLES )
+		{
+			/* Wake early so the crystal is stable when the period ends. */
+			prvRTCSetTrigger( prvRTCAdd( ulStart, ulCycles - portTICKLESS_WAKEUP_CYCLES ) );
+			#if( DEBUG == Debug_UART1 )
+			{
+				while( ( R8_UART1_LSR & RB_LSR_TX_ALL_EMP ) == 0 )
+				{
+					__nop();
+				}
+			}
+			#endif
+			if( ulCycles >= portTICKLESS_SLEEP_MIN_CYCLES )
+			{
+				LowPower_Sleep( RB_PWR_RAM2K | RB_PWR_RAM30K | RB_PWR_EXTEND );
+			}
+			else
+			{
+				LowPower_Halt();
+			}
+			if( R8_RTC_FLAG_CTRL & RB_RTC_TRIG_FLAG )
+			{
+				/* The early trigger is still pending with interrupts off, drop
+				it or the idle below returns at once. */
+				R8_RTC_FLAG_CTRL = RB_RTC_TRIG_CLR;
+				PFIC_ClearPendingIRQ( RTC_IRQn );
+				prvRTCSetTrigger( ulEnd );
+				LowPower_Idle();
+			}
+			HSECFG_Current( HSE_RCur_100 );
+		}
+		else
+		{
+			prvRTCSetTrigger( ulEnd );
+			LowPower_Idle();
+		}
+	}
+	configPOST_SLEEP_PROCESSING( xExpectedIdleTime );
+
+	ulEnd = RTC_GetCycle32k();
+	ulElapsed = ( ulEnd >= ulStart ) ? ( ulEnd - ulStart ) : ( ulEnd + ( portRTC_MAX_COUNT - ulStart ) );
+
+	/* Whole ticks slept, the remainder becomes the phase of the running tick. */
+	ullPhase = ulPhase + ( ( uint64_t ) ulElapsed * configCPU_CLOCK_HZ ) / configRTC_CLOCK_HZ;
+	xCompleteTicks = ( TickType_t ) ( ullPhase / ulReload );
+	if( xCompleteTicks > xExpectedIdleTime )
+	{
+		xCompleteTicks = xExpectedIdleTime;
+		ullPhase = 0;
+	}
+	else
+	{
+		ullPhase %= ulReload;
+	}
+	SysTick->CNT = ullPhase;
+	SysTick->CTLR |= SysTick_CTLR_STE;
+
+	/* vTaskStepTick() ends in a critical section exit, which enables interrupts. */
+	vTaskStepTick( xCompleteTicks );
+	portENABLE_INTERRUPTS();
+}
+
+#endif /* configUSE_TICKLESS_IDLE */
+
 /*-----------------------------------------------------------*/
 __HIGH_CODE
 void vPortEnterCritical( void )
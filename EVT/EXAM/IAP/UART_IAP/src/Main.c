@@ -110,11 +110,17 @@ int main()
     R32_PA_PU     |= bRXD1;
     R32_PA_DIR    &= ~bRXD1;
 
-    UART1_BaudRateCfg( 115200 );
+    UART1_BaudRateCfg( IAP_UART_BAUD );
     R8_UART1_FCR = (2<<6) | RB_FCR_TX_FIFO_CLR | RB_FCR_RX_FIFO_CLR | RB_FCR_FIFO_EN;   // FIFO򿪣4ֽ
     R8_UART1_LCR = RB_LCR_WORD_SZ;
     R8_UART1_IER = RB_IER_TXD_EN;
     R8_UART1_DIV = 1;
+#if IAP_UART_V2
+    /* v2 receives in the UART interrupt, a FIFO trigger every 4 bytes */
+    R8_UART1_IER |= RB_IER_RECV_RDY;
+    R8_UART1_MCR |= RB_MCR_INT_OE;
+    PFIC_EnableIRQ( UART1_IRQn );
+#endif
 
     Main_Circulation();
 }
@@ -30,6 +30,10 @@ uint32_t g_addr;
 
 __attribute__((aligned(4)))   uint8_t iap_rsp_data[6] = {IAP_DATA_SOP1, IAP_DATA_SOP2, 0, 0, IAP_DATA_EOP1, IAP_DATA_EOP2};
 
+/* CMD_IAP_DIGEST reply, the CRC32 sits between the status and the end bytes */
+__attribute__((aligned(4)))   uint8_t iap_digest_rsp[10] = {IAP_DATA_SOP1, IAP_DATA_SOP2, 0, 0, 0, 0, 0, 0, IAP_DATA_EOP1, IAP_DATA_EOP2};
+
+#if !IAP_UART_V2
 /*********************************************************************
  * @fn      Main_Circulation
  *
@@ -94,7 +98,7 @@ void Main_Circulation()
                 break;
             /* ״̬ڵȴʱжϽյֽǷΪϷcmd */
             case IAP_DATA_REC_STATE_WAIT_CMD:
-                if ((iap_rec_data.other.buf[all_data_rec_cnt] < CMD_IAP_PROM) || (iap_rec_data.other.buf[all_data_rec_cnt] > CMD_IAP_END))
+                if ((iap_rec_data.other.buf[all_data_rec_cnt] < CMD_IAP_PROM) || ((iap_rec_data.other.buf[all_data_rec_cnt] > CMD_IAP_END) && (iap_rec_data.other.buf[all_data_rec_cnt] != CMD_IAP_DIGEST)))
                 {
                     /* error ûcmd */
                     iap_rec_data_state = IAP_DATA_REC_STATE_WAIT_SOP1;
@@ -110,7 +114,7 @@ void Main_Circulation()
                 {
                     /* ղֽṹֽ */
                     part_rec_cnt = 0;
-                    if ((iap_rec_data.other.buf[2] == CMD_IAP_ERASE) || (iap_rec_data.other.buf[2] == CMD_IAP_VERIFY))
+                    if ((iap_rec_data.other.buf[2] == CMD_IAP_ERASE) || (iap_rec_data.other.buf[2] == CMD_IAP_VERIFY) || (iap_rec_data.other.buf[2] == CMD_IAP_DIGEST))
                     {
                         iap_rec_data_state = IAP_DATA_REC_STATE_WAIT_ADDR;
                     }
@@ -315,6 +319,28 @@ void Main_Circulation()
                             iap_rsp_data[3] = IAP_ERR_ADDR;
                         }
                         break;
+                    /* digest, the host compares the CRC32 instead of sending the image again */
+                    case CMD_IAP_DIGEST:
+                    {
+                        uint32_t len = iap_rec_data.verify.data[0] | ((uint32_t) iap_rec_data.verify.data[1] << 8)
+                                | ((uint32_t) iap_rec_data.verify.data[2] << 16) | ((uint32_t) iap_rec_data.verify.data[3] << 24);
+                        if ((iap_rec_data.verify.len == 4) && (iap_rec_data.verify.addr >= APP_CODE_START_ADDR)
+                                && (iap_rec_data.verify.addr < APP_CODE_END_ADDR) && (len <= APP_CODE_END_ADDR - iap_rec_data.verify.addr))
+                        {
+                            len = iap_crc32(iap_rec_data.verify.addr, len);
+                            iap_digest_rsp[4] = (uint8_t) len;
+                            iap_digest_rsp[5] = (uint8_t) (len >> 8);
+                            iap_digest_rsp[6] = (uint8_t) (len >> 16);
+                            iap_digest_rsp[7] = (uint8_t) (len >> 24);
+                        }
+                        else
+                        {
+                            /* Уַ */
+                            iap_rsp_data[2] = 0xfe;
+                            iap_rsp_data[3] = IAP_ERR_ADDR;
+                        }
+                        break;
+                    }
                     /* ת */
                     case CMD_IAP_END:
                         jumpApp();
@@ -343,7 +369,14 @@ void Main_Circulation()
                     iap_rec_data.other.buf[all_data_rec_cnt] = R8_UART1_RBR;
                 }
                 /* ظ */
-                UART1_SendString(iap_rsp_data, sizeof(iap_rsp_data));
+                if ((iap_rsp_data[2] == 0) && (iap_rec_data.other.buf[2] == CMD_IAP_DIGEST))
+                {
+                    UART1_SendString(iap_digest_rsp, sizeof(iap_digest_rsp));
+                }
+                else
+                {
+                    UART1_SendString(iap_rsp_data, sizeof(iap_rsp_data));
+                }
             }
         }
         else
@@ -376,6 +409,7 @@ void Main_Circulation()
         }
     }
 }
+#endif /* !IAP_UART_V2 */
 
 
 /*********************************************************************
@@ -399,3 +433,32 @@ void my_memcpy(void *dst, const void *src, uint32_t l)
         len--;
     }
 }
+
+/*********************************************************************
+ * @fn      iap_crc32
+ *
+ * @brief   CRC32 (IEEE 802.3, same as zlib crc32) of a Flash range, bitwise
+ *          to keep the IAP small, runs in ram.
+ *
+ * @param   addr    - start address
+ * @param   len     - length
+ *
+ * @return  crc
+ */
+__attribute__((section(".highcode")))
+uint32_t iap_crc32(uint32_t addr, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    PUINT8 p = (PUINT8) addr;
+    uint8_t i;
+    while (len)
+    {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+        len--;
+    }
+    return ~crc;
+}
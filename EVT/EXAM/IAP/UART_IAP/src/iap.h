@@ -20,6 +20,16 @@
 
 #define     USE_EEPROM_FLAG     0
 
+/* UART protocol: 0 - one frame of 64 bytes per reply (iap.c),
+ * 1 - v2, windowed 256 byte frames with CRC16 (iap_v2.c), needs the v2 host tool */
+#define     IAP_UART_V2         0
+
+#if IAP_UART_V2
+#define     IAP_UART_BAUD       921600
+#else
+#define     IAP_UART_BAUD       115200
+#endif
+
 #define    jumpApp   ((  void  (*)  ( void ))  ((int*)APP_CODE_START_ADDR))
 
 #define FLAG_USER_CALL_IAP   0x55
@@ -40,6 +50,7 @@ typedef struct
 #define        CMD_IAP_ERASE        0x81
 #define        CMD_IAP_VERIFY       0x82
 #define        CMD_IAP_END          0x83
+#define        CMD_IAP_DIGEST       0x86    /* CRC32 of a written range, same code as the BLE OTA */
 
 /* usb data length is 64 */
 #define     IAP_LEN            64
@@ -96,10 +107,42 @@ typedef union _IAP_CMD_STRUCT
     } other;
 } iap_cmd_t;
 
+/* v2 frame, all fields little endian. The CRC16 (CCITT, init 0xffff) covers
+ * cmd..len and the data, the data starts word aligned so it is programmed in place. */
+#define     IAP_V2_DATA_LEN     256
+#define     IAP_V2_HEAD_LEN     12
+#define     IAP_V2_WINDOW       8       /* frames the host may send before the first reply */
+#define     IAP_V2_RING_SIZE    4096    /* power of 2, more than IAP_V2_WINDOW frames */
+
+typedef struct
+{
+    UINT8    sop1;
+    UINT8    sop2;
+    UINT8    cmd;
+    UINT8    seq;
+    UINT32   addr;
+    UINT16   len;
+    UINT16   crc;
+    UINT8    data[IAP_V2_DATA_LEN];
+} iap_v2_frame_t;
+
+/* v2 reply, iap_rsp_data with the status in byte 2 */
+#define     IAP_V2_ACK          0x00    /* byte 3: seq of the last frame done */
+#define     IAP_V2_NAK          0xfd    /* byte 3: seq to send again from */
+#define     IAP_V2_ERR          0xfe    /* byte 3: IAP_ERR_t, session closed */
+
 extern uint32_t g_tcnt;
 
+extern uint8_t iap_rsp_data[6];
+
+extern uint8_t iap_digest_rsp[10];
+
 extern void my_memcpy(void *dst, const void *src, uint32_t l);
 
+extern uint32_t iap_crc32(uint32_t addr, uint32_t len);
+
+extern uint16_t iap_crc16(uint16_t crc, const uint8_t *p, uint16_t len);
+
 extern void Main_Circulation();
 
 #define IAP_DATA_SOP1     0xaa
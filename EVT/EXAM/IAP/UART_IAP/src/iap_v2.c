@@ -0,0 +1,322 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : iap_v2.c
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : UART IAP v2 protocol, selected with IAP_UART_V2.
+ *                      The UART interrupt drains the FIFO into a RAM ring,
+ *                      so frames keep arriving while Flash is erased or
+ *                      programmed. The host keeps up to IAP_V2_WINDOW frames
+ *                      in flight, each frame is answered with its seq once
+ *                      it is programmed. Blocks are erased as the first
+ *                      frame reaches them, not the whole APP area up front.
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+#include "iap.h"
+
+#if IAP_UART_V2
+
+/*
+ * Frame: aa 55 cmd seq addr[4] len[2] crc16[2] data[len]
+ *
+ *   CMD_IAP_ERASE   open a session, seq of this frame starts the count,
+ *                   addr = APP_CODE_START_ADDR, nothing is erased yet
+ *   CMD_IAP_PROM    program len bytes at addr, addr and len multiples of 4,
+ *                   addresses ascending, len <= IAP_V2_DATA_LEN
+ *   CMD_IAP_DIGEST  data = 4 byte length, reply is iap_digest_rsp with the
+ *                   CRC32 of addr..addr+length, byte 3 = seq
+ *   CMD_IAP_END     reply, then jump to the APP
+ *
+ * Frames are done in seq order. A CRC error or a gap in seq is answered with
+ * one IAP_V2_NAK carrying the expected seq, frames after it are dropped until
+ * it arrives (go back N). A repeated frame is acknowledged again and skipped.
+ */
+
+/* receive ring, written by UART1_IRQHandler */
+__attribute__((aligned(4))) uint8_t v2_ring[IAP_V2_RING_SIZE];
+volatile uint16_t v2_ring_head = 0;
+uint16_t v2_ring_tail = 0;
+
+__attribute__((aligned(4))) iap_v2_frame_t v2_frame;
+uint16_t v2_frame_cnt = 0;
+
+uint8_t  v2_seq;          /* next seq expected */
+uint8_t  v2_nak_sent;     /* one NAK per missing frame */
+uint32_t v2_erase_ptr;    /* Flash erased up to here, 0 - no session */
+uint32_t v2_prog_ptr;     /* Flash programmed up to here */
+
+/*********************************************************************
+ * @fn      v2_reply
+ *
+ * @brief   Send iap_rsp_data with a status and its argument
+ *
+ * @param   status  - IAP_V2_ACK, IAP_V2_NAK or IAP_V2_ERR
+ * @param   arg     - seq or error code
+ *
+ * @return  None.
+ */
+__attribute__((section(".highcode")))
+void v2_reply(uint8_t status, uint8_t arg)
+{
+    iap_rsp_data[2] = status;
+    iap_rsp_data[3] = arg;
+    UART1_SendString(iap_rsp_data, sizeof(iap_rsp_data));
+}
+
+/*********************************************************************
+ * @fn      v2_jump_app
+ *
+ * @brief   Stop the UART interrupt, the APP has its own vector table
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+__attribute__((section(".highcode")))
+void v2_jump_app(void)
+{
+    PFIC_DisableIRQ(UART1_IRQn);
+    R8_UART1_IER &= ~RB_IER_RECV_RDY;
+    jumpApp();
+}
+
+/*********************************************************************
+ * @fn      v2_frame_deal
+ *
+ * @brief   A complete frame is in v2_frame
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+__attribute__((section(".highcode")))
+void v2_frame_deal(void)
+{
+    uint32_t addr = v2_frame.addr;
+    uint32_t len = v2_frame.len;
+    uint8_t  err = 0;
+
+    if (iap_crc16(iap_crc16(0xffff, &v2_frame.cmd, 8), v2_frame.data, len) != v2_frame.crc)
+    {
+        if (!v2_nak_sent)
+        {
+            v2_nak_sent = 1;
+            v2_reply(IAP_V2_NAK, v2_seq);
+        }
+        return;
+    }
+
+    if (v2_frame.cmd == CMD_IAP_ERASE)
+    {
+        if (addr == APP_CODE_START_ADDR)
+        {
+            v2_seq = v2_frame.seq;
+            v2_erase_ptr = APP_CODE_START_ADDR;
+            v2_prog_ptr = APP_CODE_START_ADDR;
+        }
+        else
+        {
+            err = IAP_ERR_ADDR;
+        }
+    }
+    else if (v2_frame.seq != v2_seq)
+    {
+        if ((uint8_t) (v2_seq - v2_frame.seq) <= IAP_V2_WINDOW)
+        {
+            /* done already, the reply was lost */
+            v2_reply(IAP_V2_ACK, v2_seq - 1);
+        }
+        else if (!v2_nak_sent)
+        {
+            v2_nak_sent = 1;
+            v2_reply(IAP_V2_NAK, v2_seq);
+        }
+        return;
+    }
+    else if (v2_erase_ptr == 0)
+    {
+        err = IAP_ERR_PROG_NO_ERASE;
+    }
+    else if (v2_frame.cmd == CMD_IAP_PROM)
+    {
+        if ((addr % 4) || (len % 4) || (addr < v2_prog_ptr) || (addr > APP_CODE_END_ADDR - len))
+        {
+            err = IAP_ERR_ADDR;
+        }
+        else
+        {
+            /* erase ahead, only the blocks this frame reaches */
+            while (addr + len > v2_erase_ptr)
+            {
+                if (FLASH_ROM_ERASE(v2_erase_ptr, EEPROM_BLOCK_SIZE))
+                {
+                    err = IAP_ERR_ERASE_FAIL;
+                    break;
+                }
+                v2_erase_ptr += EEPROM_BLOCK_SIZE;
+            }
+            if (!err && len && FLASH_ROM_WRITE(addr, (PUINT32) v2_frame.data, len))
+            {
+                err = IAP_ERR_WRITE_FAIL;
+            }
+            v2_prog_ptr = addr + len;
+        }
+    }
+    else if (v2_frame.cmd == CMD_IAP_DIGEST)
+    {
+        my_memcpy(&len, v2_frame.data, 4);
+        if ((v2_frame.len == 4) && (addr >= APP_CODE_START_ADDR) && (addr < APP_CODE_END_ADDR)
+                && (len <= APP_CODE_END_ADDR - addr))
+        {
+            len = iap_crc32(addr, len);
+            iap_digest_rsp[3] = v2_seq++;
+            my_memcpy(&iap_digest_rsp[4], &len, 4);
+            v2_nak_sent = 0;
+            UART1_SendString(iap_digest_rsp, sizeof(iap_digest_rsp));
+            return;
+        }
+        err = IAP_ERR_ADDR;
+    }
+    else if (v2_frame.cmd == CMD_IAP_END)
+    {
+        v2_reply(IAP_V2_ACK, v2_seq);
+        while (!(R8_UART1_LSR & RB_LSR_TX_ALL_EMP));
+        v2_jump_app();
+    }
+    else
+    {
+        /* IAP_ERR_UNKNOWN is 0, reply here */
+        v2_erase_ptr = 0;
+        v2_reply(IAP_V2_ERR, IAP_ERR_UNKNOWN);
+        return;
+    }
+
+    if (err)
+    {
+        /* the host starts over with CMD_IAP_ERASE */
+        v2_erase_ptr = 0;
+        v2_reply(IAP_V2_ERR, err);
+        return;
+    }
+    v2_nak_sent = 0;
+    v2_reply(IAP_V2_ACK, v2_seq++);
+}
+
+/*********************************************************************
+ * @fn      Main_Circulation
+ *
+ * @brief   IAP main loop, v2 protocol, runs in ram.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+__attribute__((section(".highcode")))
+void Main_Circulation()
+{
+    uint8_t *p = (uint8_t *) &v2_frame;
+    uint8_t  b;
+
+    while (1)
+    {
+        if (v2_ring_tail != v2_ring_head)
+        {
+            b = v2_ring[v2_ring_tail & (IAP_V2_RING_SIZE - 1)];
+            v2_ring_tail++;
+            g_tcnt = 0;
+
+            /* hunt for aa 55 */
+            if (((v2_frame_cnt == 0) && (b != IAP_DATA_SOP1)) || ((v2_frame_cnt == 1) && (b != IAP_DATA_SOP2)))
+            {
+                v2_frame_cnt = (b == IAP_DATA_SOP1);
+                continue;
+            }
+            p[v2_frame_cnt++] = b;
+            if (v2_frame_cnt < IAP_V2_HEAD_LEN)
+            {
+                continue;
+            }
+            if (v2_frame.len > IAP_V2_DATA_LEN)
+            {
+                /* not a header, look for the next one */
+                v2_frame_cnt = 0;
+                continue;
+            }
+            if (v2_frame_cnt == IAP_V2_HEAD_LEN + v2_frame.len)
+            {
+                v2_frame_cnt = 0;
+                v2_frame_deal();
+            }
+        }
+        else
+        {
+            /* about two bytes at 921600 baud, the ring keeps receiving meanwhile */
+            DelayUs(20);
+            g_tcnt++;
+            if (v2_frame_cnt && (g_tcnt >= 50))
+            {
+                /* a frame stopped for 1ms, drop it, the host sends it again */
+                v2_frame_cnt = 0;
+            }
+            if (g_tcnt > 6000000)
+            {
+                /* 120 s without data, jump to the APP */
+                v2_jump_app();
+            }
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      UART1_IRQHandler
+ *
+ * @brief   FIFO trigger and receive timeout, move the bytes to the ring.
+ *          Runs from ram, so it keeps up while the Flash is busy.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+__INTERRUPT
+__HIGH_CODE
+void UART1_IRQHandler(void)
+{
+    while (R8_UART1_RFC)
+    {
+        v2_ring[v2_ring_head & (IAP_V2_RING_SIZE - 1)] = R8_UART1_RBR;
+        v2_ring_head++;
+    }
+}
+
+/*********************************************************************
+ * @fn      iap_crc16
+ *
+ * @brief   CRC16 CCITT (poly 0x1021, start with 0xffff), bitwise to keep
+ *          the IAP small, runs in ram.
+ *
+ * @param   crc     - previous value
+ * @param   p       - data
+ * @param   len     - length
+ *
+ * @return  crc
+ */
+__attribute__((section(".highcode")))
+uint16_t iap_crc16(uint16_t crc, const uint8_t *p, uint16_t len)
+{
+    uint8_t i;
+    while (len)
+    {
+        crc ^= (uint16_t) (*p++) << 8;
+        for (i = 0; i < 8; i++)
+        {
+            crc = (crc << 1) ^ (0x1021 & (0 - (crc >> 15)));
+        }
+        len--;
+    }
+    return crc;
+}
+
+#endif /* IAP_UART_V2 */
@@ -337,7 +337,7 @@ void myDevEP2_OUT_Deal(uint8_t l)
 {
     /* ûԶ */
     uint8_t s = 0;
-    uint32_t addr;
+    uint32_t addr, len;
     switch (g_iap_cmd.other.buf[0])
     {
     case CMD_IAP_PROM:
@@ -391,6 +391,34 @@ void myDevEP2_OUT_Deal(uint8_t l)
 		s = FLASH_ROM_VERIFY(addr, g_write_buf, g_iap_cmd.verify.len);
         myDevEP2_IN_Deal(s);
         break;
+    case CMD_IAP_DIGEST:
+        /* digest, the host compares the CRC32 instead of sending the image again */
+        addr = (g_iap_cmd.verify.addr[0]
+				| (uint32_t) g_iap_cmd.verify.addr[1] << 8
+				| (uint32_t) g_iap_cmd.verify.addr[2] << 16
+				| (uint32_t) g_iap_cmd.verify.addr[3] << 24);
+        len = (g_iap_cmd.verify.buf[0]
+				| (uint32_t) g_iap_cmd.verify.buf[1] << 8
+				| (uint32_t) g_iap_cmd.verify.buf[2] << 16
+				| (uint32_t) g_iap_cmd.verify.buf[3] << 24);
+        if ((g_iap_cmd.verify.len == 4) && (addr >= APP_CODE_START_ADDR) && (addr < APP_CODE_END_ADDR)
+                && (len <= APP_CODE_END_ADDR - addr))
+        {
+            len = iap_crc32(addr, len);
+            EP2_Databuf[64] = 0;
+            EP2_Databuf[65] = 0;
+            EP2_Databuf[66] = (uint8_t) len;
+            EP2_Databuf[67] = (uint8_t) (len >> 8);
+            EP2_Databuf[68] = (uint8_t) (len >> 16);
+            EP2_Databuf[69] = (uint8_t) (len >> 24);
+            R8_UEP2_T_LEN = 6;
+            R8_UEP2_CTRL = (R8_UEP2_CTRL & ~MASK_UEP_T_RES) | UEP_T_RES_ACK;
+        }
+        else
+        {
+            myDevEP2_IN_Deal(0xfe);
+        }
+        break;
     case CMD_IAP_END:
         /*λUSBתapp*/
         R32_USB_CONTROL = 0;
@@ -439,3 +467,32 @@ void my_memcpy(void *dst, const void *src, uint32_t l)
         len--;
     }
 }
+
+/*********************************************************************
+ * @fn      iap_crc32
+ *
+ * @brief   CRC32 (IEEE 802.3, same as zlib crc32) of a Flash range, bitwise
+ *          to keep the IAP small, runs in ram.
+ *
+ * @param   addr    - start address
+ * @param   len     - length
+ *
+ * @return  crc
+ */
+__attribute__((section(".highcode")))
+uint32_t iap_crc32(uint32_t addr, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    PUINT8 p = (PUINT8) addr;
+    uint8_t i;
+    while (len)
+    {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+        len--;
+    }
+    return ~crc;
+}
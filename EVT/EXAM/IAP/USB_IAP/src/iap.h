@@ -42,6 +42,7 @@ typedef struct
 #define        CMD_IAP_ERASE        0x81
 #define        CMD_IAP_VERIFY       0x82
 #define        CMD_IAP_END          0x83
+#define        CMD_IAP_DIGEST       0x86    /* CRC32 of a written range, same code as the BLE OTA */
 
 /* usb data length is 64 */
 #define     IAP_LEN            64
@@ -87,6 +88,8 @@ extern uint32_t g_tcnt;
 
 extern void my_memcpy(void *dst, const void *src, uint32_t l);
 
+extern uint32_t iap_crc32(uint32_t addr, uint32_t len);
+
 extern void USB_DevTransProcess(void);
 
 #endif /* _IAP_H_ */
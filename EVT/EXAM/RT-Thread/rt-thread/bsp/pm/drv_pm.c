@@ -0,0 +1,246 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : drv_pm.c
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : Power management for RT-Thread nano. The idle thread
+ *                      suppresses the SysTick tick up to the next timer and
+ *                      sleeps on the RTC trigger, the tick is restored from
+ *                      the RTC count on wake up.
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+#include "drv_pm.h"
+#include <rthw.h>
+
+#ifdef RT_USING_PM
+
+#define PM_RTC_MAX_COUNT            0xA8C00000
+/* longest sleep, well inside the RTC range and the 32 bit tick math */
+#define PM_MAX_SLEEP_TICKS          (RT_TICK_PER_SECOND * 60)
+
+#define SYSTICK_CTLR_STE            (1 << 0)
+#define SYSTICK_SR_CNTIF            (1 << 0)
+
+#if PM_TICKLESS_MIN_CYCLES <= PM_WAKEUP_CYCLES
+#error "PM_TICKLESS_MIN_CYCLES must be longer than PM_WAKEUP_CYCLES"
+#endif
+
+static rt_uint8_t pm_modes[PM_SLEEP_MODE_MAX];
+
+void rt_pm_request(rt_uint8_t sleep_mode)
+{
+    rt_base_t level;
+
+    if(sleep_mode >= PM_SLEEP_MODE_MAX)
+        return;
+
+    level = rt_hw_interrupt_disable();
+    if(pm_modes[sleep_mode] < 0xFF)
+        pm_modes[sleep_mode]++;
+    rt_hw_interrupt_enable(level);
+}
+
+void rt_pm_release(rt_uint8_t sleep_mode)
+{
+    rt_base_t level;
+
+    if(sleep_mode >= PM_SLEEP_MODE_MAX)
+        return;
+
+    level = rt_hw_interrupt_disable();
+    if(pm_modes[sleep_mode] > 0)
+        pm_modes[sleep_mode]--;
+    rt_hw_interrupt_enable(level);
+}
+
+static rt_uint8_t pm_select_mode(void)
+{
+    rt_uint8_t mode;
+
+    for(mode = PM_SLEEP_MODE_NONE; mode < PM_SLEEP_MODE_MAX; mode++)
+    {
+        if(pm_modes[mode])
+            return mode;
+    }
+    return PM_SLEEP_MODE_DEFAULT;
+}
+
+rt_uint32_t pm_sleep_cycles(rt_tick_t timeout, rt_uint32_t reload, rt_uint32_t phase)
+{
+    /* time left to the timeout counted from the current tick phase */
+    return ((rt_uint64_t)timeout * reload - phase) * PM_RTC_FREQ / ((rt_uint64_t)reload * RT_TICK_PER_SECOND);
+}
+
+rt_tick_t pm_tick_compensate(rt_uint32_t phase, rt_uint32_t reload,
+                             rt_uint32_t cycles, rt_uint32_t *p_phase)
+{
+    /* SysTick counts = RTC cycles * (reload * RT_TICK_PER_SECOND) / PM_RTC_FREQ */
+    rt_uint64_t total = phase + (rt_uint64_t)cycles * reload * RT_TICK_PER_SECOND / PM_RTC_FREQ;
+
+    *p_phase = (rt_uint32_t)(total % reload);
+    return (rt_tick_t)(total / reload);
+}
+
+/* the console keeps its FIFO only while the clocks run */
+static void pm_console_flush(void)
+{
+    while(!(R8_UART1_LSR & RB_LSR_TX_ALL_EMP));
+}
+
+__HIGH_CODE
+static void pm_tickless_sleep(rt_uint8_t mode)
+{
+    rt_tick_t   timeout, delta;
+    rt_uint32_t reload, phase, new_phase;
+    rt_uint32_t start, end, cycles;
+
+    timeout = rt_timer_next_timeout_tick();
+    if(timeout == RT_TICK_MAX)
+    {
+        timeout = PM_MAX_SLEEP_TICKS;
+    }
+    else
+    {
+        timeout -= rt_tick_get();
+        /* already due or in the past, let the tick handle it */
+        if((rt_int32_t)timeout <= 0)
+            return;
+        if(timeout > PM_MAX_SLEEP_TICKS)
+            timeout = PM_MAX_SLEEP_TICKS;
+    }
+
+    reload = SysTick->CMP + 1;
+    if(pm_sleep_cycles(timeout, reload, SysTick->CNT) <= PM_TICKLESS_MIN_CYCLES)
+    {
+        LowPower_Idle();
+        return;
+    }
+
+    /* stop the tick on an RTC edge so the period is whole RTC cycles */
+    cycles = RTC_GetCycle32k();
+    do
+    {
+        start = RTC_GetCycle32k();
+    } while(start == cycles);
+    SysTick->CTLR &= ~SYSTICK_CTLR_STE;
+    if(SysTick->SR & SYSTICK_SR_CNTIF)
+    {
+        /* a tick is pending, serve it first */
+        SysTick->CTLR |= SYSTICK_CTLR_STE;
+        return;
+    }
+    phase = SysTick->CNT;
+
+    cycles = pm_sleep_cycles(timeout, reload, phase);
+    if(cycles < PM_TICKLESS_MIN_CYCLES)
+    {
+        SysTick->CTLR |= SYSTICK_CTLR_STE;
+        LowPower_Idle();
+        return;
+    }
+
+    R8_RTC_FLAG_CTRL = RB_RTC_TRIG_CLR;
+    RTC_TRIGFunCfg(cycles - PM_WAKEUP_CYCLES);
+
+    pm_console_flush();
+    if(mode == PM_SLEEP_MODE_LIGHT)
+    {
+        LowPower_Halt();
+    }
+    else
+    {
+        LowPower_Sleep(RB_PWR_RAM2K | RB_PWR_RAM30K | RB_PWR_EXTEND);
+    }
+    if(R8_RTC_FLAG_CTRL & RB_RTC_TRIG_FLAG)
+    {
+        /* woken early for the crystal, idle out the rest of the period */
+        R8_RTC_FLAG_CTRL = RB_RTC_TRIG_CLR;
+        RTC_TRIGFunCfg(PM_WAKEUP_CYCLES);
+        LowPower_Idle();
+        end = RTC_GetCycle32k();
+    }
+    else
+    {
+        /* woken by another interrupt, wait for the next RTC edge */
+        cycles = RTC_GetCycle32k();
+        do
+        {
+            end = RTC_GetCycle32k();
+        } while(end == cycles);
+    }
+    HSECFG_Current(HSE_RCur_100);
+
+    if(end < start)
+        end += PM_RTC_MAX_COUNT;
+
+    delta = pm_tick_compensate(phase, reload, end - start, &new_phase);
+    SysTick->CNT = new_phase;
+    SysTick->CTLR |= SYSTICK_CTLR_STE;
+    rt_tick_set(rt_tick_get() + delta);
+}
+
+/*********************************************************************
+ * @fn      rt_system_power_manager
+ *
+ * @brief   Enter the selected sleep mode, called from the idle thread
+ *
+ * @return  none
+ */
+__HIGH_CODE
+void rt_system_power_manager(void)
+{
+    rt_base_t  level;
+    rt_uint8_t mode;
+
+    level = rt_hw_interrupt_disable();
+    mode = pm_select_mode();
+    switch(mode)
+    {
+        case PM_SLEEP_MODE_NONE:
+            break;
+
+        case PM_SLEEP_MODE_IDLE:
+            LowPower_Idle();
+            break;
+
+        case PM_SLEEP_MODE_SHUTDOWN:
+            pm_console_flush();
+            LowPower_Shutdown(0);
+            break;
+
+        default:
+            pm_tickless_sleep(mode);
+            break;
+    }
+    rt_hw_interrupt_enable(level);
+
+    /* timers that expired while asleep */
+    rt_timer_check();
+}
+
+__HIGH_CODE
+void RTC_IRQHandler(void)
+{
+    R8_RTC_FLAG_CTRL = (RB_RTC_TMR_CLR | RB_RTC_TRIG_CLR);
+}
+
+int rt_hw_pm_init(void)
+{
+    sys_safe_access_enable();
+    R8_SLP_WAKE_CTRL |= RB_SLP_RTC_WAKE;
+    sys_safe_access_disable();
+    sys_safe_access_enable();
+    R8_RTC_MODE_CTRL |= RB_RTC_TRIG_EN;
+    sys_safe_access_disable();
+    PFIC_EnableIRQ(RTC_IRQn);
+
+    /* stay awake until the application releases it */
+    pm_modes[PM_SLEEP_MODE_NONE] = 1;
+    return 0;
+}
+INIT_BOARD_EXPORT(rt_hw_pm_init);
+
+#endif /* RT_USING_PM */
@@ -0,0 +1,85 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : drv_pm.h
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : Power management for RT-Thread nano, CH58x sleep modes
+ *                      with the RTC as low power timer
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+#ifndef __DRV_PM_H__
+#define __DRV_PM_H__
+#include "CH58x_common.h"
+#include <rtthread.h>
+
+/* sleep modes, same order as the RT-Thread PM component */
+enum
+{
+    PM_SLEEP_MODE_NONE = 0, /* run */
+    PM_SLEEP_MODE_IDLE,     /* LowPower_Idle, tick keeps running */
+    PM_SLEEP_MODE_LIGHT,    /* LowPower_Halt, tick suppressed */
+    PM_SLEEP_MODE_DEEP,     /* LowPower_Sleep with RAM retention, tick suppressed */
+    PM_SLEEP_MODE_STANDBY,  /* handled as PM_SLEEP_MODE_DEEP, RAM must survive */
+    PM_SLEEP_MODE_SHUTDOWN, /* LowPower_Shutdown, wake up is a reset */
+
+    PM_SLEEP_MODE_MAX,
+};
+
+/* RTC clock: 32000 for the internal LSI, 32768 for an external LSE */
+#ifndef PM_RTC_FREQ
+#define PM_RTC_FREQ                 32000
+#endif
+
+/* deepest mode entered when no mode is requested */
+#ifndef PM_SLEEP_MODE_DEFAULT
+#define PM_SLEEP_MODE_DEFAULT       PM_SLEEP_MODE_DEEP
+#endif
+
+/* shortest idle time (RTC cycles) worth suppressing the tick for */
+#ifndef PM_TICKLESS_MIN_CYCLES
+#define PM_TICKLESS_MIN_CYCLES      (PM_RTC_FREQ / 500)
+#endif
+
+/* 32MHz crystal settling time after Halt/Sleep (RTC cycles) */
+#ifndef PM_WAKEUP_CYCLES
+#define PM_WAKEUP_CYCLES            ((PM_RTC_FREQ * 14) / 10000)
+#endif
+
+/*
+ * Keep the system at or above a sleep mode. Requests are counted; the
+ * shallowest mode with a pending request wins. PM_SLEEP_MODE_NONE is
+ * requested once at start-up, release it to let the system sleep.
+ */
+void rt_pm_request(rt_uint8_t sleep_mode);
+void rt_pm_release(rt_uint8_t sleep_mode);
+
+/* called by the idle thread when RT_USING_PM is defined */
+void rt_system_power_manager(void);
+
+/*
+ * RTC cycles from the current tick phase to a timeout, rounded down so the
+ * wake up is never late.
+ *   timeout - ticks to the next timer, at most PM_MAX_SLEEP_TICKS
+ *   reload  - SysTick counts per tick
+ *   phase   - SysTick count into the running tick
+ */
+rt_uint32_t pm_sleep_cycles(rt_tick_t timeout, rt_uint32_t reload, rt_uint32_t phase);
+
+/*
+ * Tick compensation after a suppressed period.
+ *   phase   - SysTick count into the running tick when the tick was stopped
+ *   reload  - SysTick counts per tick
+ *   cycles  - RTC cycles spent asleep
+ *   p_phase - returns the SysTick count to restart from
+ * returns the number of whole ticks that passed, exact while the SysTick
+ * rate reload * RT_TICK_PER_SECOND stays below 2^32 Hz
+ */
+rt_tick_t pm_tick_compensate(rt_uint32_t phase, rt_uint32_t reload,
+                             rt_uint32_t cycles, rt_uint32_t *p_phase);
+
+int rt_hw_pm_init(void);
+
+#endif /* __DRV_PM_H__ */
@@ -0,0 +1,51 @@
+/* Host stand-in for CH58x_common.h: the registers drv_pm.c touches are
+ * variables and the sleep calls are simulated by pm_tick_test.c */
+#ifndef __CH58x_COMMON_H__
+#define __CH58x_COMMON_H__
+
+#include <stdint.h>
+
+#define __HIGH_CODE
+
+typedef struct
+{
+    uint32_t CTLR;
+    uint32_t SR;
+    uint64_t CNT;
+    uint64_t CMP;
+} SysTick_Type;
+
+extern SysTick_Type sim_systick;
+extern uint8_t      sim_rtc_flag, sim_reg;
+
+#define SysTick             (&sim_systick)
+#define R8_RTC_FLAG_CTRL    sim_rtc_flag
+#define R8_RTC_MODE_CTRL    sim_reg
+#define R8_SLP_WAKE_CTRL    sim_reg
+#define R8_UART1_LSR        RB_LSR_TX_ALL_EMP
+
+#define RB_RTC_TMR_CLR      0x10
+#define RB_RTC_TRIG_CLR     0x20
+#define RB_RTC_TRIG_FLAG    0x80
+#define RB_RTC_TRIG_EN      0x02
+#define RB_SLP_RTC_WAKE     0x08
+#define RB_LSR_TX_ALL_EMP   0x40
+#define RB_PWR_RAM2K        0x02
+#define RB_PWR_RAM30K       0x01
+#define RB_PWR_EXTEND       0x04
+#define HSE_RCur_100        0
+#define RTC_IRQn            28
+
+void     LowPower_Idle(void);
+void     LowPower_Halt(void);
+void     LowPower_Sleep(uint8_t rm);
+void     LowPower_Shutdown(uint8_t rm);
+uint32_t RTC_GetCycle32k(void);
+void     RTC_TRIGFunCfg(uint32_t cyc);
+
+#define HSECFG_Current(c)
+#define sys_safe_access_enable()
+#define sys_safe_access_disable()
+#define PFIC_EnableIRQ(irq)
+
+#endif
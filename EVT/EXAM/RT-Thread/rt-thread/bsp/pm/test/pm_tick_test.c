@@ -0,0 +1,372 @@
+/* Host test for the tick compensation of drv_pm.c
+ *
+ * pm_sleep_cycles() and pm_tick_compensate() are checked against 128 bit
+ * arithmetic over the whole argument range, then rt_system_power_manager()
+ * runs thousands of suppressed periods against a simulated SysTick and RTC:
+ * timers at random distances, early wake ups by other interrupts, both
+ * sleep modes and the RTC wrapping at PM_RTC_MAX_COUNT. After every period
+ * the kernel tick must not have passed the next timer and the SysTick
+ * position must be within one RTC cycle of the simulated time, and over
+ * all periods the error must not build up.
+ *
+ *   make -C EVT/EXAM/RT-Thread/rt-thread/bsp/pm/test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <rthw.h>
+#include "drv_pm.h"
+
+#define RTC_MAX_COUNT       0xA8C00000
+#define MAX_SLEEP_TICKS     (RT_TICK_PER_SECOND * 60)
+#define SLEEPS              20000
+#define EARLY_WAKE_PCT      20      /* sleeps ended by another interrupt */
+
+#define CHECK(c, ...)                                    \
+    do {                                                 \
+        if(!(c)) {                                       \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);  \
+            printf(__VA_ARGS__);                         \
+            printf("\n");                                \
+            exit(1);                                     \
+        }                                                \
+    } while(0)
+
+typedef unsigned __int128 u128;
+
+SysTick_Type sim_systick;
+uint8_t      sim_rtc_flag, sim_reg;
+
+/* simulated time in SysTick counts, the RTC is derived from it */
+static uint64_t  sim_t, rtc0;
+static uint64_t  trig_at;       /* RTC count of the armed trigger, 0 - none */
+static uint32_t  reload;
+static rt_tick_t sim_tick, timer_due = RT_TICK_MAX;
+static int       irq_off, tick_pending;
+static int       slept;         /* the last sleep ran to its trigger */
+
+static uint32_t rnd(uint32_t n)
+{
+    return (uint32_t)(((uint64_t)rand() << 16 ^ rand()) % n);
+}
+
+/* SysTick counts per second */
+static uint64_t systick_hz(void)
+{
+    return (uint64_t)reload * RT_TICK_PER_SECOND;
+}
+
+static uint64_t rtc_now(void)
+{
+    return rtc0 + (uint64_t)((u128)sim_t * PM_RTC_FREQ / systick_hz());
+}
+
+/* first SysTick count at which the RTC reads cyc */
+static uint64_t rtc_edge(uint64_t cyc)
+{
+    return (uint64_t)(((u128)(cyc - rtc0) * systick_hz() + PM_RTC_FREQ - 1) / PM_RTC_FREQ);
+}
+
+/* time passes awake, a stopped SysTick holds its count and a tick that
+ * comes due with interrupts off stays pending */
+static void run(uint64_t counts)
+{
+    sim_t += counts;
+    if(!(sim_systick.CTLR & 1))
+    {
+        return;
+    }
+    sim_systick.CNT += counts;
+    while(sim_systick.CNT >= sim_systick.CMP + 1)
+    {
+        sim_systick.CNT -= sim_systick.CMP + 1;
+        sim_systick.SR = 1;
+        tick_pending++;
+        if(!irq_off)
+        {
+            rt_hw_interrupt_enable(0);
+        }
+    }
+}
+
+static void wait_trigger(int may_end_early)
+{
+    uint64_t end;
+
+    CHECK(trig_at, "sleep without an RTC trigger");
+    end = rtc_edge(trig_at);
+    CHECK(end >= sim_t, "trigger armed in the past");
+    if(may_end_early && rnd(100) < EARLY_WAKE_PCT)
+    {
+        sim_t += rnd((uint32_t)(end - sim_t) + 1);
+        return;
+    }
+    sim_t = end;
+    trig_at = 0;
+    sim_rtc_flag |= RB_RTC_TRIG_FLAG;
+    slept |= may_end_early;
+}
+
+void LowPower_Idle(void)
+{
+    if(sim_systick.CTLR & 1)
+    {
+        /* tick running: woken by the next tick */
+        run(sim_systick.CMP + 1 - sim_systick.CNT);
+        return;
+    }
+    wait_trigger(0);
+}
+
+void LowPower_Halt(void)
+{
+    CHECK(!(sim_systick.CTLR & 1), "halt with the tick running");
+    wait_trigger(1);
+}
+
+void LowPower_Sleep(uint8_t rm)
+{
+    (void)rm;
+    CHECK(!(sim_systick.CTLR & 1), "sleep with the tick running");
+    wait_trigger(1);
+}
+
+void LowPower_Shutdown(uint8_t rm)
+{
+    (void)rm;
+    CHECK(0, "shutdown entered");
+}
+
+uint32_t RTC_GetCycle32k(void)
+{
+    /* a register read takes about a microsecond */
+    run(systick_hz() / 1000000);
+    return (uint32_t)(rtc_now() % RTC_MAX_COUNT);
+}
+
+void RTC_TRIGFunCfg(uint32_t cyc)
+{
+    trig_at = rtc_now() + cyc;
+}
+
+rt_tick_t rt_tick_get(void)
+{
+    return sim_tick;
+}
+
+void rt_tick_set(rt_tick_t tick)
+{
+    sim_tick = tick;
+}
+
+rt_tick_t rt_timer_next_timeout_tick(void)
+{
+    return timer_due;
+}
+
+void rt_timer_check(void)
+{
+}
+
+rt_base_t rt_hw_interrupt_disable(void)
+{
+    irq_off = 1;
+    return 0;
+}
+
+/* SysTick_Handler for the ticks that came due meanwhile */
+void rt_hw_interrupt_enable(rt_base_t level)
+{
+    (void)level;
+    irq_off = 0;
+    CHECK(tick_pending <= 1, "%d ticks missed", tick_pending - 1);
+    sim_tick += tick_pending;
+    tick_pending = 0;
+    sim_systick.SR = 0;
+}
+
+static void check_compensate(uint32_t phase, uint32_t r, uint32_t cycles)
+{
+    u128        total = phase + (u128)cycles * r * RT_TICK_PER_SECOND / PM_RTC_FREQ;
+    rt_uint32_t new_phase = 0xFFFFFFFF;
+    rt_tick_t   ticks = pm_tick_compensate(phase, r, cycles, &new_phase);
+
+    CHECK(new_phase < r, "phase %u of %u", new_phase, r);
+    CHECK((u128)ticks * r + new_phase == total, "phase %u reload %u cycles %u: %u ticks + %u", phase, r, cycles,
+          ticks, new_phase);
+}
+
+static void check_sleep_cycles(rt_tick_t timeout, uint32_t r, uint32_t phase)
+{
+    u128        left = (u128)timeout * r - phase;
+    rt_uint32_t cycles = pm_sleep_cycles(timeout, r, phase), new_phase;
+    rt_tick_t   ticks;
+
+    /* the largest whole number of RTC cycles that ends at or before the
+     * timeout */
+    CHECK((u128)cycles * r * RT_TICK_PER_SECOND <= left * PM_RTC_FREQ, "timeout %u: %u cycles too long", timeout,
+          cycles);
+    CHECK((u128)(cycles + 1) * r * RT_TICK_PER_SECOND > left * PM_RTC_FREQ, "timeout %u: %u cycles too short",
+          timeout, cycles);
+
+    ticks = pm_tick_compensate(phase, r, cycles, &new_phase);
+    CHECK(ticks < timeout || (ticks == timeout && new_phase == 0), "timeout %u overrun to %u + %u", timeout, ticks,
+          new_phase);
+}
+
+static void test_math(void)
+{
+    /* SysTick at 1 Hz to the 2^32 Hz limit of drv_pm.h */
+    static const uint32_t reloads[] = {1, 1000000 / RT_TICK_PER_SECOND, 32000000 / RT_TICK_PER_SECOND,
+                                       60000000 / RT_TICK_PER_SECOND, 80000000 / RT_TICK_PER_SECOND,
+                                       0xFFFFFFFF / RT_TICK_PER_SECOND};
+    unsigned              i, k;
+    uint32_t              r, phase, total, part, left, split;
+    rt_uint32_t           p1, p2;
+    rt_tick_t             t1, t2;
+
+    for(k = 0; k < sizeof(reloads) / sizeof(reloads[0]); k++)
+    {
+        r = reloads[k];
+
+        /* nothing elapsed, one second, the longest RTC difference */
+        check_compensate(r - 1, r, 0);
+        t1 = pm_tick_compensate(r / 2, r, PM_RTC_FREQ, &p1);
+        CHECK(t1 == RT_TICK_PER_SECOND && p1 == r / 2, "one second is %u ticks + %u", t1, p1);
+        check_compensate(r - 1, r, RTC_MAX_COUNT - 1);
+        check_compensate(r - 1, r, 0xFFFFFFFF);
+
+        for(i = 0; i < 100000; i++)
+        {
+            phase = rnd(r);
+            check_compensate(phase, r, rnd(i & 1 ? 0xFFFFFFFF : MAX_SLEEP_TICKS * PM_RTC_FREQ / RT_TICK_PER_SECOND));
+            check_sleep_cycles(1 + rnd(MAX_SLEEP_TICKS), r, phase);
+        }
+        check_sleep_cycles(MAX_SLEEP_TICKS, r, 0);
+        check_sleep_cycles(1, r, r - 1);
+
+        /* a period cut in parts loses at most one SysTick count per part */
+        for(i = 0; i < 1000; i++)
+        {
+            total = rnd(MAX_SLEEP_TICKS * PM_RTC_FREQ / RT_TICK_PER_SECOND);
+            phase = rnd(r);
+            t1 = pm_tick_compensate(phase, r, total, &p1);
+            t2 = 0;
+            p2 = phase;
+            for(left = total, split = 0; left; left -= part, split++)
+            {
+                rt_tick_t d;
+
+                part = 1 + rnd(left < 5000 ? left : 5000);
+                d = pm_tick_compensate(p2, r, part, &p2);
+                t2 += d;
+            }
+            CHECK((int64_t)t1 * r + p1 - ((int64_t)t2 * r + p2) >= 0 &&
+                      (int64_t)t1 * r + p1 - ((int64_t)t2 * r + p2) <= split,
+                  "%u cycles in %u parts: %u + %u against %u + %u", total, split, t2, p2, t1, p1);
+        }
+    }
+}
+
+/* rt_system_power_manager() against the simulated clocks */
+static void test_sleep(uint32_t r, uint8_t mode)
+{
+    uint64_t  cycle = (r * (uint64_t)RT_TICK_PER_SECOND + PM_RTC_FREQ - 1) / PM_RTC_FREQ;
+    int64_t   err, step, worst = 0, sum = 0;
+    rt_tick_t before;
+    unsigned  i, full = 0;
+
+    reload = r;
+    sim_t = 0;
+    sim_tick = 0;
+    /* start close to the RTC wrap */
+    rtc0 = RTC_MAX_COUNT - 5 * PM_RTC_FREQ;
+    trig_at = 0;
+    sim_rtc_flag = 0;
+    sim_systick.CTLR = 0xF;
+    sim_systick.SR = 0;
+    sim_systick.CNT = 0;
+    sim_systick.CMP = r - 1;
+
+    rt_hw_pm_init();
+    rt_pm_release(PM_SLEEP_MODE_NONE);
+    rt_pm_request(mode);
+
+    err = 0;
+    for(i = 0; i < SLEEPS; i++)
+    {
+        /* a little work, then the next timer */
+        run(rnd(3 * r));
+        switch(rnd(8))
+        {
+            case 0:
+                timer_due = RT_TICK_MAX;
+                break;
+            case 1:
+                timer_due = sim_tick + rnd(3);
+                break;
+            case 2:
+                timer_due = sim_tick + MAX_SLEEP_TICKS + rnd(MAX_SLEEP_TICKS);
+                break;
+            default:
+                timer_due = sim_tick + 1 + rnd(i & 1 ? RT_TICK_PER_SECOND : 20);
+                break;
+        }
+
+        before = sim_tick;
+        slept = 0;
+        rt_system_power_manager();
+        trig_at = 0;
+
+        CHECK(sim_systick.CTLR & 1, "tick left stopped");
+        CHECK(sim_systick.CNT <= sim_systick.CMP, "SysTick count %llu past %llu",
+              (unsigned long long)sim_systick.CNT, (unsigned long long)sim_systick.CMP);
+        if(timer_due != RT_TICK_MAX)
+        {
+            CHECK((rt_int32_t)(sim_tick - timer_due) <= 0 || sim_tick == before, "tick %u passed the timer at %u",
+                  sim_tick, timer_due);
+        }
+        else
+        {
+            CHECK(sim_tick - before <= MAX_SLEEP_TICKS, "slept %u ticks without a timer", sim_tick - before);
+        }
+        if(slept && timer_due != RT_TICK_MAX && (rt_int32_t)(timer_due - before) <= MAX_SLEEP_TICKS)
+        {
+            /* slept to the timer, at most the last tick is left */
+            CHECK((rt_int32_t)(timer_due - sim_tick) <= 1, "sleep %u woke %u ticks before the timer %u from %u", i,
+                  timer_due - sim_tick, timer_due, before);
+            full++;
+        }
+
+        step = (int64_t)((uint64_t)sim_tick * r + sim_systick.CNT - sim_t) - err;
+        err += step;
+        CHECK(step <= (int64_t)cycle && step >= -(int64_t)cycle,
+              "sleep %u moved the tick %lld counts, one RTC cycle is %llu", i, (long long)step,
+              (unsigned long long)cycle);
+        if(step > worst || -step > worst)
+        {
+            worst = step < 0 ? -step : step;
+        }
+        sum += step;
+    }
+
+    CHECK(full > SLEEPS / 4, "only %u sleeps reached their timer", full);
+    /* whole RTC cycles at both ends, the error must not build up */
+    CHECK(sum < (int64_t)cycle * SLEEPS / 20 && -sum < (int64_t)cycle * SLEEPS / 20,
+          "tick drifts %+.2f RTC cycles per period", (double)sum / SLEEPS / cycle);
+    printf("reload %u %s: %u periods, %u to the timer, tick error per period max %.1f us mean %+.2f us, "
+           "total %+.1f ms over %.0f s\n",
+           r, mode == PM_SLEEP_MODE_LIGHT ? "halt " : "sleep", SLEEPS, full, worst * 1e6 / systick_hz(),
+           (double)sum / SLEEPS * 1e6 / systick_hz(), err * 1e3 / systick_hz(), (double)sim_t / systick_hz());
+    rt_pm_release(mode);
+}
+
+int main(void)
+{
+    srand(1);
+    test_math();
+    test_sleep(60000 * 1000 / RT_TICK_PER_SECOND, PM_SLEEP_MODE_DEEP);
+    test_sleep(80000 * 1000 / RT_TICK_PER_SECOND, PM_SLEEP_MODE_LIGHT);
+    test_sleep(32000 * 1000 / RT_TICK_PER_SECOND, PM_SLEEP_MODE_DEEP);
+    printf("pm tick math ok, RTC %u Hz, %u ticks/s\n", PM_RTC_FREQ, RT_TICK_PER_SECOND);
+    return 0;
+}
@@ -0,0 +1,10 @@
+/* Host stand-in for rthw.h */
+#ifndef __RT_HW_H__
+#define __RT_HW_H__
+
+#include <rtthread.h>
+
+rt_base_t rt_hw_interrupt_disable(void);
+void      rt_hw_interrupt_enable(rt_base_t level);
+
+#endif
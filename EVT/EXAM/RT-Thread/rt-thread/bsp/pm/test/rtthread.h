@@ -0,0 +1,31 @@
+/* Host stand-in for rtthread.h: the kernel types and calls drv_pm.c uses,
+ * implemented by pm_tick_test.c */
+#ifndef __RT_THREAD_H__
+#define __RT_THREAD_H__
+
+#include <stdint.h>
+
+#define RT_USING_PM
+
+#ifndef RT_TICK_PER_SECOND
+#define RT_TICK_PER_SECOND  1000
+#endif
+
+typedef int8_t      rt_int8_t;
+typedef int32_t     rt_int32_t;
+typedef uint8_t     rt_uint8_t;
+typedef uint32_t    rt_uint32_t;
+typedef uint64_t    rt_uint64_t;
+typedef long        rt_base_t;
+typedef rt_uint32_t rt_tick_t;
+
+#define RT_TICK_MAX         0xffffffff
+
+#define INIT_BOARD_EXPORT(fn)
+
+rt_tick_t rt_tick_get(void);
+void      rt_tick_set(rt_tick_t tick);
+rt_tick_t rt_timer_next_timeout_tick(void);
+void      rt_timer_check(void);
+
+#endif
@@ -86,7 +86,10 @@
 
 #define RT_USING_DEVICE
 
+// <c1>Using power management
+//  <i>Idle thread sleeps on the RTC between timers, see bsp/pm/drv_pm.h
 //#define RT_USING_PM
+// </c>
 
 // <h>IPC(Inter-process communication) Configuration
 // <c1>Using Semaphore
@@ -110,7 +110,8 @@ extern "C" {
 #endif
 
 #ifdef RT_USING_PM
-#include "drivers/pm.h"
+/* nano has no PM component, the BSP provides the API */
+#include "drv_pm.h"
 #endif
 
 #ifdef RT_USING_WIFI
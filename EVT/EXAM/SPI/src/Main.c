@@ -14,6 +14,26 @@
 
 __attribute__((aligned(4))) UINT8 spiBuff[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, 6};
 __attribute__((aligned(4))) UINT8 spiBuffrev[16];
+__attribute__((aligned(4))) UINT8 spiCmd[4] = {0x02, 0x00, 0x10, 0x00};
+
+volatile UINT8 spiAsyncDone = 0;
+
+void SPI0_CSCtrl(UINT8 active)
+{
+    if(active)
+    {
+        GPIOA_ResetBits(GPIO_Pin_12);
+    }
+    else
+    {
+        GPIOA_SetBits(GPIO_Pin_12);
+    }
+}
+
+void SPI0_XferDone(SPI0_DMAXferTypeDef *xfer)
+{
+    spiAsyncDone = 1;
+}
 
 void DebugInit(void)
 {
@@ -85,6 +105,18 @@ int main()
         PRINT(" %x", spiBuffrev[i]);
     }
     PRINT("\n");
+
+    // DMA async: command + payload under one CS, CPU free until the callback
+    {
+        SPI0_DMASegTypeDef  seg[2] = {{spiCmd, sizeof(spiCmd), SPI0_SEG_TX},
+                                      {spiBuff, sizeof(spiBuff), SPI0_SEG_TX}};
+        SPI0_DMAXferTypeDef xfer = {seg, 2, SPI0_CSCtrl, SPI0_XferDone, NULL, NULL};
+
+        SPI0_MasterDMAAsyncInit();
+        SPI0_MasterDMAAsyncSubmit(&xfer);
+        while(!spiAsyncDone);
+        PRINT("DMA async done\n");
+    }
   #else
     /* SPI 1 CH583֧*/
     GPIOA_SetBits(GPIO_Pin_3);
@@ -159,3 +191,10 @@ int main()
 
     while(1);
 }
+
+__INTERRUPT
+__HIGH_CODE
+void SPI0_IRQHandler(void)
+{
+    SPI0_MasterDMAAsyncIRQHandler();
+}
@@ -213,6 +213,180 @@ void ADC_DMACfg(uint8_t s, uint16_t startAddr, uint16_t endAddr, ADC_DMAModeType
     }
 }
 
+static ADC_StreamTypeDef *ADC_Stream = NULL;
+
+/*********************************************************************
+ * @fn      ADC_DataCalibApply
+ *
+ * @brief   Add a calibration offset to a block of samples, two samples per
+ *          32-bit word, results are clamped to 0..4095
+ *
+ * @param   buf     - samples, 4-byte aligned
+ * @param   len     - number of samples
+ * @param   offset  - ADC_DataCalib_Rough() value
+ *
+ * @return  none
+ */
+__HIGH_CODE
+void ADC_DataCalibApply(uint16_t *buf, uint32_t len, int16_t offset)
+{
+    uint32_t *p = (uint32_t *)buf;
+    uint32_t  k, w, hi, lo;
+    int32_t   v;
+
+    if(offset == 0)
+    {
+        return;
+    }
+    /* Each 16-bit lane gets sample + offset + 0x1000, which stays within
+     * 0x0001..0x2FFF for |offset| < 4096, so no carry or borrow crosses into
+     * the other lane. Lanes below 0x1000 or above 0x1FFF are clamped before
+     * the bias is taken off again. */
+    k = (uint16_t)(offset + 0x1000);
+    k |= k << 16;
+    for(; len >= 2; len -= 2)
+    {
+        w = (*p & 0x0FFF0FFF) + k;
+        hi = (w >> 13) & 0x00010001;
+        lo = ~((w >> 12) | (w >> 13)) & 0x00010001;
+        w = (w & ~((hi | lo) * 0xFFFF)) | (hi * 0x1FFF) | (lo * 0x1000);
+        *p++ = w - 0x10001000;
+    }
+    if(len)
+    {
+        v = (*(uint16_t *)p & RB_ADC_DATA) + offset;
+        *(uint16_t *)p = (v < 0) ? 0 : ((v > RB_ADC_DATA) ? RB_ADC_DATA : v);
+    }
+}
+
+/*********************************************************************
+ * @fn      ADC_StreamStart
+ *
+ * @brief   Start streaming acquisition on the configured channel
+ *
+ * @param   s       - stream descriptor, must stay valid until ADC_StreamStop
+ * @param   cycle   - sample period (256-cycle)*16*Tsys
+ *
+ * @return  none
+ */
+void ADC_StreamStart(ADC_StreamTypeDef *s, uint8_t cycle)
+{
+    ADC_StreamStop();
+
+    s->overruns = 0;
+    s->passes = 0;
+    s->done = 0;
+    ADC_Stream = s;
+
+    R8_ADC_AUTO_CYCLE = cycle;
+    R16_ADC_DMA_BEG = (uint32_t)s->buf;
+    R16_ADC_DMA_END = (uint32_t)(s->buf + 2 * s->half);
+    ADC_ClearDMAFlag();
+    R8_ADC_CTRL_DMA = (R8_ADC_CTRL_DMA & ~(RB_ADC_IE_EOC | RB_ADC_CONT_EN)) |
+                      RB_ADC_DMA_LOOP | RB_ADC_IE_DMA_END | RB_ADC_DMA_ENABLE;
+    PFIC_EnableIRQ(ADC_IRQn);
+    ADC_StartDMA();
+}
+
+/*********************************************************************
+ * @fn      ADC_StreamStop
+ *
+ * @brief   Stop streaming acquisition
+ *
+ * @return  none
+ */
+void ADC_StreamStop(void)
+{
+    R8_ADC_CTRL_DMA &= ~(RB_ADC_AUTO_EN | RB_ADC_DMA_LOOP | RB_ADC_IE_DMA_END | RB_ADC_DMA_ENABLE);
+    ADC_ClearDMAFlag();
+    ADC_Stream = NULL;
+}
+
+/*********************************************************************
+ * @fn      ADC_StreamPoll
+ *
+ * @brief   Hand finished halves to the callback
+ *
+ * @return  none
+ */
+void ADC_StreamPoll(void)
+{
+    ADC_StreamTypeDef *s = ADC_Stream;
+    uint16_t           pos, now, passes, ready, lag;
+    uint16_t          *data;
+    uint8_t            wrap, evt = 0;
+
+    if(s == NULL)
+    {
+        return;
+    }
+
+    /* The DMA position only says where the current pass is, the pass count
+     * comes from the interrupt. A wrap between the two reads, or one whose
+     * interrupt is still pending, is added here. */
+    PFIC_DisableIRQ(ADC_IRQn);
+    pos = R16_ADC_DMA_NOW - (uint16_t)(uint32_t)s->buf;
+    wrap = ADC_GetDMAStatus();
+    now = R16_ADC_DMA_NOW - (uint16_t)(uint32_t)s->buf;
+    passes = s->passes;
+    PFIC_EnableIRQ(ADC_IRQn);
+    if(wrap || now < pos)
+    {
+        passes++;
+    }
+    ready = passes * 2 + ((now >> 1) >= s->half ? 1 : 0);
+
+    lag = ready - s->done;
+    if(lag == 0)
+    {
+        return;
+    }
+    if(lag >= 2)
+    { // the DMA is back in the oldest half, only the newest one is intact
+        s->overruns += lag - 1;
+        s->done = ready - 1;
+        evt = ADC_STREAM_EVT_OVERRUN;
+    }
+
+    data = s->buf;
+    if(s->done & 1)
+    {
+        data += s->half;
+        evt |= ADC_STREAM_EVT_FULL;
+    }
+    else
+    {
+        evt |= ADC_STREAM_EVT_HALF;
+    }
+    s->done++;
+
+    ADC_DataCalibApply(data, s->half, s->offset);
+    if(s->callback)
+    {
+        s->callback(data, s->half, evt);
+    }
+}
+
+/*********************************************************************
+ * @fn      ADC_StreamIRQHandler
+ *
+ * @brief   Stream interrupt service, call it from ADC_IRQHandler
+ *
+ * @return  none
+ */
+__HIGH_CODE
+void ADC_StreamIRQHandler(void)
+{
+    if(ADC_GetDMAStatus())
+    {
+        ADC_ClearDMAFlag();
+        if(ADC_Stream)
+        {
+            ADC_Stream->passes++;
+        }
+    }
+}
+
 /*********************************************************************
  * @fn      adc_to_temperature_celsius
  *
@@ -366,3 +366,202 @@ void SPI0_SlaveDMATrans(uint8_t *pbuf, uint16_t len)
     while(!(R8_SPI0_INT_FLAG & RB_SPI_IF_CNT_END));
     R8_SPI0_CTRL_CFG &= ~RB_SPI_DMA_ENABLE;
 }
+
+static SPI0_DMAXferTypeDef *SPI0_XferHead = NULL; // running transfer
+static SPI0_DMAXferTypeDef *SPI0_XferTail = NULL;
+static uint8_t              SPI0_SegIdx;
+static uint32_t             SPI0_SegOffset;
+static volatile uint8_t     SPI0_DMARunning = 0;
+
+/*********************************************************************
+ * @fn      SPI0_DMAAsyncRunChunk
+ *
+ * @brief   Start the next DMA chunk of the running transfer
+ *
+ * @return  0 - transfer finished, 1 - chunk started
+ */
+__HIGH_CODE
+static uint8_t SPI0_DMAAsyncRunChunk(void)
+{
+    SPI0_DMAXferTypeDef *xfer = SPI0_XferHead;
+    SPI0_DMASegTypeDef  *seg;
+    uint32_t             len;
+
+    while(SPI0_SegIdx < xfer->segNum)
+    {
+        seg = &xfer->seg[SPI0_SegIdx];
+        if(SPI0_SegOffset < seg->len)
+        {
+            len = seg->len - SPI0_SegOffset;
+            if(len > SPI0_DMA_CHUNK_MAX)
+            {
+                len = SPI0_DMA_CHUNK_MAX;
+            }
+
+            R8_SPI0_CTRL_CFG &= ~RB_SPI_DMA_ENABLE;
+            if(seg->dir == SPI0_SEG_RX)
+            {
+                R8_SPI0_CTRL_MOD |= RB_SPI_FIFO_DIR;
+            }
+            else
+            {
+                R8_SPI0_CTRL_MOD &= ~RB_SPI_FIFO_DIR;
+            }
+            R16_SPI0_DMA_BEG = (uint32_t)(seg->buf + SPI0_SegOffset);
+            R16_SPI0_DMA_END = (uint32_t)(seg->buf + SPI0_SegOffset + len);
+            SPI0_SegOffset += len;
+            R8_SPI0_INT_FLAG = RB_SPI_IF_CNT_END | RB_SPI_IF_DMA_END;
+            R16_SPI0_TOTAL_CNT = len;
+            R8_SPI0_CTRL_CFG |= RB_SPI_DMA_ENABLE;
+            SPI0_DMARunning = 1;
+            return 1;
+        }
+        SPI0_SegIdx++;
+        SPI0_SegOffset = 0;
+    }
+
+    R8_SPI0_CTRL_CFG &= ~RB_SPI_DMA_ENABLE;
+    SPI0_DMARunning = 0;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      SPI0_DMAAsyncStart
+ *
+ * @brief   Start queued transfers until one has data to move, does
+ *          nothing while a chunk is in flight
+ *
+ * @return  none
+ */
+__HIGH_CODE
+static void SPI0_DMAAsyncStart(void)
+{
+    SPI0_DMAXferTypeDef *xfer;
+
+    while(!SPI0_DMARunning && (xfer = SPI0_XferHead) != NULL)
+    {
+        SPI0_SegIdx = 0;
+        SPI0_SegOffset = 0;
+        if(xfer->cs)
+        {
+            xfer->cs(1);
+        }
+        if(SPI0_DMAAsyncRunChunk())
+        {
+            return;
+        }
+        /* empty transfer, complete it right away */
+        if(xfer->cs)
+        {
+            xfer->cs(0);
+        }
+        SPI0_XferHead = xfer->next;
+        if(SPI0_XferHead == NULL)
+        {
+            SPI0_XferTail = NULL;
+        }
+        if(xfer->callback)
+        {
+            xfer->callback(xfer);
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      SPI0_MasterDMAAsyncInit
+ *
+ * @brief   Enable the SPI0 count-end interrupt for the async DMA engine,
+ *          SPI0 must already be initialised in master mode
+ *
+ * @return  none
+ */
+void SPI0_MasterDMAAsyncInit(void)
+{
+    SPI0_XferHead = NULL;
+    SPI0_XferTail = NULL;
+    SPI0_DMARunning = 0;
+    R8_SPI0_INT_FLAG = RB_SPI_IF_CNT_END | RB_SPI_IF_DMA_END;
+    R8_SPI0_INTER_EN |= RB_SPI_IE_CNT_END;
+    PFIC_EnableIRQ(SPI0_IRQn);
+}
+
+/*********************************************************************
+ * @fn      SPI0_MasterDMAAsyncSubmit
+ *
+ * @brief   Queue a transfer, it starts at once if SPI0 is idle
+ *
+ * @param   xfer    - transfer descriptor, must stay valid until the callback
+ *
+ * @return  none
+ */
+void SPI0_MasterDMAAsyncSubmit(SPI0_DMAXferTypeDef *xfer)
+{
+    uint32_t irq_status;
+
+    xfer->next = NULL;
+    SYS_DisableAllIrq(&irq_status);
+    if(SPI0_XferTail)
+    {
+        SPI0_XferTail->next = xfer;
+        SPI0_XferTail = xfer;
+    }
+    else
+    {
+        SPI0_XferHead = xfer;
+        SPI0_XferTail = xfer;
+    }
+    SPI0_DMAAsyncStart();
+    SYS_RecoverIrq(irq_status);
+}
+
+/*********************************************************************
+ * @fn      SPI0_MasterDMAAsyncBusy
+ *
+ * @brief   Whether the async DMA engine is running or has queued transfers
+ *
+ * @return  0 - idle, !0 - busy
+ */
+uint8_t SPI0_MasterDMAAsyncBusy(void)
+{
+    return (SPI0_XferHead != NULL);
+}
+
+/*********************************************************************
+ * @fn      SPI0_MasterDMAAsyncIRQHandler
+ *
+ * @brief   Async DMA interrupt service, call it from SPI0_IRQHandler
+ *
+ * @return  none
+ */
+__HIGH_CODE
+void SPI0_MasterDMAAsyncIRQHandler(void)
+{
+    SPI0_DMAXferTypeDef *xfer;
+
+    if(!(R8_SPI0_INT_FLAG & RB_SPI_IF_CNT_END))
+    {
+        return;
+    }
+    R8_SPI0_INT_FLAG = RB_SPI_IF_CNT_END | RB_SPI_IF_DMA_END;
+
+    xfer = SPI0_XferHead;
+    if(xfer == NULL || SPI0_DMAAsyncRunChunk())
+    {
+        return;
+    }
+
+    if(xfer->cs)
+    {
+        xfer->cs(0);
+    }
+    SPI0_XferHead = xfer->next;
+    if(SPI0_XferHead == NULL)
+    {
+        SPI0_XferTail = NULL;
+    }
+    if(xfer->callback)
+    {
+        xfer->callback(xfer);
+    }
+    SPI0_DMAAsyncStart();
+}
@@ -0,0 +1,388 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : CH58x_timerCap.c
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : Continuous DMA capture on TMR1/TMR2 with frequency,
+ *                      duty cycle, jitter statistics and period histogram
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+#include "CH58x_common.h"
+
+#define TMR_CAP_IRQN(base)    (((base) == BA_TMR1) ? TMR1_IRQn : TMR2_IRQn)
+
+/*********************************************************************
+ * @fn      TMR_CapStatAdd
+ *
+ * @brief   Add one value to a statistic
+ *
+ * @param   st      - statistic
+ * @param   v       - value
+ *
+ * @return  none
+ */
+static void TMR_CapStatAdd(TMR_CapStatTypeDef *st, uint32_t v)
+{
+    if(st->count == 0 || v < st->min)
+    {
+        st->min = v;
+    }
+    if(v > st->max)
+    {
+        st->max = v;
+    }
+    st->sum += v;
+    st->count++;
+}
+
+/*********************************************************************
+ * @fn      TMR_CapPeriod
+ *
+ * @brief   Account one full period
+ *
+ * @param   hcap    - engine handle
+ * @param   p       - period in Tsys
+ *
+ * @return  none
+ */
+static void TMR_CapPeriod(TMR_CapTypeDef *hcap, uint32_t p)
+{
+    uint32_t b;
+
+    TMR_CapStatAdd(&hcap->period, p);
+    if(hcap->lastPeriod)
+    {
+        TMR_CapStatAdd(&hcap->jitter, (p > hcap->lastPeriod) ? (p - hcap->lastPeriod) : (hcap->lastPeriod - p));
+    }
+    hcap->lastPeriod = p;
+
+    if(hcap->hist)
+    {
+        if(p < hcap->histMin)
+        {
+            hcap->histUnder++;
+        }
+        else
+        {
+            b = (p - hcap->histMin) / hcap->histWidth;
+            if(b < hcap->histBins)
+            {
+                hcap->hist[b]++;
+            }
+            else
+            {
+                hcap->histOver++;
+            }
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      TMR_CapWord
+ *
+ * @brief   Account one capture word
+ *
+ * @param   hcap    - engine handle
+ * @param   w       - capture word
+ *
+ * @return  none
+ */
+static void TMR_CapWord(TMR_CapTypeDef *hcap, uint32_t w)
+{
+    uint32_t width = w & TMR_CAP_WIDTH_MASK;
+
+    hcap->edges++;
+    if(width >= hcap->timeout)
+    { // the input stalled, nothing before it pairs with what comes next
+        hcap->timeouts++;
+        hcap->lastHigh = 0;
+        hcap->lastPeriod = 0;
+        return;
+    }
+
+    if(hcap->mode != Edge_To_Edge)
+    {
+        TMR_CapPeriod(hcap, width);
+    }
+    else if(w & DataBit_25)
+    {
+        hcap->lastHigh = w;
+    }
+    else if(hcap->lastHigh & DataBit_25)
+    { // a period ends with the low level that follows a high one
+        TMR_CapStatAdd(&hcap->high, hcap->lastHigh & TMR_CAP_WIDTH_MASK);
+        TMR_CapPeriod(hcap, (hcap->lastHigh & TMR_CAP_WIDTH_MASK) + width);
+        hcap->lastHigh = 0;
+    }
+}
+
+/*********************************************************************
+ * @fn      TMR_CapInit
+ *
+ * @brief   Start continuous capture on TMR1 or TMR2
+ *
+ * @param   hcap    - engine handle
+ * @param   base    - BA_TMR1 / BA_TMR2
+ * @param   mode    - capture mode, refer to CapModeTypeDef
+ * @param   buf     - capture ring, 4-byte aligned
+ * @param   size    - ring size in words
+ * @param   timeout - capture timeout in Tsys, max 33554432
+ *
+ * @return  none
+ */
+void TMR_CapInit(TMR_CapTypeDef *hcap, PUINT8V base, CapModeTypeDef mode, uint32_t *buf, uint16_t size,
+                 uint32_t timeout)
+{
+    hcap->base = base;
+    hcap->buf = buf;
+    hcap->size = size;
+    hcap->mode = mode;
+    hcap->timeout = timeout;
+    hcap->hist = NULL;
+    hcap->passes = 0;
+    hcap->rdPass = 0;
+    hcap->rdIdx = 0;
+    hcap->lastHigh = 0;
+    hcap->lastPeriod = 0;
+    TMR_CapStatReset(hcap);
+
+    base[TMR_CTRL_MOD] = RB_TMR_ALL_CLEAR;
+    base[TMR_CTRL_MOD] = RB_TMR_COUNT_EN | RB_TMR_MODE_IN | (mode << 6);
+    *(PUINT32V)(base + TMR_CNT_END) = timeout;
+
+    *(PUINT16V)(base + TMR_DMA_BEG) = (uint32_t)buf;
+    *(PUINT16V)(base + TMR_DMA_END) = (uint32_t)(buf + size);
+    base[TMR_INT_FLAG] = RB_TMR_IF_DMA_END;
+    base[TMR_INTER_EN] |= RB_TMR_IE_DMA_END;
+    base[TMR_CTRL_DMA] = RB_TMR_DMA_LOOP | RB_TMR_DMA_ENABLE;
+    PFIC_EnableIRQ(TMR_CAP_IRQN(base));
+}
+
+/*********************************************************************
+ * @fn      TMR_CapStop
+ *
+ * @brief   Stop capture, statistics are kept
+ *
+ * @param   hcap    - engine handle
+ *
+ * @return  none
+ */
+void TMR_CapStop(TMR_CapTypeDef *hcap)
+{
+    PUINT8V base = hcap->base;
+
+    base[TMR_CTRL_MOD] &= ~RB_TMR_COUNT_EN;
+    base[TMR_CTRL_DMA] = 0;
+    base[TMR_INTER_EN] &= ~RB_TMR_IE_DMA_END;
+    base[TMR_INT_FLAG] = RB_TMR_IF_DMA_END;
+}
+
+/*********************************************************************
+ * @fn      TMR_CapIRQHandler
+ *
+ * @brief   Capture interrupt service, counts ring passes
+ *
+ * @param   hcap    - engine handle
+ *
+ * @return  none
+ */
+__HIGH_CODE
+void TMR_CapIRQHandler(TMR_CapTypeDef *hcap)
+{
+    PUINT8V base = hcap->base;
+
+    if(base[TMR_INT_FLAG] & RB_TMR_IF_DMA_END)
+    {
+        base[TMR_INT_FLAG] = RB_TMR_IF_DMA_END;
+        hcap->passes++;
+    }
+}
+
+/*********************************************************************
+ * @fn      TMR_CapProcess
+ *
+ * @brief   Process the words captured since the last call
+ *
+ * @param   hcap    - engine handle
+ *
+ * @return  number of words processed
+ */
+uint32_t TMR_CapProcess(TMR_CapTypeDef *hcap)
+{
+    PUINT8V  base = hcap->base;
+    uint16_t beg = (uint16_t)(uint32_t)hcap->buf;
+    uint16_t size = hcap->size;
+    uint16_t half = size / 2;
+    uint16_t pos, now, i;
+    uint32_t passes, dp, n, k;
+    uint8_t  wrap;
+
+    /* Same scheme as the ADC stream: DMA position plus the pass count from
+     * the interrupt, a wrap not yet counted by it is added here. */
+    PFIC_DisableIRQ(TMR_CAP_IRQN(base));
+    pos = (uint16_t)(*(PUINT16V)(base + TMR_DMA_NOW) - beg) >> 2;
+    wrap = base[TMR_INT_FLAG] & RB_TMR_IF_DMA_END;
+    now = (uint16_t)(*(PUINT16V)(base + TMR_DMA_NOW) - beg) >> 2;
+    passes = hcap->passes;
+    PFIC_EnableIRQ(TMR_CAP_IRQN(base));
+    if(wrap || now < pos)
+    {
+        passes++;
+    }
+    if(now >= size)
+    {
+        now = size - 1;
+    }
+
+    dp = passes - hcap->rdPass;
+    if(dp > 1 || (dp == 1 && now >= hcap->rdIdx))
+    { // a whole ring behind: keep the newest half, the rest is gone
+        hcap->overruns += dp * size + now - hcap->rdIdx - half;
+        hcap->lastHigh = 0;
+        hcap->lastPeriod = 0;
+        if(now >= half)
+        {
+            hcap->rdIdx = now - half;
+            hcap->rdPass = passes;
+        }
+        else
+        {
+            hcap->rdIdx = now + size - half;
+            hcap->rdPass = passes - 1;
+        }
+        dp = passes - hcap->rdPass;
+    }
+    n = dp * size + now - hcap->rdIdx;
+
+    i = hcap->rdIdx;
+    for(k = n; k; k--)
+    {
+        TMR_CapWord(hcap, hcap->buf[i]);
+        if(++i == size)
+        {
+            i = 0;
+        }
+    }
+    hcap->rdIdx = now;
+    hcap->rdPass = passes;
+
+    return n;
+}
+
+/*********************************************************************
+ * @fn      TMR_CapStatReset
+ *
+ * @brief   Clear statistics and histogram
+ *
+ * @param   hcap    - engine handle
+ *
+ * @return  none
+ */
+void TMR_CapStatReset(TMR_CapTypeDef *hcap)
+{
+    memset(&hcap->period, 0, sizeof(hcap->period));
+    memset(&hcap->high, 0, sizeof(hcap->high));
+    memset(&hcap->jitter, 0, sizeof(hcap->jitter));
+    hcap->edges = 0;
+    hcap->timeouts = 0;
+    hcap->overruns = 0;
+    hcap->histUnder = 0;
+    hcap->histOver = 0;
+    if(hcap->hist)
+    {
+        memset(hcap->hist, 0, hcap->histBins * sizeof(uint32_t));
+    }
+}
+
+/*********************************************************************
+ * @fn      TMR_CapHistCfg
+ *
+ * @brief   Collect a period histogram from now on
+ *
+ * @param   hcap    - engine handle
+ * @param   bins    - bin counters, NULL to stop
+ * @param   n       - number of bins
+ * @param   min     - lower edge of bin 0 in Tsys
+ * @param   width   - bin width in Tsys
+ *
+ * @return  none
+ */
+void TMR_CapHistCfg(TMR_CapTypeDef *hcap, uint32_t *bins, uint16_t n, uint32_t min, uint32_t width)
+{
+    hcap->histBins = n;
+    hcap->histMin = min;
+    hcap->histWidth = width ? width : 1;
+    hcap->histUnder = 0;
+    hcap->histOver = 0;
+    hcap->hist = bins;
+    if(bins)
+    {
+        memset(bins, 0, n * sizeof(uint32_t));
+    }
+}
+
+/*********************************************************************
+ * @fn      TMR_CapStatAvg
+ *
+ * @brief   Average of a statistic
+ *
+ * @param   st      - statistic
+ *
+ * @return  sum / count, 0 - no samples
+ */
+uint32_t TMR_CapStatAvg(const TMR_CapStatTypeDef *st)
+{
+    return st->count ? (uint32_t)(st->sum / st->count) : 0;
+}
+
+/*********************************************************************
+ * @fn      TMR_CapFrequency
+ *
+ * @brief   Average input frequency
+ *
+ * @param   hcap    - engine handle
+ *
+ * @return  frequency in mHz, 0 - no period seen
+ */
+uint32_t TMR_CapFrequency(TMR_CapTypeDef *hcap)
+{
+    uint64_t sum = hcap->period.sum;
+    uint32_t count = hcap->period.count;
+    uint64_t f;
+
+    while(count > 0xFFFFFFFFFFFFFFFFULL / ((uint64_t)FREQ_SYS * 1000))
+    { // keeps FREQ_SYS * 1000 * count within 64 bits at any FREQ_SYS
+        count >>= 1;
+        sum >>= 1;
+    }
+    if(sum == 0)
+    {
+        return 0;
+    }
+    f = (uint64_t)FREQ_SYS * 1000 * count / sum;
+
+    return (f > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)f;
+}
+
+/*********************************************************************
+ * @fn      TMR_CapDuty
+ *
+ * @brief   Average duty cycle, Edge_To_Edge only
+ *
+ * @param   hcap    - engine handle
+ *
+ * @return  high time in 1/1000 of the period
+ */
+uint16_t TMR_CapDuty(TMR_CapTypeDef *hcap)
+{
+    if(hcap->mode != Edge_To_Edge || hcap->period.sum == 0)
+    {
+        return 0;
+    }
+
+    return (uint16_t)(hcap->high.sum * 1000 / hcap->period.sum);
+}
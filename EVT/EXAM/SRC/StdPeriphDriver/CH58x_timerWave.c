@@ -0,0 +1,194 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : CH58x_timerWave.c
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : TMR1/TMR2 PWM waveform engine fed by DMA from a double
+ *                      buffer, the WS2812 encoder is in CH58x_ws2812.c
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+#include "CH58x_common.h"
+
+#define TMR_WAVE_IRQN(base)    (((base) == BA_TMR1) ? TMR1_IRQn : TMR2_IRQn)
+
+/*********************************************************************
+ * @fn      TMR_WaveRefill
+ *
+ * @brief   Refill one half of the double buffer
+ *
+ * @param   hwave   - engine handle
+ * @param   idx     - half
+ *
+ * @return  none
+ */
+__HIGH_CODE
+static void TMR_WaveRefill(TMR_WaveTypeDef *hwave, uint8_t idx)
+{
+    uint32_t *p = hwave->buf + idx * hwave->half;
+    uint16_t  n = 0;
+
+    if(!hwave->ending)
+    {
+        n = hwave->fill(hwave->ctx, p, hwave->half);
+        if(n == 0)
+        { // end of stream, let the FIFO drain zeros before the timer stops
+            hwave->ending = 1;
+            n = (hwave->half < TMR_WAVE_TAIL) ? hwave->half : TMR_WAVE_TAIL;
+            memset(p, 0, n * sizeof(uint32_t));
+        }
+    }
+    hwave->len[idx] = n;
+}
+
+/*********************************************************************
+ * @fn      TMR_WaveRun
+ *
+ * @brief   Hand one half to the DMA
+ *
+ * @param   hwave   - engine handle
+ * @param   idx     - half
+ *
+ * @return  none
+ */
+__HIGH_CODE
+static void TMR_WaveRun(TMR_WaveTypeDef *hwave, uint8_t idx)
+{
+    PUINT8V   base = hwave->base;
+    uint32_t *p = hwave->buf + idx * hwave->half;
+
+    base[TMR_CTRL_DMA] = 0;
+    *(PUINT16V)(base + TMR_DMA_BEG) = (uint32_t)p;
+    *(PUINT16V)(base + TMR_DMA_END) = (uint32_t)(p + hwave->len[idx]);
+    base[TMR_INT_FLAG] = RB_TMR_IF_DMA_END;
+    base[TMR_CTRL_DMA] = RB_TMR_DMA_ENABLE;
+    hwave->cur = idx;
+}
+
+/*********************************************************************
+ * @fn      TMR_WaveInit
+ *
+ * @brief   Bind a waveform engine to TMR1 or TMR2
+ *
+ * @param   hwave   - engine handle
+ * @param   base    - BA_TMR1 / BA_TMR2
+ * @param   buf     - double buffer, 2 * half words, 4-byte aligned
+ * @param   half    - words per half
+ * @param   cycle   - PWM period in Tsys
+ * @param   pr      - output polarity, refer to PWMX_PolarTypeDef
+ *
+ * @return  none
+ */
+void TMR_WaveInit(TMR_WaveTypeDef *hwave, PUINT8V base, uint32_t *buf, uint16_t half, uint32_t cycle,
+                  PWMX_PolarTypeDef pr)
+{
+    hwave->base = base;
+    hwave->buf = buf;
+    hwave->half = half;
+    hwave->cycle = cycle;
+    hwave->polar = pr;
+    hwave->busy = 0;
+}
+
+/*********************************************************************
+ * @fn      TMR_WaveStart
+ *
+ * @brief   Start streaming
+ *
+ * @param   hwave   - engine handle
+ * @param   fill    - produces the duty words
+ * @param   done    - called when the output has finished, may be NULL
+ * @param   ctx     - passed to fill and done
+ *
+ * @return  0 - started, 1 - busy
+ */
+uint8_t TMR_WaveStart(TMR_WaveTypeDef *hwave, pfnTMRWaveFill_t fill, pfnTMRWaveDone_t done, void *ctx)
+{
+    PUINT8V base = hwave->base;
+
+    if(hwave->busy)
+    {
+        return 1;
+    }
+    hwave->fill = fill;
+    hwave->done = done;
+    hwave->ctx = ctx;
+    hwave->ending = 0;
+    TMR_WaveRefill(hwave, 0);
+    TMR_WaveRefill(hwave, 1);
+    hwave->busy = 1;
+
+    base[TMR_CTRL_MOD] = RB_TMR_ALL_CLEAR;
+    base[TMR_CTRL_MOD] = (hwave->polar << 4) | (PWM_Times_1 << 6);
+    *(PUINT32V)(base + TMR_CNT_END) = hwave->cycle;
+    TMR_WaveRun(hwave, 0);
+    base[TMR_INTER_EN] |= RB_TMR_IE_DMA_END;
+    PFIC_EnableIRQ(TMR_WAVE_IRQN(base));
+    base[TMR_CTRL_MOD] |= RB_TMR_OUT_EN | RB_TMR_COUNT_EN;
+
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      TMR_WaveIRQHandler
+ *
+ * @brief   Waveform interrupt service: start the next half, then refill the
+ *          finished one while the timer FIFO keeps the output going
+ *
+ * @param   hwave   - engine handle
+ *
+ * @return  none
+ */
+__HIGH_CODE
+void TMR_WaveIRQHandler(TMR_WaveTypeDef *hwave)
+{
+    PUINT8V base = hwave->base;
+    uint8_t idx = hwave->cur;
+
+    if(!(base[TMR_INT_FLAG] & RB_TMR_IF_DMA_END))
+    {
+        return;
+    }
+    if(hwave->len[idx ^ 1])
+    {
+        TMR_WaveRun(hwave, idx ^ 1);
+        TMR_WaveRefill(hwave, idx);
+        return;
+    }
+
+    /* the tail has gone into the FIFO, the data before it is out */
+    base[TMR_CTRL_DMA] = 0;
+    base[TMR_INTER_EN] &= ~RB_TMR_IE_DMA_END;
+    base[TMR_INT_FLAG] = RB_TMR_IF_DMA_END;
+    base[TMR_CTRL_MOD] &= ~(RB_TMR_OUT_EN | RB_TMR_COUNT_EN);
+    hwave->busy = 0;
+    if(hwave->done)
+    {
+        hwave->done(hwave->ctx);
+    }
+}
+
+/*********************************************************************
+ * @fn      WS2812_Show
+ *
+ * @brief   Send the pixel buffer to the strip
+ *
+ * @param   hled    - encoder handle
+ * @param   hwave   - waveform engine
+ * @param   done    - called when the strip is latched, may be NULL
+ *
+ * @return  0 - started, 1 - busy
+ */
+uint8_t WS2812_Show(WS2812_TypeDef *hled, TMR_WaveTypeDef *hwave, pfnTMRWaveDone_t done)
+{
+    if(hwave->busy)
+    {
+        return 1;
+    }
+    WS2812_Rewind(hled);
+
+    return TMR_WaveStart(hwave, WS2812_Fill, done, hled);
+}
@@ -0,0 +1,359 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : CH58x_uartAsync.c
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : Interrupt driven UART driver with ring buffers,
+ *                      one implementation for UART0..UART3
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+#include "CH58x_common.h"
+
+/*********************************************************************
+ * @fn      UART_AsyncRxDrain
+ *
+ * @brief   Move everything in the RX FIFO into the RX ring
+ *
+ * @param   huart   - driver handle
+ *
+ * @return  events to report
+ */
+__HIGH_CODE
+static uint8_t UART_AsyncRxDrain(UART_AsyncTypeDef *huart)
+{
+    PUINT8V  base = huart->base;
+    uint16_t head = huart->rxHead;
+    uint16_t room = huart->rxMask + 1 - (uint16_t)(head - huart->rxTail);
+    uint8_t  n = base[UART_RFC];
+    uint8_t  evt = UART_ASYNC_EVT_RX_DATA;
+
+    while(n--)
+    {
+        if(room)
+        {
+            huart->rxBuf[head & huart->rxMask] = base[UART_RBR];
+            head++;
+            room--;
+        }
+        else
+        {
+            (void)base[UART_RBR];
+            huart->rxDropped++;
+            evt |= UART_ASYNC_EVT_RX_OVERRUN;
+        }
+    }
+    huart->rxHead = head;
+
+    return evt;
+}
+
+/*********************************************************************
+ * @fn      UART_AsyncTxFill
+ *
+ * @brief   Top up the TX FIFO from the TX ring
+ *
+ * @param   huart   - driver handle
+ *
+ * @return  0 - ring drained, 1 - data still pending
+ */
+__HIGH_CODE
+static uint8_t UART_AsyncTxFill(UART_AsyncTypeDef *huart)
+{
+    PUINT8V  base = huart->base;
+    uint16_t tail = huart->txTail;
+    uint16_t head = huart->txHead;
+    uint8_t  n = UART_FIFO_SIZE - base[UART_TFC];
+
+    while(n-- && tail != head)
+    {
+        base[UART_THR] = huart->txBuf[tail & huart->txMask];
+        tail++;
+    }
+    huart->txTail = tail;
+
+    return (tail != head);
+}
+
+/*********************************************************************
+ * @fn      UART_AsyncInit
+ *
+ * @brief   Bind a UART to its RX/TX rings and enable RX/line status interrupts.
+ *          The UART must already be configured (UARTx_DefInit), the caller
+ *          still enables UARTx_IRQn and calls UART_AsyncIRQHandler from it.
+ *
+ * @param   huart   - driver handle
+ * @param   base    - BA_UART0..BA_UART3
+ * @param   rxBuf   - RX ring
+ * @param   rxSize  - RX ring size, power of two, at most 0x8000
+ * @param   txBuf   - TX ring
+ * @param   txSize  - TX ring size, power of two, at most 0x8000
+ * @param   cb      - event callback, called from interrupt context, may be NULL
+ *
+ * @return  none
+ */
+void UART_AsyncInit(UART_AsyncTypeDef *huart, PUINT8V base, uint8_t *rxBuf, uint16_t rxSize,
+                    uint8_t *txBuf, uint16_t txSize, pfnUARTAsyncCB_t cb)
+{
+    huart->base = base;
+    huart->rxBuf = rxBuf;
+    huart->txBuf = txBuf;
+    huart->rxMask = rxSize - 1;
+    huart->txMask = txSize - 1;
+    huart->rxHead = 0;
+    huart->rxTail = 0;
+    huart->txHead = 0;
+    huart->txTail = 0;
+    huart->rxDropped = 0;
+    huart->lineStatus = 0;
+    huart->callback = cb;
+
+    base[UART_FCR] |= RB_FCR_RX_FIFO_CLR | RB_FCR_TX_FIFO_CLR;
+    base[UART_IER] = (base[UART_IER] & ~RB_IER_THR_EMPTY) | RB_IER_RECV_RDY | RB_IER_LINE_STAT;
+    base[UART_MCR] |= RB_MCR_INT_OE;
+}
+
+/*********************************************************************
+ * @fn      UART_AsyncIRQHandler
+ *
+ * @brief   UART interrupt service, call it from UARTx_IRQHandler.
+ *          Services every pending source before returning so one entry
+ *          covers a full FIFO turn-around at high baud rates.
+ *
+ * @param   huart   - driver handle
+ *
+ * @return  none
+ */
+__HIGH_CODE
+void UART_AsyncIRQHandler(UART_AsyncTypeDef *huart)
+{
+    PUINT8V base = huart->base;
+    uint8_t evt = 0;
+    uint8_t more = 1;
+    uint8_t iir;
+
+    while(more && !((iir = base[UART_IIR]) & RB_IIR_NO_INT))
+    {
+        switch(iir & RB_IIR_INT_MASK)
+        {
+            case UART_II_LINE_STAT:
+                huart->lineStatus = base[UART_LSR];
+                evt |= UART_ASYNC_EVT_LINE_ERR;
+                break;
+
+            case UART_II_RECV_RDY:
+            case UART_II_RECV_TOUT:
+                evt |= UART_AsyncRxDrain(huart);
+                break;
+
+            case UART_II_THR_EMPTY:
+                if(!UART_AsyncTxFill(huart))
+                {
+                    base[UART_IER] &= ~RB_IER_THR_EMPTY;
+                    evt |= UART_ASYNC_EVT_TX_DONE;
+                }
+                break;
+
+            case UART_II_MODEM_CHG:
+                (void)base[UART_MSR];
+                break;
+
+            default:
+                /* unexpected source, leave it to the next entry */
+                (void)base[UART_LSR];
+                more = 0;
+                break;
+        }
+    }
+
+    if(evt && huart->callback)
+    {
+        huart->callback(huart, evt);
+    }
+}
+
+/*********************************************************************
+ * @fn      UART_AsyncRxLength
+ *
+ * @brief   Number of bytes waiting in the RX ring
+ *
+ * @param   huart   - driver handle
+ *
+ * @return  byte count
+ */
+uint16_t UART_AsyncRxLength(UART_AsyncTypeDef *huart)
+{
+    return (uint16_t)(huart->rxHead - huart->rxTail);
+}
+
+/*********************************************************************
+ * @fn      UART_AsyncRxPeek
+ *
+ * @brief   Borrow the contiguous readable span at the RX tail, the data
+ *          stays valid until it is released
+ *
+ * @param   huart   - driver handle
+ * @param   ppData  - returns the span start address
+ *
+ * @return  span length
+ */
+uint16_t UART_AsyncRxPeek(UART_AsyncTypeDef *huart, uint8_t **ppData)
+{
+    uint16_t tail = huart->rxTail;
+    uint16_t avail = (uint16_t)(huart->rxHead - tail);
+    uint16_t idx = tail & huart->rxMask;
+    uint16_t contig = huart->rxMask + 1 - idx;
+
+    *ppData = &huart->rxBuf[idx];
+
+    return (avail < contig) ? avail : contig;
+}
+
+/*********************************************************************
+ * @fn      UART_AsyncRxRelease
+ *
+ * @brief   Give back bytes borrowed with UART_AsyncRxPeek
+ *
+ * @param   huart   - driver handle
+ * @param   len     - bytes consumed
+ *
+ * @return  none
+ */
+void UART_AsyncRxRelease(UART_AsyncTypeDef *huart, uint16_t len)
+{
+    huart->rxTail += len;
+}
+
+/*********************************************************************
+ * @fn      UART_AsyncRead
+ *
+ * @brief   Copy out of the RX ring
+ *
+ * @param   huart   - driver handle
+ * @param   buf     - destination
+ * @param   len     - destination size
+ *
+ * @return  bytes actually read
+ */
+uint16_t UART_AsyncRead(UART_AsyncTypeDef *huart, uint8_t *buf, uint16_t len)
+{
+    uint16_t total = 0;
+    uint16_t n;
+    uint8_t *p;
+
+    while(total < len && (n = UART_AsyncRxPeek(huart, &p)) != 0)
+    {
+        if(n > len - total)
+        {
+            n = len - total;
+        }
+        memcpy(buf + total, p, n);
+        UART_AsyncRxRelease(huart, n);
+        total += n;
+    }
+
+    return total;
+}
+
+/*********************************************************************
+ * @fn      UART_AsyncTxReserve
+ *
+ * @brief   Borrow the contiguous writable span at the TX head
+ *
+ * @param   huart   - driver handle
+ * @param   ppData  - returns the span start address
+ *
+ * @return  span length
+ */
+uint16_t UART_AsyncTxReserve(UART_AsyncTypeDef *huart, uint8_t **ppData)
+{
+    uint16_t head = huart->txHead;
+    uint16_t room = huart->txMask + 1 - (uint16_t)(head - huart->txTail);
+    uint16_t idx = head & huart->txMask;
+    uint16_t contig = huart->txMask + 1 - idx;
+
+    *ppData = &huart->txBuf[idx];
+
+    return (room < contig) ? room : contig;
+}
+
+/*********************************************************************
+ * @fn      UART_AsyncTxCommit
+ *
+ * @brief   Queue bytes filled after UART_AsyncTxReserve and start sending.
+ *          The FIFO is primed here, the THR empty interrupt keeps it fed.
+ *
+ * @param   huart   - driver handle
+ * @param   len     - bytes filled in
+ *
+ * @return  none
+ */
+void UART_AsyncTxCommit(UART_AsyncTypeDef *huart, uint16_t len)
+{
+    uint32_t irq_status;
+
+    if(len == 0)
+    {
+        return;
+    }
+
+    SYS_DisableAllIrq(&irq_status);
+    huart->txHead += len;
+    if(!(huart->base[UART_IER] & RB_IER_THR_EMPTY))
+    {
+        UART_AsyncTxFill(huart);
+        huart->base[UART_IER] |= RB_IER_THR_EMPTY;
+    }
+    SYS_RecoverIrq(irq_status);
+}
+
+/*********************************************************************
+ * @fn      UART_AsyncWrite
+ *
+ * @brief   Copy into the TX ring and start sending
+ *
+ * @param   huart   - driver handle
+ * @param   buf     - data to send
+ * @param   len     - data length
+ *
+ * @return  bytes actually queued
+ */
+uint16_t UART_AsyncWrite(UART_AsyncTypeDef *huart, const uint8_t *buf, uint16_t len)
+{
+    uint16_t head = huart->txHead;
+    uint16_t room = huart->txMask + 1 - (uint16_t)(head - huart->txTail);
+    uint16_t idx = head & huart->txMask;
+    uint16_t first;
+
+    if(len > room)
+    {
+        len = room;
+    }
+    first = huart->txMask + 1 - idx;
+    if(first > len)
+    {
+        first = len;
+    }
+    memcpy(&huart->txBuf[idx], buf, first);
+    memcpy(huart->txBuf, buf + first, len - first);
+    UART_AsyncTxCommit(huart, len);
+
+    return len;
+}
+
+/*********************************************************************
+ * @fn      UART_AsyncTxPending
+ *
+ * @brief   Bytes queued but not yet moved into the hardware FIFO
+ *
+ * @param   huart   - driver handle
+ *
+ * @return  byte count
+ */
+uint16_t UART_AsyncTxPending(UART_AsyncTypeDef *huart)
+{
+    return (uint16_t)(huart->txHead - huart->txTail);
+}
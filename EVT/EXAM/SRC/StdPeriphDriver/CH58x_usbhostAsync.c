@@ -0,0 +1,625 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : CH58x_usbhostAsync.c
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : Interrupt driven USB host transfer engine for the
+ *                      USB1 root port, per endpoint queues, NAK retry on
+ *                      the SOF timer instead of busy waiting
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+#include "CH58x_common.h"
+
+#define USBH_STAGE_SETUP     0
+#define USBH_STAGE_DATA      1
+#define USBH_STAGE_STATUS    2
+
+#define USBH_ERR_RETRY       3 // timeouts and bad toggles tolerated per transaction
+
+static USBHostEndp_t *volatile AsyncCur; // endpoint with a transaction on the bus
+static USBHostEndp_t          *AsyncList;
+static USBHostEndp_t          *AsyncLast; // round robin position
+static uint8_t                *AsyncRxDma;
+static uint8_t                *AsyncTxDma;
+static uint8_t                 AsyncTxLen;
+static uint8_t                 AsyncStarted = 0;
+
+/* held by synchronous callers */
+static volatile uint8_t AsyncHeld;
+static volatile uint8_t AsyncHoldDepth;
+static volatile uint8_t AsyncHoldIdle;
+
+/* host registers as the synchronous code left them */
+static uint8_t  CtxSaved;
+static uint8_t  CtxDevAd, CtxUsbCtrl, CtxSetup, CtxRxCtrl, CtxTxCtrl, CtxTxLen;
+static uint16_t CtxRxDma, CtxTxDma;
+
+/*********************************************************************
+ * @fn      USBHostAsync_IsIn
+ *
+ * @brief   Direction of the next transaction on an endpoint
+ *
+ * @param   ep      - endpoint
+ *
+ * @return  non zero for IN
+ */
+__HIGH_CODE
+static uint8_t USBHostAsync_IsIn(USBHostEndp_t *ep)
+{
+    USBHostXfer_t *xfer = ep->head;
+    uint8_t        in;
+
+    if(ep->type != USB_ENDP_TYPE_CTRL)
+    {
+        return (ep->endpAddr & USB_ENDP_DIR_MASK);
+    }
+    in = (xfer->setup[0] & USB_REQ_TYP_IN) && xfer->len;
+    if(ep->stage == USBH_STAGE_DATA)
+    {
+        return in;
+    }
+    /* status stage runs the other way, IN when there was no data */
+    return (ep->stage == USBH_STAGE_STATUS) ? !in : 0;
+}
+
+/*********************************************************************
+ * @fn      USBHostAsync_Start
+ *
+ * @brief   Put the next transaction of an endpoint on the bus
+ *
+ * @param   ep      - endpoint, its queue is not empty
+ *
+ * @return  none
+ */
+__HIGH_CODE
+static void USBHostAsync_Start(USBHostEndp_t *ep)
+{
+    USBHostXfer_t *xfer = ep->head;
+    uint8_t        pid;
+    uint16_t       n;
+
+    if(!CtxSaved)
+    {
+        CtxSaved = 1;
+        CtxDevAd = R8_USB_DEV_AD;
+        CtxUsbCtrl = R8_USB_CTRL;
+        CtxSetup = R8_UH_SETUP;
+        CtxRxCtrl = R8_UH_RX_CTRL;
+        CtxTxCtrl = R8_UH_TX_CTRL;
+        CtxTxLen = R8_UH_TX_LEN;
+        CtxRxDma = R16_UH_RX_DMA;
+        CtxTxDma = R16_UH_TX_DMA;
+        R16_UH_RX_DMA = (uint16_t)(uint32_t)AsyncRxDma;
+        R16_UH_TX_DMA = (uint16_t)(uint32_t)AsyncTxDma;
+    }
+
+    R8_USB_DEV_AD = (R8_USB_DEV_AD & RB_UDA_GP_BIT) | (ep->devAddr & MASK_USB_ADDR);
+    if(ep->speed)
+    {
+        R8_USB_CTRL &= ~RB_UC_LOW_SPEED;
+        R8_UH_SETUP &= ~RB_UH_PRE_PID_EN;
+    }
+    else
+    {
+        R8_USB_CTRL |= RB_UC_LOW_SPEED;
+        if(ep->viaHub)
+        {
+            R8_UH_SETUP |= RB_UH_PRE_PID_EN;
+        }
+    }
+
+    if(ep->type == USB_ENDP_TYPE_CTRL && ep->stage == USBH_STAGE_SETUP)
+    {
+        memcpy(AsyncTxDma, xfer->setup, sizeof(USB_SETUP_REQ));
+        AsyncTxLen = sizeof(USB_SETUP_REQ);
+        R8_UH_TX_LEN = AsyncTxLen;
+        R8_UH_TX_CTRL = 0;
+        pid = USB_PID_SETUP << 4;
+    }
+    else if(USBHostAsync_IsIn(ep))
+    {
+        R8_UH_RX_CTRL = ep->toggle ? RB_UH_R_TOG : 0;
+        pid = USB_PID_IN << 4;
+    }
+    else
+    {
+        n = 0;
+        if(ep->stage != USBH_STAGE_STATUS)
+        {
+            n = xfer->len - xfer->actual;
+            if(n > ep->maxPacket)
+            {
+                n = ep->maxPacket;
+            }
+            memcpy(AsyncTxDma, xfer->buf + xfer->actual, n);
+        }
+        AsyncTxLen = n;
+        R8_UH_TX_LEN = n;
+        R8_UH_TX_CTRL = ep->toggle ? RB_UH_T_TOG : 0;
+        pid = USB_PID_OUT << 4;
+    }
+
+    AsyncCur = ep;
+    R8_USB_INT_FG = RB_UIF_TRANSFER;
+    R8_UH_EP_PID = pid | (ep->endpAddr & USB_ENDP_ADDR_MASK);
+}
+
+/*********************************************************************
+ * @fn      USBHostAsync_Finish
+ *
+ * @brief   Take the head transfer off an endpoint and report it
+ *
+ * @param   ep      - endpoint
+ * @param   status  - ERR_SUCCESS or an error code
+ *
+ * @return  none
+ */
+__HIGH_CODE
+static void USBHostAsync_Finish(USBHostEndp_t *ep, uint8_t status)
+{
+    USBHostXfer_t *xfer = ep->head;
+
+    ep->head = xfer->next;
+    if(ep->head == NULL)
+    {
+        ep->tail = NULL;
+    }
+    ep->stage = USBH_STAGE_SETUP;
+    ep->retry = 0;
+    ep->naks = 0;
+    if(ep->type == USB_ENDP_TYPE_INTER)
+    {
+        ep->wait = ep->interval;
+    }
+
+    xfer->status = status;
+    if(xfer->callback)
+    {
+        xfer->callback(xfer);
+    }
+}
+
+/*********************************************************************
+ * @fn      USBHostAsync_Done
+ *
+ * @brief   A transaction ended, move its transfer forward
+ *
+ * @param   ep      - endpoint
+ * @param   st      - R8_USB_INT_ST
+ *
+ * @return  none
+ */
+__HIGH_CODE
+static void USBHostAsync_Done(USBHostEndp_t *ep, uint8_t st)
+{
+    USBHostXfer_t *xfer = ep->head;
+    uint8_t        r = st & MASK_UIS_H_RES;
+    uint8_t        in = USBHostAsync_IsIn(ep);
+    uint8_t        n;
+
+    if(st & RB_UIS_TOG_OK)
+    {
+        ep->retry = 0;
+        ep->toggle ^= 1;
+
+        if(ep->type == USB_ENDP_TYPE_CTRL && ep->stage == USBH_STAGE_SETUP)
+        {
+            ep->toggle = 1;
+            ep->stage = xfer->len ? USBH_STAGE_DATA : USBH_STAGE_STATUS;
+            return;
+        }
+        if(ep->stage == USBH_STAGE_STATUS)
+        {
+            USBHostAsync_Finish(ep, ERR_SUCCESS);
+            return;
+        }
+
+        if(in)
+        {
+            n = R8_USB_RX_LEN;
+            if(n > xfer->len - xfer->actual)
+            {
+                USBHostAsync_Finish(ep, ERR_USB_BUF_OVER);
+                return;
+            }
+            memcpy(xfer->buf + xfer->actual, AsyncRxDma, n);
+        }
+        else
+        {
+            n = AsyncTxLen;
+        }
+        xfer->actual += n;
+
+        if(xfer->actual < xfer->len && n == ep->maxPacket)
+        {
+            return;
+        }
+        if(!in && n == ep->maxPacket && (xfer->flags & USBH_XFER_ZLP))
+        {
+            return; // a zero length packet follows
+        }
+        if(ep->type == USB_ENDP_TYPE_CTRL)
+        {
+            ep->toggle = 1;
+            ep->stage = USBH_STAGE_STATUS;
+            return;
+        }
+        USBHostAsync_Finish(ep, ERR_SUCCESS);
+    }
+    else if(r == USB_PID_NAK)
+    {
+        if(xfer->nakLimit != 0xFFFF && ep->naks++ >= xfer->nakLimit)
+        {
+            USBHostAsync_Finish(ep, USB_PID_NAK | ERR_USB_TRANSFER);
+            return;
+        }
+        /* try again on a later frame, the bus is free for other endpoints */
+        ep->wait = (ep->type == USB_ENDP_TYPE_INTER) ? ep->interval : 1;
+    }
+    else if(r == USB_PID_STALL || (r && !in))
+    {
+        USBHostAsync_Finish(ep, r | ERR_USB_TRANSFER);
+    }
+    else
+    {
+        /* no answer, or IN data with the wrong toggle */
+        if(++ep->retry >= USBH_ERR_RETRY)
+        {
+            USBHostAsync_Finish(ep, ERR_USB_TRANSFER);
+            return;
+        }
+        ep->wait = 1;
+    }
+}
+
+/*********************************************************************
+ * @fn      USBHostAsync_Kick
+ *
+ * @brief   Start the next ready endpoint, round robin, and keep the SOF
+ *          interrupt on only while some endpoint waits for a frame
+ *
+ * @return  none
+ */
+__HIGH_CODE
+static void USBHostAsync_Kick(void)
+{
+    USBHostEndp_t *first, *ep;
+    uint8_t        sof = AsyncHeld;
+
+    if(AsyncCur == NULL && !AsyncHeld && AsyncList)
+    {
+        first = (AsyncLast && AsyncLast->next) ? AsyncLast->next : AsyncList;
+        ep = first;
+        do
+        {
+            if(ep->head && ep->wait == 0)
+            {
+                AsyncLast = ep;
+                USBHostAsync_Start(ep);
+                break;
+            }
+            ep = ep->next ? ep->next : AsyncList;
+        } while(ep != first);
+    }
+
+    for(ep = AsyncList; ep; ep = ep->next)
+    {
+        if(ep->head && ep->wait)
+        {
+            sof = 1;
+        }
+    }
+    if(sof)
+    {
+        R8_USB_INT_EN |= RB_UIE_HST_SOF;
+    }
+    else
+    {
+        R8_USB_INT_EN &= ~RB_UIE_HST_SOF;
+    }
+}
+
+/*********************************************************************
+ * @fn      USBHostAsync_Init
+ *
+ * @brief   Start the engine on a host set up by USB_HostInit. Plug events
+ *          are still polled from R8_USB_INT_FG by the application, the
+ *          caller enables USB_IRQn and calls USBHostAsync_IRQHandler.
+ *
+ * @param   rxDma   - 64 byte receive buffer, 4 byte aligned
+ * @param   txDma   - 64 byte transmit buffer, 4 byte aligned
+ *
+ * @return  none
+ */
+void USBHostAsync_Init(uint8_t *rxDma, uint8_t *txDma)
+{
+    AsyncRxDma = rxDma;
+    AsyncTxDma = txDma;
+    AsyncList = NULL;
+    AsyncLast = NULL;
+    AsyncCur = NULL;
+    AsyncHeld = 0;
+    AsyncHoldDepth = 0;
+    CtxSaved = 0;
+    AsyncStarted = 1;
+
+    R8_USB_INT_FG = RB_UIF_TRANSFER | RB_UIF_HST_SOF;
+    R8_USB_INT_EN = RB_UIE_TRANSFER;
+}
+
+/*********************************************************************
+ * @fn      USBHostAsync_AddEndp
+ *
+ * @brief   Schedule an endpoint. devAddr, endpAddr, type, maxPacket,
+ *          interval, speed and viaHub are filled in by the caller, the
+ *          data toggle starts at DATA0.
+ *
+ * @param   ep      - endpoint
+ *
+ * @return  none
+ */
+void USBHostAsync_AddEndp(USBHostEndp_t *ep)
+{
+    ep->head = NULL;
+    ep->tail = NULL;
+    ep->toggle = 0;
+    ep->wait = 0;
+    ep->stage = USBH_STAGE_SETUP;
+    ep->retry = 0;
+    ep->naks = 0;
+    if(ep->interval == 0)
+    {
+        ep->interval = 1;
+    }
+
+    PFIC_DisableIRQ(USB_IRQn);
+    ep->next = AsyncList;
+    AsyncList = ep;
+    PFIC_EnableIRQ(USB_IRQn);
+}
+
+/*********************************************************************
+ * @fn      USBHostAsync_RemoveEndp
+ *
+ * @brief   Unschedule an endpoint, its queued transfers end with status
+ *          (callbacks run here). Waits for a transaction of this
+ *          endpoint on the bus, do not call it from a callback.
+ *
+ * @param   ep      - endpoint
+ * @param   status  - status for the dropped transfers, e.g. ERR_USB_DISCON
+ *
+ * @return  none
+ */
+void USBHostAsync_RemoveEndp(USBHostEndp_t *ep, uint8_t status)
+{
+    USBHostEndp_t **pp;
+    USBHostXfer_t  *xfer;
+
+    while(1)
+    {
+        PFIC_DisableIRQ(USB_IRQn);
+        if(AsyncCur != ep)
+        {
+            break;
+        }
+        PFIC_EnableIRQ(USB_IRQn);
+    }
+    for(pp = &AsyncList; *pp; pp = &(*pp)->next)
+    {
+        if(*pp == ep)
+        {
+            *pp = ep->next;
+            break;
+        }
+    }
+    AsyncLast = NULL;
+    xfer = ep->head;
+    ep->head = NULL;
+    ep->tail = NULL;
+    PFIC_EnableIRQ(USB_IRQn);
+
+    /* a callback submitting again only queues on the unlinked endpoint */
+    while(xfer)
+    {
+        USBHostXfer_t *next = xfer->next;
+        xfer->status = status;
+        if(xfer->callback)
+        {
+            xfer->callback(xfer);
+        }
+        xfer = next;
+    }
+}
+
+/*********************************************************************
+ * @fn      USBHostAsync_Submit
+ *
+ * @brief   Queue a transfer. setup, buf, len, nakLimit, flags, callback
+ *          and arg are filled in by the caller. The callback runs in the
+ *          interrupt and may submit again.
+ *
+ * @param   ep      - endpoint
+ * @param   xfer    - transfer, owned by the engine until its callback
+ *
+ * @return  ERR_SUCCESS, ERR_USB_UNKNOWN if the transfer is still queued
+ */
+uint8_t USBHostAsync_Submit(USBHostEndp_t *ep, USBHostXfer_t *xfer)
+{
+    uint8_t en = PFIC_GetStatusIRQ(USB_IRQn);
+
+    if(xfer->status == USBH_XFER_BUSY)
+    {
+        return ERR_USB_UNKNOWN;
+    }
+    xfer->next = NULL;
+    xfer->endp = ep;
+    xfer->actual = 0;
+    xfer->status = USBH_XFER_BUSY;
+
+    PFIC_DisableIRQ(USB_IRQn);
+    if(ep->tail)
+    {
+        ep->tail->next = xfer;
+    }
+    else
+    {
+        ep->head = xfer;
+    }
+    ep->tail = xfer;
+    USBHostAsync_Kick();
+    if(en)
+    {
+        PFIC_EnableIRQ(USB_IRQn);
+    }
+    return ERR_SUCCESS;
+}
+
+/*********************************************************************
+ * @fn      USBHostAsync_Transfer
+ *
+ * @brief   Synchronous form of USBHostAsync_Submit, spins until done.
+ *          Not for BLE applications or callbacks.
+ *
+ * @param   ep      - endpoint
+ * @param   setup   - 8 byte request for control endpoints, else NULL
+ * @param   buf     - data
+ * @param   len     - data length
+ * @param   actual  - returns the bytes moved, may be NULL
+ *
+ * @return  ERR_SUCCESS or an error code
+ */
+uint8_t USBHostAsync_Transfer(USBHostEndp_t *ep, const uint8_t *setup, uint8_t *buf, uint16_t len, uint16_t *actual)
+{
+    USBHostXfer_t xfer;
+
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.setup = setup;
+    xfer.buf = buf;
+    xfer.len = len;
+    xfer.nakLimit = 200; // 200 frames, as the 200 ms of HostCtrlTransfer
+    USBHostAsync_Submit(ep, &xfer);
+    while(xfer.status == USBH_XFER_BUSY)
+    {
+        ;
+    }
+    if(actual)
+    {
+        *actual = xfer.actual;
+    }
+    return xfer.status;
+}
+
+/*********************************************************************
+ * @fn      USBHostAsync_Hold
+ *
+ * @brief   Lend the host to synchronous code (USBHostTransact and the
+ *          libraries built on it). Waits for the transaction on the bus,
+ *          then puts back the registers the synchronous code left. Calls
+ *          nest, the engine runs again USBH_ASYNC_HOLD_FRAMES after the
+ *          last USBHostAsync_Release.
+ *
+ * @return  none
+ */
+void USBHostAsync_Hold(void)
+{
+    if(!AsyncStarted)
+    {
+        return;
+    }
+
+    AsyncHoldDepth++;
+    AsyncHoldIdle = 0;
+    if(AsyncHeld)
+    {
+        return;
+    }
+    AsyncHeld = 1;
+    while(AsyncCur)
+    {
+        ;
+    }
+
+    PFIC_DisableIRQ(USB_IRQn);
+    R8_USB_INT_EN = (R8_USB_INT_EN & ~RB_UIE_TRANSFER) | RB_UIE_HST_SOF;
+    if(CtxSaved)
+    {
+        CtxSaved = 0;
+        R8_USB_DEV_AD = CtxDevAd;
+        R8_USB_CTRL = CtxUsbCtrl;
+        R8_UH_SETUP = CtxSetup;
+        R8_UH_RX_CTRL = CtxRxCtrl;
+        R8_UH_TX_CTRL = CtxTxCtrl;
+        R8_UH_TX_LEN = CtxTxLen;
+        R16_UH_RX_DMA = CtxRxDma;
+        R16_UH_TX_DMA = CtxTxDma;
+    }
+    PFIC_EnableIRQ(USB_IRQn);
+}
+
+/*********************************************************************
+ * @fn      USBHostAsync_Release
+ *
+ * @brief   End of a USBHostAsync_Hold
+ *
+ * @return  none
+ */
+void USBHostAsync_Release(void)
+{
+    if(AsyncHoldDepth)
+    {
+        AsyncHoldIdle = 0;
+        AsyncHoldDepth--;
+    }
+}
+
+/*********************************************************************
+ * @fn      USBHostAsync_IRQHandler
+ *
+ * @brief   USB host interrupt service, call it from USB_IRQHandler
+ *
+ * @return  none
+ */
+__HIGH_CODE
+void USBHostAsync_IRQHandler(void)
+{
+    USBHostEndp_t *ep;
+    uint8_t        st;
+
+    if(R8_USB_INT_FG & RB_UIF_HST_SOF)
+    {
+        R8_USB_INT_FG = RB_UIF_HST_SOF;
+        for(ep = AsyncList; ep; ep = ep->next)
+        {
+            if(ep->wait)
+            {
+                ep->wait--;
+            }
+        }
+        if(AsyncHeld && AsyncHoldDepth == 0 && ++AsyncHoldIdle >= USBH_ASYNC_HOLD_FRAMES)
+        {
+            AsyncHeld = 0;
+            R8_USB_INT_FG = RB_UIF_TRANSFER;
+            R8_USB_INT_EN |= RB_UIE_TRANSFER;
+        }
+    }
+
+    /* while held and idle the flag belongs to the synchronous code */
+    if((R8_USB_INT_FG & RB_UIF_TRANSFER) && (AsyncCur || !AsyncHeld))
+    {
+        st = R8_USB_INT_ST;
+        R8_UH_EP_PID = 0x00; // stop
+        R8_USB_INT_FG = RB_UIF_TRANSFER;
+        ep = AsyncCur;
+        AsyncCur = NULL;
+        if(ep)
+        {
+            USBHostAsync_Done(ep, st);
+        }
+    }
+
+    USBHostAsync_Kick();
+}
@@ -264,21 +264,17 @@ uint8_t WaitUSB_Interrupt(void)
 }
 
 /*********************************************************************
- * @fn      USBHostTransact
+ * @fn      USBHostTransactPoll
  *
- * @brief   ,ĿĶ˵ַ/PID,ͬ־,20uSΪλNAKʱ(0,0xFFFF),0ɹ,ʱ/
- *          ӳ,ʵӦ,Ϊṩٶ,ӦöԱӳŻ
+ * @brief   USBHostTransact Ĳѯʵ,ʱ첽ó
  *
  * @param   endp_pid    - ƺ͵ַ, 4λtoken_pid, 4λǶ˵ַ
  * @param   tog         - ͬ־
  * @param   timeout     - ʱʱ
  *
- * @return  ERR_USB_UNKNOWN ʱӲ쳣
- *          ERR_USB_DISCON  豸Ͽ
- *          ERR_USB_CONNECT 豸
- *          ERR_SUCCESS     
+ * @return  ͬ USBHostTransact
  */
-uint8_t USBHostTransact(uint8_t endp_pid, uint8_t tog, uint32_t timeout)
+static uint8_t USBHostTransactPoll(uint8_t endp_pid, uint8_t tog, uint32_t timeout)
 {
     uint8_t TransRetry;
 
@@ -389,17 +385,41 @@ uint8_t USBHostTransact(uint8_t endp_pid, uint8_t tog, uint32_t timeout)
 }
 
 /*********************************************************************
- * @fn      HostCtrlTransfer
+ * @fn      USBHostTransact
  *
- * @brief   ִпƴ,8ֽpSetupReq,DataBufΪѡշ
+ * @brief   ,ĿĶ˵ַ/PID,ͬ־,20uSΪλNAKʱ(0,0xFFFF),0ɹ,ʱ/
+ *          ӳ,ʵӦ,Ϊṩٶ,ӦöԱӳŻ
  *
- * @param   DataBuf     - Ҫպͷ,ôDataBufָЧڴź
- * @param   RetLen      - ʵʳɹշܳȱRetLenָֽڱ
+ * @param   endp_pid    - ƺ͵ַ, 4λtoken_pid, 4λǶ˵ַ
+ * @param   tog         - ͬ־
+ * @param   timeout     - ʱʱ
  *
- * @return  ERR_USB_BUF_OVER    IN״̬׶γ
- *          ERR_SUCCESS         ݽɹ
+ * @return  ERR_USB_UNKNOWN ʱӲ쳣
+ *          ERR_USB_DISCON  豸Ͽ
+ *          ERR_USB_CONNECT 豸
+ *          ERR_SUCCESS     
  */
-uint8_t HostCtrlTransfer(uint8_t *DataBuf, uint8_t *RetLen)
+uint8_t USBHostTransact(uint8_t endp_pid, uint8_t tog, uint32_t timeout)
+{
+    uint8_t s;
+
+    USBHostAsync_Hold();
+    s = USBHostTransactPoll(endp_pid, tog, timeout);
+    USBHostAsync_Release();
+    return (s);
+}
+
+/*********************************************************************
+ * @fn      HostCtrlTransferPoll
+ *
+ * @brief   HostCtrlTransfer Ĳѯʵ,ƴڼ첽ó
+ *
+ * @param   DataBuf     - շ
+ * @param   RetLen      - ʵʳɹշܳ
+ *
+ * @return  ͬ HostCtrlTransfer
+ */
+static uint8_t HostCtrlTransferPoll(uint8_t *DataBuf, uint8_t *RetLen)
 {
     uint16_t RemLen = 0;
     uint8_t  s, RxLen, RxCnt, TxCnt;
@@ -495,6 +515,27 @@ uint8_t HostCtrlTransfer(uint8_t *DataBuf, uint8_t *RetLen)
     return (ERR_USB_BUF_OVER); // IN״̬׶δ
 }
 
+/*********************************************************************
+ * @fn      HostCtrlTransfer
+ *
+ * @brief   ִпƴ,8ֽpSetupReq,DataBufΪѡշ
+ *
+ * @param   DataBuf     - Ҫպͷ,ôDataBufָЧڴź
+ * @param   RetLen      - ʵʳɹշܳȱRetLenָֽڱ
+ *
+ * @return  ERR_USB_BUF_OVER    IN״̬׶γ
+ *          ERR_SUCCESS         ݽɹ
+ */
+uint8_t HostCtrlTransfer(uint8_t *DataBuf, uint8_t *RetLen)
+{
+    uint8_t s;
+
+    USBHostAsync_Hold();
+    s = HostCtrlTransferPoll(DataBuf, RetLen);
+    USBHostAsync_Release();
+    return (s);
+}
+
 /*********************************************************************
  * @fn      CopySetupReqPkg
  *
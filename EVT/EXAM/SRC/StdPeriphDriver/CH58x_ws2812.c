@@ -0,0 +1,135 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : CH58x_ws2812.c
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : WS2812/SK6812 LED strip encoder for the TMR1/TMR2
+ *                      waveform engine. Only memory is touched here, so the
+ *                      encoder also builds on a host, see test/
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+#include "CH58x_common.h"
+
+/*********************************************************************
+ * @fn      WS2812_Init
+ *
+ * @brief   Set up an LED strip encoder
+ *
+ * @param   hled    - encoder handle
+ * @param   pixels  - pixel buffer, count * bpp bytes
+ * @param   count   - number of LEDs
+ * @param   bpp     - 3 - GRB, 4 - GRBW
+ * @param   t0h     - high time of a 0 bit in Tsys
+ * @param   t1h     - high time of a 1 bit in Tsys
+ *
+ * @return  none
+ */
+void WS2812_Init(WS2812_TypeDef *hled, uint8_t *pixels, uint16_t count, uint8_t bpp, uint32_t t0h, uint32_t t1h)
+{
+    uint8_t n, k;
+
+    hled->pixels = pixels;
+    hled->count = count;
+    hled->bpp = bpp;
+    hled->reset = WS2812_RESET_SLOTS;
+    for(n = 0; n < 16; n++)
+    {
+        for(k = 0; k < 4; k++)
+        { // MSB first
+            hled->lut[n][k] = (n & (0x08 >> k)) ? t1h : t0h;
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      WS2812_SetPixel
+ *
+ * @brief   Set one LED in the pixel buffer
+ *
+ * @param   hled    - encoder handle
+ * @param   idx     - LED index
+ * @param   r, g, b - colour
+ * @param   w       - white, GRBW strips only
+ *
+ * @return  none
+ */
+void WS2812_SetPixel(WS2812_TypeDef *hled, uint16_t idx, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+{
+    uint8_t *p;
+
+    if(idx >= hled->count)
+    {
+        return;
+    }
+    p = hled->pixels + idx * hled->bpp;
+    p[0] = g;
+    p[1] = r;
+    p[2] = b;
+    if(hled->bpp > 3)
+    {
+        p[3] = w;
+    }
+}
+
+/*********************************************************************
+ * @fn      WS2812_Rewind
+ *
+ * @brief   Restart the encoder at the first pixel byte
+ *
+ * @param   hled    - encoder handle
+ *
+ * @return  none
+ */
+void WS2812_Rewind(WS2812_TypeDef *hled)
+{
+    hled->pos = 0;
+    hled->resetLeft = hled->reset;
+}
+
+/*********************************************************************
+ * @fn      WS2812_Fill
+ *
+ * @brief   Fill callback for TMR_WaveStart
+ *
+ * @param   ctx     - encoder handle
+ * @param   buf     - duty words
+ * @param   len     - room in words, a multiple of 8
+ *
+ * @return  words written, 0 - data and reset slots sent
+ */
+__HIGH_CODE
+uint16_t WS2812_Fill(void *ctx, uint32_t *buf, uint16_t len)
+{
+    WS2812_TypeDef *hled = (WS2812_TypeDef *)ctx;
+    uint32_t        bytes = (uint32_t)hled->count * hled->bpp;
+    const uint32_t *q;
+    uint16_t        n = 0;
+    uint8_t         b;
+
+    while(hled->pos < bytes && n + 8 <= len)
+    {
+        b = hled->pixels[hled->pos++];
+        q = hled->lut[b >> 4];
+        buf[n + 0] = q[0];
+        buf[n + 1] = q[1];
+        buf[n + 2] = q[2];
+        buf[n + 3] = q[3];
+        q = hled->lut[b & 0x0F];
+        buf[n + 4] = q[0];
+        buf[n + 5] = q[1];
+        buf[n + 6] = q[2];
+        buf[n + 7] = q[3];
+        n += 8;
+    }
+    while(hled->pos >= bytes && hled->resetLeft && n < len)
+    {
+        buf[n++] = 0;
+        hled->resetLeft--;
+    }
+
+    return n;
+}
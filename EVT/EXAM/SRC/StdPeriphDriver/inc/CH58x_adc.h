@@ -272,6 +272,68 @@ int adc_to_temperature_celsius(uint16_t adc_val);
  */
 #define ADC_DisablePower()        (R8_ADC_CFG &= ~RB_ADC_POWER_ON)
 
+/**
+ * @brief  ADC streaming acquisition
+ *
+ * The DMA runs in loop mode over a double buffer while the ADC converts
+ * on its own timer (ADC_AutoConverCycle), the CPU only takes the DMA end
+ * interrupt once per buffer pass. ADC_StreamPoll hands out each half as
+ * soon as the DMA has moved on to the other one, applies the calibration
+ * offset to it and calls the callback, so one half is processed while the
+ * other is being filled.
+ */
+#define ADC_STREAM_EVT_HALF       0x01 // first half of the buffer is ready
+#define ADC_STREAM_EVT_FULL       0x02 // second half of the buffer is ready
+#define ADC_STREAM_EVT_OVERRUN    0x80 // halves were overwritten before this one was handed out
+
+typedef void (*pfnADCStreamCB_t)(uint16_t *buf, uint16_t len, uint8_t evt);
+
+typedef struct
+{
+    uint16_t        *buf;      // 2 * half samples, 4-byte aligned
+    uint16_t         half;     // samples per half, even
+    int16_t          offset;   // ADC_DataCalib_Rough() value added to every sample, 0 - none
+    pfnADCStreamCB_t callback; // runs in ADC_StreamPoll
+    uint32_t         overruns; // halves lost since ADC_StreamStart
+    volatile uint16_t passes;  // driver use
+    uint16_t         done;     // driver use
+} ADC_StreamTypeDef;
+
+/**
+ * @brief   Start streaming acquisition on the configured channel, the ADC
+ *          must be initialised (ADC_ExtSingleChSampInit etc.) before
+ *
+ * @param   s       - stream descriptor, must stay valid until ADC_StreamStop
+ * @param   cycle   - sample period (256-cycle)*16*Tsys, not shorter than one conversion
+ */
+void ADC_StreamStart(ADC_StreamTypeDef *s, uint8_t cycle);
+
+/**
+ * @brief   Stop streaming acquisition, halves not yet polled are dropped
+ */
+void ADC_StreamStop(void);
+
+/**
+ * @brief   Hand finished halves to the callback, call from the main loop at
+ *          least once per half buffer
+ */
+void ADC_StreamPoll(void);
+
+/**
+ * @brief   Stream interrupt service, call it from ADC_IRQHandler
+ */
+void ADC_StreamIRQHandler(void);
+
+/**
+ * @brief   Add a calibration offset to a block of samples, two samples per
+ *          32-bit word, results are clamped to 0..4095
+ *
+ * @param   buf     - samples, 4-byte aligned
+ * @param   len     - number of samples
+ * @param   offset  - ADC_DataCalib_Rough() value
+ */
+void ADC_DataCalibApply(uint16_t *buf, uint32_t len, int16_t offset);
+
 #ifdef __cplusplus
 }
 #endif
@@ -82,6 +82,7 @@
 #include "CH58x_pwm.h"
 #include "CH58x_adc.h"
 #include "CH58x_sys.h"
+#include "CH58x_ws2812.h"
 #include "CH58x_timer.h"
 #include "CH58x_spi.h"
 #include "CH58x_usbdev.h"
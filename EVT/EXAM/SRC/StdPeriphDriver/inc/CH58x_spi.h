@@ -202,6 +202,67 @@ void SPI0_SlaveDMARecv(uint8_t *pbuf, uint16_t len);
  */
 #define SPI0_ClearITFlag(f)    (R8_SPI0_INT_FLAG = f)
 
+/**
+ * @brief  SPI0 asynchronous DMA transfer
+ *
+ * A transfer is a list of segments (e.g. command, address, payload) sent
+ * back to back with CS held. Segments longer than the 12-bit TOTAL_CNT are
+ * split into chunks and chained from the CNT_END interrupt. Transfers are
+ * queued and started one after another, the callback runs in interrupt
+ * context once the last segment has been shifted.
+ */
+#define SPI0_DMA_CHUNK_MAX    4092 // largest chunk per DMA run, keeps the next chunk 4-byte aligned
+
+#define SPI0_SEG_TX           0    // segment is written to the bus
+#define SPI0_SEG_RX           1    // segment is read from the bus
+
+typedef struct
+{
+    uint8_t *buf; // 4-byte aligned
+    uint32_t len;
+    uint8_t  dir; // SPI0_SEG_TX / SPI0_SEG_RX
+} SPI0_DMASegTypeDef;
+
+typedef struct _SPI0_DMAXfer SPI0_DMAXferTypeDef;
+
+typedef void (*pfnSPI0XferCB_t)(SPI0_DMAXferTypeDef *xfer);
+typedef void (*pfnSPI0CSCB_t)(uint8_t active);
+
+struct _SPI0_DMAXfer
+{
+    SPI0_DMASegTypeDef  *seg;
+    uint8_t              segNum;
+    pfnSPI0CSCB_t        cs;       // chip select control, may be NULL
+    pfnSPI0XferCB_t      callback; // completion callback, may be NULL
+    void                *context;  // free for the caller
+    SPI0_DMAXferTypeDef *next;     // driver use
+};
+
+/**
+ * @brief   Enable the SPI0 count-end interrupt for the async DMA engine,
+ *          SPI0 must already be initialised in master mode
+ */
+void SPI0_MasterDMAAsyncInit(void);
+
+/**
+ * @brief   Queue a transfer, it starts at once if SPI0 is idle
+ *
+ * @param   xfer    - transfer descriptor, must stay valid until the callback
+ */
+void SPI0_MasterDMAAsyncSubmit(SPI0_DMAXferTypeDef *xfer);
+
+/**
+ * @brief   Whether the async DMA engine is running or has queued transfers
+ *
+ * @return  0 - idle, !0 - busy
+ */
+uint8_t SPI0_MasterDMAAsyncBusy(void);
+
+/**
+ * @brief   Async DMA interrupt service, call it from SPI0_IRQHandler
+ */
+void SPI0_MasterDMAAsyncIRQHandler(void);
+
 #ifdef __cplusplus
 }
 #endif
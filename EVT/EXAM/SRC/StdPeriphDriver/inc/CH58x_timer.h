@@ -588,6 +588,199 @@ void TMR3_CapInit(CapModeTypeDef cap);
  */
 #define TMR3_GetITFlag(f)        (R8_TMR3_INT_FLAG & f)
 
+/**
+ * @brief  TMR1/TMR2 continuous capture engine
+ *
+ * The timer DMA runs in loop mode over a caller-owned ring of capture words,
+ * the CPU takes one DMA end interrupt per ring pass instead of one per edge.
+ * TMR_CapProcess walks the words captured since the last call and updates
+ * the statistics incrementally. All widths are in Tsys.
+ *
+ * Edge_To_Edge captures every level, bit 25 set for a high level, and gives
+ * period, high time and duty cycle. RiseEdge_To_RiseEdge and
+ * FallEdge_To_FallEdge capture whole periods only.
+ */
+#define TMR_CAP_WIDTH_MASK    (DataBit_25 - 1) // level width in a capture word
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} TMR_CapStatTypeDef;
+
+typedef struct
+{
+    PUINT8V            base;       // BA_TMR1 / BA_TMR2
+    uint32_t          *buf;        // capture ring, 4-byte aligned
+    uint16_t           size;       // ring size in words
+    uint8_t            mode;       // CapModeTypeDef
+    uint32_t           timeout;    // levels this long are a stalled input
+
+    TMR_CapStatTypeDef period;     // full periods
+    TMR_CapStatTypeDef high;       // high time of each period, Edge_To_Edge only
+    TMR_CapStatTypeDef jitter;     // |period - previous period|
+    uint32_t           edges;      // capture words processed
+    uint32_t           timeouts;   // stalls seen
+    uint32_t           overruns;   // words overwritten before they were processed
+
+    uint32_t          *hist;       // period histogram, NULL - none
+    uint16_t           histBins;
+    uint32_t           histMin;    // lower edge of bin 0
+    uint32_t           histWidth;  // bin width
+    uint32_t           histUnder;  // periods below histMin
+    uint32_t           histOver;   // periods past the last bin
+
+    volatile uint32_t  passes;     // driver use
+    uint32_t           rdPass;     // driver use
+    uint16_t           rdIdx;      // driver use
+    uint32_t           lastHigh;   // driver use, 0 - none
+    uint32_t           lastPeriod; // driver use, 0 - none
+} TMR_CapTypeDef;
+
+/**
+ * @brief   Start continuous capture on TMR1 or TMR2, the capture pin must be
+ *          configured as input before
+ *
+ * @param   hcap    - engine handle
+ * @param   base    - BA_TMR1 / BA_TMR2
+ * @param   mode    - capture mode, refer to CapModeTypeDef
+ * @param   buf     - capture ring, 4-byte aligned, must stay valid
+ * @param   size    - ring size in words
+ * @param   timeout - capture timeout in Tsys, max 33554432
+ */
+void TMR_CapInit(TMR_CapTypeDef *hcap, PUINT8V base, CapModeTypeDef mode, uint32_t *buf, uint16_t size,
+                 uint32_t timeout);
+
+/**
+ * @brief   Stop capture, statistics are kept
+ */
+void TMR_CapStop(TMR_CapTypeDef *hcap);
+
+/**
+ * @brief   Capture interrupt service, call it from TMR1_IRQHandler / TMR2_IRQHandler
+ */
+void TMR_CapIRQHandler(TMR_CapTypeDef *hcap);
+
+/**
+ * @brief   Process the words captured since the last call, call it at least
+ *          once per ring pass
+ *
+ * @return  number of words processed
+ */
+uint32_t TMR_CapProcess(TMR_CapTypeDef *hcap);
+
+/**
+ * @brief   Clear statistics and histogram, e.g. to start a new measurement window
+ */
+void TMR_CapStatReset(TMR_CapTypeDef *hcap);
+
+/**
+ * @brief   Collect a period histogram from now on
+ *
+ * @param   bins    - bin counters, NULL to stop
+ * @param   n       - number of bins
+ * @param   min     - lower edge of bin 0 in Tsys
+ * @param   width   - bin width in Tsys
+ */
+void TMR_CapHistCfg(TMR_CapTypeDef *hcap, uint32_t *bins, uint16_t n, uint32_t min, uint32_t width);
+
+/**
+ * @brief   Average of a statistic
+ *
+ * @return  sum / count, 0 - no samples
+ */
+uint32_t TMR_CapStatAvg(const TMR_CapStatTypeDef *st);
+
+/**
+ * @brief   Average input frequency
+ *
+ * @return  frequency in mHz, 0 - no period seen
+ */
+uint32_t TMR_CapFrequency(TMR_CapTypeDef *hcap);
+
+/**
+ * @brief   Average duty cycle, Edge_To_Edge only
+ *
+ * @return  high time in 1/1000 of the period
+ */
+uint16_t TMR_CapDuty(TMR_CapTypeDef *hcap);
+
+/**
+ * @brief  TMR1/TMR2 PWM waveform engine
+ *
+ * Streams duty-cycle words (one per PWM period) to the PWM FIFO from a
+ * double buffer. Each half runs as a single DMA transfer, the DMA end
+ * interrupt starts the other half and refills the finished one through the
+ * fill callback while the 8-entry timer FIFO keeps the output going. When the
+ * fill callback returns 0 a tail of zero duty words is sent and the timer is
+ * stopped with the output at its default level.
+ */
+#define TMR_WAVE_TAIL         16 // zero duty words sent after the stream, more than the FIFO holds
+
+typedef uint16_t (*pfnTMRWaveFill_t)(void *ctx, uint32_t *buf, uint16_t len); // up to len words, 0 - end of stream
+typedef void (*pfnTMRWaveDone_t)(void *ctx);
+
+typedef struct
+{
+    PUINT8V           base;    // BA_TMR1 / BA_TMR2
+    uint32_t         *buf;     // 2 * half words, 4-byte aligned
+    uint16_t          half;    // words per half
+    uint32_t          cycle;   // PWM period in Tsys
+    uint8_t           polar;   // PWMX_PolarTypeDef
+    pfnTMRWaveFill_t  fill;
+    pfnTMRWaveDone_t  done;    // runs in interrupt context, may be NULL
+    void             *ctx;
+    volatile uint8_t  busy;
+    uint8_t           cur;     // driver use
+    uint8_t           ending;  // driver use
+    uint16_t          len[2];  // driver use
+} TMR_WaveTypeDef;
+
+/**
+ * @brief   Bind a waveform engine to TMR1 or TMR2, the PWM pin must be
+ *          configured as output before
+ *
+ * @param   hwave   - engine handle
+ * @param   base    - BA_TMR1 / BA_TMR2
+ * @param   buf     - double buffer, 2 * half words, 4-byte aligned
+ * @param   half    - words per half
+ * @param   cycle   - PWM period in Tsys
+ * @param   pr      - output polarity, refer to PWMX_PolarTypeDef
+ */
+void TMR_WaveInit(TMR_WaveTypeDef *hwave, PUINT8V base, uint32_t *buf, uint16_t half, uint32_t cycle,
+                  PWMX_PolarTypeDef pr);
+
+/**
+ * @brief   Start streaming
+ *
+ * @param   hwave   - engine handle
+ * @param   fill    - produces the duty words, called from interrupt context once running
+ * @param   done    - called when the output has finished, may be NULL
+ * @param   ctx     - passed to fill and done
+ *
+ * @return  0 - started, 1 - busy
+ */
+uint8_t TMR_WaveStart(TMR_WaveTypeDef *hwave, pfnTMRWaveFill_t fill, pfnTMRWaveDone_t done, void *ctx);
+
+/**
+ * @brief   Waveform interrupt service, call it from TMR1_IRQHandler / TMR2_IRQHandler
+ */
+void TMR_WaveIRQHandler(TMR_WaveTypeDef *hwave);
+
+/**
+ * @brief   Send the pixel buffer to the strip, the engine must run with
+ *          cycle WS2812_PERIOD and High_Level polarity
+ *
+ * @param   hled    - encoder handle
+ * @param   hwave   - waveform engine
+ * @param   done    - called when the strip is latched, may be NULL
+ *
+ * @return  0 - started, 1 - busy
+ */
+uint8_t WS2812_Show(WS2812_TypeDef *hled, TMR_WaveTypeDef *hwave, pfnTMRWaveDone_t done);
+
 #ifdef __cplusplus
 }
 #endif
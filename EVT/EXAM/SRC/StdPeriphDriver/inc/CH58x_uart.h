@@ -405,6 +405,106 @@ void UART3_SendString(uint8_t *buf, uint16_t l);
  */
 uint16_t UART3_RecvString(uint8_t *buf);
 
+/**
+ * @brief  UART asynchronous driver, shared by UART0..UART3
+ *
+ * RX and TX run through caller-owned rings whose size must be a power of two.
+ * Head/tail counters are free running, the ISR is the only writer of the RX
+ * head and TX tail, the application is the only writer of the RX tail and TX
+ * head, so no lock is needed between the two sides.
+ */
+typedef void (*pfnUARTAsyncCB_t)(void *huart, uint8_t event);
+
+#define UART_ASYNC_EVT_RX_DATA     0x01 // new data in RX ring
+#define UART_ASYNC_EVT_RX_OVERRUN  0x02 // RX ring full, bytes dropped
+#define UART_ASYNC_EVT_LINE_ERR    0x04 // line status error, see lineStatus
+#define UART_ASYNC_EVT_TX_DONE     0x08 // TX ring drained
+
+typedef struct
+{
+    PUINT8V          base;       // BA_UART0..BA_UART3
+    uint8_t         *rxBuf;
+    uint8_t         *txBuf;
+    uint16_t         rxMask;
+    uint16_t         txMask;
+    volatile uint16_t rxHead;
+    volatile uint16_t rxTail;
+    volatile uint16_t txHead;
+    volatile uint16_t txTail;
+    volatile uint32_t rxDropped;
+    volatile uint8_t lineStatus;
+    pfnUARTAsyncCB_t callback;
+} UART_AsyncTypeDef;
+
+/**
+ * @brief   Bind a UART to its RX/TX rings and enable RX/line status interrupts
+ *
+ * @param   huart   - driver handle
+ * @param   base    - BA_UART0..BA_UART3, UART already configured by UARTx_DefInit
+ * @param   rxBuf   - RX ring, rxSize must be a power of two
+ * @param   txBuf   - TX ring, txSize must be a power of two
+ * @param   cb      - event callback, called from interrupt context, may be NULL
+ */
+void UART_AsyncInit(UART_AsyncTypeDef *huart, PUINT8V base, uint8_t *rxBuf, uint16_t rxSize,
+                    uint8_t *txBuf, uint16_t txSize, pfnUARTAsyncCB_t cb);
+
+/**
+ * @brief   UART interrupt service, call it from UARTx_IRQHandler
+ */
+void UART_AsyncIRQHandler(UART_AsyncTypeDef *huart);
+
+/**
+ * @brief   Number of bytes waiting in the RX ring
+ */
+uint16_t UART_AsyncRxLength(UART_AsyncTypeDef *huart);
+
+/**
+ * @brief   Borrow the contiguous readable span at the RX tail
+ *
+ * @param   ppData  - returns the span start address
+ *
+ * @return  span length, call UART_AsyncRxRelease when done
+ */
+uint16_t UART_AsyncRxPeek(UART_AsyncTypeDef *huart, uint8_t **ppData);
+
+/**
+ * @brief   Give back bytes borrowed with UART_AsyncRxPeek
+ */
+void UART_AsyncRxRelease(UART_AsyncTypeDef *huart, uint16_t len);
+
+/**
+ * @brief   Copy out of the RX ring
+ *
+ * @return  bytes actually read
+ */
+uint16_t UART_AsyncRead(UART_AsyncTypeDef *huart, uint8_t *buf, uint16_t len);
+
+/**
+ * @brief   Borrow the contiguous writable span at the TX head
+ *
+ * @param   ppData  - returns the span start address
+ *
+ * @return  span length, call UART_AsyncTxCommit with the bytes filled in
+ */
+uint16_t UART_AsyncTxReserve(UART_AsyncTypeDef *huart, uint8_t **ppData);
+
+/**
+ * @brief   Queue bytes filled after UART_AsyncTxReserve and start sending
+ */
+void UART_AsyncTxCommit(UART_AsyncTypeDef *huart, uint16_t len);
+
+/**
+ * @brief   Copy into the TX ring and start sending
+ *
+ * @return  bytes actually queued
+ */
+uint16_t UART_AsyncWrite(UART_AsyncTypeDef *huart, const uint8_t *buf, uint16_t len);
+
+/**
+ * @brief   Bytes queued but not yet moved into the hardware FIFO
+ */
+uint16_t UART_AsyncTxPending(UART_AsyncTypeDef *huart);
+
 #ifdef __cplusplus
 }
 #endif
@@ -342,6 +342,105 @@ uint8_t U2HubGetPortStatus(uint8_t HubPortIndex);                         // 
 uint8_t U2HubSetPortFeature(uint8_t HubPortIndex, uint8_t FeatureSelt);   // HUB˿
 uint8_t U2HubClearPortFeature(uint8_t HubPortIndex, uint8_t FeatureSelt); // HUB˿
 
+/**
+ * @brief  USB host asynchronous transfer engine (USB1 root port)
+ *
+ * Endpoints are scheduled round robin, one transaction at a time, from the
+ * transfer completion interrupt. A NAK parks the endpoint until a later
+ * frame (interrupt endpoints: bInterval frames), counted by the host SOF
+ * interrupt, so the CPU is free for the BLE stack meanwhile. The engine
+ * uses its own DMA buffers; USBHostTransact and HostCtrlTransfer hold it
+ * while they run, so existing synchronous code keeps working beside it.
+ */
+#define USBH_XFER_BUSY           0xFF // status while queued or running
+#define USBH_XFER_ZLP            0x01 // flags: end an OUT transfer of whole packets with a ZLP
+#define USBH_ASYNC_HOLD_FRAMES   5    // frames after the last synchronous call before the engine runs again
+
+typedef struct _USBH_ENDP USBHostEndp_t;
+typedef struct _USBH_XFER USBHostXfer_t;
+typedef void (*pfnUSBHostXferCB_t)(USBHostXfer_t *xfer);
+
+struct _USBH_XFER
+{
+    USBHostXfer_t     *next;
+    USBHostEndp_t     *endp;
+    const uint8_t     *setup;    // control endpoints: 8 byte request
+    uint8_t           *buf;
+    uint16_t           len;
+    volatile uint16_t  actual;   // bytes moved
+    uint16_t           nakLimit; // NAKs tolerated, 0xFFFF for ever
+    volatile uint8_t   status;   // USBH_XFER_BUSY, then ERR_SUCCESS or an error code
+    uint8_t            flags;
+    pfnUSBHostXferCB_t callback; // called from interrupt context, may be NULL
+    void              *arg;
+};
+
+struct _USBH_ENDP
+{
+    USBHostEndp_t *next;
+    USBHostXfer_t *head;
+    USBHostXfer_t *tail;
+    uint8_t        devAddr;   // USB address of the device
+    uint8_t        endpAddr;  // bEndpointAddress, 0 for the control endpoint
+    uint8_t        type;      // USB_ENDP_TYPE_CTRL / BULK / INTER
+    uint8_t        maxPacket; // wMaxPacketSize, at most 64
+    uint8_t        interval;  // frames between polls of an interrupt endpoint
+    uint8_t        speed;     // 0 low speed, 1 full speed
+    uint8_t        viaHub;    // low speed device behind a hub, sends PRE
+    uint8_t        toggle;
+    uint8_t        wait;      // frames until the next transaction
+    uint8_t        stage;
+    uint8_t        retry;
+    uint16_t       naks;
+};
+
+/**
+ * @brief   Start the engine on a host set up by USB_HostInit, plug events are still polled
+ *
+ * @param   rxDma   - 64 byte receive buffer, 4 byte aligned
+ * @param   txDma   - 64 byte transmit buffer, 4 byte aligned
+ */
+void USBHostAsync_Init(uint8_t *rxDma, uint8_t *txDma);
+
+/**
+ * @brief   Schedule an endpoint, fields up to viaHub filled in by the caller
+ */
+void USBHostAsync_AddEndp(USBHostEndp_t *ep);
+
+/**
+ * @brief   Unschedule an endpoint, its queued transfers end with status
+ */
+void USBHostAsync_RemoveEndp(USBHostEndp_t *ep, uint8_t status);
+
+/**
+ * @brief   Queue a transfer, its callback runs in the interrupt when it is done
+ *
+ * @return  ERR_SUCCESS, ERR_USB_UNKNOWN if the transfer is still queued
+ */
+uint8_t USBHostAsync_Submit(USBHostEndp_t *ep, USBHostXfer_t *xfer);
+
+/**
+ * @brief   Submit and spin until done, not for BLE applications
+ *
+ * @return  ERR_SUCCESS or an error code
+ */
+uint8_t USBHostAsync_Transfer(USBHostEndp_t *ep, const uint8_t *setup, uint8_t *buf, uint16_t len, uint16_t *actual);
+
+/**
+ * @brief   Lend the host to synchronous code, calls nest
+ */
+void USBHostAsync_Hold(void);
+
+/**
+ * @brief   End of a USBHostAsync_Hold
+ */
+void USBHostAsync_Release(void);
+
+/**
+ * @brief   USB host interrupt service, call it from USB_IRQHandler
+ */
+void USBHostAsync_IRQHandler(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,88 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : CH58x_ws2812.h
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : WS2812/SK6812 LED strip encoder, no register access
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+#ifndef __CH58x_WS2812_H__
+#define __CH58x_WS2812_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief   WS2812 / SK6812 LED strip encoder for the TMR1/TMR2 waveform
+ *          engine, see WS2812_Show in CH58x_timer.h
+ *
+ * Pixels are kept in wire order, G R B (W) per LED. Every data bit becomes
+ * one PWM period whose duty is T0H or T1H, a 16-entry nibble table holds the
+ * four duty words of every nibble so the encoder copies words instead of
+ * testing bits. The strip is latched by the zero duty reset slots at the end.
+ */
+#define WS2812_PERIOD         (FREQ_SYS / 800000)  // 1.25us bit period
+#define WS2812_T0H            (FREQ_SYS / 2500000) // 0.4us
+#define WS2812_T1H            (FREQ_SYS / 1250000) // 0.8us
+#define SK6812_T0H            (FREQ_SYS / 3333333) // 0.3us
+#define SK6812_T1H            (FREQ_SYS / 1666666) // 0.6us
+#define WS2812_RESET_SLOTS    240                  // 300us low latches the data
+
+typedef struct
+{
+    uint8_t  *pixels;    // count * bpp bytes
+    uint16_t  count;     // LEDs
+    uint8_t   bpp;       // 3 - GRB, 4 - GRBW
+    uint16_t  reset;     // zero duty slots after the data
+    uint32_t  pos;       // driver use
+    uint16_t  resetLeft; // driver use
+    uint32_t  lut[16][4];
+} WS2812_TypeDef;
+
+/**
+ * @brief   Set up an LED strip encoder
+ *
+ * @param   hled    - encoder handle
+ * @param   pixels  - pixel buffer, count * bpp bytes
+ * @param   count   - number of LEDs
+ * @param   bpp     - 3 - GRB, 4 - GRBW
+ * @param   t0h     - high time of a 0 bit in Tsys, e.g. WS2812_T0H
+ * @param   t1h     - high time of a 1 bit in Tsys, e.g. WS2812_T1H
+ */
+void WS2812_Init(WS2812_TypeDef *hled, uint8_t *pixels, uint16_t count, uint8_t bpp, uint32_t t0h, uint32_t t1h);
+
+/**
+ * @brief   Set one LED in the pixel buffer
+ *
+ * @param   hled    - encoder handle
+ * @param   idx     - LED index
+ * @param   r, g, b - colour
+ * @param   w       - white, GRBW strips only
+ */
+void WS2812_SetPixel(WS2812_TypeDef *hled, uint16_t idx, uint8_t r, uint8_t g, uint8_t b, uint8_t w);
+
+/**
+ * @brief   Restart the encoder at the first pixel byte
+ *
+ * @param   hled    - encoder handle
+ */
+void WS2812_Rewind(WS2812_TypeDef *hled);
+
+/**
+ * @brief   Fill callback for TMR_WaveStart, encodes whole bytes, half must be
+ *          a multiple of 8
+ */
+uint16_t WS2812_Fill(void *ctx, uint32_t *buf, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __CH58x_WS2812_H__
@@ -0,0 +1,17 @@
+/* Host stand-in for inc/CH58x_common.h: CH58x_ws2812.c touches no registers,
+ * it only needs the section attribute and the system clock */
+#ifndef __CH58x_COMMON_H__
+#define __CH58x_COMMON_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef FREQ_SYS
+#define FREQ_SYS    60000000
+#endif
+
+#define __HIGH_CODE
+
+#include "CH58x_ws2812.h"
+
+#endif
@@ -0,0 +1,187 @@
+/* Host test for the WS2812 encoder (CH58x_ws2812.c)
+ *
+ * The duty words WS2812_Fill() hands to the waveform engine are collected
+ * over refills of several sizes, then decoded back to bytes by their high
+ * time and compared with the pixel buffer. Every high time, the bit period
+ * and the reset low time are checked in ns against the WS2812B and SK6812
+ * datasheet windows at the FREQ_SYS the test is built with.
+ *
+ *   make -C EVT/EXAM/SRC/StdPeriphDriver/test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "CH58x_common.h"
+
+#define MAX_LEDS    300
+#define MAX_WORDS   (MAX_LEDS * 4 * 8 + WS2812_RESET_SLOTS)
+#define MAX_LEN     1000
+#define CANARY      0xDEADBEEF
+
+#define CHECK(c, ...)                                    \
+    do {                                                 \
+        if(!(c)) {                                       \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);  \
+            printf(__VA_ARGS__);                         \
+            printf("\n");                                \
+            exit(1);                                     \
+        }                                                \
+    } while(0)
+
+typedef struct
+{
+    const char *name;
+    uint32_t    t0h, t1h;      // Tsys
+    double      t0h_ns, t1h_ns; // datasheet nominal
+} strip_t;
+
+/* WS2812B and SK6812: high times +-150ns, period 1.25us +-600ns, reset
+ * low above 280us for the newer WS2812B parts */
+#define HIGH_TOL_NS     150.0
+#define PERIOD_NS       1250.0
+#define PERIOD_TOL_NS   600.0
+#define RESET_MIN_NS    280000.0
+
+static const strip_t strips[] = {
+    {"WS2812", WS2812_T0H, WS2812_T1H, 400.0, 800.0},
+    {"SK6812", SK6812_T0H, SK6812_T1H, 300.0, 600.0},
+};
+
+static uint8_t  pixels[MAX_LEDS * 4];
+static uint32_t stream[MAX_WORDS + MAX_LEN + 8];
+
+static double ns(uint32_t tsys)
+{
+    return tsys * 1e9 / FREQ_SYS;
+}
+
+static int near(double v, double nominal, double tol)
+{
+    return v >= nominal - tol && v <= nominal + tol;
+}
+
+static void check_timing(const strip_t *s)
+{
+    CHECK(near(ns(WS2812_PERIOD), PERIOD_NS, PERIOD_TOL_NS), "period %.0f ns", ns(WS2812_PERIOD));
+    CHECK(near(ns(s->t0h), s->t0h_ns, HIGH_TOL_NS), "%s T0H %.0f ns", s->name, ns(s->t0h));
+    CHECK(near(ns(s->t1h), s->t1h_ns, HIGH_TOL_NS), "%s T1H %.0f ns", s->name, ns(s->t1h));
+    CHECK(s->t1h < WS2812_PERIOD, "%s T1H does not fit the period", s->name);
+    CHECK(WS2812_RESET_SLOTS * ns(WS2812_PERIOD) >= RESET_MIN_NS, "reset %.0f ns",
+          WS2812_RESET_SLOTS * ns(WS2812_PERIOD));
+}
+
+/* Run one frame through WS2812_Fill() with refills of len words, like the
+ * engine asks for half its buffer at a time; returns the words collected */
+static uint32_t collect(WS2812_TypeDef *hled, uint16_t len)
+{
+    uint32_t total = 0;
+    uint16_t n, k;
+
+    WS2812_Rewind(hled);
+    for(;;)
+    {
+        for(k = 0; k < len + 8; k++)
+        {
+            stream[total + k] = CANARY;
+        }
+        n = WS2812_Fill(hled, &stream[total], len);
+        CHECK(n <= len, "filled %u words into %u", n, len);
+        CHECK(stream[total + len] == CANARY, "wrote past the %u word refill", len);
+        if(n == 0)
+        {
+            break;
+        }
+        total += n;
+        CHECK(total <= MAX_WORDS, "stream does not end");
+    }
+    CHECK(WS2812_Fill(hled, stream + total, len) == 0, "refill after the end returned data");
+    return total;
+}
+
+static void decode(const WS2812_TypeDef *hled, const strip_t *s, uint32_t total)
+{
+    uint32_t bytes = (uint32_t)hled->count * hled->bpp;
+    uint32_t i, w = 0;
+    uint8_t  b;
+    int      k;
+
+    CHECK(total == bytes * 8 + hled->reset, "%u words for %u bytes", total, bytes);
+    for(i = 0; i < bytes; i++)
+    {
+        b = 0;
+        for(k = 0; k < 8; k++, w++)
+        {
+            double h = ns(stream[w]);
+
+            if(near(h, s->t1h_ns, HIGH_TOL_NS))
+            {
+                b |= 0x80 >> k;
+            }
+            else
+            {
+                CHECK(near(h, s->t0h_ns, HIGH_TOL_NS), "%s byte %u bit %d: high %.0f ns", s->name, i, k, h);
+            }
+        }
+        CHECK(b == hled->pixels[i], "%s byte %u decodes to %02x, buffer has %02x", s->name, i, b, hled->pixels[i]);
+    }
+    for(; w < total; w++)
+    {
+        CHECK(stream[w] == 0, "reset slot %u not low", w - bytes * 8);
+    }
+}
+
+static void test_set_pixel(void)
+{
+    WS2812_TypeDef hled;
+
+    memset(pixels, 0xAA, sizeof(pixels));
+    WS2812_Init(&hled, pixels, 2, 3, WS2812_T0H, WS2812_T1H);
+    WS2812_SetPixel(&hled, 1, 0x11, 0x22, 0x33, 0x44);
+    CHECK(pixels[3] == 0x22 && pixels[4] == 0x11 && pixels[5] == 0x33, "GRB order");
+    CHECK(pixels[6] == 0xAA, "GRB strip wrote white");
+    WS2812_SetPixel(&hled, 2, 1, 2, 3, 4);
+    CHECK(pixels[6] == 0xAA, "index past the strip written");
+
+    WS2812_Init(&hled, pixels, 2, 4, WS2812_T0H, WS2812_T1H);
+    WS2812_SetPixel(&hled, 1, 0x11, 0x22, 0x33, 0x44);
+    CHECK(pixels[4] == 0x22 && pixels[5] == 0x11 && pixels[6] == 0x33 && pixels[7] == 0x44, "GRBW order");
+}
+
+int main(void)
+{
+    static const uint16_t counts[] = {1, 2, 7, 60, MAX_LEDS};
+    static const uint16_t lens[] = {8, 24, 64, 256, MAX_LEN};
+    WS2812_TypeDef        hled;
+    unsigned              s, c, l, bpp, frames = 0;
+    uint32_t              i, total;
+
+    test_set_pixel();
+
+    srand(1);
+    for(s = 0; s < sizeof(strips) / sizeof(strips[0]); s++)
+    {
+        check_timing(&strips[s]);
+        for(bpp = 3; bpp <= 4; bpp++)
+        {
+            for(c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+            {
+                for(i = 0; i < sizeof(pixels); i++)
+                {
+                    pixels[i] = (uint8_t)rand();
+                }
+                pixels[0] = 0x00;
+                pixels[counts[c] * bpp - 1] = 0xFF;
+                WS2812_Init(&hled, pixels, counts[c], bpp, strips[s].t0h, strips[s].t1h);
+                for(l = 0; l < sizeof(lens) / sizeof(lens[0]); l++)
+                {
+                    total = collect(&hled, lens[l]);
+                    decode(&hled, &strips[s], total);
+                    frames++;
+                }
+            }
+        }
+    }
+
+    printf("ws2812 at %u Hz: T0H/T1H %u/%u (WS2812) %u/%u (SK6812) of %u Tsys, %u frames ok\n", FREQ_SYS,
+           WS2812_T0H, WS2812_T1H, SK6812_T0H, SK6812_T1H, WS2812_PERIOD, frames);
+    return 0;
+}
@@ -13,10 +13,18 @@
 #include "CH58x_common.h"
 
 __attribute__((aligned(4))) uint32_t CapBuf[100];
-__attribute__((aligned(4))) uint32_t PwmBuf[100];
+__attribute__((aligned(4))) uint32_t WaveBuf[2 * 96];
+uint8_t                              LedPixels[300 * 3];
+TMR_WaveTypeDef                      Tmr2Wave;
+WS2812_TypeDef                       Strip;
 
 volatile uint8_t capFlag = 0;
 
+__attribute__((aligned(4))) uint32_t CapRing[128];
+uint32_t                             CapHist[16];
+TMR_CapTypeDef                       Tmr1Cap;
+volatile uint8_t                     capRunning = 0;
+
 /*********************************************************************
  * @fn      DebugInit
  *
@@ -93,6 +101,36 @@ int main()
 
 #endif
 
+#if 1 /* ʱ1DMA׽ͳƵʡռձȺͶPA10 ɽ PB22  PWM */
+    {
+        uint16_t j;
+
+        capRunning = 1;
+        TMR_CapInit(&Tmr1Cap, BA_TMR1, Edge_To_Edge, CapRing, 128, FREQ_SYS / 10); // ƽ100msΪͣת
+        TMR_CapHistCfg(&Tmr1Cap, CapHist, 16, 5600, 50);                           // ֱͼ 5600~6400 Tsys
+        for(i = 0; i < 3; i++)
+        {
+            for(j = 0; j < 1000; j++)
+            {
+                mDelaymS(1);
+                TMR_CapProcess(&Tmr1Cap); // ÿȦDMAٴһ
+            }
+            PRINT("f=%ld.%03ldHz duty=%d/1000 period %ld/%ld/%ld jitter %ld/%ld overrun %ld\n",
+                  TMR_CapFrequency(&Tmr1Cap) / 1000, TMR_CapFrequency(&Tmr1Cap) % 1000, TMR_CapDuty(&Tmr1Cap),
+                  Tmr1Cap.period.min, TMR_CapStatAvg(&Tmr1Cap.period), Tmr1Cap.period.max,
+                  TMR_CapStatAvg(&Tmr1Cap.jitter), Tmr1Cap.jitter.max, Tmr1Cap.overruns);
+            for(j = 0; j < 16; j++)
+            {
+                PRINT("%ld ", CapHist[j]);
+            }
+            PRINT("\n");
+            TMR_CapStatReset(&Tmr1Cap);
+        }
+        TMR_CapStop(&Tmr1Cap);
+        capRunning = 0;
+    }
+#endif
+
 #if 1 /* ʱ2 */
     GPIOB_ModeCfg(GPIO_Pin_11, GPIO_ModeIN_PD);
     GPIOPinRemap(ENABLE, RB_PIN_TMR2);
@@ -114,30 +152,27 @@ int main()
 
 #endif
 
-#if 1 /* ʱ2,DMA PWM.*/
+#if 1 /* ʱ2DMA PWM  WS2812 ƴPB11 */
+    GPIOB_ResetBits(GPIO_Pin_11);
     GPIOB_ModeCfg(GPIO_Pin_11, GPIO_ModeOut_PP_5mA);
     GPIOPinRemap(ENABLE, RB_PIN_TMR2);
 
-    PRINT("TMR2 DMA PWM\n");
-    TMR2_PWMCycleCfg(60 * 2000); //  2000us  Ƶ60Mhz ÿ60M 60Ϊ1΢
-    for(i=0; i<50; i++)
-    {
-      PwmBuf[i]=2400*i;
-    }
-    for(i=50; i<100; i++)
+    PRINT("TMR2 WS2812\n");
+    TMR_WaveInit(&Tmr2Wave, BA_TMR2, WaveBuf, 96, WS2812_PERIOD, High_Level); // ÿ뻺4ŵƣDMAжб
+    WS2812_Init(&Strip, LedPixels, 300, 3, WS2812_T0H, WS2812_T1H);
+    for(i = 0; i < 255; i++)
     {
-      PwmBuf[i]=2400*(100-i);
+        uint16_t j;
+
+        for(j = 0; j < 300; j++)
+        {
+            WS2812_SetPixel(&Strip, j, (uint8_t)(i + j), (uint8_t)(i * 2 + j), (uint8_t)(255 - i), 0);
+        }
+        WS2812_Show(&Strip, &Tmr2Wave, NULL);
+        while(Tmr2Wave.busy);
+        mDelaymS(20);
     }
 
-    TMR2_PWMInit(Low_Level, PWM_Times_16);
-    TMR2_DMACfg(ENABLE, (uint16_t)(uint32_t)&PwmBuf[0], (uint16_t)(uint32_t)&PwmBuf[100], Mode_LOOP);
-    TMR2_PWMEnable();
-    TMR2_Enable();
-    /* жϣ100ڽж */
-    TMR2_ClearITFlag(TMR1_2_IT_DMA_END);
-    TMR2_ITCfg(ENABLE, TMR1_2_IT_DMA_END);
-    PFIC_EnableIRQ(TMR2_IRQn);
-
 #endif
 
     while(1);
@@ -172,7 +207,11 @@ __INTERRUPT
 __HIGH_CODE
 void TMR1_IRQHandler(void) // TMR1 ʱж
 {
-    if(TMR1_GetITFlag(TMR1_2_IT_DMA_END))
+    if(capRunning)
+    {
+        TMR_CapIRQHandler(&Tmr1Cap);
+    }
+    else if(TMR1_GetITFlag(TMR1_2_IT_DMA_END))
     {
         TMR1_ITCfg(DISABLE, TMR1_2_IT_DMA_END); // ʹõDMA+жϣעɺرմжʹܣһֱϱжϡ
         TMR1_ClearITFlag(TMR1_2_IT_DMA_END);    // жϱ־
@@ -199,9 +238,6 @@ void TMR2_IRQHandler(void)
     }
     if(TMR2_GetITFlag(TMR1_2_IT_DMA_END))
     {
-        TMR2_ClearITFlag(TMR1_2_IT_DMA_END);
-        PRINT("DMA end\n");
-        /* DMA  */
-        /* ûҪĴ */
+        TMR_WaveIRQHandler(&Tmr2Wave); // һ뻺岢շһ
     }
 }
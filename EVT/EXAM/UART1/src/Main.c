@@ -16,6 +16,14 @@ uint8_t TxBuff[] = "This is a tx exam\r\n";
 uint8_t RxBuff[100];
 uint8_t trigB;
 
+#define UART1_ASYNC_EXAM    0 // 1 - echo through the interrupt driven async driver
+
+#if UART1_ASYNC_EXAM
+UART_AsyncTypeDef Uart1Async;
+uint8_t           RxRing[256]; // power of two
+uint8_t           TxRing[256]; // power of two
+#endif
+
 /*********************************************************************
  * @fn      main
  *
@@ -35,6 +43,22 @@ int main()
     GPIOA_ModeCfg(GPIO_Pin_9, GPIO_ModeOut_PP_5mA); // TXD-עIOߵƽ
     UART1_DefInit();
 
+#if UART1_ASYNC_EXAM // async driver, no polling of the FIFO counters
+    UART_AsyncInit(&Uart1Async, BA_UART1, RxRing, sizeof(RxRing), TxRing, sizeof(TxRing), NULL);
+    PFIC_EnableIRQ(UART1_IRQn);
+    while(1)
+    {
+        uint8_t *p;
+        uint16_t n = UART_AsyncRxPeek(&Uart1Async, &p);
+        if(n)
+        {
+            n = UART_AsyncWrite(&Uart1Async, p, n);
+            UART_AsyncRxRelease(&Uart1Async, n);
+        }
+    }
+
+#endif
+
 #if 1 // Դڷַ
     UART1_SendString(TxBuff, sizeof(TxBuff));
 
@@ -75,6 +99,11 @@ void UART1_IRQHandler(void)
 {
     volatile uint8_t i;
 
+#if UART1_ASYNC_EXAM
+    UART_AsyncIRQHandler(&Uart1Async);
+    return;
+#endif
+
     switch(UART1_GetITFlag())
     {
         case UART_II_LINE_STAT: // ·״̬
@@ -247,6 +247,34 @@ volatile UINT8 usb_irq_flag[USB_IRQ_FLAG_NUM];
 UINT8 cdc_uart_sta_trans_step = 0;
 UINT8 ven_ep1_trans_step = 0;
 
+/* USB <-> UART0 bridge on the data endpoint (EP1 in CDC mode, EP2 in vendor mode)
+ * The endpoint runs double buffered with automatic toggle, the hardware picks the
+ * buffer by the toggle bit: OUT DATA0/DATA1 at +0/+64, IN DATA0/DATA1 at +128/+192.
+ * One OUT buffer is drained into the UART TX ring while the host fills the other,
+ * OUT is NAKed only when both are still full. One IN buffer is filled from the UART
+ * RX ring while the other is on the bus. */
+#define BRIDGE_RING_SIZE        1024    // UART rings, power of two
+
+#define BRIDGE_UEP_CTRL    (*((PUINT8V)(USB_BASE_ADDR + 0x22 + bridge_ep * 4)))
+#define BRIDGE_UEP_T_LEN   (*((PUINT8V)(USB_BASE_ADDR + 0x20 + bridge_ep * 4)))
+
+__aligned(4) UINT8 BridgeEpBuf[4*MAX_PACKET_SIZE];
+UINT8 BridgeRxRing[BRIDGE_RING_SIZE];
+UINT8 BridgeTxRing[BRIDGE_RING_SIZE];
+UART_AsyncTypeDef BridgeUart;
+
+UINT8 bridge_ep = 0;             // data endpoint, 0 - bridge not started
+volatile UINT8 bridge_out_cnt;   // OUT buffers holding data
+UINT8 bridge_out_wr;             // OUT buffer the next packet goes to
+UINT8 bridge_out_rd;             // OUT buffer drained next
+UINT8 bridge_out_off;            // bytes of bridge_out_rd already queued
+UINT8 bridge_out_len[2];
+volatile UINT8 bridge_in_busy;   // an IN packet is armed
+volatile UINT8 bridge_in_ready;  // the next IN buffer is filled, waiting for the bus
+UINT8 bridge_in_wr;              // IN buffer filled next
+UINT8 bridge_in_len;             // length of the waiting IN buffer
+UINT8 bridge_in_last;            // length of the last IN packet armed, 64 needs a ZLP
+
 /* ˵0öϴ֡ */
 UINT8 ep0_send_buf[256];
 
@@ -276,6 +304,7 @@ const UINT8 *pDescr;
 
 /* ˵״̬ú */
 void USBDevEPnINSetStatus(UINT8 ep_num, UINT8 type, UINT8 sta);
+void BridgeReset(void);
 
 /*******************************************************************************
 * Function Name  : CH341RegWrite
@@ -469,6 +498,89 @@ UINT8 CH341RegRead(UINT8 reg_add,UINT8 *reg_val)
 #define DEF_BIT_USB_SUPD                0x40                                    /* USB߹־ */
 #define DEF_BIT_USB_HS                  0x80                                    /* USB١ȫٱ־ */
 
+/*******************************************************************************
+* Function Name  : BridgeInArm
+* Description    : Hand the next IN buffer to the hardware
+* Input          : lenpacket length, 0 sends a ZLP
+* Output         : None
+* Return         : None
+*******************************************************************************/
+__attribute__((section(".highcode")))
+void BridgeInArm(UINT8 len)
+{
+  BRIDGE_UEP_T_LEN = len;
+  bridge_in_last = len;
+  bridge_in_busy = 1;
+  BRIDGE_UEP_CTRL = BRIDGE_UEP_CTRL & ~MASK_UEP_T_RES; //IN_ACK
+}
+
+/*******************************************************************************
+* Function Name  : BridgeOutDrain
+* Description    : Move received OUT buffers into the UART TX ring and give them
+*                  back to the host. Runs in the USB interrupt, or with it masked.
+* Input          : None
+* Output         : None
+* Return         : None
+*******************************************************************************/
+__attribute__((section(".highcode")))
+void BridgeOutDrain(void)
+{
+  UINT8 len, n;
+
+  while(bridge_out_cnt)
+  {
+    len = bridge_out_len[bridge_out_rd];
+    n = UART_AsyncWrite(&BridgeUart, &BridgeEpBuf[bridge_out_rd * MAX_PACKET_SIZE + bridge_out_off],
+                        len - bridge_out_off);
+    bridge_out_off += n;
+    if(bridge_out_off < len) break;   //UART side full, keep the buffer
+
+    bridge_out_off = 0;
+    bridge_out_rd ^= 1;
+    bridge_out_cnt--;
+    BRIDGE_UEP_CTRL = BRIDGE_UEP_CTRL & ~MASK_UEP_R_RES; //OUT_ACK
+  }
+}
+
+/*******************************************************************************
+* Function Name  : BridgeEpIRQ
+* Description    : Transfer done on the bridge data endpoint, USB interrupt
+* Input          : int_stR8_USB_INT_ST
+* Output         : None
+* Return         : None
+*******************************************************************************/
+__attribute__((section(".highcode")))
+void BridgeEpIRQ(UINT8 int_st)
+{
+  if((int_st & MASK_UIS_TOKEN) == UIS_TOKEN_OUT)
+  {
+    if(R8_USB_INT_FG & RB_U_TOG_OK)   //ͬݰ
+    {
+      bridge_out_len[bridge_out_wr] = R8_USB_RX_LEN;
+      bridge_out_wr ^= 1;
+      if(++bridge_out_cnt == 2)
+      {
+        /* the packet after this one has nowhere to go */
+        BRIDGE_UEP_CTRL = (BRIDGE_UEP_CTRL & ~MASK_UEP_R_RES) | UEP_R_RES_NAK;
+      }
+      BridgeOutDrain();
+    }
+  }
+  else
+  {
+    bridge_in_busy = 0;
+    if(bridge_in_ready)
+    {
+      bridge_in_ready = 0;
+      BridgeInArm(bridge_in_len);
+    }
+    else
+    {
+      BRIDGE_UEP_CTRL = (BRIDGE_UEP_CTRL & ~MASK_UEP_T_RES) | UEP_T_RES_NAK;
+    }
+  }
+}
+
 /* жϴ */
 __attribute__((interrupt("WCH-Interrupt-fast")))
 __attribute__((section(".highcode")))
@@ -486,7 +598,12 @@ void USB_IRQHandler(void)
       usb_irq_pid[usb_irq_w_idx]  = R8_USB_INT_ST;  //& 0x3f;//(0x30 | 0x0F);
       usb_irq_len[usb_irq_w_idx]  = R8_USB_RX_LEN;
 
-      switch(usb_irq_pid[usb_irq_w_idx]& 0x3f){   //ǰĶ˵
+      if(bridge_ep && ((usb_irq_pid[usb_irq_w_idx] & MASK_UIS_ENDP) == bridge_ep)){
+        /* bridge data endpoint, done here rather than queued */
+        BridgeEpIRQ(usb_irq_pid[usb_irq_w_idx]);
+        usb_irq_flag[usb_irq_w_idx] = 0;
+      }
+      else switch(usb_irq_pid[usb_irq_w_idx]& 0x3f){   //ǰĶ˵
         case UIS_TOKEN_OUT | 2:{
           if( R8_USB_INT_FG & RB_U_TOG_OK ){   //ͬݰ
             R8_UEP2_CTRL ^=  RB_UEP_R_TOG;
@@ -1207,6 +1324,7 @@ void USB_IRQProcessHandler( void )   /* USB
                   dg_log("SET_CONFIGURATION\r\n");
                   devinf.gUsbFlag |= DEF_BIT_USB_SET_CFG;
                   devinf.UsbConfig = UsbSetupBuf->wValueL;
+                  BridgeReset();
                   break;
                 }
                 case USB_CLEAR_FEATURE:
@@ -1234,6 +1352,7 @@ void USB_IRQProcessHandler( void )   /* USB
 
                     cdc_uart_sta_trans_step = 0;
                     ven_ep1_trans_step = 0;
+                    BridgeReset();
                   }
                   else if ( ( UsbSetupBuf->bRequestType & USB_REQ_RECIP_MASK ) == USB_REQ_RECIP_ENDP )  // ˵
                   {
@@ -1249,6 +1368,8 @@ void USB_IRQProcessHandler( void )   /* USB
                       case 0x01: R8_UEP1_CTRL = (R8_UEP1_CTRL & (~ ( RB_UEP_R_TOG | MASK_UEP_R_RES ))) | UEP_R_RES_ACK; break;
                       default: len = 0xFF;  break;
                     }
+                    /* DATA0 again on the bridge endpoint, its buffers follow the toggle */
+                    if( (UsbSetupBuf->wIndexL & 0x0F) == bridge_ep ) BridgeReset();
                   }
                   else len = 0xFF;                                  // Ƕ˵㲻֧
 
@@ -1625,6 +1746,7 @@ void USB_IRQProcessHandler( void )   /* USB
       R8_UEP3_CTRL = UEP_T_RES_NAK;
       R8_UEP4_CTRL = UEP_T_RES_NAK;
     }
+    BridgeReset();
 
     cdc_uart_sta_trans_step = 0;
     ven_ep1_trans_step = 0;
@@ -1715,6 +1837,148 @@ void USBParaInit(void)
   Ep4DataOUTFlag = 0;
 }
 
+/*******************************************************************************
+* Function Name  : BridgeReset
+* Description    : Drop the bridge endpoint state, both toggles back to DATA0
+* Input          : None
+* Output         : None
+* Return         : None
+*******************************************************************************/
+void BridgeReset(void)
+{
+  if(bridge_ep == 0) return;
+
+  PFIC_DisableIRQ(USB_IRQn);
+  bridge_out_cnt = 0;
+  bridge_out_wr = 0;
+  bridge_out_rd = 0;
+  bridge_out_off = 0;
+  bridge_in_busy = 0;
+  bridge_in_ready = 0;
+  bridge_in_wr = 0;
+  bridge_in_last = 0;
+  BRIDGE_UEP_CTRL = RB_UEP_AUTO_TOG | UEP_R_RES_ACK | UEP_T_RES_NAK;
+  PFIC_EnableIRQ(USB_IRQn);
+}
+
+/*******************************************************************************
+* Function Name  : BridgeInit
+* Description    : Put the data endpoint in double buffer mode for the bridge
+* Input          : ep1 - CDC, 2 - vendor
+* Output         : None
+* Return         : None
+*******************************************************************************/
+void BridgeInit(UINT8 ep)
+{
+  bridge_ep = ep;
+  if(ep == 1)
+  {
+    R8_UEP4_1_MOD |= RB_UEP1_BUF_MOD;
+    R16_UEP1_DMA = (UINT16)(UINT32)&BridgeEpBuf[0];
+  }
+  else
+  {
+    R8_UEP2_3_MOD |= RB_UEP2_BUF_MOD;
+    R16_UEP2_DMA = (UINT16)(UINT32)&BridgeEpBuf[0];
+  }
+  BridgeReset();
+}
+
+/*******************************************************************************
+* Function Name  : BridgeUartConfig
+* Description    : Apply Uart0Para to UART0 and flush the bridge rings
+*                  With R8_UART0_DIV = 1 the rate is 7.5M / divisor at 60MHz,
+*                  so 2.5M and 3.75M are exact, others round to the nearest.
+* Input          : None
+* Output         : None
+* Return         : None
+*******************************************************************************/
+void BridgeUartConfig(void)
+{
+  UINT8 lcr;
+
+  PFIC_DisableIRQ(UART0_IRQn);
+  PFIC_DisableIRQ(USB_IRQn);
+
+  if(Uart0Para.BaudRate) UART0_BaudRateCfg(Uart0Para.BaudRate);
+
+  if((Uart0Para.DataBits >= 5) && (Uart0Para.DataBits <= 8)) lcr = Uart0Para.DataBits - 5;
+  else lcr = RB_LCR_WORD_SZ;
+
+  /* CDC: 0 - 1 bit, 1 - 1.5 bits, 2 - 2 bits; vendor: HAL_UART_xxx_STOP_BIT(S) */
+  if(usb_work_mode == USB_VENDOR_MODE)
+  {
+    if(Uart0Para.StopBits == HAL_UART_TWO_STOP_BITS) lcr |= RB_LCR_STOP_BIT;
+  }
+  else if(Uart0Para.StopBits)
+  {
+    lcr |= RB_LCR_STOP_BIT;
+  }
+
+  /* 1 odd, 2 even, 3 mark, 4 space */
+  if((Uart0Para.ParityType >= 1) && (Uart0Para.ParityType <= 4))
+  {
+    lcr |= RB_LCR_PAR_EN | ((Uart0Para.ParityType - 1) << 4);
+  }
+  R8_UART0_LCR = lcr;
+
+  UART_AsyncInit(&BridgeUart, BA_UART0, BridgeRxRing, sizeof(BridgeRxRing),
+                 BridgeTxRing, sizeof(BridgeTxRing), NULL);
+
+  PFIC_EnableIRQ(USB_IRQn);
+  PFIC_EnableIRQ(UART0_IRQn);
+}
+
+/*******************************************************************************
+* Function Name  : BridgePoll
+* Description    : Bridge main loop work: line coding changes, OUT buffers the
+*                  UART could not take yet, IN packets from the UART RX ring
+* Input          : None
+* Output         : None
+* Return         : None
+*******************************************************************************/
+void BridgePoll(void)
+{
+  UINT16 n;
+
+  if(CDCSer0ParaChange || VENSer0ParaChange)
+  {
+    CDCSer0ParaChange = 0;
+    VENSer0ParaChange = 0;
+    BridgeUartConfig();
+  }
+
+  if(bridge_ep == 0) return;
+
+  PFIC_DisableIRQ(USB_IRQn);
+
+  BridgeOutDrain();
+
+  if(!bridge_in_ready)
+  {
+    n = UART_AsyncRxLength(&BridgeUart);
+    if(n >= MAX_PACKET_SIZE) n = MAX_PACKET_SIZE;
+    else if(bridge_in_busy) n = 0;    //wait for a full packet while one is on the bus
+
+    /* a transfer that ended on a full packet is closed with a ZLP once the UART goes quiet */
+    if(n || (!bridge_in_busy && (bridge_in_last == MAX_PACKET_SIZE)))
+    {
+      UART_AsyncRead(&BridgeUart, &BridgeEpBuf[(2 + bridge_in_wr) * MAX_PACKET_SIZE], n);
+      bridge_in_wr ^= 1;
+      if(bridge_in_busy)
+      {
+        bridge_in_len = n;
+        bridge_in_ready = 1;
+      }
+      else
+      {
+        BridgeInArm(n);
+      }
+    }
+  }
+
+  PFIC_EnableIRQ(USB_IRQn);
+}
 
 /*******************************************************************************
 * Function Name  : InitCDCDevice
@@ -1763,6 +2027,9 @@ void InitCDCDevice(void)
   /* ˵4״̬IN--NAK ֶת */
   R8_UEP4_CTRL = UEP_T_RES_NAK;
 
+  /* ˵1ţ˫ */
+  BridgeInit(1);
+
   /* 豸ַ */
   R8_USB_DEV_AD = 0x00;
 
@@ -1826,6 +2093,9 @@ void InitVendorDevice(void)
   /* ˵2״̬OUT--ACK IN--NAK Զת */
   R8_UEP2_CTRL =  UEP_R_RES_ACK | UEP_T_RES_NAK;
 
+  /* ˵2ţ˫ */
+  BridgeInit(2);
+
   /* 豸ַ */
   R8_USB_DEV_AD = 0x00;
 
@@ -1905,46 +2175,6 @@ void InitUSBDevice(void)
   else                                 InitCDCDevice();
 }
 
-/* ͨѶ */
-/*******************************************************************************
-* Function Name  : SendUSBData
-* Description    : ݴ
-* Input          : p_send_dat͵ָ
-                   send_len͵״̬
-* Output         : None
-* Return         : ͵״̬
-*******************************************************************************/
-UINT8 SendUSBData(UINT8 *p_send_dat,UINT16 send_len)
-{
-  UINT8 sta = 0;
-
-  /* ģʽ */
-  if(usb_work_mode == USB_VENDOR_MODE)
-  {
-    memcpy(&Ep2Buffer[MAX_PACKET_SIZE],p_send_dat,send_len);
-
-    Ep2DataINFlag = 0;
-    R8_UEP2_T_LEN = (UINT8)send_len;
-    PFIC_DisableIRQ(USB_IRQn);
-    R8_UEP2_CTRL = R8_UEP2_CTRL & 0xfc; //IN_ACK
-    PFIC_EnableIRQ(USB_IRQn);
-  }
-  /* CDCģʽ */
-  else
-  {
-    /* ֱӷ */
-    memcpy(&Ep1Buffer[MAX_PACKET_SIZE],p_send_dat,send_len);
-
-    Ep1DataINFlag = 0;
-    R8_UEP1_T_LEN = (UINT8)send_len;
-    PFIC_DisableIRQ(USB_IRQn);
-    R8_UEP1_CTRL = R8_UEP1_CTRL & 0xfc; //IN_ACK
-    PFIC_EnableIRQ(USB_IRQn);
-  }
-
-  return sta;
-}
-
 void DebugInit( void )
 {
   GPIOA_SetBits( GPIO_Pin_9 );
@@ -1953,6 +2183,20 @@ void DebugInit( void )
   UART1_DefInit();
 }
 
+/*******************************************************************************
+* Function Name  : UART0_IRQHandler
+* Description    : ţUART0ж
+* Input          : None
+* Output         : None
+* Return         : None
+*******************************************************************************/
+__attribute__((interrupt("WCH-Interrupt-fast")))
+__attribute__((section(".highcode")))
+void UART0_IRQHandler(void)
+{
+  UART_AsyncIRQHandler(&BridgeUart);
+}
+
 int main()
 {
   SetSysClock( CLK_SOURCE_PLL_60MHz );
@@ -1960,7 +2204,14 @@ int main()
   DebugInit();  //PA9
   printf("start\n");
 
+  /*  UART0PB4 RXDPB7 TXD */
+  GPIOB_SetBits( GPIO_Pin_7 );
+  GPIOB_ModeCfg( GPIO_Pin_4, GPIO_ModeIN_PU );
+  GPIOB_ModeCfg( GPIO_Pin_7, GPIO_ModeOut_PP_5mA );
+  UART0_DefInit();
+
   InitUSBDevPara();
+  BridgeUartConfig();
   InitUSBDevice();
 
   PFIC_EnableIRQ( USB_IRQn );
@@ -1968,6 +2219,7 @@ int main()
   while(1)
   {
     USB_IRQProcessHandler();
+    BridgePoll();
   }
 }
 
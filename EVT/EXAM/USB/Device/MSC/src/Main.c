@@ -0,0 +1,669 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : Main.c
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : USB Mass Storage device (Bulk-Only Transport), the disk
+ *                      is a RAM disk, the on-chip Data-Flash or an SPI NOR on
+ *                      SPI0, selected with MSC_DISK. A blank medium gets an
+ *                      empty FAT12 file system on start.
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+#include "CH58x_common.h"
+#include "msc.h"
+
+#define MSC_DISK_RAM          0
+#define MSC_DISK_DATAFLASH    1
+#define MSC_DISK_SPINOR       2
+
+#ifndef MSC_DISK
+#define MSC_DISK              MSC_DISK_DATAFLASH
+#endif
+
+#define MSC_SYNC_IDLE_TICKS   2 // write the Flash cache back after 200ms without commands
+
+#define DevEP0SIZE            0x40
+// Device descriptor, replace the VID/PID with your own
+const uint8_t MyDevDescr[] = {0x12, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, DevEP0SIZE, 0x86, 0x1A, 0x0C, 0xFE,
+                              0x00, 0x01, 0x01, 0x02, 0x03, 0x01};
+// Configuration descriptor: one interface, mass storage, SCSI transparent, Bulk-Only
+const uint8_t MyCfgDescr[] = {0x09, 0x02, 0x20, 0x00, 0x01, 0x01, 0x00, 0x80, 0x32,
+                              0x09, 0x04, 0x00, 0x00, 0x02, 0x08, 0x06, 0x50, 0x00,
+                              0x07, 0x05, MSC_EP_IN, 0x02, MSC_EP_SIZE, 0x00, 0x00,
+                              0x07, 0x05, MSC_EP_OUT, 0x02, MSC_EP_SIZE, 0x00, 0x00};
+// Language descriptor
+const uint8_t MyLangDescr[] = {0x04, 0x03, 0x09, 0x04};
+// Manufacturer
+const uint8_t MyManuInfo[] = {0x0E, 0x03, 'w', 0, 'c', 0, 'h', 0, '.', 0, 'c', 0, 'n', 0};
+// Product
+const uint8_t MyProdInfo[] = {0x16, 0x03, 'C', 0, 'H', 0, '5', 0, '8', 0, 'x', 0, ' ', 0, 'D', 0, 'i', 0, 's', 0, 'k', 0};
+// Serial number, Bulk-Only needs one, built from the MAC address
+uint8_t MySerialInfo[2 + 12 * 2];
+
+/**********************************************************/
+uint8_t        DevConfig;
+uint8_t        SetupReqCode;
+uint16_t       SetupReqLen;
+const uint8_t *pDescr;
+
+/******** Endpoint RAM ****************************************/
+__attribute__((aligned(4))) uint8_t EP0_Databuf[64 + 64 + 64]; //ep0(64)+ep4_out(64)+ep4_in(64)
+
+/* EP1 runs double buffered with automatic toggle, the hardware picks the
+ * buffer by the toggle bit: OUT DATA0/DATA1 at +0/+64, IN DATA0/DATA1 at
+ * +128/+192. The host fills one OUT buffer while the main loop empties the
+ * other, one IN packet is staged while the previous one is on the bus. */
+__attribute__((aligned(4))) uint8_t MscEpBuf[4 * MSC_EP_SIZE];
+
+volatile uint8_t MscOutCnt;  // OUT buffers holding a packet
+uint8_t          MscOutWr;   // OUT buffer the host fills next
+uint8_t          MscOutRd;   // OUT buffer handed to the engine next
+uint8_t          MscOutLen[2];
+volatile uint8_t MscInBusy;  // an IN packet is armed
+volatile uint8_t MscInReady; // the other IN buffer is staged
+uint8_t          MscInWr;    // IN buffer filled next
+uint8_t          MscInLen;   // length of the staged IN packet
+volatile uint8_t MscInHalt;
+volatile uint8_t MscOutHalt;
+volatile uint8_t MscEpOff;   // reset pending, the main loop restarts the transport
+
+/*********************************************************************
+ * @fn      MscInArm
+ *
+ * @brief   Hand the next IN buffer to the hardware
+ *
+ * @param   len     - packet length
+ *
+ * @return  none
+ */
+__HIGH_CODE
+void MscInArm(uint8_t len)
+{
+    R8_UEP1_T_LEN = len;
+    MscInBusy = 1;
+    R8_UEP1_CTRL = (R8_UEP1_CTRL & ~MASK_UEP_T_RES) | UEP_T_RES_ACK;
+}
+
+/*********************************************************************
+ * @fn      MscEpIRQ
+ *
+ * @brief   Transfer done on EP1, USB interrupt
+ *
+ * @param   intst   - R8_USB_INT_ST
+ *
+ * @return  none
+ */
+__HIGH_CODE
+void MscEpIRQ(uint8_t intst)
+{
+    if((intst & MASK_UIS_TOKEN) == UIS_TOKEN_OUT)
+    {
+        if(intst & RB_UIS_TOG_OK)
+        { // out of sync packets are dropped
+            MscOutLen[MscOutWr] = R8_USB_RX_LEN;
+            MscOutWr ^= 1;
+            if(++MscOutCnt == 2)
+            { // the next packet has nowhere to go
+                R8_UEP1_CTRL = (R8_UEP1_CTRL & ~MASK_UEP_R_RES) | UEP_R_RES_NAK;
+            }
+        }
+    }
+    else
+    {
+        MscInBusy = 0;
+        if(MscInReady)
+        {
+            MscInReady = 0;
+            MscInArm(MscInLen);
+        }
+        else
+        {
+            R8_UEP1_CTRL = (R8_UEP1_CTRL & ~MASK_UEP_T_RES) | UEP_T_RES_NAK;
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      MscEpStop
+ *
+ * @brief   Freeze EP1 until the main loop restarts the transport,
+ *          USB interrupt
+ *
+ * @param   clearHalt   - bus reset / SET_CONFIGURATION, halts and toggles
+ *                        are cleared; a Bulk-Only reset keeps both
+ *
+ * @return  none
+ */
+void MscEpStop(uint8_t clearHalt)
+{
+    MscEpOff = 1;
+    if(clearHalt)
+    {
+        MscInHalt = 0;
+        MscOutHalt = 0;
+        R8_UEP1_CTRL = RB_UEP_AUTO_TOG | UEP_R_RES_NAK | UEP_T_RES_NAK;
+        return;
+    }
+    if(!MscInHalt)
+    {
+        R8_UEP1_CTRL = (R8_UEP1_CTRL & ~MASK_UEP_T_RES) | UEP_T_RES_NAK;
+    }
+    if(!MscOutHalt)
+    {
+        R8_UEP1_CTRL = (R8_UEP1_CTRL & ~MASK_UEP_R_RES) | UEP_R_RES_NAK;
+    }
+}
+
+/*********************************************************************
+ * @fn      MscEpClearHalt
+ *
+ * @brief   CLEAR_FEATURE(ENDPOINT_HALT) on EP1, USB interrupt
+ *
+ * @param   ep      - MSC_EP_IN / MSC_EP_OUT
+ *
+ * @return  none
+ */
+void MscEpClearHalt(uint8_t ep)
+{
+    if(!MscEpOff && !MSC_ClearHalt(ep))
+    {
+        return; // invalid CBW: stays halted until the Bulk-Only reset
+    }
+    if(ep == MSC_EP_IN)
+    {
+        MscInHalt = 0;
+        MscInBusy = 0;
+        MscInReady = 0;
+        MscInWr = 0;
+        R8_UEP1_CTRL = (R8_UEP1_CTRL & ~(RB_UEP_T_TOG | MASK_UEP_T_RES)) | UEP_T_RES_NAK;
+    }
+    else
+    {
+        MscOutHalt = 0;
+        MscOutCnt = 0;
+        MscOutWr = 0;
+        MscOutRd = 0;
+        R8_UEP1_CTRL = (R8_UEP1_CTRL & ~(RB_UEP_R_TOG | MASK_UEP_R_RES)) | (MscEpOff ? UEP_R_RES_NAK : UEP_R_RES_ACK);
+    }
+}
+
+/*********************************************************************
+ * @fn      MscRestart
+ *
+ * @brief   Restart the transport after a reset, main loop. The buffer
+ *          indexes follow the toggles, a Bulk-Only reset leaves them as
+ *          they are.
+ *
+ * @return  none
+ */
+void MscRestart(void)
+{
+    PFIC_DisableIRQ(USB_IRQn);
+    MscOutCnt = 0;
+    MscOutWr = (R8_UEP1_CTRL & RB_UEP_R_TOG) ? 1 : 0;
+    MscOutRd = MscOutWr;
+    MscInBusy = 0;
+    MscInReady = 0;
+    MscInWr = (R8_UEP1_CTRL & RB_UEP_T_TOG) ? 1 : 0;
+    MSC_Reset();
+    if(!MscOutHalt)
+    {
+        R8_UEP1_CTRL = (R8_UEP1_CTRL & ~MASK_UEP_R_RES) | UEP_R_RES_ACK;
+    }
+    MscEpOff = 0;
+    PFIC_EnableIRQ(USB_IRQn);
+}
+
+/* Endpoint glue for msc.c, main loop */
+
+uint8_t *MSC_EpOutGet(uint8_t *len)
+{
+    if(MscEpOff || MscOutCnt == 0)
+    {
+        return NULL;
+    }
+    *len = MscOutLen[MscOutRd];
+    return &MscEpBuf[MscOutRd * MSC_EP_SIZE];
+}
+
+void MSC_EpOutFree(void)
+{
+    PFIC_DisableIRQ(USB_IRQn);
+    if(!MscEpOff && MscOutCnt)
+    {
+        MscOutRd ^= 1;
+        MscOutCnt--;
+        if(!MscOutHalt)
+        {
+            R8_UEP1_CTRL = (R8_UEP1_CTRL & ~MASK_UEP_R_RES) | UEP_R_RES_ACK;
+        }
+    }
+    PFIC_EnableIRQ(USB_IRQn);
+}
+
+uint8_t *MSC_EpInGet(void)
+{
+    if(MscEpOff || MscInHalt || MscInReady)
+    {
+        return NULL;
+    }
+    return &MscEpBuf[(2 + MscInWr) * MSC_EP_SIZE];
+}
+
+void MSC_EpInSend(uint8_t len)
+{
+    PFIC_DisableIRQ(USB_IRQn);
+    if(!MscEpOff)
+    {
+        MscInWr ^= 1;
+        if(MscInBusy)
+        {
+            MscInLen = len;
+            MscInReady = 1;
+        }
+        else
+        {
+            MscInArm(len);
+        }
+    }
+    PFIC_EnableIRQ(USB_IRQn);
+}
+
+uint8_t MSC_EpInBusy(void)
+{
+    return (MscInBusy || MscInReady);
+}
+
+void MSC_EpStall(uint8_t ep)
+{
+    PFIC_DisableIRQ(USB_IRQn);
+    if(ep == MSC_EP_IN)
+    {
+        MscInHalt = 1;
+        R8_UEP1_CTRL = (R8_UEP1_CTRL & ~MASK_UEP_T_RES) | UEP_T_RES_STALL;
+    }
+    else
+    {
+        MscOutHalt = 1;
+        R8_UEP1_CTRL = (R8_UEP1_CTRL & ~MASK_UEP_R_RES) | UEP_R_RES_STALL;
+    }
+    PFIC_EnableIRQ(USB_IRQn);
+}
+
+/*********************************************************************
+ * @fn      USB_DevTransProcess
+ *
+ * @brief   USB transfer handling
+ *
+ * @return  none
+ */
+__HIGH_CODE
+void USB_DevTransProcess(void)
+{
+    uint8_t len, chtype;
+    uint8_t intflag, errflag = 0;
+
+    intflag = R8_USB_INT_FG;
+    if(intflag & RB_UIF_TRANSFER)
+    {
+        if((R8_USB_INT_ST & MASK_UIS_TOKEN) != MASK_UIS_TOKEN) // not idle
+        {
+            switch(R8_USB_INT_ST & (MASK_UIS_TOKEN | MASK_UIS_ENDP))
+            // token and endpoint
+            {
+                case UIS_TOKEN_IN:
+                {
+                    switch(SetupReqCode)
+                    {
+                        case USB_GET_DESCRIPTOR:
+                            len = SetupReqLen >= DevEP0SIZE ? DevEP0SIZE : SetupReqLen; // this packet
+                            memcpy(pEP0_DataBuf, pDescr, len);
+                            SetupReqLen -= len;
+                            pDescr += len;
+                            R8_UEP0_T_LEN = len;
+                            R8_UEP0_CTRL ^= RB_UEP_T_TOG; // toggle
+                            break;
+                        case USB_SET_ADDRESS:
+                            R8_USB_DEV_AD = (R8_USB_DEV_AD & RB_UDA_GP_BIT) | SetupReqLen;
+                            R8_UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
+                            break;
+                        default:
+                            R8_UEP0_T_LEN = 0; // status stage done, or a ZLP ends the control transfer
+                            R8_UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
+                            break;
+                    }
+                }
+                break;
+
+                case UIS_TOKEN_OUT:
+                    len = R8_USB_RX_LEN;
+                    break;
+
+                case UIS_TOKEN_OUT | 1:
+                case UIS_TOKEN_IN | 1:
+                    MscEpIRQ(R8_USB_INT_ST);
+                    break;
+
+                default:
+                    break;
+            }
+            R8_USB_INT_FG = RB_UIF_TRANSFER;
+        }
+
+        if(R8_USB_INT_ST & RB_UIS_SETUP_ACT) // SETUP
+        {
+            R8_UEP0_CTRL = RB_UEP_R_TOG | RB_UEP_T_TOG | UEP_R_RES_ACK | UEP_T_RES_NAK;
+            SetupReqLen = pSetupReqPak->wLength;
+            SetupReqCode = pSetupReqPak->bRequest;
+            chtype = pSetupReqPak->bRequestType;
+
+            len = 0;
+            errflag = 0;
+            if((pSetupReqPak->bRequestType & USB_REQ_TYP_MASK) != USB_REQ_TYP_STANDARD)
+            {
+                if((pSetupReqPak->bRequestType & USB_REQ_TYP_MASK) == USB_REQ_TYP_CLASS &&
+                   (pSetupReqPak->bRequestType & USB_REQ_RECIP_MASK) == USB_REQ_RECIP_INTERF &&
+                   (pSetupReqPak->wIndex & 0xff) == 0)
+                {
+                    switch(SetupReqCode)
+                    {
+                        case MSC_REQ_GET_MAX_LUN:
+                            pEP0_DataBuf[0] = 0; // one LUN
+                            if(SetupReqLen > 1)
+                                SetupReqLen = 1;
+                            break;
+                        case MSC_REQ_RESET:
+                            MscEpStop(0);
+                            break;
+                        default:
+                            errflag = 0xFF;
+                            break;
+                    }
+                }
+                else
+                {
+                    errflag = 0xFF;
+                }
+            }
+            else /* standard request */
+            {
+                switch(SetupReqCode)
+                {
+                    case USB_GET_DESCRIPTOR:
+                    {
+                        switch(((pSetupReqPak->wValue) >> 8))
+                        {
+                            case USB_DESCR_TYP_DEVICE:
+                                pDescr = MyDevDescr;
+                                len = MyDevDescr[0];
+                                break;
+
+                            case USB_DESCR_TYP_CONFIG:
+                                pDescr = MyCfgDescr;
+                                len = MyCfgDescr[2];
+                                break;
+
+                            case USB_DESCR_TYP_STRING:
+                            {
+                                switch((pSetupReqPak->wValue) & 0xff)
+                                {
+                                    case 1:
+                                        pDescr = MyManuInfo;
+                                        len = MyManuInfo[0];
+                                        break;
+                                    case 2:
+                                        pDescr = MyProdInfo;
+                                        len = MyProdInfo[0];
+                                        break;
+                                    case 3:
+                                        pDescr = MySerialInfo;
+                                        len = MySerialInfo[0];
+                                        break;
+                                    case 0:
+                                        pDescr = MyLangDescr;
+                                        len = MyLangDescr[0];
+                                        break;
+                                    default:
+                                        errflag = 0xFF; // unsupported string
+                                        break;
+                                }
+                            }
+                            break;
+
+                            default:
+                                errflag = 0xff;
+                                break;
+                        }
+                        if(SetupReqLen > len)
+                            SetupReqLen = len; // total to send
+                        len = (SetupReqLen >= DevEP0SIZE) ? DevEP0SIZE : SetupReqLen;
+                        memcpy(pEP0_DataBuf, pDescr, len);
+                        pDescr += len;
+                    }
+                    break;
+
+                    case USB_SET_ADDRESS:
+                        SetupReqLen = (pSetupReqPak->wValue) & 0xff;
+                        break;
+
+                    case USB_GET_CONFIGURATION:
+                        pEP0_DataBuf[0] = DevConfig;
+                        if(SetupReqLen > 1)
+                            SetupReqLen = 1;
+                        break;
+
+                    case USB_SET_CONFIGURATION:
+                        DevConfig = (pSetupReqPak->wValue) & 0xff;
+                        MscEpStop(1);
+                        break;
+
+                    case USB_CLEAR_FEATURE:
+                    {
+                        if((pSetupReqPak->bRequestType & USB_REQ_RECIP_MASK) == USB_REQ_RECIP_ENDP) // endpoint
+                        {
+                            switch((pSetupReqPak->wIndex) & 0xff)
+                            {
+                                case MSC_EP_IN:
+                                case MSC_EP_OUT:
+                                    MscEpClearHalt((pSetupReqPak->wIndex) & 0xff);
+                                    break;
+                                default:
+                                    errflag = 0xFF; // unsupported endpoint
+                                    break;
+                            }
+                        }
+                        else
+                            errflag = 0xFF;
+                    }
+                    break;
+
+                    case USB_GET_INTERFACE:
+                        pEP0_DataBuf[0] = 0x00;
+                        if(SetupReqLen > 1)
+                            SetupReqLen = 1;
+                        break;
+
+                    case USB_GET_STATUS:
+                        pEP0_DataBuf[0] = 0x00;
+                        pEP0_DataBuf[1] = 0x00;
+                        if((pSetupReqPak->bRequestType & USB_REQ_RECIP_MASK) == USB_REQ_RECIP_ENDP)
+                        {
+                            if(((pSetupReqPak->wIndex & 0xff) == MSC_EP_IN && MscInHalt) ||
+                               ((pSetupReqPak->wIndex & 0xff) == MSC_EP_OUT && MscOutHalt))
+                            {
+                                pEP0_DataBuf[0] = 0x01; // halted
+                            }
+                        }
+                        if(SetupReqLen > 2)
+                            SetupReqLen = 2;
+                        break;
+
+                    default:
+                        errflag = 0xff;
+                        break;
+                }
+            }
+            if(errflag == 0xff) // error or unsupported
+            {
+                R8_UEP0_CTRL = RB_UEP_R_TOG | RB_UEP_T_TOG | UEP_R_RES_STALL | UEP_T_RES_STALL; // STALL
+            }
+            else
+            {
+                if(chtype & 0x80) // device to host
+                {
+                    len = (SetupReqLen > DevEP0SIZE) ? DevEP0SIZE : SetupReqLen;
+                    SetupReqLen -= len;
+                }
+                else
+                    len = 0; // host to device
+                R8_UEP0_T_LEN = len;
+                R8_UEP0_CTRL = RB_UEP_R_TOG | RB_UEP_T_TOG | UEP_R_RES_ACK | UEP_T_RES_ACK; // DATA1
+            }
+
+            R8_USB_INT_FG = RB_UIF_TRANSFER;
+        }
+    }
+    else if(intflag & RB_UIF_BUS_RST)
+    {
+        R8_USB_DEV_AD = 0;
+        R8_UEP0_CTRL = UEP_R_RES_ACK | UEP_T_RES_NAK;
+        MscEpStop(1);
+        R8_USB_INT_FG = RB_UIF_BUS_RST;
+    }
+    else if(intflag & RB_UIF_SUSPEND)
+    {
+        R8_USB_INT_FG = RB_UIF_SUSPEND;
+    }
+    else
+    {
+        R8_USB_INT_FG = intflag;
+    }
+}
+
+/*********************************************************************
+ * @fn      SerialInit
+ *
+ * @brief   Build the serial number string from the MAC address
+ *
+ * @return  none
+ */
+void SerialInit(void)
+{
+    const char hex[] = "0123456789ABCDEF";
+    uint8_t    mac[6];
+    uint8_t    i;
+
+    GetMACAddress(mac);
+    MySerialInfo[0] = sizeof(MySerialInfo);
+    MySerialInfo[1] = 0x03;
+    for(i = 0; i < 12; i++)
+    {
+        MySerialInfo[2 + i * 2] = hex[(mac[5 - i / 2] >> ((i & 1) ? 0 : 4)) & 0x0F];
+        MySerialInfo[3 + i * 2] = 0;
+    }
+}
+
+/*********************************************************************
+ * @fn      DebugInit
+ *
+ * @brief   Debug UART
+ *
+ * @return  none
+ */
+void DebugInit(void)
+{
+    GPIOA_SetBits(GPIO_Pin_9);
+    GPIOA_ModeCfg(GPIO_Pin_8, GPIO_ModeIN_PU);
+    GPIOA_ModeCfg(GPIO_Pin_9, GPIO_ModeOut_PP_5mA);
+    UART1_DefInit();
+}
+
+/*********************************************************************
+ * @fn      main
+ *
+ * @brief   Main
+ *
+ * @return  none
+ */
+int main()
+{
+    const MSC_DiskTypeDef *disk;
+    uint8_t                idle = 0;
+
+    SetSysClock(CLK_SOURCE_PLL_60MHz);
+
+    DebugInit();
+    PRINT("start\n");
+
+#if MSC_DISK == MSC_DISK_RAM
+    disk = MSC_RamDiskInit();
+#elif MSC_DISK == MSC_DISK_DATAFLASH
+    disk = MSC_DataFlashInit();
+#else
+    disk = MSC_SpiNorInit();
+#endif
+    if(disk == NULL)
+    {
+        PRINT("no disk\n");
+    }
+    else
+    {
+        PRINT("disk %d blocks\n", (int)disk->blockCount);
+        if(MSC_DiskFormat(disk))
+        {
+            PRINT("format failed\n");
+        }
+    }
+    MSC_Init(disk);
+    SerialInit();
+
+    pEP0_RAM_Addr = EP0_Databuf;
+    pEP1_RAM_Addr = MscEpBuf;
+    USB_DeviceInit();
+    R8_UEP2_3_MOD = 0;                // EP2/EP3 unused
+    R8_UEP4_1_MOD |= RB_UEP1_BUF_MOD; // EP1 double buffered
+    MscEpStop(1);
+    PFIC_EnableIRQ(USB_IRQn);
+
+    TMR0_TimerInit(FREQ_SYS / 10); // 100ms tick for the idle write back
+
+    while(1)
+    {
+        if(MscEpOff)
+        {
+            MscRestart();
+        }
+        MSC_Poll();
+
+        if(TMR0_GetITFlag(TMR0_3_IT_CYC_END))
+        {
+            TMR0_ClearITFlag(TMR0_3_IT_CYC_END);
+            if(!MSC_Idle())
+            {
+                idle = 0;
+            }
+            else if(idle < MSC_SYNC_IDLE_TICKS && ++idle == MSC_SYNC_IDLE_TICKS && disk && disk->sync)
+            { // hosts rarely send SYNCHRONIZE CACHE to removable disks
+                disk->sync();
+            }
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      USB_IRQHandler
+ *
+ * @brief   USB interrupt
+ *
+ * @return  none
+ */
+__INTERRUPT
+__HIGH_CODE
+void USB_IRQHandler(void)
+{
+    USB_DevTransProcess();
+}
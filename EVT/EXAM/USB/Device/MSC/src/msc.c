@@ -0,0 +1,652 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : msc.c
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : USB Mass Storage Bulk-Only Transport with the SCSI
+ *                      transparent command set, one LUN. The state machine
+ *                      runs in the main loop and only talks to the endpoints
+ *                      through the MSC_Ep* glue, so slow Flash writes never
+ *                      block the USB interrupt and the file builds on a PC.
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+#include <string.h>
+#include "msc.h"
+
+#define MSC_CBW_SIGNATURE          0x43425355
+#define MSC_CSW_SIGNATURE          0x53425355
+#define MSC_CBW_LEN                31
+#define MSC_CSW_LEN                13
+
+#define MSC_CSW_PASSED             0x00
+#define MSC_CSW_FAILED             0x01
+#define MSC_CSW_PHASE_ERROR        0x02
+
+/* SCSI operation codes */
+#define SCSI_TEST_UNIT_READY       0x00
+#define SCSI_REQUEST_SENSE         0x03
+#define SCSI_INQUIRY               0x12
+#define SCSI_MODE_SENSE6           0x1A
+#define SCSI_START_STOP_UNIT       0x1B
+#define SCSI_PREVENT_ALLOW_REMOVAL 0x1E
+#define SCSI_READ_FORMAT_CAPACITY  0x23
+#define SCSI_READ_CAPACITY10       0x25
+#define SCSI_READ10                0x28
+#define SCSI_WRITE10               0x2A
+#define SCSI_VERIFY10              0x2F
+#define SCSI_SYNC_CACHE10          0x35
+#define SCSI_MODE_SENSE10          0x5A
+
+/* Sense keys */
+#define SENSE_NONE                 0x00
+#define SENSE_NOT_READY            0x02
+#define SENSE_MEDIUM_ERROR         0x03
+#define SENSE_ILLEGAL_REQUEST      0x05
+#define SENSE_DATA_PROTECT         0x07
+
+/* Additional sense codes */
+#define ASC_NONE                   0x00
+#define ASC_WRITE_FAULT            0x03
+#define ASC_UNRECOVERED_READ       0x11
+#define ASC_INVALID_COMMAND        0x20
+#define ASC_LBA_OUT_OF_RANGE       0x21
+#define ASC_INVALID_FIELD_IN_CDB   0x24
+#define ASC_WRITE_PROTECTED        0x27
+#define ASC_MEDIUM_NOT_PRESENT     0x3A
+
+#define MSC_ST_CBW                 0 // waiting for a CBW
+#define MSC_ST_DATA_IN             1 // sending data, then maybe halting IN
+#define MSC_ST_DATA_OUT            2 // receiving data
+#define MSC_ST_CSW                 3 // CSW waiting for an IN buffer
+#define MSC_ST_HALT                4 // invalid CBW, both endpoints halted until reset
+
+static const uint8_t MscInquiry[36] = {
+    0x00,                                                      // direct access block device
+    0x80,                                                      // removable
+    0x04,                                                      // SPC-2
+    0x02,                                                      // response data format
+    31, 0x00, 0x00, 0x00,                                      // additional length
+    'W', 'C', 'H', ' ', ' ', ' ', ' ', ' ',                    // vendor
+    'C', 'H', '5', '8', 'x', ' ', 'M', 'S', 'C', ' ', 'D', 'i', 's', 'k', ' ', ' ', // product
+    '1', '.', '0', '0'                                         // revision
+};
+
+static const MSC_DiskTypeDef *MscDisk;
+
+static uint8_t  MscState;
+static uint8_t  MscActive;    // a CBW arrived since the last MSC_Idle()
+static uint8_t  MscStatus;    // bCSWStatus of the command in progress
+static uint8_t  MscHostIn;    // CBW direction bit
+static uint8_t  MscEjected;   // START STOP UNIT unloaded the medium
+static uint8_t  MscSenseKey;
+static uint8_t  MscSenseAsc;
+static uint8_t  MscLastIn;    // length of the last IN packet of the data stage
+static uint32_t MscTag;
+static uint32_t MscHostLen;   // dCBWDataTransferLength
+static uint32_t MscDone;      // data stage bytes moved so far
+static uint32_t MscLba;       // next block of READ(10)/WRITE(10)
+static uint32_t MscBlocks;    // blocks still to move
+static uint16_t MscBufLen;    // data in: valid bytes, data out: bytes received
+static uint16_t MscBufOff;    // data in: bytes sent
+
+static __attribute__((aligned(4))) uint8_t MscBuf[MSC_BLOCK_SIZE];
+
+static uint32_t MSC_GetBE32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void MSC_PutBE32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint32_t MSC_GetLE32(const uint8_t *p)
+{
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static void MSC_PutLE32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/*********************************************************************
+ * @fn      MSC_Fail
+ *
+ * @brief   Fail the command and latch the sense data for REQUEST SENSE
+ *
+ * @param   key     - sense key
+ * @param   asc     - additional sense code
+ *
+ * @return  none
+ */
+static void MSC_Fail(uint8_t key, uint8_t asc)
+{
+    MscSenseKey = key;
+    MscSenseAsc = asc;
+    MscStatus = MSC_CSW_FAILED;
+}
+
+/*********************************************************************
+ * @fn      MSC_Ready
+ *
+ * @brief   Check that a medium is present, fail the command if not
+ *
+ * @return  1 - ready
+ */
+static uint8_t MSC_Ready(void)
+{
+    if(MscDisk == NULL || MscDisk->blockCount == 0 || MscEjected)
+    {
+        MSC_Fail(SENSE_NOT_READY, ASC_MEDIUM_NOT_PRESENT);
+        return 0;
+    }
+    return 1;
+}
+
+/*********************************************************************
+ * @fn      MSC_Start
+ *
+ * @brief   Enter the data stage, or go straight to the CSW. The host and
+ *          device expectations are matched as in the thirteen cases of
+ *          the Bulk-Only spec: a shorter device transfer is padded by
+ *          halting the pipe, a longer one or a direction mismatch is a
+ *          phase error.
+ *
+ * @param   dirIn   - device wants to send (1) or receive (0)
+ * @param   devLen  - bytes the device wants to move
+ *
+ * @return  none
+ */
+static void MSC_Start(uint8_t dirIn, uint32_t devLen)
+{
+    if(devLen && (MscHostLen < devLen || MscHostIn != dirIn))
+    {
+        MscStatus = MSC_CSW_PHASE_ERROR;
+        MscBlocks = 0;
+        MscBufLen = 0;
+        devLen = 0;
+    }
+    if(MscHostLen == 0)
+    {
+        MscState = MSC_ST_CSW;
+    }
+    else if(MscHostIn)
+    {
+        MscState = MSC_ST_DATA_IN; // nothing to send halts IN there, once the pipe is idle
+    }
+    else if(devLen == 0)
+    {
+        MSC_EpStall(MSC_EP_OUT);
+        MscState = MSC_ST_CSW;
+    }
+    else
+    {
+        MscState = MSC_ST_DATA_OUT;
+    }
+}
+
+/*********************************************************************
+ * @fn      MSC_Reply
+ *
+ * @brief   Send a short response built in MscBuf
+ *
+ * @param   len     - response length
+ * @param   alloc   - allocation length from the CDB
+ *
+ * @return  none
+ */
+static void MSC_Reply(uint16_t len, uint16_t alloc)
+{
+    if(len > alloc)
+    {
+        len = alloc;
+    }
+    if(len > MscHostLen)
+    {
+        len = (uint16_t)MscHostLen;
+    }
+    MscBufLen = len;
+    MSC_Start(1, len);
+}
+
+/*********************************************************************
+ * @fn      MSC_Scsi
+ *
+ * @brief   Decode a command block and set up its data stage
+ *
+ * @param   cb      - command block
+ *
+ * @return  none
+ */
+static void MSC_Scsi(const uint8_t *cb)
+{
+    uint32_t lba, n;
+
+    memset(MscBuf, 0, 36);
+    switch(cb[0])
+    {
+        case SCSI_TEST_UNIT_READY:
+            MSC_Ready();
+            MSC_Start(0, 0);
+            break;
+
+        case SCSI_REQUEST_SENSE:
+            MscBuf[0] = 0x70; // current error, fixed format
+            MscBuf[2] = MscSenseKey;
+            MscBuf[7] = 10;
+            MscBuf[12] = MscSenseAsc;
+            MscSenseKey = SENSE_NONE;
+            MscSenseAsc = ASC_NONE;
+            MSC_Reply(18, cb[4]);
+            break;
+
+        case SCSI_INQUIRY:
+            if(cb[1] & 0x01)
+            { // no vital product data pages
+                MSC_Fail(SENSE_ILLEGAL_REQUEST, ASC_INVALID_FIELD_IN_CDB);
+                MSC_Start(1, 0);
+                break;
+            }
+            memcpy(MscBuf, MscInquiry, sizeof(MscInquiry));
+            MSC_Reply(sizeof(MscInquiry), ((uint16_t)cb[3] << 8) | cb[4]);
+            break;
+
+        case SCSI_READ_FORMAT_CAPACITY:
+            MscBuf[3] = 8; // capacity list length
+            if(MscDisk && MscDisk->blockCount)
+            {
+                MSC_PutBE32(&MscBuf[4], MscDisk->blockCount);
+                MscBuf[8] = MscEjected ? 0x03 : 0x02; // no medium / formatted
+            }
+            else
+            {
+                MSC_PutBE32(&MscBuf[4], 0xFFFFFFFF);
+                MscBuf[8] = 0x03;
+            }
+            MscBuf[10] = MSC_BLOCK_SIZE >> 8;
+            MscBuf[11] = MSC_BLOCK_SIZE & 0xFF;
+            MSC_Reply(12, ((uint16_t)cb[7] << 8) | cb[8]);
+            break;
+
+        case SCSI_READ_CAPACITY10:
+            if(!MSC_Ready())
+            {
+                MSC_Start(1, 0);
+                break;
+            }
+            MSC_PutBE32(&MscBuf[0], MscDisk->blockCount - 1);
+            MSC_PutBE32(&MscBuf[4], MSC_BLOCK_SIZE);
+            MSC_Reply(8, 8);
+            break;
+
+        case SCSI_MODE_SENSE6:
+            MscBuf[0] = 3; // mode data length, no block descriptor, no pages
+            MscBuf[2] = (MscDisk && MscDisk->writeProtect) ? 0x80 : 0x00;
+            MSC_Reply(4, cb[4]);
+            break;
+
+        case SCSI_MODE_SENSE10:
+            MscBuf[1] = 6;
+            MscBuf[3] = (MscDisk && MscDisk->writeProtect) ? 0x80 : 0x00;
+            MSC_Reply(8, ((uint16_t)cb[7] << 8) | cb[8]);
+            break;
+
+        case SCSI_START_STOP_UNIT:
+            if((cb[4] & 0x03) == 0x02)
+            { // eject: the host is done with the medium
+                if(MscDisk && MscDisk->sync && MscDisk->sync())
+                {
+                    MSC_Fail(SENSE_MEDIUM_ERROR, ASC_WRITE_FAULT);
+                }
+                MscEjected = 1;
+            }
+            else if((cb[4] & 0x03) == 0x03)
+            {
+                MscEjected = 0;
+            }
+            MSC_Start(0, 0);
+            break;
+
+        case SCSI_PREVENT_ALLOW_REMOVAL:
+            MSC_Start(0, 0);
+            break;
+
+        case SCSI_SYNC_CACHE10:
+            if(MSC_Ready() && MscDisk->sync && MscDisk->sync())
+            {
+                MSC_Fail(SENSE_MEDIUM_ERROR, ASC_WRITE_FAULT);
+            }
+            MSC_Start(0, 0);
+            break;
+
+        case SCSI_READ10:
+        case SCSI_WRITE10:
+        case SCSI_VERIFY10:
+            lba = MSC_GetBE32(&cb[2]);
+            n = ((uint32_t)cb[7] << 8) | cb[8];
+            if(!MSC_Ready())
+            {
+                n = 0;
+            }
+            else if(lba >= MscDisk->blockCount || n > MscDisk->blockCount - lba)
+            {
+                MSC_Fail(SENSE_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE);
+                n = 0;
+            }
+            else if(cb[0] == SCSI_WRITE10 && MscDisk->writeProtect)
+            {
+                MSC_Fail(SENSE_DATA_PROTECT, ASC_WRITE_PROTECTED);
+                n = 0;
+            }
+            if(cb[0] == SCSI_VERIFY10)
+            { // nothing to compare against, BYTCHK is not supported
+                n = 0;
+            }
+            MscLba = lba;
+            MscBlocks = n;
+            MSC_Start(cb[0] != SCSI_WRITE10, n * MSC_BLOCK_SIZE);
+            break;
+
+        default:
+            MSC_Fail(SENSE_ILLEGAL_REQUEST, ASC_INVALID_COMMAND);
+            MSC_Start(MscHostIn, 0);
+            break;
+    }
+}
+
+/*********************************************************************
+ * @fn      MSC_Cbw
+ *
+ * @brief   Check a received CBW and start its command
+ *
+ * @param   p       - packet
+ * @param   len     - packet length
+ *
+ * @return  none
+ */
+static void MSC_Cbw(const uint8_t *p, uint8_t len)
+{
+    if(len != MSC_CBW_LEN || MSC_GetLE32(p) != MSC_CBW_SIGNATURE)
+    { // not valid: halt both pipes until reset recovery
+        MscState = MSC_ST_HALT;
+        MSC_EpStall(MSC_EP_IN);
+        MSC_EpStall(MSC_EP_OUT);
+        return;
+    }
+    MscActive = 1;
+    MscTag = MSC_GetLE32(&p[4]);
+    MscHostLen = MSC_GetLE32(&p[8]);
+    MscHostIn = (p[12] & 0x80) ? 1 : 0;
+    MscStatus = MSC_CSW_PASSED;
+    MscDone = 0;
+    MscBlocks = 0;
+    MscBufLen = 0;
+    MscBufOff = 0;
+    MscLastIn = 0;
+
+    if((p[13] & 0x0F) != 0 || (p[14] & 0x1F) == 0 || (p[14] & 0x1F) > 16)
+    { // meaningful but not for us
+        MSC_Fail(SENSE_ILLEGAL_REQUEST, ASC_INVALID_FIELD_IN_CDB);
+        MSC_Start(MscHostIn, 0);
+        return;
+    }
+    MSC_Scsi(&p[15]);
+}
+
+/*********************************************************************
+ * @fn      MSC_DataIn
+ *
+ * @brief   Keep the IN endpoint fed, blocks are read one at a time
+ *          into MscBuf while the previous packets are on the bus
+ *
+ * @return  none
+ */
+static void MSC_DataIn(void)
+{
+    uint8_t *p;
+    uint16_t n;
+
+    for(;;)
+    {
+        if(MscBufOff == MscBufLen)
+        {
+            if(MscBlocks == 0)
+            {
+                break;
+            }
+            if(MscDisk->read(MscLba, MscBuf))
+            {
+                MSC_Fail(SENSE_MEDIUM_ERROR, ASC_UNRECOVERED_READ);
+                MscBlocks = 0;
+                break;
+            }
+            MscLba++;
+            MscBlocks--;
+            MscBufOff = 0;
+            MscBufLen = MSC_BLOCK_SIZE;
+        }
+        p = MSC_EpInGet();
+        if(p == NULL)
+        {
+            return;
+        }
+        n = MscBufLen - MscBufOff;
+        if(n > MSC_EP_SIZE)
+        {
+            n = MSC_EP_SIZE;
+        }
+        memcpy(p, &MscBuf[MscBufOff], n);
+        MSC_EpInSend((uint8_t)n);
+        MscBufOff += n;
+        MscDone += n;
+        MscLastIn = (uint8_t)n;
+    }
+
+    /* A short packet already ends the data stage for the host, otherwise
+     * the rest is padded by halting IN once the queued packets are out */
+    if(MscDone < MscHostLen && (MscDone == 0 || MscLastIn == MSC_EP_SIZE))
+    {
+        if(MSC_EpInBusy())
+        {
+            return;
+        }
+        MSC_EpStall(MSC_EP_IN);
+    }
+    MscState = MSC_ST_CSW;
+}
+
+/*********************************************************************
+ * @fn      MSC_DataOut
+ *
+ * @brief   Collect OUT packets into MscBuf and write each full block
+ *
+ * @return  none
+ */
+static void MSC_DataOut(void)
+{
+    uint8_t *p;
+    uint8_t  len;
+    uint16_t n;
+
+    while(MscBlocks)
+    {
+        p = MSC_EpOutGet(&len);
+        if(p == NULL)
+        {
+            return;
+        }
+        n = MSC_BLOCK_SIZE - MscBufLen;
+        if(n > len)
+        {
+            n = len;
+        }
+        memcpy(&MscBuf[MscBufLen], p, n);
+        MSC_EpOutFree();
+        MscBufLen += n;
+        MscDone += len;
+        if(MscBufLen == MSC_BLOCK_SIZE)
+        {
+            /* after a failure the rest is taken and dropped so the host gets its CSW */
+            if(MscStatus == MSC_CSW_PASSED && MscDisk->write(MscLba, MscBuf))
+            {
+                MSC_Fail(SENSE_MEDIUM_ERROR, ASC_WRITE_FAULT);
+            }
+            MscLba++;
+            MscBlocks--;
+            MscBufLen = 0;
+        }
+        if(len < MSC_EP_SIZE)
+        {
+            break; // the host ended the transfer early
+        }
+    }
+    if(MscDone < MscHostLen)
+    {
+        MSC_EpStall(MSC_EP_OUT);
+    }
+    MscState = MSC_ST_CSW;
+}
+
+/*********************************************************************
+ * @fn      MSC_Csw
+ *
+ * @brief   Send the CSW of the finished command
+ *
+ * @return  none
+ */
+static void MSC_Csw(void)
+{
+    uint8_t *p;
+
+    p = MSC_EpInGet();
+    if(p == NULL)
+    {
+        return;
+    }
+    MSC_PutLE32(&p[0], MSC_CSW_SIGNATURE);
+    MSC_PutLE32(&p[4], MscTag);
+    MSC_PutLE32(&p[8], MscHostLen - MscDone);
+    p[12] = MscStatus;
+    MSC_EpInSend(MSC_CSW_LEN);
+    MscState = MSC_ST_CBW;
+}
+
+/*********************************************************************
+ * @fn      MSC_Init
+ *
+ * @brief   Start the engine on a block device
+ *
+ * @param   disk    - block device, must stay valid
+ *
+ * @return  none
+ */
+void MSC_Init(const MSC_DiskTypeDef *disk)
+{
+    MscDisk = disk;
+    MscEjected = 0;
+    MscSenseKey = SENSE_NONE;
+    MscSenseAsc = ASC_NONE;
+    MSC_Reset();
+}
+
+/*********************************************************************
+ * @fn      MSC_Reset
+ *
+ * @brief   Bulk-Only Mass Storage Reset or USB bus reset
+ *
+ * @return  none
+ */
+void MSC_Reset(void)
+{
+    MscState = MSC_ST_CBW;
+}
+
+/*********************************************************************
+ * @fn      MSC_ClearHalt
+ *
+ * @brief   CLEAR_FEATURE(ENDPOINT_HALT) from the host
+ *
+ * @param   ep      - MSC_EP_IN / MSC_EP_OUT
+ *
+ * @return  1 - the endpoint may be resumed
+ */
+uint8_t MSC_ClearHalt(uint8_t ep)
+{
+    (void)ep;
+    return (MscState != MSC_ST_HALT);
+}
+
+/*********************************************************************
+ * @fn      MSC_Poll
+ *
+ * @brief   Run the transport, call from the main loop
+ *
+ * @return  none
+ */
+void MSC_Poll(void)
+{
+    uint8_t  cbw[MSC_CBW_LEN];
+    uint8_t *p;
+    uint8_t  len;
+
+    switch(MscState)
+    {
+        case MSC_ST_CBW:
+            p = MSC_EpOutGet(&len);
+            if(p)
+            { // copied out first, the command may halt OUT
+                if(len > MSC_CBW_LEN)
+                {
+                    len = 0;
+                }
+                memcpy(cbw, p, len);
+                MSC_EpOutFree();
+                MSC_Cbw(cbw, len);
+            }
+            break;
+
+        case MSC_ST_DATA_IN:
+            MSC_DataIn();
+            break;
+
+        case MSC_ST_DATA_OUT:
+            MSC_DataOut();
+            break;
+
+        default:
+            break;
+    }
+    if(MscState == MSC_ST_CSW)
+    {
+        MSC_Csw();
+    }
+}
+
+/*********************************************************************
+ * @fn      MSC_Idle
+ *
+ * @brief   Whether the engine stayed between commands since the last
+ *          call. A command that starts and ends between two calls still
+ *          counts as activity, so a periodic caller never misses a write.
+ *
+ * @return  1 - waiting for a CBW and none received since the last call
+ */
+uint8_t MSC_Idle(void)
+{
+    uint8_t active = MscActive;
+
+    MscActive = 0;
+    return (!active && MscState == MSC_ST_CBW);
+}
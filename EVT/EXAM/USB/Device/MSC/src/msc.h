@@ -0,0 +1,123 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : msc.h
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : USB Mass Storage Bulk-Only Transport and SCSI command set
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+#ifndef __MSC_H
+#define __MSC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define MSC_BLOCK_SIZE      512  // logical block size reported to the host
+#define MSC_EP_SIZE         64   // bulk endpoint size
+#define MSC_EP_IN           0x81
+#define MSC_EP_OUT          0x01
+
+/* Class requests */
+#define MSC_REQ_GET_MAX_LUN 0xFE
+#define MSC_REQ_RESET       0xFF
+
+/* Block device behind the single LUN */
+typedef struct
+{
+    uint32_t blockCount;                                  // capacity in MSC_BLOCK_SIZE blocks
+    uint8_t  writeProtect;                                // reported in MODE SENSE, writes fail
+    uint8_t (*read)(uint32_t lba, uint8_t *buf);          // read one block, 0 - ok
+    uint8_t (*write)(uint32_t lba, const uint8_t *buf);   // write one block, 0 - ok
+    uint8_t (*sync)(void);                                // write out cached data, may be NULL
+} MSC_DiskTypeDef;
+
+/* Endpoint glue, provided by the application
+ * The engine runs in the main loop, the USB interrupt only hands buffers
+ * back and forth. All of them return at once. */
+uint8_t *MSC_EpOutGet(uint8_t *len); // oldest received OUT packet, NULL if none
+void     MSC_EpOutFree(void);        // give the packet from MSC_EpOutGet back to the host
+uint8_t *MSC_EpInGet(void);          // free IN buffer, NULL if none or the endpoint is halted
+void     MSC_EpInSend(uint8_t len);  // queue the buffer from MSC_EpInGet
+uint8_t  MSC_EpInBusy(void);         // IN packets queued and not yet taken by the host
+void     MSC_EpStall(uint8_t ep);    // halt MSC_EP_IN or MSC_EP_OUT
+
+/* Block devices in msc_disk.c
+ * Flash backends keep one erase unit (MSC_CACHE_SIZE) in RAM and combine all
+ * block writes that land in it. The unit is erased and programmed page by page
+ * when a write moves to another unit or the sync hook is called. */
+#ifndef MSC_RAMDISK_BLOCKS
+#define MSC_RAMDISK_BLOCKS  16       // RAM disk size in blocks
+#endif
+#ifndef MSC_DATAFLASH_OFFSET
+#define MSC_DATAFLASH_OFFSET 0       // first Data-Flash byte used, erase unit aligned
+#endif
+#ifndef MSC_DATAFLASH_SIZE
+#define MSC_DATAFLASH_SIZE  (EEPROM_MAX_SIZE - MSC_DATAFLASH_OFFSET)
+#endif
+#ifndef MSC_CACHE_SIZE
+#define MSC_CACHE_SIZE      4096     // erase unit of Data-Flash blocks and SPI NOR sectors
+#endif
+
+const MSC_DiskTypeDef *MSC_RamDiskInit(void);
+const MSC_DiskTypeDef *MSC_DataFlashInit(void);
+const MSC_DiskTypeDef *MSC_SpiNorInit(void);   // SPI0 on PA12(CS) PA13(SCK) PA14(MOSI) PA15(MISO), NULL if no chip
+
+/**
+ * @brief   Put an empty FAT12 file system on a medium without a boot
+ *          sector signature, so a fresh disk shows up ready to use
+ *
+ * @param   disk    - block device
+ *
+ * @return  0 - ok or already formatted
+ */
+uint8_t MSC_DiskFormat(const MSC_DiskTypeDef *disk);
+
+/**
+ * @brief   Start the engine on a block device, the device may change later
+ *          by calling it again
+ *
+ * @param   disk    - block device, must stay valid
+ */
+void MSC_Init(const MSC_DiskTypeDef *disk);
+
+/**
+ * @brief   Bulk-Only Mass Storage Reset or USB bus reset, wait for a CBW
+ */
+void MSC_Reset(void);
+
+/**
+ * @brief   CLEAR_FEATURE(ENDPOINT_HALT) from the host
+ *
+ * @param   ep      - MSC_EP_IN / MSC_EP_OUT
+ *
+ * @return  1 - the endpoint may be resumed, 0 - keep it halted until
+ *          a Bulk-Only Mass Storage Reset (invalid CBW)
+ */
+uint8_t MSC_ClearHalt(uint8_t ep);
+
+/**
+ * @brief   Run the transport, call from the main loop
+ */
+void MSC_Poll(void);
+
+/**
+ * @brief   Whether the engine stayed between commands since the last call,
+ *          cached writes may be flushed. Commands that completed between two
+ *          calls count as activity.
+ *
+ * @return  1 - waiting for a CBW and none received since the last call
+ */
+uint8_t MSC_Idle(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,453 @@
+/********************************** (C) COPYRIGHT *******************************
+ * File Name          : msc_disk.c
+ * Author             : WCH
+ * Version            : V1.0
+ * Date               : 2022/06/10
+ * Description        : Block devices for the MSC example: RAM disk, on-chip
+ *                      Data-Flash and SPI NOR on SPI0. Both Flash devices go
+ *                      through one erase unit sized write-combining cache, the
+ *                      host writes 512 byte blocks but Flash is erased 4KB at
+ *                      a time, so a unit is read once, updated in RAM and
+ *                      erased and programmed once when the host moves on.
+ *********************************************************************************
+ * Copyright (c) 2021 Nanjing Qinheng Microelectronics Co., Ltd.
+ * Attention: This software (modified or not) and binary are used for
+ * microcontroller manufactured by Nanjing Qinheng Microelectronics.
+ *******************************************************************************/
+
+#include "CH58x_common.h"
+#include "msc.h"
+
+#define MSC_FLASH_PAGE_SIZE   256          // program unit of both Flash devices
+#define MSC_CACHE_NONE        0xFFFFFFFF
+
+/* Raw Flash access below the cache */
+typedef struct
+{
+    uint8_t (*read)(uint32_t addr, uint8_t *buf, uint16_t len);
+    uint8_t (*erase)(uint32_t addr);                              // one MSC_CACHE_SIZE unit
+    uint8_t (*program)(uint32_t addr, uint8_t *buf, uint16_t len); // inside one page
+} MSC_FlashOpsTypeDef;
+
+static const MSC_FlashOpsTypeDef *MscFlash;
+
+static __attribute__((aligned(4))) uint8_t MscCache[MSC_CACHE_SIZE];
+static uint32_t MscCacheAddr = MSC_CACHE_NONE; // Flash address of the unit in MscCache
+static uint8_t  MscCacheDirty;
+
+static MSC_DiskTypeDef MscDiskDev;
+
+/*********************************************************************
+ * @fn      MSC_FlashSync
+ *
+ * @brief   Erase the cached unit and program it back, pages left all
+ *          0xFF by the host are skipped
+ *
+ * @return  0 - ok, the cache stays dirty on error
+ */
+static uint8_t MSC_FlashSync(void)
+{
+    uint16_t i, j;
+
+    if(!MscCacheDirty)
+    {
+        return 0;
+    }
+    if(MscFlash->erase(MscCacheAddr))
+    {
+        return 1;
+    }
+    for(i = 0; i < MSC_CACHE_SIZE; i += MSC_FLASH_PAGE_SIZE)
+    {
+        for(j = 0; j < MSC_FLASH_PAGE_SIZE; j++)
+        {
+            if(MscCache[i + j] != 0xFF)
+            {
+                break;
+            }
+        }
+        if(j < MSC_FLASH_PAGE_SIZE && MscFlash->program(MscCacheAddr + i, &MscCache[i], MSC_FLASH_PAGE_SIZE))
+        {
+            return 1;
+        }
+    }
+    MscCacheDirty = 0;
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      MSC_FlashRead
+ *
+ * @brief   Read one block, from the cache if its unit is loaded
+ *
+ * @param   lba     - block number
+ * @param   buf     - MSC_BLOCK_SIZE bytes
+ *
+ * @return  0 - ok
+ */
+static uint8_t MSC_FlashRead(uint32_t lba, uint8_t *buf)
+{
+    uint32_t addr = lba * MSC_BLOCK_SIZE;
+
+    if((addr & ~(uint32_t)(MSC_CACHE_SIZE - 1)) == MscCacheAddr)
+    {
+        memcpy(buf, &MscCache[addr & (MSC_CACHE_SIZE - 1)], MSC_BLOCK_SIZE);
+        return 0;
+    }
+    return MscFlash->read(addr, buf, MSC_BLOCK_SIZE);
+}
+
+/*********************************************************************
+ * @fn      MSC_FlashWrite
+ *
+ * @brief   Write one block into the cache, loading its unit first
+ *
+ * @param   lba     - block number
+ * @param   buf     - MSC_BLOCK_SIZE bytes
+ *
+ * @return  0 - ok
+ */
+static uint8_t MSC_FlashWrite(uint32_t lba, const uint8_t *buf)
+{
+    uint32_t addr = lba * MSC_BLOCK_SIZE;
+    uint32_t unit = addr & ~(uint32_t)(MSC_CACHE_SIZE - 1);
+    uint8_t *p;
+
+    if(unit != MscCacheAddr)
+    {
+        if(MSC_FlashSync())
+        {
+            return 1;
+        }
+        MscCacheAddr = MSC_CACHE_NONE;
+        if(MscFlash->read(unit, MscCache, MSC_CACHE_SIZE))
+        {
+            return 1;
+        }
+        MscCacheAddr = unit;
+    }
+    p = &MscCache[addr & (MSC_CACHE_SIZE - 1)];
+    if(memcmp(p, buf, MSC_BLOCK_SIZE))
+    { // rewriting the same data is common, it costs no erase
+        memcpy(p, buf, MSC_BLOCK_SIZE);
+        MscCacheDirty = 1;
+    }
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      MSC_FlashDiskInit
+ *
+ * @brief   Fill the disk descriptor of a cached Flash device
+ *
+ * @param   ops     - raw Flash access
+ * @param   size    - bytes, a multiple of MSC_CACHE_SIZE
+ *
+ * @return  disk descriptor
+ */
+static const MSC_DiskTypeDef *MSC_FlashDiskInit(const MSC_FlashOpsTypeDef *ops, uint32_t size)
+{
+    MscFlash = ops;
+    MscCacheAddr = MSC_CACHE_NONE;
+    MscCacheDirty = 0;
+    MscDiskDev.blockCount = size / MSC_BLOCK_SIZE;
+    MscDiskDev.writeProtect = 0;
+    MscDiskDev.read = MSC_FlashRead;
+    MscDiskDev.write = MSC_FlashWrite;
+    MscDiskDev.sync = MSC_FlashSync;
+    return &MscDiskDev;
+}
+
+/* RAM disk ******************************************************************/
+
+static __attribute__((aligned(4))) uint8_t MscRamDisk[MSC_RAMDISK_BLOCKS][MSC_BLOCK_SIZE];
+
+static uint8_t MSC_RamRead(uint32_t lba, uint8_t *buf)
+{
+    memcpy(buf, MscRamDisk[lba], MSC_BLOCK_SIZE);
+    return 0;
+}
+
+static uint8_t MSC_RamWrite(uint32_t lba, const uint8_t *buf)
+{
+    memcpy(MscRamDisk[lba], buf, MSC_BLOCK_SIZE);
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      MSC_RamDiskInit
+ *
+ * @brief   RAM disk of MSC_RAMDISK_BLOCKS blocks, empty after reset
+ *
+ * @return  disk descriptor
+ */
+const MSC_DiskTypeDef *MSC_RamDiskInit(void)
+{
+    MscDiskDev.blockCount = MSC_RAMDISK_BLOCKS;
+    MscDiskDev.writeProtect = 0;
+    MscDiskDev.read = MSC_RamRead;
+    MscDiskDev.write = MSC_RamWrite;
+    MscDiskDev.sync = NULL;
+    return &MscDiskDev;
+}
+
+/* Data-Flash ****************************************************************/
+
+static uint8_t MSC_DataFlashRead(uint32_t addr, uint8_t *buf, uint16_t len)
+{
+    EEPROM_READ(MSC_DATAFLASH_OFFSET + addr, buf, len);
+    return 0;
+}
+
+static uint8_t MSC_DataFlashErase(uint32_t addr)
+{
+    return EEPROM_ERASE(MSC_DATAFLASH_OFFSET + addr, MSC_CACHE_SIZE);
+}
+
+static uint8_t MSC_DataFlashProgram(uint32_t addr, uint8_t *buf, uint16_t len)
+{
+    return EEPROM_WRITE(MSC_DATAFLASH_OFFSET + addr, buf, len);
+}
+
+static const MSC_FlashOpsTypeDef MscDataFlashOps = {
+    MSC_DataFlashRead,
+    MSC_DataFlashErase,
+    MSC_DataFlashProgram,
+};
+
+/*********************************************************************
+ * @fn      MSC_DataFlashInit
+ *
+ * @brief   Disk on the on-chip Data-Flash, MSC_DATAFLASH_SIZE bytes from
+ *          MSC_DATAFLASH_OFFSET
+ *
+ * @return  disk descriptor
+ */
+const MSC_DiskTypeDef *MSC_DataFlashInit(void)
+{
+    return MSC_FlashDiskInit(&MscDataFlashOps, MSC_DATAFLASH_SIZE & ~(uint32_t)(MSC_CACHE_SIZE - 1));
+}
+
+/* SPI NOR *******************************************************************/
+
+#define NOR_CMD_WRITE_ENABLE  0x06
+#define NOR_CMD_READ_STATUS   0x05
+#define NOR_CMD_READ          0x03
+#define NOR_CMD_PAGE_PROGRAM  0x02
+#define NOR_CMD_SECTOR_ERASE  0x20 // 4KB
+#define NOR_CMD_JEDEC_ID      0x9F
+#define NOR_CMD_RELEASE_PD    0xAB
+#define NOR_SR_BUSY           0x01
+#define NOR_DMA_CHUNK         2048 // below the 12-bit SPI0 DMA count
+
+#define NOR_CS_LOW()          GPIOA_ResetBits(GPIO_Pin_12)
+#define NOR_CS_HIGH()         GPIOA_SetBits(GPIO_Pin_12)
+
+static void MSC_NorCmd(uint8_t cmd, uint32_t addr)
+{
+    SPI0_MasterSendByte(cmd);
+    SPI0_MasterSendByte((uint8_t)(addr >> 16));
+    SPI0_MasterSendByte((uint8_t)(addr >> 8));
+    SPI0_MasterSendByte((uint8_t)addr);
+}
+
+static void MSC_NorWriteEnable(void)
+{
+    NOR_CS_LOW();
+    SPI0_MasterSendByte(NOR_CMD_WRITE_ENABLE);
+    NOR_CS_HIGH();
+}
+
+static void MSC_NorWait(void)
+{
+    uint8_t sr;
+
+    do
+    {
+        NOR_CS_LOW();
+        SPI0_MasterSendByte(NOR_CMD_READ_STATUS);
+        sr = SPI0_MasterRecvByte();
+        NOR_CS_HIGH();
+    } while(sr & NOR_SR_BUSY);
+}
+
+static uint8_t MSC_NorRead(uint32_t addr, uint8_t *buf, uint16_t len)
+{
+    uint16_t n;
+
+    NOR_CS_LOW();
+    MSC_NorCmd(NOR_CMD_READ, addr);
+    while(len)
+    {
+        n = (len > NOR_DMA_CHUNK) ? NOR_DMA_CHUNK : len;
+        SPI0_MasterDMARecv(buf, n);
+        buf += n;
+        len -= n;
+    }
+    NOR_CS_HIGH();
+    return 0;
+}
+
+static uint8_t MSC_NorErase(uint32_t addr)
+{
+    MSC_NorWriteEnable();
+    NOR_CS_LOW();
+    MSC_NorCmd(NOR_CMD_SECTOR_ERASE, addr);
+    NOR_CS_HIGH();
+    MSC_NorWait();
+    return 0;
+}
+
+static uint8_t MSC_NorProgram(uint32_t addr, uint8_t *buf, uint16_t len)
+{
+    MSC_NorWriteEnable();
+    NOR_CS_LOW();
+    MSC_NorCmd(NOR_CMD_PAGE_PROGRAM, addr);
+    SPI0_MasterDMATrans(buf, len);
+    NOR_CS_HIGH();
+    MSC_NorWait();
+    return 0;
+}
+
+static const MSC_FlashOpsTypeDef MscNorOps = {
+    MSC_NorRead,
+    MSC_NorErase,
+    MSC_NorProgram,
+};
+
+/*********************************************************************
+ * @fn      MSC_SpiNorInit
+ *
+ * @brief   Disk on a 25-series SPI NOR, the size comes from its JEDEC ID.
+ *          Only 3-byte addressing, larger chips are used up to 16MB.
+ *
+ * @return  disk descriptor, NULL if no chip answers
+ */
+const MSC_DiskTypeDef *MSC_SpiNorInit(void)
+{
+    uint8_t mfr, cap;
+
+    NOR_CS_HIGH();
+    GPIOA_ModeCfg(GPIO_Pin_12 | GPIO_Pin_13 | GPIO_Pin_14, GPIO_ModeOut_PP_5mA);
+    GPIOA_ModeCfg(GPIO_Pin_15, GPIO_ModeIN_PU);
+    SPI0_MasterDefInit();
+
+    NOR_CS_LOW();
+    SPI0_MasterSendByte(NOR_CMD_RELEASE_PD);
+    NOR_CS_HIGH();
+    DelayUs(50);
+
+    NOR_CS_LOW();
+    SPI0_MasterSendByte(NOR_CMD_JEDEC_ID);
+    mfr = SPI0_MasterRecvByte();
+    SPI0_MasterRecvByte(); // memory type
+    cap = SPI0_MasterRecvByte();
+    NOR_CS_HIGH();
+
+    if(mfr == 0x00 || mfr == 0xFF || cap < 16 || cap > 32)
+    {
+        return NULL;
+    }
+    if(cap > 24)
+    {
+        cap = 24;
+    }
+    return MSC_FlashDiskInit(&MscNorOps, 1UL << cap);
+}
+
+/* FAT12 formatter ***********************************************************/
+
+#define MSC_FAT_ROOT_ENTRIES  64
+
+static void MSC_PutLE16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+/*********************************************************************
+ * @fn      MSC_DiskFormat
+ *
+ * @brief   Put an empty FAT12 file system on a medium without a boot
+ *          sector signature
+ *
+ * @param   disk    - block device
+ *
+ * @return  0 - ok or already formatted
+ */
+uint8_t MSC_DiskFormat(const MSC_DiskTypeDef *disk)
+{
+    static __attribute__((aligned(4))) uint8_t buf[MSC_BLOCK_SIZE];
+    uint32_t total, lba;
+    uint16_t spf, rootSec;
+    uint8_t  spc;
+
+    if(disk->read(0, buf))
+    {
+        return 1;
+    }
+    if(buf[510] == 0x55 && buf[511] == 0xAA)
+    {
+        return 0;
+    }
+
+    total = disk->blockCount;
+    spc = 1;
+    while(total / spc > 4084 && spc < 128)
+    {
+        spc <<= 1; // FAT12 holds at most 4084 clusters
+    }
+    rootSec = MSC_FAT_ROOT_ENTRIES * 32 / MSC_BLOCK_SIZE;
+    spf = (uint16_t)(((total / spc + 2) * 3 / 2 + MSC_BLOCK_SIZE - 1) / MSC_BLOCK_SIZE);
+
+    memset(buf, 0, MSC_BLOCK_SIZE);
+    buf[0] = 0xEB;
+    buf[1] = 0x3C;
+    buf[2] = 0x90;
+    memcpy(&buf[3], "MSDOS5.0", 8);
+    MSC_PutLE16(&buf[11], MSC_BLOCK_SIZE);
+    buf[13] = spc;
+    MSC_PutLE16(&buf[14], 1); // reserved sectors
+    buf[16] = 2;              // FAT copies
+    MSC_PutLE16(&buf[17], MSC_FAT_ROOT_ENTRIES);
+    if(total < 0x10000)
+    {
+        MSC_PutLE16(&buf[19], (uint16_t)total);
+    }
+    else
+    {
+        MSC_PutLE16(&buf[32], (uint16_t)total);
+        MSC_PutLE16(&buf[34], (uint16_t)(total >> 16));
+    }
+    buf[21] = 0xF8; // fixed disk
+    MSC_PutLE16(&buf[22], spf);
+    MSC_PutLE16(&buf[24], 32); // sectors per track
+    MSC_PutLE16(&buf[26], 64); // heads
+    buf[36] = 0x80;
+    buf[38] = 0x29; // extended boot signature
+    MSC_PutLE16(&buf[39], 0x0583);
+    MSC_PutLE16(&buf[41], 0x1A86);
+    memcpy(&buf[43], "CH58x DISK FAT12   ", 19);
+    buf[510] = 0x55;
+    buf[511] = 0xAA;
+    if(disk->write(0, buf))
+    {
+        return 1;
+    }
+
+    for(lba = 1; lba < 1 + 2 * (uint32_t)spf + rootSec; lba++)
+    {
+        memset(buf, 0, MSC_BLOCK_SIZE);
+        if(lba == 1 || lba == 1 + (uint32_t)spf)
+        { // media byte and end of chain marker in cluster 0 and 1
+            buf[0] = 0xF8;
+            buf[1] = 0xFF;
+            buf[2] = 0xFF;
+        }
+        if(disk->write(lba, buf))
+        {
+            return 1;
+        }
+    }
+    return disk->sync ? disk->sync() : 0;
+}
@@ -0,0 +1,43 @@
+/* Host stand-in for CH58x_common.h, just enough for msc_disk.c
+ *
+ * The Data-Flash calls go to the simulated Flash of msc_test.c, SPI0 and
+ * GPIO do nothing and no SPI NOR chip answers. */
+#ifndef __CH58x_COMMON_H__
+#define __CH58x_COMMON_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define EEPROM_MAX_SIZE               0x8000
+
+void    sim_flash_read(uint32_t addr, void *buf, uint32_t len);
+uint8_t sim_flash_erase(uint32_t addr, uint32_t len);
+uint8_t sim_flash_write(uint32_t addr, const void *buf, uint32_t len);
+
+#define EEPROM_READ(addr, buf, len)   sim_flash_read(addr, buf, len)
+#define EEPROM_ERASE(addr, len)       sim_flash_erase(addr, len)
+#define EEPROM_WRITE(addr, buf, len)  sim_flash_write(addr, buf, len)
+
+#define GPIO_Pin_12                   0x00001000
+#define GPIO_Pin_13                   0x00002000
+#define GPIO_Pin_14                   0x00004000
+#define GPIO_Pin_15                   0x00008000
+#define GPIO_ModeIN_PU                0
+#define GPIO_ModeOut_PP_5mA           1
+#define GPIOA_ModeCfg(pin, mode)      ((void)(pin), (void)(mode))
+#define GPIOA_SetBits(pin)            ((void)(pin))
+#define GPIOA_ResetBits(pin)          ((void)(pin))
+#define DelayUs(t)                    ((void)(t))
+
+#define SPI0_MasterDefInit()          ((void)0)
+#define SPI0_MasterSendByte(d)        ((void)(d))
+#define SPI0_MasterDMATrans(buf, len) ((void)(buf), (void)(len))
+#define SPI0_MasterDMARecv(buf, len)  memset(buf, 0, len)
+
+static inline uint8_t SPI0_MasterRecvByte(void)
+{
+    return 0x00;
+}
+
+#endif
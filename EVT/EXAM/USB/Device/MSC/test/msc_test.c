@@ -0,0 +1,484 @@
+/* Host test for the Bulk-Only transport (msc.c) and the cached Flash disk
+ * (msc_disk.c)
+ *
+ * A scripted host talks to the engine through fake endpoints: it queues a CBW
+ * and its OUT data, takes IN packets as soon as they are queued, clears halts
+ * the way a real host does and parses the CSW. The disk behind it is the
+ * Data-Flash disk on a simulated Flash image that only clears bits on
+ * programming, erases whole MSC_CACHE_SIZE units and counts both.
+ *
+ *   make -C EVT/EXAM/USB/Device/MSC/test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "CH58x_common.h"
+#include "msc.h"
+
+#define SYNC_IDLE_TICKS 2 // MSC_SYNC_IDLE_TICKS of Main.c
+
+#define CHECK(c, ...)                                    \
+    do {                                                 \
+        if(!(c)) {                                       \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);  \
+            printf(__VA_ARGS__);                         \
+            printf("\n");                                \
+            exit(1);                                     \
+        }                                                \
+    } while(0)
+
+/* Simulated Data-Flash *****************************************************/
+
+static uint8_t  flash[EEPROM_MAX_SIZE];
+static uint32_t flashErases, flashPrograms;
+static int      flashFail; // the next erase reports an error
+
+void sim_flash_read(uint32_t addr, void *buf, uint32_t len)
+{
+    CHECK(addr + len <= sizeof(flash), "read %05x+%u", (unsigned)addr, (unsigned)len);
+    memcpy(buf, &flash[addr], len);
+}
+
+uint8_t sim_flash_erase(uint32_t addr, uint32_t len)
+{
+    CHECK(addr % MSC_CACHE_SIZE == 0 && len == MSC_CACHE_SIZE && addr + len <= sizeof(flash), "erase %05x+%u",
+          (unsigned)addr, (unsigned)len);
+    if(flashFail)
+    {
+        flashFail = 0;
+        return 1;
+    }
+    memset(&flash[addr], 0xFF, len);
+    flashErases++;
+    return 0;
+}
+
+uint8_t sim_flash_write(uint32_t addr, const void *buf, uint32_t len)
+{
+    uint32_t i;
+
+    CHECK(addr % 256 + len <= 256 && addr + len <= sizeof(flash), "program %05x+%u crosses a page",
+          (unsigned)addr, (unsigned)len);
+    for(i = 0; i < len; i++)
+    {
+        flash[addr + i] &= ((const uint8_t *)buf)[i];
+        CHECK(flash[addr + i] == ((const uint8_t *)buf)[i], "program %05x over data not erased", (unsigned)(addr + i));
+    }
+    flashPrograms++;
+    return 0;
+}
+
+/* Fake endpoints and the host behind them ***********************************/
+
+static uint8_t  outQ[128][MSC_EP_SIZE];
+static uint8_t  outLen[128];
+static unsigned outRd, outWr;
+static uint8_t  inBuf[MSC_EP_SIZE];
+static uint8_t  inLen, inReady, inHalt;
+static unsigned stallsIn, stallsOut;
+
+/* what the host saw of the last command */
+static uint8_t  rxData[4096];
+static uint32_t rxLen;
+static uint32_t rxWant;    // dCBWDataTransferLength of an IN command
+static int      rxDataEnd; // data stage over: short packet, halt or all bytes in
+static uint8_t  csw[MSC_EP_SIZE];
+static int      cswLen;
+static uint32_t tag;
+
+uint8_t *MSC_EpOutGet(uint8_t *len)
+{
+    if(outRd == outWr)
+    {
+        return NULL;
+    }
+    *len = outLen[outRd % 128];
+    return outQ[outRd % 128];
+}
+
+void MSC_EpOutFree(void)
+{
+    CHECK(outRd != outWr, "OUT packet freed twice");
+    outRd++;
+}
+
+uint8_t *MSC_EpInGet(void)
+{
+    return (inHalt || inReady) ? NULL : inBuf;
+}
+
+void MSC_EpInSend(uint8_t len)
+{
+    CHECK(!inHalt && !inReady && len <= MSC_EP_SIZE, "IN send of %u", len);
+    inLen = len;
+    inReady = 1;
+}
+
+uint8_t MSC_EpInBusy(void)
+{
+    return inReady;
+}
+
+void MSC_EpStall(uint8_t ep)
+{
+    if(ep == MSC_EP_IN)
+    {
+        inHalt = 1;
+        stallsIn++;
+    }
+    else
+    {
+        CHECK(ep == MSC_EP_OUT, "stall of endpoint %02x", ep);
+        outRd = outWr; // the host stops at the halt and drops the rest
+        stallsOut++;
+    }
+}
+
+static void queue_out(const uint8_t *p, uint32_t len)
+{
+    uint32_t n;
+
+    do
+    {
+        n = len > MSC_EP_SIZE ? MSC_EP_SIZE : len;
+        CHECK(outWr - outRd < 128, "OUT queue full");
+        memcpy(outQ[outWr % 128], p, n);
+        outLen[outWr % 128] = (uint8_t)n;
+        outWr++;
+        p += n;
+        len -= n;
+    } while(len);
+}
+
+/* the host side of one MSC_Poll() */
+static void host(void)
+{
+    if(inHalt && MSC_ClearHalt(MSC_EP_IN))
+    {
+        rxDataEnd = 1;
+        inHalt = 0;
+    }
+    if(!inReady)
+    {
+        return;
+    }
+    inReady = 0;
+    if(!rxDataEnd)
+    {
+        memcpy(&rxData[rxLen], inBuf, inLen);
+        rxLen += inLen;
+        CHECK(rxLen <= rxWant, "%u bytes in for %u", (unsigned)rxLen, (unsigned)rxWant);
+        if(inLen < MSC_EP_SIZE || rxLen == rxWant)
+        {
+            rxDataEnd = 1;
+        }
+        return;
+    }
+    CHECK(cswLen == 0, "IN packet after the CSW");
+    memcpy(csw, inBuf, inLen);
+    cswLen = inLen;
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/* Run one command to its CSW, returns bCSWStatus, the residue in *residue */
+static int command(const uint8_t *cb, uint8_t cbLen, uint8_t dirIn, uint32_t hostLen, const uint8_t *out,
+                   uint32_t *residue)
+{
+    uint8_t cbw[31] = {0x55, 0x53, 0x42, 0x43};
+    int     i;
+
+    put_le32(&cbw[4], ++tag);
+    put_le32(&cbw[8], hostLen);
+    cbw[12] = dirIn ? 0x80 : 0x00;
+    cbw[14] = cbLen;
+    memcpy(&cbw[15], cb, cbLen);
+    queue_out(cbw, sizeof(cbw));
+    if(!dirIn && hostLen)
+    {
+        queue_out(out, hostLen);
+    }
+    rxLen = 0;
+    rxWant = dirIn ? hostLen : 0;
+    rxDataEnd = !dirIn || hostLen == 0;
+    cswLen = 0;
+
+    for(i = 0; i < 1000 && cswLen == 0; i++)
+    {
+        MSC_Poll();
+        host();
+    }
+    CHECK(cswLen == 13, "no CSW for opcode %02x", cb[0]);
+    CHECK(get_le32(csw) == 0x53425355 && get_le32(&csw[4]) == tag, "bad CSW");
+    outRd = outWr; // OUT data the device never asked for is not resent
+    if(residue)
+    {
+        *residue = get_le32(&csw[8]);
+    }
+    return csw[12];
+}
+
+static void cdb10(uint8_t *cb, uint8_t op, uint32_t lba, uint16_t n)
+{
+    memset(cb, 0, 10);
+    cb[0] = op;
+    cb[2] = (uint8_t)(lba >> 24);
+    cb[3] = (uint8_t)(lba >> 16);
+    cb[4] = (uint8_t)(lba >> 8);
+    cb[5] = (uint8_t)lba;
+    cb[7] = (uint8_t)(n >> 8);
+    cb[8] = (uint8_t)n;
+}
+
+static int read10(uint32_t lba, uint16_t n, uint8_t *buf)
+{
+    uint8_t cb[10];
+    int     st;
+
+    cdb10(cb, 0x28, lba, n);
+    st = command(cb, 10, 1, n * MSC_BLOCK_SIZE, NULL, NULL);
+    if(st == 0)
+    {
+        CHECK(rxLen == n * MSC_BLOCK_SIZE, "READ(10) moved %u bytes", (unsigned)rxLen);
+        memcpy(buf, rxData, rxLen);
+    }
+    return st;
+}
+
+static int write10(uint32_t lba, uint16_t n, const uint8_t *buf)
+{
+    uint8_t cb[10];
+
+    cdb10(cb, 0x2A, lba, n);
+    return command(cb, 10, 0, n * MSC_BLOCK_SIZE, buf, NULL);
+}
+
+static void sense(uint8_t key, uint8_t asc)
+{
+    uint8_t cb[6] = {0x03, 0, 0, 0, 18, 0};
+
+    CHECK(command(cb, 6, 1, 18, NULL, NULL) == 0 && rxLen == 18, "REQUEST SENSE");
+    CHECK(rxData[2] == key && rxData[12] == asc, "sense %02x/%02x, want %02x/%02x", rxData[2], rxData[12], key, asc);
+}
+
+static void fill(uint8_t *buf, uint32_t len, unsigned seed)
+{
+    uint32_t i;
+
+    for(i = 0; i < len; i++)
+    {
+        buf[i] = (uint8_t)(seed * 131 + i * 7 + (i >> 9));
+    }
+}
+
+static const MSC_DiskTypeDef *disk_init(void)
+{
+    const MSC_DiskTypeDef *disk;
+
+    memset(flash, 0xFF, sizeof(flash));
+    flashErases = flashPrograms = 0;
+    outRd = outWr = 0;
+    inReady = inHalt = 0;
+    disk = MSC_DataFlashInit();
+    MSC_Init(disk);
+    return disk;
+}
+
+/* Tests **********************************************************************/
+
+static void test_info(void)
+{
+    const MSC_DiskTypeDef *disk = disk_init();
+    uint8_t  inquiry[6] = {0x12, 0, 0, 0, 36, 0};
+    uint8_t  cap[10] = {0x25};
+    uint32_t residue;
+
+    CHECK(disk->blockCount == EEPROM_MAX_SIZE / MSC_BLOCK_SIZE, "%u blocks", (unsigned)disk->blockCount);
+    CHECK(command(inquiry, 6, 1, 36, NULL, &residue) == 0 && rxLen == 36 && residue == 0, "INQUIRY");
+    CHECK(rxData[0] == 0x00 && rxData[1] == 0x80 && memcmp(&rxData[8], "WCH", 3) == 0, "INQUIRY data");
+
+    /* allocation length below the response: cut short, the short packet ends the stage */
+    inquiry[4] = 5;
+    CHECK(command(inquiry, 6, 1, 36, NULL, &residue) == 0 && rxLen == 5 && residue == 31, "short INQUIRY");
+
+    CHECK(command(cap, 10, 1, 8, NULL, NULL) == 0 && rxLen == 8, "READ CAPACITY");
+    CHECK(rxData[3] == disk->blockCount - 1 && rxData[6] == MSC_BLOCK_SIZE >> 8, "READ CAPACITY data");
+
+    /* unknown command and bad LBA fail with the matching sense data */
+    cap[0] = 0xC7;
+    CHECK(command(cap, 10, 0, 0, NULL, NULL) == 1, "unknown opcode");
+    sense(0x05, 0x20);
+    CHECK(write10(disk->blockCount, 1, rxData) == 1, "WRITE past the end");
+    sense(0x05, 0x21);
+    sense(0x00, 0x00);
+}
+
+static void test_read_write(void)
+{
+    const MSC_DiskTypeDef *disk = disk_init();
+    static uint8_t data[4 * MSC_BLOCK_SIZE], back[4 * MSC_BLOCK_SIZE];
+    uint8_t        syncCb[10] = {0x35};
+
+    CHECK(MSC_DiskFormat(disk) == 0, "format");
+    CHECK(flash[510] == 0x55 && flash[511] == 0xAA && flash[512] == 0xF8, "no FAT12 on the Flash");
+    flashErases = 0;
+    CHECK(MSC_DiskFormat(disk) == 0 && flashErases == 0, "formatted twice");
+
+    /* blocks 6..9 straddle two cache units */
+    fill(data, sizeof(data), 1);
+    CHECK(write10(6, 4, data) == 0, "WRITE(10)");
+    CHECK(read10(6, 4, back) == 0 && memcmp(data, back, sizeof(data)) == 0, "read back through the cache");
+    CHECK(memcmp(&flash[6 * MSC_BLOCK_SIZE], data, 2 * MSC_BLOCK_SIZE) == 0, "first unit not written back on the move");
+    CHECK(memcmp(&flash[8 * MSC_BLOCK_SIZE], data + 2 * MSC_BLOCK_SIZE, 2 * MSC_BLOCK_SIZE) != 0,
+          "second unit written before a sync");
+
+    CHECK(command(syncCb, 10, 0, 0, NULL, NULL) == 0, "SYNCHRONIZE CACHE");
+    CHECK(memcmp(&flash[6 * MSC_BLOCK_SIZE], data, sizeof(data)) == 0, "Flash differs after the sync");
+
+    /* same data again costs no erase */
+    flashErases = 0;
+    CHECK(write10(8, 2, data + 2 * MSC_BLOCK_SIZE) == 0 && command(syncCb, 10, 0, 0, NULL, NULL) == 0, "rewrite");
+    CHECK(flashErases == 0, "%u erases for unchanged data", (unsigned)flashErases);
+
+    /* a failed erase fails the sync and keeps the data for the next one */
+    fill(data, MSC_BLOCK_SIZE, 2);
+    CHECK(write10(9, 1, data) == 0, "WRITE(10)");
+    flashFail = 1;
+    CHECK(command(syncCb, 10, 0, 0, NULL, NULL) == 1, "failed sync passed");
+    sense(0x03, 0x03);
+    CHECK(command(syncCb, 10, 0, 0, NULL, NULL) == 0, "second sync");
+    CHECK(memcmp(&flash[9 * MSC_BLOCK_SIZE], data, MSC_BLOCK_SIZE) == 0, "data lost after a failed sync");
+}
+
+/* The thirteen cases of the Bulk-Only spec that the device can tell apart */
+static void test_cases(void)
+{
+    static uint8_t buf[2 * MSC_BLOCK_SIZE];
+    uint8_t  tur[6] = {0x00};
+    uint8_t  cb[10];
+    uint32_t residue;
+    unsigned s;
+
+    disk_init();
+
+    /* Hi > Dn: nothing to send, IN halted, CSW passed with the whole residue */
+    s = stallsIn;
+    CHECK(command(tur, 6, 1, 64, NULL, &residue) == 0 && residue == 64 && stallsIn == s + 1, "case 4");
+
+    /* Ho > Dn: OUT halted */
+    s = stallsOut;
+    fill(buf, 64, 3);
+    CHECK(command(tur, 6, 0, 64, buf, &residue) == 0 && residue == 64 && stallsOut == s + 1, "case 9");
+
+    /* Hn < Di and Hi < Di: phase error, no data moved */
+    cdb10(cb, 0x28, 0, 1);
+    CHECK(command(cb, 10, 1, 0, NULL, NULL) == 2, "case 2");
+    CHECK(command(cb, 10, 1, 100, NULL, NULL) == 2, "case 7");
+
+    /* Ho <> Di and Hi <> Do: direction mismatch is a phase error */
+    CHECK(command(cb, 10, 0, MSC_BLOCK_SIZE, buf, NULL) == 2, "case 10");
+    cdb10(cb, 0x2A, 0, 1);
+    CHECK(command(cb, 10, 1, MSC_BLOCK_SIZE, NULL, NULL) == 2, "case 8");
+
+    /* Hi > Di: one block read for two, padded by an IN halt */
+    cdb10(cb, 0x28, 0, 1);
+    s = stallsIn;
+    CHECK(command(cb, 10, 1, 2 * MSC_BLOCK_SIZE, NULL, &residue) == 0 && rxLen == MSC_BLOCK_SIZE &&
+              residue == MSC_BLOCK_SIZE && stallsIn == s + 1,
+          "case 5");
+
+    /* Ho > Do: one block written for two */
+    cdb10(cb, 0x2A, 3, 1);
+    fill(buf, sizeof(buf), 4);
+    s = stallsOut;
+    CHECK(command(cb, 10, 0, 2 * MSC_BLOCK_SIZE, buf, &residue) == 0 && residue == MSC_BLOCK_SIZE &&
+              stallsOut == s + 1,
+          "case 11");
+
+    /* Ho < Do: phase error */
+    CHECK(command(cb, 10, 0, 64, buf, NULL) == 2, "case 13");
+}
+
+static void test_invalid_cbw(void)
+{
+    uint8_t  tur[6] = {0x00};
+    uint8_t  bad[30] = {0x55, 0x53, 0x42, 0x43};
+    unsigned si = stallsIn, so = stallsOut;
+    int      i;
+
+    disk_init();
+    queue_out(bad, sizeof(bad));
+    for(i = 0; i < 10; i++)
+    {
+        MSC_Poll();
+    }
+    CHECK(stallsIn == si + 1 && stallsOut == so + 1 && inHalt, "short CBW did not halt both pipes");
+    CHECK(!MSC_ClearHalt(MSC_EP_IN) && !MSC_ClearHalt(MSC_EP_OUT), "halt cleared before reset recovery");
+
+    /* Bulk-Only Mass Storage Reset, then CLEAR_FEATURE */
+    MSC_Reset();
+    CHECK(MSC_ClearHalt(MSC_EP_IN) && MSC_ClearHalt(MSC_EP_OUT), "halt kept after reset recovery");
+    inHalt = 0;
+    CHECK(command(tur, 6, 0, 0, NULL, NULL) == 0, "no command after reset recovery");
+}
+
+/* the idle write back of Main.c */
+static uint8_t idleTicks;
+
+static void tick(const MSC_DiskTypeDef *disk)
+{
+    if(!MSC_Idle())
+    {
+        idleTicks = 0;
+    }
+    else if(idleTicks < SYNC_IDLE_TICKS && ++idleTicks == SYNC_IDLE_TICKS && disk->sync)
+    {
+        disk->sync();
+    }
+}
+
+static void test_idle_sync(void)
+{
+    const MSC_DiskTypeDef *disk = disk_init();
+    static uint8_t data[MSC_BLOCK_SIZE];
+    unsigned       round;
+    int            i;
+
+    idleTicks = 0;
+    tick(disk);
+    for(round = 0; round < 3; round++)
+    {
+        /* each write starts and ends between two ticks */
+        fill(data, sizeof(data), 10 + round);
+        CHECK(write10(round, 1, data) == 0, "WRITE(10)");
+        tick(disk);
+        CHECK(memcmp(&flash[round * MSC_BLOCK_SIZE], data, MSC_BLOCK_SIZE) != 0, "written back while busy");
+        for(i = 0; i < SYNC_IDLE_TICKS; i++)
+        {
+            tick(disk);
+        }
+        CHECK(memcmp(&flash[round * MSC_BLOCK_SIZE], data, MSC_BLOCK_SIZE) == 0,
+              "write %u not written back after the idle time", round);
+    }
+}
+
+int main(void)
+{
+    test_info();
+    test_read_write();
+    test_cases();
+    test_invalid_cbw();
+    test_idle_sync();
+    printf("msc_test: all passed\n");
+    return 0;
+}
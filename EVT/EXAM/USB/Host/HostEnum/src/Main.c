@@ -15,6 +15,73 @@
 __attribute__((aligned(4))) uint8_t RxBuffer[MAX_PACKET_SIZE]; // IN, must even address
 __attribute__((aligned(4))) uint8_t TxBuffer[MAX_PACKET_SIZE]; // OUT, must even address
 
+#define USB_HOST_ASYNC_EXAM    0 // 1 - read the mouse/keyboard through the async transfer engine
+
+#if USB_HOST_ASYNC_EXAM
+__attribute__((aligned(4))) uint8_t AsyncRxDma[MAX_PACKET_SIZE];
+__attribute__((aligned(4))) uint8_t AsyncTxDma[MAX_PACKET_SIZE];
+USBHostEndp_t    HidEndp;
+USBHostXfer_t    HidXfer;
+uint8_t          HidEndpOpen = 0;
+uint8_t          HidReport[MAX_PACKET_SIZE];
+volatile uint8_t HidReportLen = 0;
+
+/*********************************************************************
+ * @fn      HidReportCB
+ *
+ * @brief   ж϶˵㴫(ж),汨Ⱥѯ
+ *
+ * @param   xfer    - ɵĴ
+ *
+ * @return  none
+ */
+void HidReportCB(USBHostXfer_t *xfer)
+{
+    if(xfer->status == ERR_SUCCESS)
+    {
+        HidReportLen = xfer->actual;
+    }
+    if(xfer->status != ERR_USB_DISCON)
+    {
+        USBHostAsync_Submit(xfer->endp, xfer);
+    }
+}
+
+/*********************************************************************
+ * @fn      HidAsyncOpen
+ *
+ * @brief   HID豸ж϶˵,ɴÿ10֡ѯһ
+ *
+ * @param   port    - 0 ΪROOT-HUB˿,ΪⲿHUBĶ˿ں
+ *
+ * @return  none
+ */
+void HidAsyncOpen(uint8_t port)
+{
+    uint8_t endp = port ? DevOnHubPort[port - 1].GpVar[0] : ThisUsbDev.GpVar[0];
+
+    if((endp & USB_ENDP_ADDR_MASK) == 0)
+    {
+        return;
+    }
+    HidEndp.devAddr = port ? DevOnHubPort[port - 1].DeviceAddress : ThisUsbDev.DeviceAddress;
+    HidEndp.endpAddr = USB_ENDP_DIR_MASK | (endp & USB_ENDP_ADDR_MASK);
+    HidEndp.type = USB_ENDP_TYPE_INTER;
+    HidEndp.maxPacket = MAX_PACKET_SIZE;
+    HidEndp.interval = 10;
+    HidEndp.speed = port ? DevOnHubPort[port - 1].DeviceSpeed : ThisUsbDev.DeviceSpeed;
+    HidEndp.viaHub = port && !HidEndp.speed;
+    USBHostAsync_AddEndp(&HidEndp);
+
+    HidXfer.buf = HidReport;
+    HidXfer.len = sizeof(HidReport);
+    HidXfer.nakLimit = 0xFFFF; // ûʱ豸NAK,һֱѯ
+    HidXfer.callback = HidReportCB;
+    USBHostAsync_Submit(&HidEndp, &HidXfer);
+    HidEndpOpen = 1;
+}
+#endif
+
 /*********************************************************************
  * @fn      main
  *
@@ -41,6 +108,10 @@ int main()
     pHOST_RX_RAM_Addr = RxBuffer;
     pHOST_TX_RAM_Addr = TxBuffer;
     USB_HostInit();
+#if USB_HOST_ASYNC_EXAM
+    USBHostAsync_Init(AsyncRxDma, AsyncTxDma);
+    PFIC_EnableIRQ(USB_IRQn);
+#endif
     PRINT("Wait Device In\n");
     while(1)
     {
@@ -51,6 +122,13 @@ int main()
             s = AnalyzeRootHub();
             if(s == ERR_USB_CONNECT)
                 FoundNewDev = 1;
+#if USB_HOST_ASYNC_EXAM
+            if(HidEndpOpen)
+            { // 豸仯,رж϶˵
+                USBHostAsync_RemoveEndp(&HidEndp, ERR_USB_DISCON);
+                HidEndpOpen = 0;
+            }
+#endif
         }
 
         if(FoundNewDev || s == ERR_USB_CONNECT)
@@ -71,6 +149,29 @@ int main()
             PRINT("EnumAllHubPort err = %02X\n", (uint16_t)s);
         }
 
+#if USB_HOST_ASYNC_EXAM
+        /* ,ж϶˵ɴѯ,ѭֻӡ */
+        if(!HidEndpOpen)
+        {
+            loc = SearchTypeDevice(DEV_TYPE_MOUSE);
+            if(loc == 0xFFFF)
+                loc = SearchTypeDevice(DEV_TYPE_KEYBOARD);
+            if(loc != 0xFFFF)
+                HidAsyncOpen((uint8_t)loc);
+        }
+        if(HidReportLen)
+        {
+            len = HidReportLen;
+            HidReportLen = 0;
+            PRINT("HID data: ");
+            for(i = 0; i < len; i++)
+            {
+                PRINT("x%02X ", (uint16_t)(HidReport[i]));
+            }
+            PRINT("\n");
+        }
+
+#else
         /* 豸 */
         loc = SearchTypeDevice(DEV_TYPE_MOUSE); // ROOT-HUBԼⲿHUB˿ָ͵豸ڵĶ˿ں
         if(loc != 0xFFFF)
@@ -153,5 +254,22 @@ int main()
             }
             SetUsbSpeed(1); // ĬΪȫ
         }
+#endif
     }
 }
+
+#if USB_HOST_ASYNC_EXAM
+/*********************************************************************
+ * @fn      USB_IRQHandler
+ *
+ * @brief   USBжϺ
+ *
+ * @return  none
+ */
+__INTERRUPT
+__HIGH_CODE
+void USB_IRQHandler(void)
+{
+    USBHostAsync_IRQHandler();
+}
+#endif
@@ -40,7 +40,7 @@ UINT8 DISK_BASE_BUF[DISK_BASE_BUF_LEN] __attribute__((aligned(4))); /* 
 //    CHRV3DiskStatus=DISK_MOUNTED;  // ǿƿ豸ӳɹ(ֻļϵͳ)
 //}
 
-UINT8 CHRV3ReadSector(UINT8 SectCount, PUINT8 DataBuf) /* Ӵ̶ȡݵ */
+static UINT8 CHRV3ReadSectorRaw(UINT32 Lba, UINT8 SectCount, PUINT8 DataBuf) /* READ10Ӵ̵ָLBAȡ, */
 {
     UINT8 retry;
     //	if ( use_external_interface ) return( extReadSector( CHRV3vLbaCurrent, SectCount, DataBuf ) );  /* ⲿӿ */
@@ -52,10 +52,10 @@ UINT8 CHRV3ReadSector(UINT8 SectCount, PUINT8 DataBuf) /* 
         pCBW->mCBW_CB_Len = 10;
         pCBW->mCBW_CB_Buf[0] = SPC_CMD_READ10;
         pCBW->mCBW_CB_Buf[1] = 0x00;
-        pCBW->mCBW_CB_Buf[2] = (UINT8)(CHRV3vLbaCurrent >> 24);
-        pCBW->mCBW_CB_Buf[3] = (UINT8)(CHRV3vLbaCurrent >> 16);
-        pCBW->mCBW_CB_Buf[4] = (UINT8)(CHRV3vLbaCurrent >> 8);
-        pCBW->mCBW_CB_Buf[5] = (UINT8)(CHRV3vLbaCurrent);
+        pCBW->mCBW_CB_Buf[2] = (UINT8)(Lba >> 24);
+        pCBW->mCBW_CB_Buf[3] = (UINT8)(Lba >> 16);
+        pCBW->mCBW_CB_Buf[4] = (UINT8)(Lba >> 8);
+        pCBW->mCBW_CB_Buf[5] = (UINT8)(Lba);
         pCBW->mCBW_CB_Buf[6] = 0x00;
         pCBW->mCBW_CB_Buf[7] = 0x00;
         pCBW->mCBW_CB_Buf[8] = SectCount;
@@ -75,7 +75,7 @@ UINT8 CHRV3ReadSector(UINT8 SectCount, PUINT8 DataBuf) /* 
 }
 
   #ifdef EN_DISK_WRITE
-UINT8 CHRV3WriteSector(UINT8 SectCount, PUINT8 DataBuf) /* еĶݿд */
+static UINT8 CHRV3WriteSectorRaw(UINT32 Lba, UINT8 SectCount, PUINT8 DataBuf) /* WRITE10д̵ָLBA, */
 {
     UINT8 retry;
     //	if ( use_external_interface ) return( extWriteSector( CHRV3vLbaCurrent, SectCount, DataBuf ) );  /* ⲿӿ */
@@ -87,10 +87,10 @@ UINT8 CHRV3WriteSector(UINT8 SectCount, PUINT8 DataBuf) /* 
         pCBW->mCBW_CB_Len = 10;
         pCBW->mCBW_CB_Buf[0] = SPC_CMD_WRITE10;
         pCBW->mCBW_CB_Buf[1] = 0x00;
-        pCBW->mCBW_CB_Buf[2] = (UINT8)(CHRV3vLbaCurrent >> 24);
-        pCBW->mCBW_CB_Buf[3] = (UINT8)(CHRV3vLbaCurrent >> 16);
-        pCBW->mCBW_CB_Buf[4] = (UINT8)(CHRV3vLbaCurrent >> 8);
-        pCBW->mCBW_CB_Buf[5] = (UINT8)(CHRV3vLbaCurrent);
+        pCBW->mCBW_CB_Buf[2] = (UINT8)(Lba >> 24);
+        pCBW->mCBW_CB_Buf[3] = (UINT8)(Lba >> 16);
+        pCBW->mCBW_CB_Buf[4] = (UINT8)(Lba >> 8);
+        pCBW->mCBW_CB_Buf[5] = (UINT8)(Lba);
         pCBW->mCBW_CB_Buf[6] = 0x00;
         pCBW->mCBW_CB_Buf[7] = 0x00;
         pCBW->mCBW_CB_Buf[8] = SectCount;
@@ -110,6 +110,263 @@ UINT8 CHRV3WriteSector(UINT8 SectCount, PUINT8 DataBuf) /* 
     return (CHRV3IntStatus = ERR_USB_DISK_ERR); /* ̲ */
 }
   #endif
+
+/* 
+   CHRV3ӳFAT,Ŀ¼ļ֮лʱһpDISK_BASE_BUF,ͬһFATᱻд,
+   ÿҪһBulkOnly.READ10/WRITE10֮:
+   1. DISK_CACHE_SECTORSLRU,ֻFAT(CHRV3vDataStart֮ǰ,FAT12/16Ŀ¼),
+      Щĵдֻ»沢־,ڱ̭ߵCHRV3CacheFlushʱд;
+      д(ļԼFAT32Ŀ¼Ŀ¼)ֱд;
+   2. DISK_READ_AHEADԤ,ĵϴζ,һREAD10.
+   дֱӷʴ,뻺汣һ.
+   ע: FATFAT12/16Ŀ¼дӳ,,д,޸,ɾļ֮ԼγU֮ǰCHRV3CacheFlush,
+         UϵFATѾдļݲһ */
+
+  #if DISK_CACHE_SECTORS > 0
+#define DISK_CACHE_VALID    0x01 /* Ч */
+#define DISK_CACHE_DIRTY    0x02 /* ޸,δд */
+
+typedef struct
+{
+    UINT32 Lba;  /* LBA */
+    UINT32 Age;  /* һηʵʱ,LRṶ */
+    UINT8  Flag; /* DISK_CACHE_VALID/DISK_CACHE_DIRTY */
+} DISK_CACHE_TAG;
+
+static DISK_CACHE_TAG DiskCacheTag[DISK_CACHE_SECTORS];
+static UINT8          DiskCacheBuf[DISK_CACHE_SECTORS][DISK_CACHE_SECT_SIZE] __attribute__((aligned(4)));
+static UINT32         DiskCacheClock;
+  #endif
+
+  #if DISK_READ_AHEAD > 1
+static UINT8  DiskRaBuf[DISK_READ_AHEAD * DISK_CACHE_SECT_SIZE] __attribute__((aligned(4)));
+static UINT32 DiskRaLba;   /* ԤڵʼLBA */
+static UINT8  DiskRaCount; /* ԤеЧ,0򴰿Ч */
+static UINT32 DiskRaNext;  /* ϴεһLBA,ʶ˳ */
+  #endif
+
+/* ļϵͳδȻʱʹû */
+#define DISK_CACHE_USABLE()    (CHRV3DiskStatus >= DISK_READY && CHRV3vSectorSize <= DISK_CACHE_SECT_SIZE)
+
+void CHRV3CacheClear(void) /* Ԥеȫ,δд̵ */
+{
+  #if DISK_CACHE_SECTORS > 0
+    UINT8 i;
+    for(i = 0; i != DISK_CACHE_SECTORS; i++)
+    {
+        DiskCacheTag[i].Flag = 0;
+    }
+  #endif
+  #if DISK_READ_AHEAD > 1
+    DiskRaCount = 0;
+    DiskRaNext = 0xFFFFFFFF;
+  #endif
+}
+
+  #if DISK_CACHE_SECTORS > 0
+static UINT8 DiskCacheFind(UINT32 Lba) /* һ,ػ,δҵ0xFF */
+{
+    UINT8 i;
+    for(i = 0; i != DISK_CACHE_SECTORS; i++)
+    {
+        if((DiskCacheTag[i].Flag & DISK_CACHE_VALID) && DiskCacheTag[i].Lba == Lba)
+        {
+            return (i);
+        }
+    }
+    return (0xFF);
+}
+
+    #ifdef EN_DISK_WRITE
+static UINT8 DiskCacheWriteBack(UINT8 i) /* ໺д */
+{
+    UINT8 s;
+    if((DiskCacheTag[i].Flag & DISK_CACHE_DIRTY) == 0)
+    {
+        return (ERR_SUCCESS);
+    }
+    s = CHRV3WriteSectorRaw(DiskCacheTag[i].Lba, 1, DiskCacheBuf[i]);
+    if(s == ERR_SUCCESS)
+    {
+        DiskCacheTag[i].Flag &= ~DISK_CACHE_DIRTY;
+    }
+    return (s);
+}
+    #endif
+
+static UINT8 DiskCacheAlloc(UINT8 *pIndex) /* 仺,ʹÿ,̭δʵһ */
+{
+    UINT8 i, v;
+    v = 0;
+    for(i = 0; i != DISK_CACHE_SECTORS; i++)
+    {
+        if((DiskCacheTag[i].Flag & DISK_CACHE_VALID) == 0)
+        {
+            v = i;
+            break;
+        }
+        if(DiskCacheClock - DiskCacheTag[i].Age > DiskCacheClock - DiskCacheTag[v].Age)
+        {
+            v = i;
+        }
+    }
+    #ifdef EN_DISK_WRITE
+    i = DiskCacheWriteBack(v);
+    if(i != ERR_SUCCESS)
+    {
+        return (i); /* дʧû */
+    }
+    #endif
+    DiskCacheTag[v].Flag = 0;
+    *pIndex = v;
+    return (ERR_SUCCESS);
+}
+  #endif
+
+UINT8 CHRV3ReadSector(UINT8 SectCount, PUINT8 DataBuf) /* Ӵ̶ȡݵ */
+{
+    UINT32 lba;
+    UINT8  s;
+  #if DISK_CACHE_SECTORS > 0
+    UINT8 i;
+  #endif
+    lba = CHRV3vLbaCurrent;
+    if(!DISK_CACHE_USABLE())
+    {
+        CHRV3CacheClear(); /* δ,U,еѾЧ */
+        return (CHRV3ReadSectorRaw(lba, SectCount, DataBuf));
+    }
+    if(SectCount != 1)
+    { /* ֱӷʴ,ȻδдصĻ */
+        s = CHRV3ReadSectorRaw(lba, SectCount, DataBuf);
+  #if DISK_CACHE_SECTORS > 0
+        if(s == ERR_SUCCESS)
+        {
+            for(i = 0; i != DISK_CACHE_SECTORS; i++)
+            {
+                if((DiskCacheTag[i].Flag & DISK_CACHE_DIRTY) && DiskCacheTag[i].Lba - lba < SectCount)
+                {
+                    memcpy(DataBuf + ((DiskCacheTag[i].Lba - lba) << CHRV3vSectorSizeB), DiskCacheBuf[i], CHRV3vSectorSize);
+                }
+            }
+        }
+  #endif
+        return (s);
+    }
+  #if DISK_CACHE_SECTORS > 0
+    i = DiskCacheFind(lba);
+    if(i != 0xFF)
+    { /*  */
+        memcpy(DataBuf, DiskCacheBuf[i], CHRV3vSectorSize);
+        DiskCacheTag[i].Age = ++DiskCacheClock;
+    #if DISK_READ_AHEAD > 1
+        DiskRaNext = lba + 1;
+    #endif
+        return (CHRV3IntStatus = ERR_SUCCESS);
+    }
+  #endif
+  #if DISK_READ_AHEAD > 1
+    if(lba - DiskRaLba >= DiskRaCount && lba == DiskRaNext && lba >= CHRV3vDataStart)
+    { /* ˳,һζ,ʧ˻ص(ܳ˴ĩβ) */
+        DiskRaCount = 0;
+        if(CHRV3ReadSectorRaw(lba, DISK_READ_AHEAD, DiskRaBuf) == ERR_SUCCESS)
+        {
+            DiskRaLba = lba;
+            DiskRaCount = DISK_READ_AHEAD;
+        }
+    }
+    DiskRaNext = lba + 1;
+    if(lba - DiskRaLba < DiskRaCount)
+    { /* Ԥ */
+        memcpy(DataBuf, DiskRaBuf + ((lba - DiskRaLba) << CHRV3vSectorSizeB), CHRV3vSectorSize);
+        return (CHRV3IntStatus = ERR_SUCCESS);
+    }
+  #endif
+    s = CHRV3ReadSectorRaw(lba, 1, DataBuf);
+  #if DISK_CACHE_SECTORS > 0
+    if(s == ERR_SUCCESS && lba < CHRV3vDataStart && DiskCacheAlloc(&i) == ERR_SUCCESS)
+    { /* ֻFAT,˳ļʱFAT */
+        memcpy(DiskCacheBuf[i], DataBuf, CHRV3vSectorSize);
+        DiskCacheTag[i].Lba = lba;
+        DiskCacheTag[i].Age = ++DiskCacheClock;
+        DiskCacheTag[i].Flag = DISK_CACHE_VALID;
+    }
+  #endif
+    return (s);
+}
+
+  #ifdef EN_DISK_WRITE
+UINT8 CHRV3WriteSector(UINT8 SectCount, PUINT8 DataBuf) /* еĶݿд */
+{
+    UINT32 lba;
+    UINT8  s;
+    #if DISK_CACHE_SECTORS > 0
+    UINT8 i;
+    #endif
+    lba = CHRV3vLbaCurrent;
+    if(!DISK_CACHE_USABLE())
+    {
+        CHRV3CacheClear();
+        return (CHRV3WriteSectorRaw(lba, SectCount, DataBuf));
+    }
+    #if DISK_READ_AHEAD > 1
+    if(DiskRaCount && (lba - DiskRaLba < DiskRaCount || DiskRaLba - lba < SectCount))
+    {
+        DiskRaCount = 0; /* дԤص, */
+    }
+    #endif
+    #if DISK_CACHE_SECTORS > 0
+    if(SectCount == 1 && lba < CHRV3vDataStart)
+    { /* FATĵдֻд뻺,ӳٵ̭CHRV3CacheFlushʱд,д */
+        i = DiskCacheFind(lba);
+        if(i == 0xFF)
+        {
+            s = DiskCacheAlloc(&i);
+            if(s != ERR_SUCCESS)
+            {
+                return (s);
+            }
+            DiskCacheTag[i].Lba = lba;
+        }
+        memcpy(DiskCacheBuf[i], DataBuf, CHRV3vSectorSize);
+        DiskCacheTag[i].Age = ++DiskCacheClock;
+        DiskCacheTag[i].Flag = DISK_CACHE_VALID | DISK_CACHE_DIRTY;
+        return (CHRV3IntStatus = ERR_SUCCESS);
+    }
+    #endif
+    s = CHRV3WriteSectorRaw(lba, SectCount, DataBuf);
+    #if DISK_CACHE_SECTORS > 0
+    if(s == ERR_SUCCESS)
+    { /* ֱд֮±ǵĻ */
+        for(i = 0; i != DISK_CACHE_SECTORS; i++)
+        {
+            if((DiskCacheTag[i].Flag & DISK_CACHE_VALID) && DiskCacheTag[i].Lba - lba < SectCount)
+            {
+                memcpy(DiskCacheBuf[i], DataBuf + ((DiskCacheTag[i].Lba - lba) << CHRV3vSectorSizeB), CHRV3vSectorSize);
+                DiskCacheTag[i].Flag = DISK_CACHE_VALID;
+            }
+        }
+    }
+    #endif
+    return (s);
+}
+  #endif
+
+UINT8 CHRV3CacheFlush(void) /* δдд,رļ֮󼰰γU֮ǰ */
+{
+  #if DISK_CACHE_SECTORS > 0 && defined EN_DISK_WRITE
+    UINT8 i, s;
+    for(i = 0; i != DISK_CACHE_SECTORS; i++)
+    {
+        s = DiskCacheWriteBack(i);
+        if(s != ERR_SUCCESS)
+        {
+            return (s);
+        }
+    }
+  #endif
+    return (ERR_SUCCESS);
+}
 #endif // NO_DEFAULT_ACCESS_SECTOR
 
 #ifndef NO_DEFAULT_DISK_CONNECT /* ӦóжNO_DEFAULT_DISK_CONNECTԽֹĬϵļӳ,Ȼбдĳ */
@@ -276,6 +533,9 @@ UINT8 CHRV3LibInit(void) /* 
     pDISK_FAT_BUF = &DISK_BASE_BUF[0];  /* ָⲿRAMĴFATݻ,pDISK_BASE_BUFԽԼRAM */
 //	pDISK_FAT_BUF = & DISK_FAT_BUF[0];  /* ָⲿRAMĴFATݻ,pDISK_BASE_BUFٶ */
 /* ϣļȡٶ,ôеCHRV3LibInit֮,pDISK_FAT_BUFָһpDISK_BASE_BUFͬСĻ */
+#endif
+#ifndef NO_DEFAULT_ACCESS_SECTOR
+    CHRV3CacheClear(); /*  */
 #endif
     CHRV3DiskStatus = DISK_UNKNOWN;          /* δ֪״̬ */
     CHRV3vSectorSizeB = 9;                   /* Ĭϵ̵512B */
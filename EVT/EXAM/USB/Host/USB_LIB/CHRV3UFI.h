@@ -233,6 +233,16 @@ typedef CMD_PARAM CMD_PARAM_I;
 #define DISK_BASE_BUF_LEN		512		/* ĬϵĴݻСΪ512ֽ,ѡΪ20484096֧ĳЩU,Ϊ0ֹ.Hļж建ӦópDISK_BASE_BUFָ */
 #endif
 
+#ifndef DISK_CACHE_SECTORS
+#define DISK_CACHE_SECTORS		4		/* (LRU,д),ֻFAT(FAT12/16Ŀ¼),ÿռDISK_CACHE_SECT_SIZEֽRAM,Ϊ0ֹ */
+#endif
+#ifndef DISK_READ_AHEAD
+#define DISK_READ_AHEAD			4		/* ˳ļʱһԤ,ռDISK_READ_AHEAD*DISK_CACHE_SECT_SIZEֽRAM,С2ֹԤ */
+#endif
+#ifndef DISK_CACHE_SECT_SIZE
+#define DISK_CACHE_SECT_SIZE	512		/* ֵ֧С,U̲ʹû */
+#endif
+
 /* ӳṩı */
 extern	UINT8V	CHRV3IntStatus;				/* CHRV3ж״̬ */
 extern	UINT8V	CHRV3DiskStatus;			/* ̼ļ״̬ */
@@ -285,6 +295,8 @@ extern	UINT8	CHRV3ReadSector( UINT8 SectCount, PUINT8 DataBuf );	/* 
 #ifdef	EN_DISK_WRITE
 extern	UINT8	CHRV3WriteSector( UINT8 SectCount, PUINT8 DataBuf );	/* еĶݿд */
 #endif
+extern	UINT8	CHRV3CacheFlush( void );	/* δдд,رļ֮󼰰γU֮ǰ */
+extern	void	CHRV3CacheClear( void );	/* еȫ */
 
 extern	UINT8	CHRV3DiskConnect( void );	/* ǷӲ´״̬ */
 extern	void	xFileNameEnumer( void );	/* ⲿӳ,ļöٻصӳ */
@@ -0,0 +1,14 @@
+/* Host stand-in for CH58x_common.h, just enough for CH583UFI.c
+ *
+ * The real register and USB type definitions come from CH583SFR.h. Nothing
+ * that touches the registers is called by the test. */
+#ifndef __CH58x_COMMON_H__
+#define __CH58x_COMMON_H__
+
+#include <stdint.h>
+#include <string.h>
+#include "CH583SFR.h"
+
+uint8_t CtrlGetConfigDescr(void);
+
+#endif
@@ -0,0 +1,291 @@
+/* Host test for the sector cache and read-ahead of CH583UFI.c
+ *
+ * CH583UFI.c runs on a fake Bulk-Only device: CHRV3BulkOnlyCmd decodes the
+ * READ(10)/WRITE(10) in the CBW and moves sectors of a disk image, counting
+ * commands. A second image is the model of what the file library wrote.
+ * Reads must always match the model, the disk must match it after
+ * CHRV3CacheFlush, and data-area writes must reach the disk at once.
+ *
+ *   make -C EVT/EXAM/USB/Host/USB_LIB/test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "CH58x_common.h"
+#include "CHRV3UFI.h"
+
+#define SECT       512
+#define DISK_SECTS 256
+#define DATA_START 40 // first LBA of the data area
+
+#define CHECK(c, ...)                                    \
+    do {                                                 \
+        if(!(c)) {                                       \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);  \
+            printf(__VA_ARGS__);                         \
+            printf("\n");                                \
+            exit(1);                                     \
+        }                                                \
+    } while(0)
+
+/* Variables and calls of libRV3UFI.a used by CH583UFI.c *********************/
+
+UINT8V  CHRV3IntStatus;
+UINT8V  CHRV3DiskStatus;
+UINT8   CHRV3vSectorSizeB;
+UINT16  CHRV3vSectorSize;
+UINT32  CHRV3vStartLba;
+UINT32  CHRV3vDataStart;
+UINT32  CHRV3vLbaCurrent;
+UINT8   CHRV3vCurrentLun;
+PUINT8  pDISK_BASE_BUF;
+PUINT8  pDISK_FAT_BUF;
+UINT16  CHRV3vPacketSize;
+PUINT32 pTX_DMA_A_REG;
+PUINT32 pRX_DMA_A_REG;
+PUINT16 pTX_LEN_REG;
+PUINT16 pRX_LEN_REG;
+UINT8   RxBuffer[MAX_PACKET_SIZE] __attribute__((aligned(4)));
+UINT8   TxBuffer[MAX_PACKET_SIZE] __attribute__((aligned(4)));
+
+static UINT8    disk[DISK_SECTS][SECT];
+static UINT8    model[DISK_SECTS][SECT];
+static unsigned cmdRead, cmdWrite;
+static int      failWrites; // WRITE(10) commands that fail from now on
+
+UINT8 CHRV3BulkOnlyCmd(PUINT8 DataBuf)
+{
+    UINT32 lba, n;
+
+    lba = (UINT32)pCBW->mCBW_CB_Buf[2] << 24 | (UINT32)pCBW->mCBW_CB_Buf[3] << 16 |
+          (UINT32)pCBW->mCBW_CB_Buf[4] << 8 | pCBW->mCBW_CB_Buf[5];
+    n = pCBW->mCBW_CB_Buf[8];
+    CHECK(n && lba + n <= DISK_SECTS && pCBW->mCBW_DataLen == n * SECT, "CBW lba %u n %u len %u", (unsigned)lba,
+          (unsigned)n, (unsigned)pCBW->mCBW_DataLen);
+    if(pCBW->mCBW_CB_Buf[0] == SPC_CMD_READ10)
+    {
+        CHECK(pCBW->mCBW_Flag == 0x80, "READ(10) direction");
+        memcpy(DataBuf, disk[lba], n * SECT);
+        cmdRead++;
+    }
+    else
+    {
+        CHECK(pCBW->mCBW_CB_Buf[0] == SPC_CMD_WRITE10 && pCBW->mCBW_Flag == 0x00, "opcode %02x",
+              pCBW->mCBW_CB_Buf[0]);
+        if(failWrites)
+        {
+            failWrites--;
+            return (CHRV3IntStatus = ERR_USB_DISK_ERR);
+        }
+        memcpy(disk[lba], DataBuf, n * SECT);
+        cmdWrite++;
+    }
+    return (CHRV3IntStatus = ERR_SUCCESS);
+}
+
+UINT8 CHRV3AnalyzeError(UINT8 iMode)
+{
+    (void)iMode;
+    return (CHRV3IntStatus); // no retries
+}
+
+UINT8 CHRV3GetVer(void)
+{
+    return (CHRV3_LIB_VER);
+}
+
+void mDelayuS(UINT16 n)
+{
+    (void)n;
+}
+
+UINT8 HubGetPortStatus(UINT8 HubPortIndex)
+{
+    (void)HubPortIndex;
+    return (ERR_USB_DISCON);
+}
+
+UINT8 HubClearPortFeature(UINT8 HubPortIndex, UINT8 FeatureSelt)
+{
+    (void)HubPortIndex;
+    (void)FeatureSelt;
+    return (ERR_USB_DISCON);
+}
+
+uint8_t CtrlGetConfigDescr(void)
+{
+    return (ERR_USB_DISCON);
+}
+
+/* Helpers ********************************************************************/
+
+static UINT8 buf[8 * SECT];
+
+static void fill(UINT8 *p, unsigned n, unsigned seed)
+{
+    unsigned i;
+
+    for(i = 0; i < n; i++)
+    {
+        p[i] = (UINT8)(seed * 37 + i * 13 + (i >> 8));
+    }
+}
+
+static void mount(void)
+{
+    unsigned i;
+
+    for(i = 0; i < DISK_SECTS; i++)
+    {
+        fill(disk[i], SECT, i);
+    }
+    memcpy(model, disk, sizeof(disk));
+    CHRV3CacheClear();
+    CHRV3vSectorSizeB = 9;
+    CHRV3vSectorSize = SECT;
+    CHRV3vDataStart = DATA_START;
+    CHRV3DiskStatus = DISK_READY;
+    cmdRead = cmdWrite = 0;
+    failWrites = 0;
+}
+
+static void read_check(UINT32 lba, UINT8 n)
+{
+    CHRV3vLbaCurrent = lba;
+    CHECK(CHRV3ReadSector(n, buf) == ERR_SUCCESS, "read %u+%u", (unsigned)lba, n);
+    CHECK(memcmp(buf, model[lba], n * SECT) == 0, "read %u+%u differs from the model", (unsigned)lba, n);
+}
+
+static UINT8 write_sect(UINT32 lba, UINT8 n, unsigned seed)
+{
+    fill(buf, n * SECT, seed);
+    CHRV3vLbaCurrent = lba;
+    if(CHRV3WriteSector(n, buf) != ERR_SUCCESS)
+    {
+        return (1);
+    }
+    memcpy(model[lba], buf, n * SECT);
+    return (0);
+}
+
+/* Tests **********************************************************************/
+
+/* FAT area writes wait for the flush, data area writes go out at once */
+static void test_write_scope(void)
+{
+    mount();
+    CHECK(write_sect(DATA_START + 3, 1, 1) == 0, "data write");
+    CHECK(memcmp(disk[DATA_START + 3], model[DATA_START + 3], SECT) == 0, "data sector left in the cache");
+    CHECK(write_sect(DATA_START - 1, 1, 2) == 0, "directory write");
+    CHECK(write_sect(5, 1, 3) == 0, "FAT write");
+#if DISK_CACHE_SECTORS > 0
+    CHECK(cmdWrite == 1, "%u WRITE(10) for one data sector", cmdWrite);
+    CHECK(memcmp(disk[5], model[5], SECT) != 0, "FAT sector written through");
+#endif
+    read_check(5, 1);
+    read_check(DATA_START - 1, 1);
+    CHECK(CHRV3CacheFlush() == ERR_SUCCESS, "flush");
+    CHECK(memcmp(disk, model, sizeof(disk)) == 0, "disk differs after the flush");
+}
+
+/* the same FAT sector read twice and a sequential file read */
+static void test_commands(void)
+{
+    UINT32 lba;
+
+    mount();
+    read_check(7, 1);
+    read_check(7, 1);
+    for(lba = DATA_START; lba < DATA_START + 8; lba++)
+    {
+        read_check(lba, 1);
+    }
+#if DISK_CACHE_SECTORS > 0 && DISK_READ_AHEAD > 1
+    /* the first data read is a single one, the window starts with the second */
+    CHECK(cmdRead == 1 + 1 + (7 + DISK_READ_AHEAD - 1) / DISK_READ_AHEAD, "%u READ(10)", cmdRead);
+#else
+    CHECK(cmdRead == 10, "%u READ(10)", cmdRead);
+#endif
+
+    /* a write inside the read-ahead window is seen by the next read */
+    CHECK(write_sect(DATA_START + 6, 1, 4) == 0, "write in the window");
+    read_check(DATA_START + 6, 1);
+    read_check(DATA_START + 7, 1);
+}
+
+/* a failed write-back keeps the data for the next flush */
+static void test_flush_error(void)
+{
+    mount();
+    CHECK(write_sect(3, 1, 5) == 0, "FAT write");
+#if DISK_CACHE_SECTORS > 0
+    failWrites = 1;
+    CHECK(CHRV3CacheFlush() != ERR_SUCCESS, "failed flush passed");
+    read_check(3, 1);
+#endif
+    CHECK(CHRV3CacheFlush() == ERR_SUCCESS, "second flush");
+    CHECK(memcmp(disk, model, sizeof(disk)) == 0, "disk differs after the flush");
+}
+
+/* a disk that is not ready bypasses and drops the cache */
+static void test_not_ready(void)
+{
+    mount();
+    read_check(2, 1);
+    memset(disk[2], 0x5A, SECT); // another disk plugged in
+    memset(model[2], 0x5A, SECT);
+    CHRV3DiskStatus = DISK_MOUNTED;
+    read_check(2, 1);
+    CHECK(write_sect(4, 1, 6) == 0 && memcmp(disk[4], model[4], SECT) == 0, "write cached before mount");
+    CHRV3DiskStatus = DISK_READY;
+    read_check(2, 1);
+}
+
+/* random mix of single and multi-sector traffic against the model */
+static void test_random(void)
+{
+    unsigned i;
+    UINT32   lba;
+    UINT8    n;
+
+    mount();
+    srand(1);
+    for(i = 0; i < 200000; i++)
+    {
+        n = (rand() % 4) ? 1 : 2 + rand() % 7;
+        lba = (rand() % 3) ? rand() % (DATA_START + 8) : rand() % (DISK_SECTS - n + 1);
+        if(lba + n > DISK_SECTS)
+        {
+            lba = DISK_SECTS - n;
+        }
+        if(rand() % 3 == 0)
+        {
+            CHECK(write_sect(lba, n, i) == 0, "write %u+%u", (unsigned)lba, n);
+        }
+        else
+        {
+            read_check(lba, n);
+        }
+        if(rand() % 500 == 0)
+        {
+            CHECK(CHRV3CacheFlush() == ERR_SUCCESS, "flush");
+            CHECK(memcmp(disk, model, sizeof(disk)) == 0, "disk differs after a flush at op %u", i);
+        }
+        else if(n == 1 && lba >= DATA_START)
+        {
+            CHECK(memcmp(disk[lba], model[lba], SECT) == 0, "data sector %u not on the disk", (unsigned)lba);
+        }
+    }
+    CHECK(CHRV3CacheFlush() == ERR_SUCCESS, "flush");
+    CHECK(memcmp(disk, model, sizeof(disk)) == 0, "disk differs after the last flush");
+}
+
+int main(void)
+{
+    test_write_scope();
+    test_commands();
+    test_flush_error();
+    test_not_ready();
+    test_random();
+    printf("ufi_cache_test (cache %d, read-ahead %d): all passed\n", DISK_CACHE_SECTORS, DISK_READ_AHEAD);
+    return 0;
+}
@@ -193,6 +193,8 @@ int main()
                     mCmdParam.Close.mUpdateLen = 1; /* Զļ,ֽΪλдļ,óرļԱԶļ */
                     i = CHRV3FileClose();
                     mStopIfError(i);
+                    i = CHRV3CacheFlush(); /* едU */
+                    mStopIfError(i);
 
 //                    strcpy((PCHAR)mCmdParam.Create.mPathName, "/NEWFILE.TXT"); /* ļ,ڸĿ¼,ļ */
 //                    s = CHRV3FileOpen();                                       /* ½ļ,ļѾɾ½ */
@@ -139,6 +139,8 @@ int main()
                     mCmdParam.Close.mUpdateLen = 1; /* Զļ,ֽΪλдļ,óرļԱԶļ */
                     i = CHRV3FileClose();
                     mStopIfError(i);
+                    i = CHRV3CacheFlush(); /* едU */
+                    mStopIfError(i);
 
 //                    strcpy((uint8_t *)mCmdParam.Create.mPathName, "/NEWFILE.TXT"); /* ļ,ڸĿ¼,ļ */
 //                    s = CHRV3FileOpen();                                           /* ½ļ,ļѾɾ½ */
@@ -150,6 +152,8 @@ int main()
                     i = CHRV3FileErase();                                  //ɾļر
                     if(i != ERR_SUCCESS)
                         PRINT("Error: %02X\n", (uint16_t)i); //ʾ
+                    i = CHRV3CacheFlush(); /* ɾļ޸Ŀ¼FAT,ͬҪдU */
+                    mStopIfError(i);
                 }
             }
         }
@@ -149,6 +149,7 @@ int main()
                         }
                     }
                     i = CHRV3FileClose(); //رļ
+                    CHRV3CacheFlush();    //едU
                     PRINT("Uʾ\n");
                 }
                 else
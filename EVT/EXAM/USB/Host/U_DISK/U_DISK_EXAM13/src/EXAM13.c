@@ -701,6 +701,9 @@ int main()
                     LongFileName[17] = 0X0000;
 
                     s = CreatLongName(); /*ļ*/
+                    i = CHRV3CacheFlush(); /*едU,ʱѾдĲҲҪд*/
+                    if(s == ERR_SUCCESS)
+                        s = i;
                     if(s != ERR_SUCCESS)
                         PRINT("Error: %02x\n", s);
                     else
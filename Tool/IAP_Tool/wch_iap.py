@@ -0,0 +1,375 @@
+#!/usr/bin/env python3
+"""Host uploader for the CH58x UART IAP v2 protocol (IAP/UART_IAP, IAP_UART_V2 = 1).
+
+upload      flash an image through a serial port (needs pyserial)
+loopback    flash an image into a simulated device over a lossy link
+
+Frame, little endian, see UART_IAP/src/iap_v2.c:
+
+    aa 55 cmd seq addr[4] len[2] crc16[2] data[len]
+
+    crc16 is CCITT (poly 0x1021, start 0xffff) over cmd..len and data.
+    CMD_IAP_ERASE opens the session, the device erases each 4 KB block when
+    the first CMD_IAP_PROM frame reaches it. Up to WINDOW frames are sent
+    before waiting, the device answers every frame once it is done:
+
+    aa 55 00 seq 55 aa      ACK, seq and all frames before it are done
+    aa 55 fd seq 55 aa      NAK, send again starting at seq
+    aa 55 fe err 55 aa      error, the session is closed
+    aa 55 00 seq crc[4] 55 aa   CMD_IAP_DIGEST reply, CRC32 of the range
+
+The image is checked with CMD_IAP_DIGEST before CMD_IAP_END starts it.
+
+loopback runs the same uploader against a Python model of the device,
+dropping and corrupting bytes on both directions, and checks the flash.
+"""
+
+import argparse
+import random
+import struct
+import sys
+import time
+import zlib
+
+CMD_IAP_PROM = 0x80
+CMD_IAP_ERASE = 0x81
+CMD_IAP_END = 0x83
+CMD_IAP_DIGEST = 0x86
+
+ACK, NAK, ERR = 0x00, 0xFD, 0xFE
+ERRORS = ["unknown", "overtime", "check", "addr", "erase fail",
+          "prog no erase", "write fail", "verify"]
+
+APP_CODE_START_ADDR = 0x1000
+APP_CODE_END_ADDR = 0x70000
+DATA_LEN = 256
+WINDOW = 8
+BLOCK = 4096
+
+
+def crc16(data, crc=0xFFFF):
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1) & 0xFFFF
+    return crc
+
+
+def frame(cmd, seq, addr, data=b""):
+    head = struct.pack("<BBIH", cmd, seq, addr, len(data))
+    return b"\xaa\x55" + head + struct.pack("<H", crc16(data, crc16(head))) + data
+
+
+def load_image(path):
+    if not path.lower().endswith(".hex"):
+        with open(path, "rb") as f:
+            return APP_CODE_START_ADDR, f.read()
+    data = {}
+    upper = 0
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith(":"):
+                continue
+            rec = bytes.fromhex(line[1:])
+            n, addr, typ = rec[0], (rec[1] << 8) | rec[2], rec[3]
+            if typ == 0x00:
+                for i in range(n):
+                    data[upper + addr + i] = rec[4 + i]
+            elif typ == 0x04:
+                upper = ((rec[4] << 8) | rec[5]) << 16
+            elif typ == 0x02:
+                upper = ((rec[4] << 8) | rec[5]) << 4
+            elif typ == 0x01:
+                break
+    start = min(data)
+    out = bytearray(b"\xff" * (max(data) + 1 - start))
+    for a, v in data.items():
+        out[a - start] = v
+    return start, bytes(out)
+
+
+def device_error(rsp):
+    return IOError("device error: %s" % (ERRORS[rsp[3]] if rsp[3] < len(ERRORS) else rsp[3]))
+
+
+class Replies:
+    """Splits the byte stream from the device into replies."""
+
+    def __init__(self, link):
+        self.link = link
+        self.buf = bytearray()
+
+    def get(self, timeout):
+        end = time.monotonic() + timeout
+        while True:
+            while len(self.buf) >= 2 and self.buf[:2] != b"\xaa\x55":
+                del self.buf[0]
+            if len(self.buf) >= 6:
+                n = 10 if self.buf[2] == ACK and self.buf[4:6] != b"\x55\xaa" else 6
+                if len(self.buf) >= n:
+                    rsp = bytes(self.buf[:n])
+                    del self.buf[:n]
+                    if rsp[-2:] == b"\x55\xaa":
+                        return rsp
+                    del self.buf[0]
+                    continue
+            left = end - time.monotonic()
+            if left <= 0:
+                return None
+            self.buf += self.link.read(left)
+
+
+class Uploader:
+    def __init__(self, link, window=WINDOW, timeout=0.5, retries=20, log=print):
+        self.link = link
+        self.rx = Replies(link)
+        self.window = window
+        self.timeout = timeout
+        self.retries = retries
+        self.log = log
+        self.seq = 0
+        self.resent = 0
+
+    def request(self, cmd, addr, data=b""):
+        """One frame, waits for its reply."""
+        seq = self.seq
+        for _ in range(self.retries):
+            self.link.write(frame(cmd, seq, addr, data))
+            while True:
+                rsp = self.rx.get(self.timeout)
+                if rsp is None or rsp[2] == NAK:
+                    break
+                if rsp[2] == ERR:
+                    raise device_error(rsp)
+                if rsp[3] == seq:
+                    self.seq = (seq + 1) & 0xFF
+                    return rsp
+            self.resent += 1
+        raise IOError("no reply to command %02x" % cmd)
+
+    def program(self, addr, image):
+        frames = []
+        for off in range(0, len(image), DATA_LEN):
+            chunk = image[off:off + DATA_LEN]
+            chunk += b"\xff" * (-len(chunk) % 4)
+            frames.append((addr + off, chunk))
+        seq0 = self.seq
+        base = nxt = 0
+        stall = 0
+        while base < len(frames):
+            while nxt < len(frames) and nxt - base < self.window:
+                a, d = frames[nxt]
+                self.link.write(frame(CMD_IAP_PROM, (seq0 + nxt) & 0xFF, a, d))
+                nxt += 1
+            rsp = self.rx.get(self.timeout)
+            if rsp is None:
+                stall += 1
+                if stall > self.retries:
+                    raise IOError("no reply at frame %d" % base)
+                self.resent += nxt - base
+                nxt = base
+                continue
+            idx = base + ((rsp[3] - (seq0 + base)) & 0xFF)
+            if rsp[2] == ERR:
+                raise device_error(rsp)
+            if idx >= nxt:
+                continue        # stale reply from before a resend
+            if rsp[2] == ACK:
+                base = idx + 1
+                stall = 0
+            elif rsp[2] == NAK:
+                self.resent += nxt - idx
+                nxt = idx
+        self.seq = (seq0 + len(frames)) & 0xFF
+
+    def run(self, addr, image):
+        t = time.monotonic()
+        self.request(CMD_IAP_ERASE, APP_CODE_START_ADDR)
+        self.program(addr, image)
+        rsp = self.request(CMD_IAP_DIGEST, addr, struct.pack("<I", len(image)))
+        crc = struct.unpack_from("<I", rsp, 4)[0]
+        if crc != zlib.crc32(image):
+            raise IOError("digest mismatch, device %08x image %08x" % (crc, zlib.crc32(image)))
+        dt = time.monotonic() - t
+        self.log("%d bytes in %.2f s (%.1f KB/s), %d frames resent, crc32 %08x ok" %
+                 (len(image), dt, len(image) / 1024.0 / max(dt, 1e-6), self.resent, crc))
+        try:
+            self.request(CMD_IAP_END, 0)
+        except IOError:
+            # the device may have jumped with its reply lost, the image is verified
+            self.log("no reply to CMD_IAP_END")
+
+
+class SerialLink:
+    def __init__(self, port, baud):
+        import serial
+        self.s = serial.Serial(port, baud, timeout=0)
+
+    def write(self, b):
+        self.s.write(b)
+
+    def read(self, timeout):
+        self.s.timeout = timeout
+        return self.s.read(max(1, self.s.in_waiting))
+
+
+class Device:
+    """Python model of iap_v2.c, for the loopback check."""
+
+    def __init__(self):
+        self.flash = bytearray(b"\x5a" * APP_CODE_END_ADDR)
+        self.buf = bytearray()
+        self.seq = 0
+        self.nak_sent = False
+        self.erase_ptr = 0
+        self.prog_ptr = 0
+        self.erased = 0
+        self.started = False
+
+    def reply(self, status, arg):
+        return bytes([0xAA, 0x55, status, arg & 0xFF, 0x55, 0xAA])
+
+    def feed(self, data):
+        out = b""
+        for b in data:
+            if (len(self.buf) == 0 and b != 0xAA) or (len(self.buf) == 1 and b != 0x55):
+                self.buf = bytearray([b]) if b == 0xAA else bytearray()
+                continue
+            self.buf.append(b)
+            if len(self.buf) < 12:
+                continue
+            n = struct.unpack_from("<H", self.buf, 8)[0]
+            if n > DATA_LEN:
+                self.buf = bytearray()
+                continue
+            if len(self.buf) == 12 + n:
+                out += self.deal(bytes(self.buf))
+                self.buf = bytearray()
+        return out
+
+    def nak(self):
+        if self.nak_sent:
+            return b""
+        self.nak_sent = True
+        return self.reply(NAK, self.seq)
+
+    def deal(self, f):
+        cmd, seq, addr, n, crc = struct.unpack_from("<BBIHH", f, 2)
+        data = f[12:]
+        if crc16(data, crc16(f[2:10])) != crc:
+            return self.nak()
+        err = 0
+        if cmd == CMD_IAP_ERASE:
+            if addr == APP_CODE_START_ADDR:
+                self.seq = seq
+                self.erase_ptr = self.prog_ptr = APP_CODE_START_ADDR
+            else:
+                err = 3
+        elif seq != self.seq:
+            if (self.seq - seq) & 0xFF <= WINDOW:
+                return self.reply(ACK, self.seq - 1)
+            return self.nak()
+        elif self.erase_ptr == 0:
+            err = 5
+        elif cmd == CMD_IAP_PROM:
+            if addr % 4 or n % 4 or addr < self.prog_ptr or addr > APP_CODE_END_ADDR - n:
+                err = 3
+            else:
+                while addr + n > self.erase_ptr:
+                    self.flash[self.erase_ptr:self.erase_ptr + BLOCK] = b"\xff" * BLOCK
+                    self.erase_ptr += BLOCK
+                    self.erased += 1
+                for i, v in enumerate(data):
+                    self.flash[addr + i] &= v
+                self.prog_ptr = addr + n
+        elif cmd == CMD_IAP_DIGEST:
+            length = struct.unpack("<I", data)[0] if n == 4 else -1
+            if 0 <= length <= APP_CODE_END_ADDR - addr and addr >= APP_CODE_START_ADDR:
+                crc = zlib.crc32(bytes(self.flash[addr:addr + length]))
+                self.seq = (self.seq + 1) & 0xFF
+                self.nak_sent = False
+                return bytes([0xAA, 0x55, ACK, seq]) + struct.pack("<I", crc) + b"\x55\xaa"
+            err = 3
+        elif cmd == CMD_IAP_END:
+            self.started = True
+            return self.reply(ACK, self.seq)
+        else:
+            self.erase_ptr = 0
+            return self.reply(ERR, 0)
+        if err:
+            self.erase_ptr = 0
+            return self.reply(ERR, err)
+        self.nak_sent = False
+        self.seq = (self.seq + 1) & 0xFF
+        return self.reply(ACK, seq)
+
+
+class LossyLink:
+    """Host side of an in-memory link to Device that loses and flips bytes."""
+
+    def __init__(self, dev, loss, rng):
+        self.dev = dev
+        self.loss = loss
+        self.rng = rng
+        self.pending = bytearray()
+
+    def spoil(self, data):
+        out = bytearray()
+        for b in data:
+            r = self.rng.random()
+            if r < self.loss:
+                continue
+            if r < 2 * self.loss:
+                b ^= 1 << self.rng.randrange(8)
+            out.append(b)
+        return bytes(out)
+
+    def write(self, data):
+        self.pending += self.spoil(self.dev.feed(self.spoil(data)))
+
+    def read(self, timeout):
+        if not self.pending:
+            time.sleep(min(timeout, 0.001))
+            return b""
+        out = bytes(self.pending)
+        self.pending.clear()
+        return out
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    u = sub.add_parser("upload", help="flash an image through a serial port")
+    u.add_argument("port")
+    u.add_argument("image", help=".bin starting at 0x1000 or .hex")
+    u.add_argument("--baud", type=int, default=921600)
+    l = sub.add_parser("loopback", help="flash a simulated device over a lossy link")
+    l.add_argument("image")
+    l.add_argument("--loss", type=float, default=0.0001,
+                   help="probability a byte is dropped, the same again that it is corrupted")
+    l.add_argument("--seed", type=int, default=1)
+    for p in (u, l):
+        p.add_argument("--window", type=int, default=WINDOW, choices=range(1, WINDOW + 1),
+                       metavar="1..%d" % WINDOW)
+    args = ap.parse_args()
+
+    addr, image = load_image(args.image)
+    if addr < APP_CODE_START_ADDR or addr + len(image) > APP_CODE_END_ADDR:
+        sys.exit("image outside %x..%x" % (APP_CODE_START_ADDR, APP_CODE_END_ADDR))
+
+    if args.cmd == "upload":
+        Uploader(SerialLink(args.port, args.baud), args.window).run(addr, image)
+        return
+
+    dev = Device()
+    up = Uploader(LossyLink(dev, args.loss, random.Random(args.seed)), args.window, timeout=0.01)
+    up.run(addr, image)
+    if dev.flash[addr:addr + len(image)] != image or not dev.started:
+        sys.exit("loopback: flash does not match")
+    used = (len(image) + (addr - APP_CODE_START_ADDR) + BLOCK - 1) // BLOCK
+    print("loopback ok, %d blocks erased for %d used" % (dev.erased, used))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,582 @@
+#!/usr/bin/env python3
+"""Host side helpers for the CH58x BLE OTA (BackupUpgrade_OTA).
+
+delta       build a delta patch from the image running in imageA and the new image
+apply       rebuild the new image from an old image and a patch (reference check)
+compress    build an LZ4 compressed image
+decompress  unpack a compressed image (reference check)
+info        show a stream header
+digest      CRC32 of an image and the CMD_IAP_DIGEST request, check a reply
+
+Images are raw .bin files starting at IMAGE_A_START_ADD, or Intel .hex files
+(the address of the first byte is taken as the image start, see --base).
+
+Stream layout (little endian, see BackupUpgrade_OTA/APP/include/ota_delta.h):
+
+    header, 32 bytes
+        "WCHD" (delta) or "WCHZ" (compressed), version, flags, 2 x reserved,
+        old size, old CRC32 (0 for "WCHZ"), new size, new CRC32, body size,
+        CRC32 of the 28 bytes before
+    "WCHD" body
+        0x01 <n>          DIFF,  n bytes = old + diff, coded as pairs
+                                 <zeros> <m> m * diff byte
+        0x02 <n> n*byte   EXTRA, literal bytes
+        0x03 <d>          SEEK,  old pointer += d (zigzag)
+    <n> are LEB128 varints, CRC32 is the zlib one.
+    "WCHZ" body
+        one LZ4 block (standard block format, 64 KB window)
+
+Sending a stream, after CMD_IAP_ERASE of imageB:
+    CMD_IAP_PATCH (0x85), len, addr = stream offset / 16 (LE), data
+    The first frame carries the 32 byte header alone, the body follows in
+    frames of FRAME_DATA bytes. Every frame is answered with a status,
+    frames that complete a digest check (header, last frame) answer when
+    the check is done. Finish with CMD_IAP_END as for a full image.
+    --frames writes the frames, one hex line each.
+
+Verifying a written image without sending it again:
+    CMD_IAP_DIGEST (0x86), len = 4, addr, 4 byte length (LE)
+    The device answers status 0, a reserved byte and the CRC32 (LE) of the
+    range, the same zlib CRC32 as above. addr is written as for CMD_IAP_VERIFY
+    on each link:
+        ble   2 bytes, flash address / 16 (the device adds IMAGE_A_SIZE)
+        uart  aa 55 86 04 <addr 4> <len 4> <checksum 2> 55 aa, reply
+              aa 55 00 00 <crc 4> 55 aa
+        usb   86 04 <addr 4> <len 4>
+    CMD_IAP_VERIFY still works with devices that do not know the command.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"WCHD"
+MAGIC_LZ4 = b"WCHZ"
+VERSION = 1
+HEAD_LEN = 32
+OP_DIFF = 0x01
+OP_EXTRA = 0x02
+OP_SEEK = 0x03
+
+IMAGE_SIZE = 216 * 1024
+CMD_IAP_PATCH = 0x85
+CMD_IAP_DIGEST = 0x86
+IMAGE_A_START_ADD = 0x1000
+FRAME_DATA = 240            # multiple of 16, fits IAP_LEN - 4
+
+# bsdiff compares at most this many bytes per step of the suffix search
+SEARCH_CMP = 1024
+
+# LZ4 block rules: 4 byte minimum match, 64 KB window, the last match
+# starts 12 bytes before the end and the last 5 bytes are literals
+LZ4_MINMATCH = 4
+LZ4_WINDOW = 0xFFFF
+LZ4_MFLIMIT = 12
+LZ4_LASTLITERALS = 5
+LZ4_CHAIN = 16
+
+
+def load_image(path, base):
+    if not path.lower().endswith(".hex"):
+        with open(path, "rb") as f:
+            return f.read()
+    data = {}
+    upper = 0
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith(":"):
+                continue
+            rec = bytes.fromhex(line[1:])
+            n, addr, typ = rec[0], (rec[1] << 8) | rec[2], rec[3]
+            if typ == 0x00:
+                for i in range(n):
+                    data[upper + addr + i] = rec[4 + i]
+            elif typ == 0x04:
+                upper = ((rec[4] << 8) | rec[5]) << 16
+            elif typ == 0x02:
+                upper = ((rec[4] << 8) | rec[5]) << 4
+            elif typ == 0x01:
+                break
+    if not data:
+        return b""
+    start = min(data) if base is None else base
+    out = bytearray(b"\xff" * (max(data) + 1 - start))
+    for a, v in data.items():
+        if a >= start:
+            out[a - start] = v
+    return bytes(out)
+
+
+def varint(v):
+    out = bytearray()
+    while True:
+        b = v & 0x7F
+        v >>= 7
+        if v:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return out
+
+
+def zigzag(v):
+    return (v << 1) if v >= 0 else ((-v << 1) - 1)
+
+
+def suffix_array(buf):
+    """Prefix doubling, ranks are refined until every suffix is unique."""
+    n = len(buf)
+    sa = list(range(n))
+    rank = list(buf)
+    k = 1
+    while True:
+        key = [(rank[i], rank[i + k] if i + k < n else -1) for i in range(n)]
+        sa.sort(key=key.__getitem__)
+        new = [0] * n
+        for j in range(1, n):
+            new[sa[j]] = new[sa[j - 1]] + (key[sa[j]] != key[sa[j - 1]])
+        rank = new
+        if n == 0 or rank[sa[-1]] == n - 1:
+            return sa
+        k <<= 1
+
+
+def match_len(a, ai, b, bi):
+    n = min(len(a) - ai, len(b) - bi)
+    lo, step = 0, 16
+    while lo < n:
+        s = min(step, n - lo)
+        if a[ai + lo:ai + lo + s] == b[bi + lo:bi + lo + s]:
+            lo += s
+            step <<= 1
+        elif s == 1:
+            break
+        else:
+            step = s >> 1
+    return lo
+
+
+def search(sa, old, new, nb):
+    st, en = 0, len(sa)
+    while en - st > 2:
+        x = st + (en - st) // 2
+        p = sa[x]
+        if old[p:p + SEARCH_CMP] < new[nb:nb + SEARCH_CMP]:
+            st = x
+        else:
+            en = x
+    best_len, best_pos = -1, 0
+    for x in range(st, min(en + 1, len(sa))):
+        n = match_len(old, sa[x], new, nb)
+        if n > best_len:
+            best_len, best_pos = n, sa[x]
+    return best_pos, max(best_len, 0)
+
+
+def bsdiff(old, new):
+    """Yields (diff bytes, extra bytes, seek) triples, bsdiff 4 style."""
+    sa = suffix_array(old)
+    oldsize, newsize = len(old), len(new)
+    scan = length = pos = 0
+    lastscan = lastpos = lastoffset = 0
+    while scan < newsize:
+        oldscore = 0
+        scan += length
+        scsc = scan
+        while scan < newsize:
+            pos, length = search(sa, old, new, scan)
+            while scsc < scan + length:
+                if scsc + lastoffset < oldsize and old[scsc + lastoffset] == new[scsc]:
+                    oldscore += 1
+                scsc += 1
+            if (length == oldscore and length != 0) or length > oldscore + 8:
+                break
+            if scan + lastoffset < oldsize and old[scan + lastoffset] == new[scan]:
+                oldscore -= 1
+            scan += 1
+
+        if length != oldscore or scan == newsize:
+            s = sf = lenf = 0
+            i = 0
+            while lastscan + i < scan and lastpos + i < oldsize:
+                if old[lastpos + i] == new[lastscan + i]:
+                    s += 1
+                i += 1
+                if s * 2 - i > sf * 2 - lenf:
+                    sf, lenf = s, i
+
+            lenb = 0
+            if scan < newsize:
+                s = sb = 0
+                i = 1
+                while scan >= lastscan + i and pos >= i:
+                    if old[pos - i] == new[scan - i]:
+                        s += 1
+                    if s * 2 - i > sb * 2 - lenb:
+                        sb, lenb = s, i
+                    i += 1
+
+            if lastscan + lenf > scan - lenb:
+                overlap = (lastscan + lenf) - (scan - lenb)
+                s = ss = lens = 0
+                for i in range(overlap):
+                    if new[lastscan + lenf - overlap + i] == old[lastpos + lenf - overlap + i]:
+                        s += 1
+                    if new[scan - lenb + i] == old[pos - lenb + i]:
+                        s -= 1
+                    if s > ss:
+                        ss, lens = s, i + 1
+                lenf += lens - overlap
+                lenb -= lens
+
+            diff = bytes((new[lastscan + i] - old[lastpos + i]) & 0xFF for i in range(lenf))
+            extra = new[lastscan + lenf:scan - lenb]
+            seek = (pos - lenb) - (lastpos + lenf)
+            yield diff, extra, seek
+
+            lastscan = scan - lenb
+            lastpos = pos - lenb
+            lastoffset = pos - scan
+
+
+def encode_diff(diff):
+    """Pairs of <zeros> <m> m*byte, zero runs under 3 bytes stay literal."""
+    out = bytearray()
+    i, n = 0, len(diff)
+    while i < n:
+        z = i
+        while z < n and diff[z] == 0:
+            z += 1
+        out += varint(z - i)
+        i = z
+        if i == n:
+            break
+        e = i
+        while e < n:
+            if diff[e]:
+                e += 1
+                continue
+            r = e
+            while r < n and diff[r] == 0 and r - e < 3:
+                r += 1
+            if r < n and diff[r] and r - e < 3:
+                e = r
+            else:
+                break
+        out += varint(e - i) + diff[i:e]
+        i = e
+    return out
+
+
+def make_patch(old, new):
+    body = bytearray()
+    seek = 0
+    for diff, extra, next_seek in bsdiff(old, new):
+        # a seek only matters when something follows it
+        if seek:
+            body += bytes([OP_SEEK]) + varint(zigzag(seek))
+        if diff:
+            body += bytes([OP_DIFF]) + varint(len(diff)) + encode_diff(diff)
+        if extra:
+            body += bytes([OP_EXTRA]) + varint(len(extra)) + extra
+        seek = next_seek
+    return make_head(MAGIC, old, new, body) + bytes(body)
+
+
+def make_head(magic, old, new, body):
+    head = magic + struct.pack("<BBxxIIIII", VERSION, 0,
+                               len(old), zlib.crc32(old) if old else 0,
+                               len(new), zlib.crc32(new), len(body))
+    return head + struct.pack("<I", zlib.crc32(head))
+
+
+def lz4_length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def lz4_sequence(out, lit, off, mlen):
+    ml = mlen - LZ4_MINMATCH if off else 0
+    out.append((min(len(lit), 15) << 4) | min(ml, 15))
+    if len(lit) >= 15:
+        lz4_length(out, len(lit) - 15)
+    out += lit
+    if off:
+        out += struct.pack("<H", off)
+        if ml >= 15:
+            lz4_length(out, ml - 15)
+
+
+def lz4_compress(src):
+    """LZ4 block, greedy parse over short hash chains."""
+    n = len(src)
+    out = bytearray()
+    chains = {}
+    anchor = i = 0
+    limit = n - LZ4_MFLIMIT
+    while i < limit:
+        chain = chains.setdefault(src[i:i + LZ4_MINMATCH], [])
+        best_len = best_pos = 0
+        for c in reversed(chain):
+            if i - c > LZ4_WINDOW:
+                break
+            m = LZ4_MINMATCH + match_len(src, c + LZ4_MINMATCH, src, i + LZ4_MINMATCH)
+            if m > best_len:
+                best_len, best_pos = m, c
+        chain.append(i)
+        if len(chain) > LZ4_CHAIN:
+            del chain[0]
+        best_len = min(best_len, n - LZ4_LASTLITERALS - i)
+        if best_len < LZ4_MINMATCH:
+            i += 1
+            continue
+        lz4_sequence(out, src[anchor:i], i - best_pos, best_len)
+        for j in range(i + 1, min(i + best_len, limit)):
+            c = chains.setdefault(src[j:j + LZ4_MINMATCH], [])
+            c.append(j)
+            if len(c) > LZ4_CHAIN:
+                del c[0]
+        i += best_len
+        anchor = i
+    lz4_sequence(out, src[anchor:], 0, 0)
+    return bytes(out)
+
+
+def lz4_decompress(src, size):
+    out = bytearray()
+    i = 0
+    while i < len(src):
+        tok = src[i]
+        i += 1
+        lit = tok >> 4
+        if lit == 15:
+            while True:
+                lit += src[i]
+                i += 1
+                if src[i - 1] != 255:
+                    break
+        out += src[i:i + lit]
+        i += lit
+        if i == len(src):
+            break
+        off = src[i] | (src[i + 1] << 8)
+        i += 2
+        ml = tok & 15
+        if ml == 15:
+            while True:
+                ml += src[i]
+                i += 1
+                if src[i - 1] != 255:
+                    break
+        ml += LZ4_MINMATCH
+        if off == 0 or off > len(out):
+            raise ValueError("bad match offset at %d" % i)
+        for _ in range(ml):
+            out.append(out[-off])
+    if len(out) != size:
+        raise ValueError("decompressed size mismatch")
+    return bytes(out)
+
+
+def make_compressed(new):
+    body = lz4_compress(new)
+    return make_head(MAGIC_LZ4, b"", new, body) + body
+
+
+def read_varint(p, i):
+    v = shift = 0
+    while True:
+        b = p[i]
+        i += 1
+        v |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return v, i
+
+
+def parse_head(patch, magic):
+    if len(patch) < HEAD_LEN or patch[:4] != magic:
+        raise ValueError("not a %s stream" % magic.decode())
+    ver, flags, osz, ocrc, nsz, ncrc, bsz, hcrc = struct.unpack_from("<BBxxIIIIII", patch, 4)
+    if ver != VERSION or hcrc != zlib.crc32(patch[:HEAD_LEN - 4]):
+        raise ValueError("bad stream header")
+    return osz, ocrc, nsz, ncrc, bsz
+
+
+def decompress(stream):
+    osz, ocrc, nsz, ncrc, bsz = parse_head(stream, MAGIC_LZ4)
+    if len(stream) != HEAD_LEN + bsz:
+        raise ValueError("stream size mismatch")
+    out = lz4_decompress(stream[HEAD_LEN:], nsz)
+    if zlib.crc32(out) != ncrc:
+        raise ValueError("unpacked image does not match")
+    return out
+
+
+def apply_patch(old, patch):
+    osz, ocrc, nsz, ncrc, bsz = parse_head(patch, MAGIC)
+    if len(old) < osz or zlib.crc32(old[:osz]) != ocrc:
+        raise ValueError("old image is not the patch base")
+    if len(patch) != HEAD_LEN + bsz:
+        raise ValueError("patch size mismatch")
+    out = bytearray()
+    i, op = HEAD_LEN, 0
+    while i < len(patch):
+        code = patch[i]
+        n, i = read_varint(patch, i + 1)
+        if code == OP_DIFF:
+            end = op + n
+            while op < end:
+                z, i = read_varint(patch, i)
+                out += old[op:op + z]
+                op += z
+                if op == end:
+                    break
+                m, i = read_varint(patch, i)
+                out += bytes((old[op + k] + patch[i + k]) & 0xFF for k in range(m))
+                op += m
+                i += m
+        elif code == OP_EXTRA:
+            out += patch[i:i + n]
+            i += n
+        elif code == OP_SEEK:
+            op += (n >> 1) ^ -(n & 1)
+        else:
+            raise ValueError("bad op %02x at %d" % (code, i - 1))
+    if len(out) != nsz or zlib.crc32(out) != ncrc:
+        raise ValueError("rebuilt image does not match")
+    return bytes(out)
+
+
+def frames(patch):
+    chunks = [patch[:HEAD_LEN]]
+    chunks += [patch[o:o + FRAME_DATA] for o in range(HEAD_LEN, len(patch), FRAME_DATA)]
+    off = 0
+    for c in chunks:
+        addr = off // 16
+        yield bytes([CMD_IAP_PATCH, len(c), addr & 0xFF, addr >> 8]) + c
+        off += len(c)
+
+
+def digest_frame(link, addr, size):
+    body = struct.pack("<I", size)
+    if link == "ble":
+        return bytes([CMD_IAP_DIGEST, len(body)]) + struct.pack("<H", addr // 16) + body
+    head = bytes([CMD_IAP_DIGEST, len(body)]) + struct.pack("<I", addr) + body
+    if link == "usb":
+        return head
+    return b"\xaa\x55" + head + struct.pack("<H", sum(head) & 0xFFFF) + b"\x55\xaa"
+
+
+def digest_reply(link, reply):
+    """CRC32 from a CMD_IAP_DIGEST reply, None when the device refused it."""
+    if link == "uart":
+        if len(reply) != 10 or reply[:2] != b"\xaa\x55" or reply[-2:] != b"\x55\xaa":
+            return None
+        reply = reply[2:-2]
+    if len(reply) != 6 or reply[0] != 0:
+        return None
+    return struct.unpack_from("<I", reply, 2)[0]
+
+
+def write_stream(args, stream):
+    with open(args.output, "wb") as f:
+        f.write(stream)
+    if args.frames:
+        with open(args.frames, "w") as f:
+            for fr in frames(stream):
+                f.write(fr.hex() + "\n")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    d = sub.add_parser("delta", help="build a delta patch")
+    d.add_argument("old")
+    d.add_argument("new")
+    d.add_argument("-o", "--output", required=True)
+    d.add_argument("--frames", help="also write the CMD_IAP_PATCH frames as hex lines")
+    a = sub.add_parser("apply", help="rebuild the new image from old + patch")
+    a.add_argument("old")
+    a.add_argument("patch")
+    a.add_argument("-o", "--output")
+    c = sub.add_parser("compress", help="build an LZ4 compressed image")
+    c.add_argument("new")
+    c.add_argument("-o", "--output", required=True)
+    c.add_argument("--frames", help="also write the CMD_IAP_PATCH frames as hex lines")
+    u = sub.add_parser("decompress", help="unpack a compressed image")
+    u.add_argument("stream")
+    u.add_argument("-o", "--output")
+    i = sub.add_parser("info", help="show a stream header")
+    i.add_argument("patch")
+    g = sub.add_parser("digest", help="CRC32 of an image, CMD_IAP_DIGEST request")
+    g.add_argument("image")
+    g.add_argument("--link", choices=("ble", "uart", "usb"), default="ble")
+    g.add_argument("--addr", type=lambda s: int(s, 0), default=IMAGE_A_START_ADD,
+                   help="flash address the image was written to (default 0x1000)")
+    g.add_argument("--reply", help="device reply as hex, compared with the image")
+    for p in (d, a, c, g):
+        p.add_argument("--base", type=lambda s: int(s, 0), default=None,
+                       help="image start for .hex input (default: first address)")
+    args = ap.parse_args()
+
+    if args.cmd == "delta":
+        old = load_image(args.old, args.base)
+        new = load_image(args.new, args.base)
+        if len(old) > IMAGE_SIZE or len(new) > IMAGE_SIZE:
+            sys.exit("image larger than IMAGE_SIZE")
+        patch = make_patch(old, new)
+        apply_patch(old, patch)
+        write_stream(args, patch)
+        print("old %d new %d patch %d bytes (%.1f%%)" %
+              (len(old), len(new), len(patch), 100.0 * len(patch) / max(len(new), 1)))
+    elif args.cmd == "compress":
+        new = load_image(args.new, args.base)
+        if len(new) > IMAGE_SIZE:
+            sys.exit("image larger than IMAGE_SIZE")
+        stream = make_compressed(new)
+        decompress(stream)
+        write_stream(args, stream)
+        print("image %d compressed %d bytes (%.1f%%)" %
+              (len(new), len(stream), 100.0 * len(stream) / max(len(new), 1)))
+    elif args.cmd in ("apply", "decompress"):
+        if args.cmd == "apply":
+            with open(args.patch, "rb") as f:
+                new = apply_patch(load_image(args.old, args.base), f.read())
+        else:
+            with open(args.stream, "rb") as f:
+                new = decompress(f.read())
+        if args.output:
+            with open(args.output, "wb") as f:
+                f.write(new)
+        print("ok, %d bytes crc32 %08x" % (len(new), zlib.crc32(new)))
+    elif args.cmd == "digest":
+        img = load_image(args.image, args.base)
+        crc = zlib.crc32(img)
+        print("image %d bytes crc32 %08x" % (len(img), crc))
+        print("request %s" % digest_frame(args.link, args.addr, len(img)).hex())
+        if args.reply:
+            got = digest_reply(args.link, bytes.fromhex(args.reply))
+            if got is None:
+                sys.exit("device refused the digest, fall back to CMD_IAP_VERIFY")
+            if got != crc:
+                sys.exit("digest mismatch, device %08x" % got)
+            print("digest ok")
+    else:
+        with open(args.patch, "rb") as f:
+            patch = f.read()
+        magic = MAGIC_LZ4 if patch[:4] == MAGIC_LZ4 else MAGIC
+        osz, ocrc, nsz, ncrc, bsz = parse_head(patch, magic)
+        print("type %s" % ("compressed" if magic == MAGIC_LZ4 else "delta"))
+        if magic == MAGIC:
+            print("old %d bytes crc32 %08x" % (osz, ocrc))
+        print("new %d bytes crc32 %08x" % (nsz, ncrc))
+        print("body %d bytes" % bsz)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Loopback throughput test for the USB COM example (USB/Device/COM).
+
+The example bridges its USB data endpoint to UART0 (PB7 TXD, PB4 RXD).
+Jumper PB7 to PB4, then everything written to the port comes back:
+
+    host -> bulk OUT -> UART0 TX -> jumper -> UART0 RX -> bulk IN -> host
+
+stream      write random data at full speed while reading it back, report
+            the throughput in both directions and check every byte
+blocks      write blocks of a multiple of 64 bytes one at a time and wait for
+            each echo, a missing ZLP shows up as a block that never completes
+
+Needs pyserial. The baud rate is sent to the device with SET_LINE_CODING, use
+one the UART divider hits exactly at 60 MHz (7.5M / n: 2500000, 1875000,
+1500000, 937500 ...) or 115200-class rates for long cables.
+"""
+
+import argparse
+import os
+import sys
+import threading
+import time
+
+try:
+    import serial
+except ImportError:
+    serial = None
+
+
+def open_port(args):
+    if serial is None:
+        sys.exit("pyserial is needed: pip install pyserial")
+    port = serial.Serial(args.port, args.baud, timeout=0.1)
+    port.reset_input_buffer()
+    return port
+
+
+def stream(args):
+    port = open_port(args)
+    data = os.urandom(args.size)
+    got = bytearray()
+    sent = [0]
+
+    def writer():
+        for i in range(0, len(data), args.chunk):
+            port.write(data[i:i + args.chunk])
+            sent[0] = i + args.chunk
+        port.flush()
+
+    start = time.time()
+    t = threading.Thread(target=writer, daemon=True)
+    t.start()
+    idle = time.time()
+    while len(got) < len(data):
+        part = port.read(4096)
+        if part:
+            got += part
+            idle = time.time()
+        elif time.time() - idle > args.timeout:
+            break
+    elapsed = time.time() - start
+    t.join(1)
+    port.close()
+
+    # 10 bits per byte on the wire with 8N1
+    print("%d bytes in %.2f s, %.1f KB/s, UART line limit %.1f KB/s"
+          % (len(got), elapsed, len(got) / elapsed / 1024, args.baud / 10 / 1024))
+    if len(got) != len(data):
+        print("short: %d of %d bytes came back" % (len(got), len(data)))
+        return 1
+    if bytes(got) != data:
+        bad = next(i for i in range(len(data)) if got[i] != data[i])
+        print("mismatch at byte %d" % bad)
+        return 1
+    print("ok")
+    return 0
+
+
+def blocks(args):
+    port = open_port(args)
+    errors = 0
+    for n in range(1, args.count + 1):
+        block = os.urandom(64 * n)
+        start = time.time()
+        port.write(block)
+        got = bytearray()
+        while len(got) < len(block) and time.time() - start < args.timeout:
+            got += port.read(len(block) - len(got))
+        if bytes(got) != block:
+            print("%5d bytes: FAIL, %d came back" % (len(block), len(got)))
+            errors += 1
+        else:
+            print("%5d bytes: ok %.1f ms" % (len(block), (time.time() - start) * 1000))
+    port.close()
+    return 1 if errors else 0
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    for name, func in (("stream", stream), ("blocks", blocks)):
+        p = sub.add_parser(name)
+        p.set_defaults(func=func)
+        p.add_argument("port", help="serial port, e.g. /dev/ttyACM0 or COM5")
+        p.add_argument("--baud", type=int, default=2500000)
+        p.add_argument("--timeout", type=float, default=2.0, help="seconds without data before giving up")
+
+    sub.choices["stream"].add_argument("--size", type=int, default=1 << 20, help="bytes to send")
+    sub.choices["stream"].add_argument("--chunk", type=int, default=4096, help="bytes per write")
+    sub.choices["blocks"].add_argument("--count", type=int, default=16, help="largest block in 64 byte units")
+
+    args = ap.parse_args()
+    sys.exit(args.func(args))
+
+
+if __name__ == "__main__":
+    main()